@@ -1970,6 +1970,7 @@ void CG_ExecuteNewServerCommands( int latestSequence );
 void CG_ParseServerinfo( void );
 void CG_SetConfigValues( void );
 void CG_ShaderStateChanged(void);
+void CG_UpdateConfigStrings( void );
 
 //
 // cg_playerstate.c
@@ -23,7 +23,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
-#define	CGAME_API_VERSION		2
+#define	CGAME_API_VERSION		3
 
 #define	CMD_BACKUP			512
 #define	CMD_MASK			(CMD_BACKUP - 1)
@@ -439,6 +439,7 @@ typedef enum cgameImportLegacy_e {
 	// newmod start
 	CG_CVAR_FLAGS = 5000,
 	CG_R_FONT_DRAWSTRING_FLOAT,
+	CG_DEMO_SEEK,
 } cgameImportLegacy_t;
 
 typedef enum cgameExportLegacy_e {
@@ -720,6 +721,7 @@ typedef struct cgameImport_s {
 
 	struct {
 		float			(*R_Font_StrLenPixels)					( const char *text, const int iFontIndex, const float scale );
+		qboolean		(*CL_DemoSeek)							( int serverTime );
 	} ext;
 } cgameImport_t;
 
@@ -709,8 +709,9 @@ void SetDuelistHealthsFromConfigString ( const char *str ) {
 
 /*
 ================
-CG_ConfigStringModified
+CG_ConfigStringChanged
 
+Reacts to configstring num having a new value in cgs.gameState
 ================
 */
 extern int cgSiegeRoundState;
@@ -720,15 +721,8 @@ void CG_ParseWeatherEffect(const char *str);
 extern void CG_ParseSiegeState(const char *str); //cg_main.c
 extern int cg_beatingSiegeTime;
 extern int cg_siegeWinTeam;
-static void CG_ConfigStringModified( void ) {
+static void CG_ConfigStringChanged( int num ) {
 	const char	*str;
-	int		num;
-
-	num = atoi( CG_Argv( 1 ) );
-
-	// get the gamestate from the client system, which will have the
-	// new configstring already integrated
-	trap->GetGameState( &cgs.gameState );
 
 	// look up the individual string that was modified
 	str = CG_ConfigString( num );
@@ -916,6 +910,47 @@ static void CG_ConfigStringModified( void ) {
 
 }
 
+/*
+================
+CG_ConfigStringModified
+
+================
+*/
+static void CG_ConfigStringModified( void ) {
+	int		num;
+
+	num = atoi( CG_Argv( 1 ) );
+
+	// get the gamestate from the client system, which will have the
+	// new configstring already integrated
+	trap->GetGameState( &cgs.gameState );
+
+	CG_ConfigStringChanged( num );
+}
+
+/*
+================
+CG_UpdateConfigStrings
+
+Catches up with every configstring that changed without a "cs"
+command reaching us, as when a demo is seeked
+================
+*/
+void CG_UpdateConfigStrings( void ) {
+	static gameState_t	oldGameState;
+	int					i;
+
+	oldGameState = cgs.gameState;
+	trap->GetGameState( &cgs.gameState );
+
+	for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+		if ( strcmp( oldGameState.stringData + oldGameState.stringOffsets[i],
+			cgs.gameState.stringData + cgs.gameState.stringOffsets[i] ) ) {
+			CG_ConfigStringChanged( i );
+		}
+	}
+}
+
 //frees all ghoul2 stuff and npc stuff from a centity -rww
 void CG_KillCEntityG2(int entNum)
 {
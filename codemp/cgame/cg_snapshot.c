@@ -344,6 +344,43 @@ static snapshot_t *CG_ReadNextSnapshot( void ) {
 }
 
 
+/*
+============
+CG_DemoSeek
+
+The client moved demo playback and flagged the snapshot it landed on.
+Everything up to that snapshot's commands has already been applied to
+the gamestate, so catch up with the configstrings, drop whatever belongs
+to the old position and start over as with the first snapshot.
+============
+*/
+static void CG_DemoSeek( snapshot_t *snap ) {
+	int		i;
+
+	cgs.serverCommandSequence = snap->serverCommandSequence;
+	CG_UpdateConfigStrings();
+
+	if ( cg.snap ) {
+		for ( i = 0 ; i < cg.snap->numEntities ; i++ ) {
+			cg_entities[ cg.snap->entities[ i ].number ].currentValid = qfalse;
+		}
+	}
+
+	trap->R_ClearDecals();
+	trap->S_ClearLoopingSounds();
+	CG_InitLocalEntities();
+	CG_InitMarkPolys();
+
+	cg.snap = NULL;
+	cg.nextSnap = NULL;
+	cg.thisFrameTeleport = qtrue;
+
+	if ( !( snap->snapFlags & SNAPFLAG_NOT_ACTIVE ) ) {
+		CG_SetInitialSnapshot( snap );
+	}
+}
+
+
 /*
 ============
 CG_ProcessSnapshots
@@ -371,8 +408,11 @@ void CG_ProcessSnapshots( void ) {
 	trap->GetCurrentSnapshotNumber( &n, &cg.latestSnapshotTime );
 	if ( n != cg.latestSnapshotNum ) {
 		if ( n < cg.latestSnapshotNum ) {
-			// this should never happen
-			trap->Error( ERR_DROP, "CG_ProcessSnapshots: n < cg.latestSnapshotNum" );
+			// this should never happen, except when a demo is seeked back
+			if ( !cg.demoPlayback ) {
+				trap->Error( ERR_DROP, "CG_ProcessSnapshots: n < cg.latestSnapshotNum" );
+			}
+			cgs.processedSnapshotNum = n - 1;
 		}
 		cg.latestSnapshotNum = n;
 	}
@@ -387,6 +427,11 @@ void CG_ProcessSnapshots( void ) {
 			return;
 		}
 
+		if ( snap->snapFlags & SNAPFLAG_DEMOSEEK ) {
+			CG_DemoSeek( snap );
+			continue;
+		}
+
 		// set our weapon selection to what
 		// the playerstate is currently using
 		if ( !( snap->snapFlags & SNAPFLAG_NOT_ACTIVE ) ) {
@@ -408,6 +453,11 @@ void CG_ProcessSnapshots( void ) {
 				break;
 			}
 
+			if ( snap->snapFlags & SNAPFLAG_DEMOSEEK ) {
+				CG_DemoSeek( snap );
+				continue;
+			}
+
 			CG_SetNextSnap( snap );
 
 
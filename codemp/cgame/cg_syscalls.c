@@ -229,6 +229,9 @@ float trap_R_Font_StrLenPixelsFloat(const char *text, const int iFontIndex, cons
 	float width = (float)Q_syscall( CG_R_FONT_STRLENPIXELS, text, iFontIndex, PASSFLOAT(1.0f));
 	return width * scale;
 }
+qboolean trap_CL_DemoSeek( int serverTime ) {
+	return Q_syscall( CG_DEMO_SEEK, serverTime );
+}
 int trap_R_Font_StrLenChars(const char *text) {
 	return Q_syscall( CG_R_FONT_STRLENCHARS, text);
 }
@@ -944,4 +947,5 @@ static void TranslateSyscalls( void ) {
 	trap->G2API_GetSurfaceName				= trap_G2API_GetSurfaceName;
 
 	trap->ext.R_Font_StrLenPixels			= trap_R_Font_StrLenPixelsFloat;
+	trap->ext.CL_DemoSeek					= trap_CL_DemoSeek;
 }
@@ -23,6 +23,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "client.h"
 #include "snd_local.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #define INDEX_FILE_EXTENSION ".index.dat"
 
 #define MAX_RIFF_CHUNKS 16
@@ -56,6 +61,7 @@ typedef struct aviFileData_s
   int           numVideoFrames;
   int           maxRecordSize;
   qboolean      motionJpeg;
+  qboolean      limit2GB;
 
   qboolean      audio;
   audioFormat_t a;
@@ -63,8 +69,6 @@ typedef struct aviFileData_s
 
   int           chunkStack[ MAX_RIFF_CHUNKS ];
   int           chunkStackTop;
-
-  byte          *cBuffer, *eBuffer;
 } aviFileData_t;
 
 static aviFileData_t afd;
@@ -74,9 +78,55 @@ static aviFileData_t afd;
 static byte buffer[ MAX_AVI_BUFFER ];
 static int  bufIndex;
 
+/*
+===============
+Chunk writer
+
+CL_TakeVideoFrame and CL_WriteAVIAudioFrame queue their chunks in the
+order they are called, so video and audio stay interleaved the way they
+were captured.  A video chunk is queued empty, and filled in when the
+renderer passes the encoded frame to CL_WriteAVIVideoFrame, a frame or
+two later and possibly from another thread.
+
+The writer thread writes the chunks and their index entries in queue
+order, waiting at any chunk that isn't filled yet.  While it runs nothing
+else uses afd.f, afd.idxF or the file sizes in afd, and FS_Write only
+touches the handle it's given.  When a chunk would take the file past
+2GB the writer stops and sets aviSplit, and the main thread finishes the
+file and opens the next one before letting it go on.
+
+The writer never reports anything itself.  A failed write sets aviFailed,
+which the main thread turns into an error or warning, and whatever FS_Write
+prints is queued by Com_Printf until the main thread's next print.
+===============
+*/
+
+#define AVI_MAX_QUEUED_FRAMES 8
+
+typedef struct aviChunk_s
+{
+  char          id[ 5 ];
+  qboolean      video;
+  qboolean      ready;          // video waits for the renderer
+  byte          *data;          // malloc'd, the renderer may call from any thread
+  int           size;           // -1 for a frame that was dropped
+} aviChunk_t;
+
+static std::thread                aviWriter;
+static std::mutex                 aviMutex;
+static std::condition_variable    aviWake;          // a chunk is ready, or quit
+static std::condition_variable    aviIdle;          // a chunk was written, or aviSplit
+static std::deque<aviChunk_t *>   aviChunks;
+static int                        aviQueuedFrames;  // video chunks in aviChunks
+static bool                       aviSplit;
+static bool                       aviFailed;        // the rest of the chunks are dropped
+static bool                       aviQuit;
+
 /*
 ===============
 SafeFS_Write
+
+Main thread only, the writer checks its own writes
 ===============
 */
 static QINLINE void SafeFS_Write( const void *buffer, int len, fileHandle_t f )
@@ -326,38 +376,359 @@ void CL_WriteAVIHeader( void )
 
 /*
 ===============
-CL_OpenAVIForWriting
+CL_AVIPut4Bytes
+===============
+*/
+static QINLINE void CL_AVIPut4Bytes( byte *p, int x )
+{
+  p[ 0 ] = (byte)( ( x >>  0 ) & 0xFF );
+  p[ 1 ] = (byte)( ( x >>  8 ) & 0xFF );
+  p[ 2 ] = (byte)( ( x >> 16 ) & 0xFF );
+  p[ 3 ] = (byte)( ( x >> 24 ) & 0xFF );
+}
 
-Creates an AVI file and gets it into a state where
-writing the actual data can begin
+/*
+===============
+CL_AVIChunkFits
 ===============
 */
-qboolean CL_OpenAVIForWriting( const char *fileName )
+static qboolean CL_AVIChunkFits( int size )
 {
-  if( afd.fileOpen )
+  unsigned int newFileSize;
+
+  if( !afd.limit2GB )
+    return qtrue;
+
+  newFileSize =
+    afd.fileSize +                // Current file size
+    8 + size + 2 +                // Chunk header + contents + padding
+    ( afd.numIndices * 16 ) +     // The index
+    4;                            // The index size
+
+  // I assume all the operating systems
+  // we target can handle a 2Gb file
+  return (qboolean)( newFileSize <= INT_MAX );
+}
+
+/*
+===============
+CL_WriteAVIChunk
+
+Writer thread only
+===============
+*/
+static qboolean CL_WriteAVIChunk( const aviChunk_t *chunk )
+{
+  int   chunkOffset = afd.fileSize - afd.moviOffset - 8;
+  int   chunkSize = 8 + chunk->size;
+  int   paddingSize = PADLEN( chunk->size, 2 );
+  byte  padding[ 4 ] = { 0 };
+  byte  header[ 8 ];
+  byte  index[ 16 ];
+
+  Com_Memcpy( header, chunk->id, 4 );
+  CL_AVIPut4Bytes( header + 4, chunk->size );
+
+  if( FS_Write( header, 8, afd.f ) < 8 ||
+      FS_Write( chunk->data, chunk->size, afd.f ) < chunk->size ||
+      FS_Write( padding, paddingSize, afd.f ) < paddingSize )
     return qfalse;
 
-  Com_Memset( &afd, 0, sizeof( aviFileData_t ) );
+  afd.fileSize += ( chunkSize + paddingSize );
+  afd.moviSize += ( chunkSize + paddingSize );
 
-  // Don't start if a framerate has not been chosen
-  if( cl_aviFrameRate->integer <= 0 )
+  if( chunk->video )
   {
-    Com_Printf( S_COLOR_RED "cl_aviFrameRate must be >= 1\n" );
+    afd.numVideoFrames++;
+    if( chunk->size > afd.maxRecordSize )
+      afd.maxRecordSize = chunk->size;
+  }
+  else
+  {
+    afd.numAudioFrames++;
+    afd.a.totalBytes += chunk->size;
+  }
+
+  // Index
+  Com_Memcpy( index, chunk->id, 4 );                            //dwIdentifier
+  CL_AVIPut4Bytes( index + 4, chunk->video ? 0x00000010 : 0 );  //dwFlags (all video frames are KeyFrames)
+  CL_AVIPut4Bytes( index + 8, chunkOffset );                    //dwOffset
+  CL_AVIPut4Bytes( index + 12, chunk->size );                   //dwLength
+  if( FS_Write( index, 16, afd.idxF ) < 16 )
     return qfalse;
+
+  afd.numIndices++;
+
+  return qtrue;
+}
+
+/*
+===============
+CL_AVIWriterThread
+===============
+*/
+static void CL_AVIWriterThread( void )
+{
+  std::unique_lock<std::mutex> lock( aviMutex );
+
+  for( ;; )
+  {
+    aviWake.wait( lock, [] {
+      if( aviChunks.empty( ) )
+        return aviQuit;
+      return aviChunks.front( )->ready && !aviSplit;
+    } );
+
+    // quitting still writes everything queued
+    if( aviChunks.empty( ) )
+      return;
+
+    aviChunk_t *chunk = aviChunks.front( );
+
+    if( chunk->size >= 0 && !aviFailed )
+    {
+      if( !CL_AVIChunkFits( chunk->size ) )
+      {
+        aviSplit = true;
+        aviIdle.notify_all( );
+        continue;
+      }
+
+      lock.unlock( );
+      qboolean written = CL_WriteAVIChunk( chunk );
+      lock.lock( );
+
+      if( !written )
+        aviFailed = true;
+    }
+
+    aviChunks.pop_front( );
+    if( chunk->video )
+      aviQueuedFrames--;
+    free( chunk->data );
+    delete chunk;
+
+    aviIdle.notify_all( );
   }
+}
+
+/*
+===============
+CL_QueueAVIChunk
 
+Video frames are queued without data, to be filled in by CL_WriteAVIVideoFrame
+===============
+*/
+static void CL_QueueAVIChunk( const char *id, qboolean video, byte *data, int size )
+{
+  aviChunk_t *chunk = new aviChunk_t( );
+
+  Q_strncpyz( chunk->id, id, sizeof( chunk->id ) );
+  chunk->video = video;
+  chunk->ready = data ? qtrue : qfalse;
+  chunk->data = data;
+  chunk->size = size;
+
+  {
+    std::lock_guard<std::mutex> lock( aviMutex );
+    aviChunks.push_back( chunk );
+    if( video )
+      aviQueuedFrames++;
+  }
+  aviWake.notify_one( );
+}
+
+/*
+===============
+CL_BeginAVIFile
+
+Writes the space for the header and starts the temporary index
+===============
+*/
+static qboolean CL_BeginAVIFile( const char *fileName )
+{
   if( ( afd.f = FS_FOpenFileWrite( fileName ) ) <= 0 )
+  {
+    afd.f = 0;
     return qfalse;
+  }
 
   if( ( afd.idxF = FS_FOpenFileWrite(
           va( "%s" INDEX_FILE_EXTENSION, fileName ) ) ) <= 0 )
   {
     FS_FCloseFile( afd.f );
+    afd.f = afd.idxF = 0;
     return qfalse;
   }
 
   Q_strncpyz( afd.fileName, fileName, MAX_QPATH );
 
+  afd.fileSize = 0;
+  afd.moviSize = 0;
+  afd.numIndices = 0;
+  afd.numVideoFrames = 0;
+  afd.numAudioFrames = 0;
+  afd.maxRecordSize = 0;
+  afd.a.totalBytes = 0;
+
+  // This doesn't write a real header, but allocates the
+  // correct amount of space at the beginning of the file
+  CL_WriteAVIHeader( );
+
+  SafeFS_Write( buffer, bufIndex, afd.f );
+  afd.fileSize = bufIndex;
+
+  bufIndex = 0;
+  START_CHUNK( "idx1" );
+  SafeFS_Write( buffer, bufIndex, afd.idxF );
+
+  afd.moviSize = 4; // For the "movi"
+
+  return qtrue;
+}
+
+/*
+===============
+CL_EndAVIFile
+
+Appends the index and writes the real header.  The writer
+thread must be stopped or waiting on aviSplit.
+===============
+*/
+static void CL_EndAVIFile( void )
+{
+  int indexRemainder;
+  int indexSize = afd.numIndices * 16;
+  const char *idxFileName = va( "%s" INDEX_FILE_EXTENSION, afd.fileName );
+
+  if( !afd.f )
+    return;
+
+  FS_Seek( afd.idxF, 4, FS_SEEK_SET );
+  bufIndex = 0;
+  WRITE_4BYTES( indexSize );
+  SafeFS_Write( buffer, bufIndex, afd.idxF );
+  FS_FCloseFile( afd.idxF );
+  afd.idxF = 0;
+
+  // Write index
+
+  // Open the temp index file
+  if( ( indexSize = FS_FOpenFileRead( idxFileName,
+          &afd.idxF, qtrue ) ) <= 0 )
+  {
+    FS_FCloseFile( afd.f );
+    afd.f = 0;
+    return;
+  }
+
+  indexRemainder = indexSize;
+
+  // Append index to end of avi file
+  while( indexRemainder > MAX_AVI_BUFFER )
+  {
+    FS_Read( buffer, MAX_AVI_BUFFER, afd.idxF );
+    SafeFS_Write( buffer, MAX_AVI_BUFFER, afd.f );
+    afd.fileSize += MAX_AVI_BUFFER;
+    indexRemainder -= MAX_AVI_BUFFER;
+  }
+  FS_Read( buffer, indexRemainder, afd.idxF );
+  SafeFS_Write( buffer, indexRemainder, afd.f );
+  afd.fileSize += indexRemainder;
+  FS_FCloseFile( afd.idxF );
+  afd.idxF = 0;
+
+  // Remove temp index file
+  FS_HomeRemove( idxFileName );
+
+  // Write the real header
+  FS_Seek( afd.f, 0, FS_SEEK_SET );
+  CL_WriteAVIHeader( );
+
+  bufIndex = 4;
+  WRITE_4BYTES( afd.fileSize - 8 ); // "RIFF" size
+
+  bufIndex = afd.moviOffset + 4;    // Skip "LIST"
+  WRITE_4BYTES( afd.moviSize );
+
+  SafeFS_Write( buffer, bufIndex, afd.f );
+
+  FS_FCloseFile( afd.f );
+  afd.f = 0;
+
+  Com_Printf( "Wrote %d:%d frames to %s\n", afd.numVideoFrames, afd.numAudioFrames, afd.fileName );
+}
+
+/*
+===============
+CL_WaitForAVIWriter
+
+Waits until fewer than AVI_MAX_QUEUED_FRAMES video frames are queued,
+or until the queue is empty if drain is set.  Starts the next file
+whenever the writer asks.  Returns qfalse if a write failed.
+===============
+*/
+static qboolean CL_WaitForAVIWriter( qboolean drain )
+{
+  std::unique_lock<std::mutex> lock( aviMutex );
+
+  for( ;; )
+  {
+    aviIdle.wait( lock, [drain] {
+      if( aviSplit )
+        return true;
+      if( drain )
+        return aviChunks.empty( );
+      return aviQueuedFrames < AVI_MAX_QUEUED_FRAMES;
+    } );
+
+    if( !aviSplit )
+      break;
+
+    // the writer is waiting, so the file is ours
+    lock.unlock( );
+    CL_EndAVIFile( );
+    qboolean opened = CL_BeginAVIFile( va( "%s_", afd.fileName ) );
+    lock.lock( );
+
+    if( !opened )
+      aviFailed = true;
+    aviSplit = false;
+    aviWake.notify_one( );
+  }
+
+  if( aviFailed )
+  {
+    // reported once, the writer drops what's left
+    aviFailed = false;
+    return qfalse;
+  }
+
+  return qtrue;
+}
+
+/*
+===============
+CL_OpenAVIForWriting
+
+Creates an AVI file and gets it into a state where
+writing the actual data can begin
+===============
+*/
+qboolean CL_OpenAVIForWriting( const char *fileName )
+{
+  if( afd.fileOpen )
+    return qfalse;
+
+  Com_Memset( &afd, 0, sizeof( aviFileData_t ) );
+
+  // Don't start if a framerate has not been chosen
+  if( cl_aviFrameRate->integer <= 0 )
+  {
+    Com_Printf( S_COLOR_RED "cl_aviFrameRate must be >= 1\n" );
+    return qfalse;
+  }
+
   afd.frameRate = cl_aviFrameRate->integer;
   afd.framePeriod = (int)( 1000000.0f / afd.frameRate );
   afd.width = cls.glconfig.vidWidth;
@@ -368,13 +739,7 @@ qboolean CL_OpenAVIForWriting( const char *fileName )
   else
     afd.motionJpeg = qfalse;
 
-  // Buffers only need to store RGB pixels.
-  // Allocate a bit more space for the capture buffer to account for possible
-  // padding at the end of pixel lines, and padding for alignment
-  #define MAX_PACK_LEN 16
-  afd.cBuffer = (byte *)Z_Malloc((afd.width * 3 + MAX_PACK_LEN - 1) * afd.height + MAX_PACK_LEN - 1, TAG_AVI, qtrue);
-  // raw avi files have pixel lines start on 4-byte boundaries
-  afd.eBuffer = (byte *)Z_Malloc(PAD(afd.width * 3, AVI_LINE_PADDING) * afd.height, TAG_AVI, qtrue);
+  afd.limit2GB = cl_avi2GBLimit->integer ? qtrue : qfalse;
 
   afd.a.rate = dma.speed;
   afd.a.format = WAV_FORMAT_PCM;
@@ -416,18 +781,15 @@ qboolean CL_OpenAVIForWriting( const char *fileName )
         "with OpenAL. Set s_UseOpenAL to 0 for audio capture\n" );
   }
 
-  // This doesn't write a real header, but allocates the
-  // correct amount of space at the beginning of the file
-  CL_WriteAVIHeader( );
+  if( !CL_BeginAVIFile( fileName ) )
+    return qfalse;
 
-  SafeFS_Write( buffer, bufIndex, afd.f );
-  afd.fileSize = bufIndex;
+  aviQueuedFrames = 0;
+  aviSplit = false;
+  aviFailed = false;
+  aviQuit = false;
+  aviWriter = std::thread( CL_AVIWriterThread );
 
-  bufIndex = 0;
-  START_CHUNK( "idx1" );
-  SafeFS_Write( buffer, bufIndex, afd.idxF );
-
-  afd.moviSize = 4; // For the "movi"
   afd.fileOpen = qtrue;
 
   return qtrue;
@@ -435,81 +797,40 @@ qboolean CL_OpenAVIForWriting( const char *fileName )
 
 /*
 ===============
-CL_CheckFileSize
+CL_WriteAVIVideoFrame
+
+Called by the renderer, from any thread, with the frames CL_TakeVideoFrame
+asked for in the same order.  A NULL imageBuffer drops the frame.
 ===============
 */
-static qboolean CL_CheckFileSize( int bytesToAdd )
+void CL_WriteAVIVideoFrame( const byte *imageBuffer, int size )
 {
-  unsigned int newFileSize;
-
-  newFileSize =
-    afd.fileSize +                // Current file size
-    bytesToAdd +                  // What we want to add
-    ( afd.numIndices * 16 ) +     // The index
-    4;                            // The index size
+  byte  *data = NULL;
 
-  if ( cl_avi2GBLimit->integer )
+  if( imageBuffer )
   {
-    // I assume all the operating systems
-    // we target can handle a 2Gb file
-    if ( newFileSize > INT_MAX )
-    {
-      // Close the current file...
-      CL_CloseAVI();
+    data = (byte *)malloc( size );
+    Com_Memcpy( data, imageBuffer, size );
+  }
+  else
+    size = -1;
 
-      // ...And open a new one
-      CL_OpenAVIForWriting( va( "%s_", afd.fileName ) );
+  std::lock_guard<std::mutex> lock( aviMutex );
 
-      return qtrue;
+  for( aviChunk_t *chunk : aviChunks )
+  {
+    if( chunk->video && !chunk->ready )
+    {
+      chunk->data = data;
+      chunk->size = size;
+      chunk->ready = qtrue;
+      aviWake.notify_one( );
+      return;
     }
   }
 
-  return qfalse;
-}
-
-/*
-===============
-CL_WriteAVIVideoFrame
-===============
-*/
-void CL_WriteAVIVideoFrame( const byte *imageBuffer, int size )
-{
-  int   chunkOffset = afd.fileSize - afd.moviOffset - 8;
-  int   chunkSize = 8 + size;
-  int   paddingSize = PADLEN(size, 2);
-  byte  padding[ 4 ] = { 0 };
-
-  if( !afd.fileOpen )
-    return;
-
-  // Chunk header + contents + padding
-  if( CL_CheckFileSize( 8 + size + 2 ) )
-    return;
-
-  bufIndex = 0;
-  WRITE_STRING( "00dc" );
-  WRITE_4BYTES( size );
-
-  SafeFS_Write( buffer, 8, afd.f );
-  SafeFS_Write( imageBuffer, size, afd.f );
-  SafeFS_Write( padding, paddingSize, afd.f );
-  afd.fileSize += ( chunkSize + paddingSize );
-
-  afd.numVideoFrames++;
-  afd.moviSize += ( chunkSize + paddingSize );
-
-  if( size > afd.maxRecordSize )
-    afd.maxRecordSize = size;
-
-  // Index
-  bufIndex = 0;
-  WRITE_STRING( "00dc" );           //dwIdentifier
-  WRITE_4BYTES( 0x00000010 );       //dwFlags (all frames are KeyFrames)
-  WRITE_4BYTES( chunkOffset );      //dwOffset
-  WRITE_4BYTES( size );             //dwLength
-  SafeFS_Write( buffer, 16, afd.idxF );
-
-  afd.numIndices++;
+  // nothing was asked for, the file is being closed
+  free( data );
 }
 
 #define PCM_BUFFER_SIZE 44100
@@ -530,10 +851,6 @@ void CL_WriteAVIAudioFrame( const byte *pcmBuffer, int size )
   if( !afd.fileOpen )
     return;
 
-  // Chunk header + contents + padding
-  if( CL_CheckFileSize( 8 + bytesInBuffer + size + 2 ) )
-    return;
-
   if( bytesInBuffer + size > PCM_BUFFER_SIZE )
   {
     Com_Printf( S_COLOR_YELLOW
@@ -548,33 +865,12 @@ void CL_WriteAVIAudioFrame( const byte *pcmBuffer, int size )
   if( bytesInBuffer >= (int)ceil( (float)afd.a.rate / (float)afd.frameRate ) *
         afd.a.sampleSize )
   {
-    int   chunkOffset = afd.fileSize - afd.moviOffset - 8;
-    int   chunkSize = 8 + bytesInBuffer;
-    int   paddingSize = PADLEN(bytesInBuffer, 2);
-    byte  padding[ 4 ] = { 0 };
+    byte  *data = (byte *)malloc( bytesInBuffer );
 
-    bufIndex = 0;
-    WRITE_STRING( "01wb" );
-    WRITE_4BYTES( bytesInBuffer );
+    Com_Memcpy( data, pcmCaptureBuffer, bytesInBuffer );
 
-    SafeFS_Write( buffer, 8, afd.f );
-    SafeFS_Write( pcmCaptureBuffer, bytesInBuffer, afd.f );
-    SafeFS_Write( padding, paddingSize, afd.f );
-    afd.fileSize += ( chunkSize + paddingSize );
-
-    afd.numAudioFrames++;
-    afd.moviSize += ( chunkSize + paddingSize );
-    afd.a.totalBytes += bytesInBuffer;
-
-    // Index
-    bufIndex = 0;
-    WRITE_STRING( "01wb" );           //dwIdentifier
-    WRITE_4BYTES( 0 );                //dwFlags
-    WRITE_4BYTES( chunkOffset );      //dwOffset
-    WRITE_4BYTES( bytesInBuffer );    //dwLength
-    SafeFS_Write( buffer, 16, afd.idxF );
-
-    afd.numIndices++;
+    // queued behind the video frame it goes with
+    CL_QueueAVIChunk( "01wb", qfalse, data, bytesInBuffer );
 
     bytesInBuffer = 0;
   }
@@ -591,8 +887,13 @@ void CL_TakeVideoFrame( void )
   if( !afd.fileOpen )
     return;
 
-  re->TakeVideoFrame( afd.width, afd.height,
-      afd.cBuffer, afd.eBuffer, afd.motionJpeg );
+  // Don't let capture run too far ahead of the encoding and writing
+  if( !CL_WaitForAVIWriter( qfalse ) )
+    Com_Error( ERR_DROP, "Failed to write avi file" );
+
+  CL_QueueAVIChunk( "00dc", qtrue, NULL, 0 );
+
+  re->TakeVideoFrame( afd.width, afd.height, afd.motionJpeg );
 }
 
 /*
@@ -604,67 +905,45 @@ Closes the AVI file and writes an index chunk
 */
 qboolean CL_CloseAVI( void )
 {
-  int indexRemainder;
-  int indexSize = afd.numIndices * 16;
-  const char *idxFileName = va( "%s" INDEX_FILE_EXTENSION, afd.fileName );
+  qboolean written;
 
   // AVI file isn't open
   if( !afd.fileOpen )
     return qfalse;
 
-  afd.fileOpen = qfalse;
-
-  FS_Seek( afd.idxF, 4, FS_SEEK_SET );
-  bufIndex = 0;
-  WRITE_4BYTES( indexSize );
-  SafeFS_Write( buffer, bufIndex, afd.idxF );
-  FS_FCloseFile( afd.idxF );
-
-  // Write index
+  // Get the frames still being read back and encoded
+  if( re && re->FlushVideoFrames )
+    re->FlushVideoFrames( );
 
-  // Open the temp index file
-  if( ( indexSize = FS_FOpenFileRead( idxFileName,
-          &afd.idxF, qtrue ) ) <= 0 )
+  // Anything the renderer didn't deliver isn't coming
   {
-    FS_FCloseFile( afd.f );
-    return qfalse;
+    std::lock_guard<std::mutex> lock( aviMutex );
+    for( aviChunk_t *chunk : aviChunks )
+    {
+      if( !chunk->ready )
+      {
+        chunk->size = -1;
+        chunk->ready = qtrue;
+      }
+    }
   }
+  aviWake.notify_one( );
 
-  indexRemainder = indexSize;
+  written = CL_WaitForAVIWriter( qtrue );
 
-  // Append index to end of avi file
-  while( indexRemainder > MAX_AVI_BUFFER )
   {
-    FS_Read( buffer, MAX_AVI_BUFFER, afd.idxF );
-    SafeFS_Write( buffer, MAX_AVI_BUFFER, afd.f );
-    afd.fileSize += MAX_AVI_BUFFER;
-    indexRemainder -= MAX_AVI_BUFFER;
+    std::lock_guard<std::mutex> lock( aviMutex );
+    aviQuit = true;
   }
-  FS_Read( buffer, indexRemainder, afd.idxF );
-  SafeFS_Write( buffer, indexRemainder, afd.f );
-  afd.fileSize += indexRemainder;
-  FS_FCloseFile( afd.idxF );
-
-  // Remove temp index file
-  FS_HomeRemove( idxFileName );
-
-  // Write the real header
-  FS_Seek( afd.f, 0, FS_SEEK_SET );
-  CL_WriteAVIHeader( );
+  aviWake.notify_one( );
+  aviWriter.join( );
 
-  bufIndex = 4;
-  WRITE_4BYTES( afd.fileSize - 8 ); // "RIFF" size
-
-  bufIndex = afd.moviOffset + 4;    // Skip "LIST"
-  WRITE_4BYTES( afd.moviSize );
+  afd.fileOpen = qfalse;
 
-  SafeFS_Write( buffer, bufIndex, afd.f );
+  CL_EndAVIFile( );
 
-  Z_Free( afd.cBuffer );
-  Z_Free( afd.eBuffer );
-  FS_FCloseFile( afd.f );
-
-  Com_Printf( "Wrote %d:%d frames to %s\n", afd.numVideoFrames, afd.numAudioFrames, afd.fileName );
+  if( !written )
+    Com_Printf( S_COLOR_YELLOW "WARNING: Failed to write %s\n", afd.fileName );
 
   return qtrue;
 }
@@ -111,6 +111,11 @@ qboolean CL_GetSnapshot( int snapshotNumber, snapshot_t *snapshot ) {
 		return qfalse;
 	}
 
+	// frames from before a demo seek belong to the old position
+	if ( clc.demoplaying && snapshotNumber < clc.demoSeekSnapshot ) {
+		return qfalse;
+	}
+
 	// if the frame is not valid, we can't return it
 	clSnap = &cl.snapshots[snapshotNumber & PACKET_MASK];
 	if ( !clSnap->valid ) {
@@ -146,6 +151,10 @@ qboolean CL_GetSnapshot( int snapshotNumber, snapshot_t *snapshot ) {
 		memcpy(&snapshot->entities[i], &cl.parseEntities[ entNum ], sizeof(entityState_t));
 	}
 
+	if ( clc.demoplaying && snapshotNumber == clc.demoSeekSnapshot ) {
+		clc.demoSeekHeld = qfalse;
+	}
+
 	// FIXME: configstring changes and server commands!!!
 
 	return qtrue;
@@ -893,6 +902,12 @@ void CL_SetCGameTime( void ) {
 		return;
 	}
 
+	// after a seek, let the cgame pick up the snapshot it landed on
+	// before reading past it
+	if ( clc.demoSeekHeld ) {
+		return;
+	}
+
 	// if we are playing a demo back, we can just keep reading
 	// messages from the demo file until the cgame definately
 	// has valid snapshots to interpolate between
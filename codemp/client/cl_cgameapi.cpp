@@ -1692,6 +1692,9 @@ intptr_t CL_CgameSystemCalls( intptr_t *args ) {
 		re->Font_DrawString_Float(VMF(1), VMF(2), (const char *)VMA(3), (const float *)VMA(4), args[5], args[6], VMF(7));
 		return 0;
 
+	case CG_DEMO_SEEK:
+		return CL_DemoSeek( args[1] );
+
 	default:
 		assert(0); // bk010102
 		Com_Error( ERR_DROP, "Bad cgame system trap: %ld", (long int) args[0] );
@@ -1919,6 +1922,7 @@ void CL_BindCGame( void ) {
 		cgi.G2API_GetSurfaceName				= CL_G2API_GetSurfaceName;
 
 		cgi.ext.R_Font_StrLenPixels				= re->ext.Font_StrLenPixels;
+		cgi.ext.CL_DemoSeek						= CL_DemoSeek;
 
 		GetCGameAPI = (GetCGameAPI_t)cgvm->GetModuleAPI;
 		ret = GetCGameAPI( CGAME_API_VERSION, &cgi );
@@ -0,0 +1,590 @@
+/*
+===========================================================================
+Copyright (C) 2013 - 2015, OpenJK contributors
+
+This file is part of the OpenJK source code.
+
+OpenJK is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+
+// cl_demo.cpp -- demo index and seeking
+
+#include "client.h"
+
+/*
+=============================================================================
+
+Demo index
+
+A demo can only be parsed forward, since every snapshot is delta
+compressed from an earlier one and configstrings change through server
+commands.  Every cl_demoKeyframeInterval seconds of server time a
+keyframe is taken: the configstrings as they are at that point, the
+snapshots later messages can still delta from, and the file offset of
+the next message.  Seeking restores the nearest keyframe before the
+target and parses forward from there without rendering.
+
+The index is built lazily.  Opening a demo only reads ahead to its first
+active snapshot for the first keyframe, and a seek past the end of the
+index takes keyframes as it reads forward, so a later seek back never
+parses more than one interval of the demo.
+
+The index stops at the next gamestate, since that reloads the level.
+Once playback has gone past it, the index is started again from there on
+the next seek.
+
+=============================================================================
+*/
+
+#define	DEMO_KEYFRAME_BUFFER	0x100000		// a keyframe that doesn't fit is skipped
+
+typedef struct demoKeyframe_s {
+	int			offset;					// of the message after the snapshot
+	int			serverTime;
+	int			messageNum;
+	int			serverCommandSequence;	// every command up to this is in the configstrings
+	int			size;
+	byte		*data;
+} demoKeyframe_t;
+
+typedef struct demoIndex_s {
+	qboolean		built;
+	demoKeyframe_t	*keyframes;
+	int				numKeyframes;
+	int				maxKeyframes;
+	int				interval;			// msec of server time between keyframes
+	int				endOffset;			// of the first message not looked at for keyframes yet
+	int				endTime;			// of the last snapshot looked at
+} demoIndex_t;
+
+static demoIndex_t	demoIndex;
+
+// bcs0/bcs1/bcs2 split a configstring that is too big for one command
+static char			demoBigConfigString[BIG_INFO_STRING];
+static qboolean		demoInBigConfigString;
+
+/*
+===============
+CL_DemoFreeIndex
+===============
+*/
+void CL_DemoFreeIndex( void ) {
+	int		i;
+
+	for ( i = 0; i < demoIndex.numKeyframes; i++ ) {
+		Z_Free( demoIndex.keyframes[i].data );
+	}
+	if ( demoIndex.keyframes ) {
+		Z_Free( demoIndex.keyframes );
+	}
+	Com_Memset( &demoIndex, 0, sizeof( demoIndex ) );
+}
+
+/*
+===============
+CL_DemoExecuteServerCommands
+
+Applies the configstring changes among the server commands read since
+the last call, like CL_GetServerCommand does when the cgame asks for
+them.  Everything else is left for the cgame, which skips whatever it
+missed while the demo was read ahead.
+===============
+*/
+static void CL_DemoExecuteServerCommands( void ) {
+	char	*s, *cmd;
+
+	if ( clc.lastExecutedServerCommand < clc.serverCommandSequence - MAX_RELIABLE_COMMANDS ) {
+		clc.lastExecutedServerCommand = clc.serverCommandSequence - MAX_RELIABLE_COMMANDS;
+	}
+
+	while ( clc.lastExecutedServerCommand < clc.serverCommandSequence ) {
+		clc.lastExecutedServerCommand++;
+		s = clc.serverCommands[ clc.lastExecutedServerCommand & ( MAX_RELIABLE_COMMANDS - 1 ) ];
+
+		Cmd_TokenizeString( s );
+		cmd = Cmd_Argv( 0 );
+
+		if ( !strcmp( cmd, "bcs0" ) ) {
+			Com_sprintf( demoBigConfigString, sizeof( demoBigConfigString ), "cs %s \"%s", Cmd_Argv( 1 ), Cmd_Argv( 2 ) );
+			demoInBigConfigString = qtrue;
+		} else if ( !strcmp( cmd, "bcs1" ) || !strcmp( cmd, "bcs2" ) ) {
+			if ( !demoInBigConfigString ) {
+				continue;
+			}
+			Q_strcat( demoBigConfigString, sizeof( demoBigConfigString ), Cmd_Argv( 2 ) );
+			if ( cmd[3] == '2' ) {
+				Q_strcat( demoBigConfigString, sizeof( demoBigConfigString ), "\"" );
+				demoInBigConfigString = qfalse;
+				Cmd_TokenizeString( demoBigConfigString );
+				CL_ConfigstringModified();
+			}
+		} else if ( !strcmp( cmd, "cs" ) ) {
+			CL_ConfigstringModified();
+		}
+	}
+}
+
+/*
+===============
+CL_DemoWriteKeyframe
+
+The snapshots kept are the current one and every one since the frame it
+was delta compressed from, since later messages can't delta from
+anything older than that.  Entities are written against their baselines,
+which don't change within a gamestate.
+===============
+*/
+static void CL_DemoWriteKeyframe( msg_t *msg ) {
+	clSnapshot_t	*frame;
+	entityState_t	*es;
+	const char		*s;
+	int				first, n, i;
+
+	for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+		s = cl.gameState.stringData + cl.gameState.stringOffsets[i];
+		if ( !s[0] ) {
+			continue;
+		}
+		MSG_WriteShort( msg, i );
+		MSG_WriteBigString( msg, s );
+	}
+	MSG_WriteShort( msg, MAX_CONFIGSTRINGS );
+
+	first = cl.snap.deltaNum > 0 ? cl.snap.deltaNum : cl.snap.messageNum;
+	if ( cl.snap.messageNum - first >= PACKET_BACKUP ) {
+		first = cl.snap.messageNum - PACKET_BACKUP + 1;
+	}
+
+	for ( n = first; n <= cl.snap.messageNum; n++ ) {
+		frame = &cl.snapshots[n & PACKET_MASK];
+		if ( !frame->valid || frame->messageNum != n ) {
+			continue;
+		}
+		if ( cl.parseEntitiesNum - frame->parseEntitiesNum >= MAX_PARSE_ENTITIES ) {
+			continue;
+		}
+
+		MSG_WriteByte( msg, 1 );
+		MSG_WriteLong( msg, frame->messageNum );
+		MSG_WriteLong( msg, frame->deltaNum );
+		MSG_WriteLong( msg, frame->serverTime );
+		MSG_WriteLong( msg, frame->serverCommandNum );
+		MSG_WriteByte( msg, frame->snapFlags );
+		MSG_WriteShort( msg, frame->ping );
+		MSG_WriteData( msg, frame->areamask, sizeof( frame->areamask ) );
+#ifdef _ONEBIT_COMBO
+		MSG_WriteDeltaPlayerstate( msg, NULL, &frame->ps, NULL, NULL );
+		if ( frame->ps.m_iVehicleNum ) {
+			MSG_WriteDeltaPlayerstate( msg, NULL, &frame->vps, NULL, NULL, qtrue );
+		}
+#else
+		MSG_WriteDeltaPlayerstate( msg, NULL, &frame->ps );
+		if ( frame->ps.m_iVehicleNum ) {
+			MSG_WriteDeltaPlayerstate( msg, NULL, &frame->vps, qtrue );
+		}
+#endif
+
+		MSG_WriteShort( msg, frame->numEntities );
+		for ( i = 0; i < frame->numEntities; i++ ) {
+			es = &cl.parseEntities[( frame->parseEntitiesNum + i ) & ( MAX_PARSE_ENTITIES - 1 )];
+			MSG_WriteDeltaEntity( msg, &cl.entityBaselines[es->number], es, qtrue );
+		}
+	}
+	MSG_WriteByte( msg, 0 );
+}
+
+/*
+===============
+CL_DemoAddKeyframe
+===============
+*/
+static void CL_DemoAddKeyframe( byte *buffer ) {
+	demoKeyframe_t	*kf;
+	msg_t			msg;
+
+	MSG_Init( &msg, buffer, DEMO_KEYFRAME_BUFFER );
+	CL_DemoWriteKeyframe( &msg );
+	if ( msg.overflowed ) {
+		Com_DPrintf( "CL_DemoAddKeyframe: keyframe at %i too big, skipped\n", cl.snap.serverTime );
+		return;
+	}
+
+	if ( demoIndex.numKeyframes == demoIndex.maxKeyframes ) {
+		demoKeyframe_t *keyframes;
+
+		demoIndex.maxKeyframes = demoIndex.maxKeyframes ? demoIndex.maxKeyframes * 2 : 64;
+		keyframes = (demoKeyframe_t *)Z_Malloc( demoIndex.maxKeyframes * sizeof( *keyframes ), TAG_CLIENTS, qtrue );
+		if ( demoIndex.keyframes ) {
+			Com_Memcpy( keyframes, demoIndex.keyframes, demoIndex.numKeyframes * sizeof( *keyframes ) );
+			Z_Free( demoIndex.keyframes );
+		}
+		demoIndex.keyframes = keyframes;
+	}
+
+	kf = &demoIndex.keyframes[demoIndex.numKeyframes++];
+	kf->offset = FS_FTell( clc.demofile );
+	kf->serverTime = cl.snap.serverTime;
+	kf->messageNum = cl.snap.messageNum;
+	kf->serverCommandSequence = clc.serverCommandSequence;
+	kf->size = msg.cursize;
+	kf->data = (byte *)Z_Malloc( msg.cursize, TAG_CLIENTS );
+	Com_Memcpy( kf->data, msg.data, msg.cursize );
+}
+
+/*
+===============
+CL_DemoRestoreKeyframe
+===============
+*/
+static void CL_DemoRestoreKeyframe( const demoKeyframe_t *kf ) {
+	clSnapshot_t	snap;
+	entityState_t	*es;
+	msg_t			msg;
+	char			*s;
+	int				i, len, num, count;
+
+	MSG_Init( &msg, kf->data, kf->size );
+	msg.cursize = kf->size;
+	MSG_BeginReading( &msg );
+
+	// rebuild the configstrings
+	Com_Memset( &cl.gameState, 0, sizeof( cl.gameState ) );
+	cl.gameState.dataCount = 1;
+	while ( ( i = MSG_ReadShort( &msg ) ) != MAX_CONFIGSTRINGS ) {
+		if ( i < 0 || i >= MAX_CONFIGSTRINGS ) {
+			Com_Error( ERR_DROP, "CL_DemoRestoreKeyframe: bad configstring %i", i );
+		}
+		s = MSG_ReadBigString( &msg );
+		len = strlen( s );
+		if ( len + 1 + cl.gameState.dataCount > MAX_GAMESTATE_CHARS ) {
+			Com_Error( ERR_DROP, "MAX_GAMESTATE_CHARS exceeded" );
+		}
+		cl.gameState.stringOffsets[i] = cl.gameState.dataCount;
+		Com_Memcpy( cl.gameState.stringData + cl.gameState.dataCount, s, len + 1 );
+		cl.gameState.dataCount += len + 1;
+	}
+
+	// and the snapshots, oldest first
+	for ( i = 0; i < PACKET_BACKUP; i++ ) {
+		cl.snapshots[i].valid = qfalse;
+	}
+	cl.parseEntitiesNum = 0;
+
+	while ( MSG_ReadByte( &msg ) ) {
+		Com_Memset( &snap, 0, sizeof( snap ) );
+		snap.valid = qtrue;
+		snap.messageNum = MSG_ReadLong( &msg );
+		snap.deltaNum = MSG_ReadLong( &msg );
+		snap.serverTime = MSG_ReadLong( &msg );
+		snap.serverCommandNum = MSG_ReadLong( &msg );
+		snap.snapFlags = MSG_ReadByte( &msg );
+		snap.ping = MSG_ReadShort( &msg );
+		MSG_ReadData( &msg, snap.areamask, sizeof( snap.areamask ) );
+		MSG_ReadDeltaPlayerstate( &msg, NULL, &snap.ps );
+		if ( snap.ps.m_iVehicleNum ) {
+			MSG_ReadDeltaPlayerstate( &msg, NULL, &snap.vps, qtrue );
+		}
+
+		count = MSG_ReadShort( &msg );
+		snap.parseEntitiesNum = cl.parseEntitiesNum;
+		snap.numEntities = count;
+		for ( i = 0; i < count; i++ ) {
+			num = MSG_ReadBits( &msg, GENTITYNUM_BITS );
+			es = &cl.parseEntities[cl.parseEntitiesNum & ( MAX_PARSE_ENTITIES - 1 )];
+			MSG_ReadDeltaEntity( &msg, &cl.entityBaselines[num], es, num );
+			cl.parseEntitiesNum++;
+		}
+
+		cl.snapshots[snap.messageNum & PACKET_MASK] = snap;
+		cl.snap = snap;
+	}
+
+	clc.serverMessageSequence = kf->messageNum;
+	clc.serverCommandSequence = kf->serverCommandSequence;
+	clc.lastExecutedServerCommand = kf->serverCommandSequence;
+	demoInBigConfigString = qfalse;
+
+	FS_Seek( clc.demofile, kf->offset, FS_SEEK_SET );
+}
+
+/*
+===============
+CL_DemoReadAhead
+
+Parses the next message without handing anything to the cgame.
+Returns qfalse without reading it at the end of the demo, or if it turns
+out to hold a new gamestate, in which case the file is left at its start
+for regular playback.
+===============
+*/
+static qboolean CL_DemoReadAhead( void ) {
+	msg_t	buf;
+	byte	bufData[MAX_MSGLEN];
+	int		offset;
+
+	offset = FS_FTell( clc.demofile );
+	if ( !CL_GetDemoMessage( &buf, bufData, sizeof( bufData ) ) ) {
+		FS_Seek( clc.demofile, offset, FS_SEEK_SET );
+		return qfalse;
+	}
+
+	clc.demoIndexing = qtrue;
+	CL_ParseServerMessage( &buf );
+	if ( !clc.demoIndexing ) {
+		FS_Seek( clc.demofile, offset, FS_SEEK_SET );
+		return qfalse;
+	}
+	clc.demoIndexing = qfalse;
+
+	CL_DemoExecuteServerCommands();
+	return qtrue;
+}
+
+/*
+===============
+CL_DemoSeekable
+
+Whether the current snapshot is one playback can be moved to: the cgame
+can't start from a snapshot that isn't active, or with a configstring
+half read.
+===============
+*/
+static qboolean CL_DemoSeekable( void ) {
+	return (qboolean)( cl.snap.valid && !( cl.snap.snapFlags & SNAPFLAG_NOT_ACTIVE ) && !demoInBigConfigString );
+}
+
+/*
+===============
+CL_DemoIndexMessage
+
+Called after each message read ahead, with the offset it was read from.
+If that was the end of the index, the index is extended over it, taking
+a keyframe whenever an interval has gone by since the last one.
+===============
+*/
+static void CL_DemoIndexMessage( int offset, byte *buffer ) {
+	if ( offset != demoIndex.endOffset ) {
+		return;
+	}
+	demoIndex.endOffset = FS_FTell( clc.demofile );
+
+	// only messages that brought a new snapshot matter
+	if ( !cl.snap.valid || cl.snap.messageNum != clc.serverMessageSequence ) {
+		return;
+	}
+	demoIndex.endTime = cl.snap.serverTime;
+
+	if ( !CL_DemoSeekable() ) {
+		return;
+	}
+	if ( !demoIndex.numKeyframes
+		|| cl.snap.serverTime - demoIndex.keyframes[demoIndex.numKeyframes - 1].serverTime >= demoIndex.interval ) {
+		CL_DemoAddKeyframe( buffer );
+	}
+}
+
+/*
+===============
+CL_DemoBuildIndex
+
+Starts the index with a keyframe at the first snapshot from the current
+position on, then puts the client back exactly where it was.  The rest
+is indexed as seeks read through it.
+===============
+*/
+void CL_DemoBuildIndex( void ) {
+	clientActive_t		*savedCl;
+	clientConnection_t	*savedClc;
+	byte				*buffer;
+	int					start, offset;
+
+	CL_DemoFreeIndex();
+
+	if ( !clc.demoplaying || !clc.demofile || cl_demoKeyframeInterval->value <= 0 ) {
+		return;
+	}
+
+	start = FS_FTell( clc.demofile );
+
+	savedCl = (clientActive_t *)Z_Malloc( sizeof( cl ), TAG_TEMP_WORKSPACE );
+	savedClc = (clientConnection_t *)Z_Malloc( sizeof( clc ), TAG_TEMP_WORKSPACE );
+	buffer = (byte *)Z_Malloc( DEMO_KEYFRAME_BUFFER, TAG_TEMP_WORKSPACE );
+	Com_Memcpy( savedCl, &cl, sizeof( cl ) );
+	Com_Memcpy( savedClc, &clc, sizeof( clc ) );
+
+	// the configstrings already hold everything up to here
+	clc.lastExecutedServerCommand = clc.serverCommandSequence;
+	demoInBigConfigString = qfalse;
+
+	demoIndex.interval = (int)( cl_demoKeyframeInterval->value * 1000 );
+	demoIndex.endOffset = start;
+	demoIndex.endTime = cl.snap.serverTime;
+
+	while ( !demoIndex.numKeyframes ) {
+		offset = FS_FTell( clc.demofile );
+		if ( !CL_DemoReadAhead() ) {
+			break;
+		}
+		CL_DemoIndexMessage( offset, buffer );
+	}
+	demoIndex.built = qtrue;
+
+	Com_Memcpy( &cl, savedCl, sizeof( cl ) );
+	Com_Memcpy( &clc, savedClc, sizeof( clc ) );
+	FS_Seek( clc.demofile, start, FS_SEEK_SET );
+	demoInBigConfigString = qfalse;
+
+	Z_Free( buffer );
+	Z_Free( savedClc );
+	Z_Free( savedCl );
+}
+
+/*
+===============
+CL_DemoFindKeyframe
+
+The last keyframe at or before serverTime, or the first one
+===============
+*/
+static const demoKeyframe_t *CL_DemoFindKeyframe( int serverTime ) {
+	int		i;
+
+	for ( i = demoIndex.numKeyframes - 1; i > 0; i-- ) {
+		if ( demoIndex.keyframes[i].serverTime <= serverTime ) {
+			break;
+		}
+	}
+	return &demoIndex.keyframes[i];
+}
+
+/*
+===============
+CL_DemoSeek
+
+Moves playback to the first active snapshot at or after serverTime, or
+to the last one before the end of the demo or the next gamestate.  The
+snapshot it lands on is flagged SNAPFLAG_DEMOSEEK, older ones aren't
+handed to the cgame any more, and no further messages are read until
+the cgame has drawn a frame, so it can start over from exactly that
+snapshot with the configstrings as they were there.
+===============
+*/
+qboolean CL_DemoSeek( int serverTime ) {
+	const demoKeyframe_t	*kf;
+	byte					*buffer;
+	int						offset;
+
+	if ( !clc.demoplaying || !clc.demofile || cls.state != CA_ACTIVE || cl_timedemo->integer ) {
+		return qfalse;
+	}
+
+	if ( !demoIndex.built ) {
+		CL_DemoBuildIndex();
+	}
+	if ( !demoIndex.numKeyframes ) {
+		return qfalse;
+	}
+
+	serverTime = Q_max( serverTime, demoIndex.keyframes[0].serverTime );
+	kf = CL_DemoFindKeyframe( serverTime );
+
+	// reading on is quicker than going back if the target is close ahead
+	if ( cl.snap.serverTime > serverTime || cl.snap.serverTime < kf->serverTime ) {
+		CL_DemoRestoreKeyframe( kf );
+	}
+
+	// past the end of the index this takes keyframes for the next seek
+	buffer = (byte *)Z_Malloc( DEMO_KEYFRAME_BUFFER, TAG_TEMP_WORKSPACE );
+	while ( cl.snap.serverTime < serverTime || !CL_DemoSeekable() ) {
+		offset = FS_FTell( clc.demofile );
+		if ( !CL_DemoReadAhead() ) {
+			break;
+		}
+		CL_DemoIndexMessage( offset, buffer );
+	}
+	Z_Free( buffer );
+
+	// the demo ran out on a snapshot the cgame can't start from, go back to the last keyframe
+	if ( !CL_DemoSeekable() ) {
+		CL_DemoRestoreKeyframe( CL_DemoFindKeyframe( serverTime ) );
+	}
+
+	cl.snap.snapFlags |= SNAPFLAG_DEMOSEEK;
+	cl.snapshots[cl.snap.messageNum & PACKET_MASK].snapFlags |= SNAPFLAG_DEMOSEEK;
+	clc.demoSeekSnapshot = cl.snap.messageNum;
+	clc.demoSeekHeld = qtrue;
+
+	// continue from the new snapshot as if it were the first one
+	cl.serverTimeDelta = cl.snap.serverTime - cls.realtime;
+	cl.serverTime = cl.snap.serverTime;
+	cl.oldServerTime = cl.snap.serverTime;
+	cl.oldFrameServerTime = cl.snap.serverTime;
+	cl.newSnapshots = qfalse;
+
+	S_StopAllSounds();
+	return qtrue;
+}
+
+/*
+===============
+CL_DemoSeek_f
+
+demo_seek <seconds>, counted from the start of the demo
+demo_seek +<seconds> or -<seconds>, from the current time
+Either may be given as minutes:seconds.
+===============
+*/
+void CL_DemoSeek_f( void ) {
+	const char	*arg, *colon;
+	int			msec, target;
+
+	if ( !clc.demoplaying || cls.state != CA_ACTIVE ) {
+		Com_Printf( "Not playing a demo.\n" );
+		return;
+	}
+
+	if ( !demoIndex.built ) {
+		CL_DemoBuildIndex();
+	}
+	if ( !demoIndex.numKeyframes ) {
+		Com_Printf( "This demo can't be seeked.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "usage: demo_seek [+|-]<seconds>|<minutes:seconds>\n" );
+		Com_Printf( "at %.1f seconds, indexed up to %.1f\n", ( cl.snap.serverTime - demoIndex.keyframes[0].serverTime ) / 1000.0f,
+			( demoIndex.endTime - demoIndex.keyframes[0].serverTime ) / 1000.0f );
+		return;
+	}
+
+	arg = Cmd_Argv( 1 );
+	colon = strchr( arg, ':' );
+	msec = (int)( atof( colon ? colon + 1 : arg + ( *arg == '+' || *arg == '-' ) ) * 1000 );
+	if ( colon ) {
+		msec += atoi( arg + ( *arg == '+' || *arg == '-' ) ) * 60000;
+	}
+
+	if ( *arg == '+' ) {
+		target = cl.snap.serverTime + msec;
+	} else if ( *arg == '-' ) {
+		target = cl.snap.serverTime - msec;
+	} else {
+		target = demoIndex.keyframes[0].serverTime + msec;
+	}
+
+	if ( !CL_DemoSeek( target ) ) {
+		Com_Printf( "Couldn't seek the demo.\n" );
+	}
+}
@@ -68,6 +68,7 @@ cvar_t	*cl_timedemo;
 cvar_t	*cl_aviFrameRate;
 cvar_t	*cl_aviMotionJpeg;
 cvar_t	*cl_avi2GBLimit;
+cvar_t	*cl_demoKeyframeInterval;
 cvar_t	*cl_forceavidemo;
 
 cvar_t	*cl_freelook;
@@ -452,54 +453,63 @@ void CL_DemoCompleted( void ) {
 
 /*
 =================
-CL_ReadDemoMessage
+CL_GetDemoMessage
+
+Reads the next message of the demo without parsing it.
+Returns qfalse at the end of the demo.
 =================
 */
-void CL_ReadDemoMessage( void ) {
+qboolean CL_GetDemoMessage( msg_t *buf, byte *bufData, int bufSize ) {
 	int			r;
-	msg_t		buf;
-	byte		bufData[ MAX_MSGLEN ];
 	int			s;
 
-	if ( !clc.demofile ) {
-		CL_DemoCompleted ();
-		return;
-	}
-
 	// get the sequence number
 	r = FS_Read( &s, 4, clc.demofile);
 	if ( r != 4 ) {
-		CL_DemoCompleted ();
-		return;
+		return qfalse;
 	}
 	clc.serverMessageSequence = LittleLong( s );
 
 	// init the message
-	MSG_Init( &buf, bufData, sizeof( bufData ) );
+	MSG_Init( buf, bufData, bufSize );
 
 	// get the length
-	r = FS_Read (&buf.cursize, 4, clc.demofile);
+	r = FS_Read (&buf->cursize, 4, clc.demofile);
 	if ( r != 4 ) {
-		CL_DemoCompleted ();
-		return;
+		return qfalse;
 	}
-	buf.cursize = LittleLong( buf.cursize );
-	if ( buf.cursize == -1 ) {
-		CL_DemoCompleted ();
-		return;
+	buf->cursize = LittleLong( buf->cursize );
+	if ( buf->cursize == -1 ) {
+		return qfalse;
 	}
-	if ( buf.cursize > buf.maxsize ) {
+	if ( buf->cursize > buf->maxsize ) {
 		Com_Error (ERR_DROP, "CL_ReadDemoMessage: demoMsglen > MAX_MSGLEN");
 	}
-	r = FS_Read( buf.data, buf.cursize, clc.demofile );
-	if ( r != buf.cursize ) {
+	r = FS_Read( buf->data, buf->cursize, clc.demofile );
+	if ( r != buf->cursize ) {
 		Com_Printf( "Demo file was truncated.\n");
+		return qfalse;
+	}
+
+	buf->readcount = 0;
+	return qtrue;
+}
+
+/*
+=================
+CL_ReadDemoMessage
+=================
+*/
+void CL_ReadDemoMessage( void ) {
+	msg_t		buf;
+	byte		bufData[ MAX_MSGLEN ];
+
+	if ( !clc.demofile || !CL_GetDemoMessage( &buf, bufData, sizeof( bufData ) ) ) {
 		CL_DemoCompleted ();
 		return;
 	}
 
 	clc.lastPacketTime = cls.realtime;
-	buf.readcount = 0;
 	CL_ParseServerMessage( &buf );
 }
 
@@ -597,6 +607,12 @@ void CL_PlayDemo_f( void ) {
 	while ( cls.state >= CA_CONNECTED && cls.state < CA_PRIMED ) {
 		CL_ReadDemoMessage();
 	}
+
+	// start indexing the demo so it can be seeked, seeks index the rest
+	if ( cls.state == CA_PRIMED ) {
+		CL_DemoBuildIndex();
+	}
+
 	// don't get the first snapshot this frame, to prevent the long
 	// time from the gamestate load from messing causing a time skip
 	clc.firstDemoFrameSkipped = qfalse;
@@ -847,6 +863,7 @@ void CL_Disconnect( qboolean showMainMenu ) {
 		FS_FCloseFile( clc.demofile );
 		clc.demofile = 0;
 	}
+	CL_DemoFreeIndex();
 
 	if ( cls.uiStarted && showMainMenu ) {
 		UIVM_SetActiveMenu( UIMENU_NONE );
@@ -2545,6 +2562,7 @@ void CL_InitRef( void ) {
 	ri.FS_FreeFileList = FS_FreeFileList;
 	ri.FS_Read = FS_Read;
 	ri.FS_ReadFile = FS_ReadFile;
+	ri.FS_ReadFileMapped = FS_ReadFileMapped;
 	ri.FS_FCloseFile = FS_FCloseFile;
 	ri.FS_FOpenFileRead = FS_FOpenFileRead;
 	ri.FS_FOpenFileWrite = FS_FOpenFileWrite;
@@ -2554,6 +2572,8 @@ void CL_InitRef( void ) {
 	ri.FS_ListFiles = FS_ListFiles;
 	ri.FS_Write = FS_Write;
 	ri.FS_WriteFile = FS_WriteFile;
+	ri.FS_LoadedPakChecksums = FS_LoadedPakChecksums;
+	ri.FS_FileOrigin = FS_FileOrigin;
 	ri.CM_BoxTrace = CM_BoxTrace;
 	ri.CM_DrawDebugSurface = CM_DrawDebugSurface;
 	ri.CM_CullWorldBox = CM_CullWorldBox;
@@ -2582,8 +2602,11 @@ void CL_InitRef( void ) {
 	ri.WIN_SetGamma = WIN_SetGamma;
     ri.WIN_Shutdown = WIN_Shutdown;
     ri.WIN_Present = WIN_Present;
+	ri.WIN_SwapBuffers = WIN_SwapBuffers;
+	ri.WIN_UpdateWindow = WIN_UpdateWindow;
 	ri.GL_GetProcAddress = WIN_GL_GetProcAddress;
 	ri.GL_ExtensionSupported = WIN_GL_ExtensionSupported;
+	ri.GL_MakeCurrent = WIN_GL_MakeCurrent;
 
 	ri.CM_GetCachedMapDiskImage = CM_GetCachedMapDiskImage;
 	ri.CM_SetCachedMapDiskImage = CM_SetCachedMapDiskImage;
@@ -2829,6 +2852,7 @@ void CL_Init( void ) {
 	cl_activeAction = Cvar_Get( "activeAction", "", CVAR_TEMP );
 
 	cl_timedemo = Cvar_Get ("timedemo", "0", 0);
+	cl_demoKeyframeInterval = Cvar_Get ("cl_demoKeyframeInterval", "10", CVAR_ARCHIVE, "Seconds of demo between the keyframes demo_seek starts from, 0 to not index demos" );
 	cl_aviFrameRate = Cvar_Get ("cl_aviFrameRate", "25", CVAR_ARCHIVE);
 	cl_aviMotionJpeg = Cvar_Get ("cl_aviMotionJpeg", "1", CVAR_ARCHIVE);
 	cl_avi2GBLimit = Cvar_Get ("cl_avi2GBLimit", "1", CVAR_ARCHIVE );
@@ -2955,6 +2979,7 @@ void CL_Init( void ) {
 	Cmd_AddCommand ("demo", CL_PlayDemo_f, "Playback a demo" );
 	Cmd_SetCommandCompletionFunc( "demo", CL_CompleteDemoName );
 	Cmd_AddCommand ("demo_restart", CL_DemoRestart_f, "Restarts the current or last-played demo" );
+	Cmd_AddCommand ("demo_seek", CL_DemoSeek_f, "Jumps to a time in the demo being played" );
 	Cmd_AddCommand ("stoprecord", CL_StopRecord_f, "Stop recording a demo" );
 	Cmd_AddCommand ("configstrings", CL_Configstrings_f, "Prints the configstrings list" );
 	Cmd_AddCommand ("clientinfo", CL_Clientinfo_f, "Prints the userinfo variables" );
@@ -3034,6 +3059,7 @@ void CL_Shutdown( void ) {
 	Cmd_RemoveCommand ("record");
 	Cmd_RemoveCommand ("demo");
 	Cmd_RemoveCommand ("demo_restart");
+	Cmd_RemoveCommand ("demo_seek");
 	Cmd_RemoveCommand ("cinematic");
 	Cmd_RemoveCommand ("stoprecord");
 	Cmd_RemoveCommand ("connect");
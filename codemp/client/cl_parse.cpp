@@ -527,6 +527,11 @@ void CL_ParseGamestate( msg_t *msg ) {
 	// wipe local client state
 	CL_ClearState();
 
+	// the demo index only covers the previous gamestate
+	if ( clc.demoplaying ) {
+		CL_DemoFreeIndex();
+	}
+
 	// a gamestate always marks a server command sequence
 	clc.serverCommandSequence = MSG_ReadLong( msg );
 
@@ -860,6 +865,13 @@ void CL_ParseServerMessage( msg_t *msg ) {
 			}
 		}
 
+		// reading ahead for the demo index stops short of anything
+		// that would reload the level
+		if ( clc.demoIndexing && cmd != svc_nop && cmd != svc_serverCommand && cmd != svc_snapshot ) {
+			clc.demoIndexing = qfalse;
+			return;
+		}
+
 	// other commands
 		switch ( cmd ) {
 		default:
@@ -253,6 +253,9 @@ typedef struct clientConnection_s {
 	qboolean	demowaiting;	// don't record until a non-delta message is received
 	qboolean	firstDemoFrameSkipped;
 	fileHandle_t	demofile;
+	qboolean	demoIndexing;		// cleared by the parser on anything a keyframe can't restore
+	int			demoSeekSnapshot;	// cgame isn't given snapshots older than the one a seek landed on
+	qboolean	demoSeekHeld;		// don't read further until the cgame has taken that snapshot
 
 	int			timeDemoFrames;		// counter of rendered frames
 	int			timeDemoStart;		// cls.realtime before first frame
@@ -431,6 +434,7 @@ extern	cvar_t	*cl_timedemo;
 extern	cvar_t	*cl_aviFrameRate;
 extern	cvar_t	*cl_aviMotionJpeg;
 extern	cvar_t	*cl_avi2GBLimit;
+extern	cvar_t	*cl_demoKeyframeInterval;
 
 extern	cvar_t	*cl_forceavidemo;
 
@@ -485,6 +489,7 @@ void CL_Vid_Restart_f( void );
 void CL_Snd_Restart_f (void);
 void CL_StartDemoLoop( void );
 void CL_NextDemo( void );
+qboolean CL_GetDemoMessage( msg_t *buf, byte *bufData, int bufSize );
 void CL_ReadDemoMessage( void );
 
 void CL_InitDownloads(void);
@@ -617,6 +622,15 @@ void CL_CGameRendering( stereoFrame_t stereo );
 void CL_SetCGameTime( void );
 void CL_FirstSnapshot( void );
 void CL_ShaderStateChanged(void);
+void CL_ConfigstringModified( void );
+
+//
+// cl_demo.c
+//
+void CL_DemoFreeIndex( void );
+void CL_DemoBuildIndex( void );
+qboolean CL_DemoSeek( int serverTime );
+void CL_DemoSeek_f( void );
 
 //
 // cl_ui.c
@@ -2944,11 +2944,19 @@ qboolean NPC_SetCombatPoint( int combatPointID )
 }
 
 extern qboolean CheckItemCanBePickedUpByNPC( gentity_t *item, gentity_t *pickerupper );
+#define	MAX_UNROUTED_WEAPONS	64
+
 gentity_t *NPC_SearchForWeapons( void )
 {
 	gentity_t *found = g_entities, *bestFound = NULL;
 	float		dist, bestDist = Q3_INFINITE;
 	int i;
+	//the ones we can't nav to, which need a clear straight path instead
+	gentity_t	*unrouted[MAX_UNROUTED_WEAPONS];
+	vec3_t		unroutedOrigin[MAX_UNROUTED_WEAPONS];
+	float		unroutedDist[MAX_UNROUTED_WEAPONS];
+	qboolean	unroutedClear[MAX_UNROUTED_WEAPONS];
+	int			numUnrouted = 0;
 
 //	for ( found = g_entities; found < &g_entities[globals.num_entities] ; found++)
 	for ( i = 0; i<level.num_entities; i++)
@@ -2985,7 +2993,14 @@ gentity_t *NPC_SearchForWeapons( void )
 					if ( !trap->Nav_GetBestPathBetweenEnts( (sharedEntity_t *)NPCS.NPC, (sharedEntity_t *)found, NF_CLEAR_PATH )
 						|| trap->Nav_GetBestNodeAltRoute2( NPCS.NPC->waypoint, found->waypoint, NODE_NONE ) == WAYPOINT_NONE )
 					{//can't possibly have a route to any OR can't possibly have a route to this one OR don't have a route to this one
-						if ( NAV_ClearPathToPoint( NPCS.NPC, NPCS.NPC->r.mins, NPCS.NPC->r.maxs, found->r.currentOrigin, NPCS.NPC->clipmask, ENTITYNUM_NONE ) )
+						if ( numUnrouted < MAX_UNROUTED_WEAPONS )
+						{//check for a clear straight path along with the others below
+							unrouted[numUnrouted] = found;
+							VectorCopy( found->r.currentOrigin, unroutedOrigin[numUnrouted] );
+							unroutedDist[numUnrouted] = dist;
+							numUnrouted++;
+						}
+						else if ( NAV_ClearPathToPoint( NPCS.NPC, NPCS.NPC->r.mins, NPCS.NPC->r.maxs, found->r.currentOrigin, NPCS.NPC->clipmask, ENTITYNUM_NONE ) )
 						{//have a clear straight path to this one
 							bestDist = dist;
 							bestFound = found;
@@ -3001,6 +3016,21 @@ gentity_t *NPC_SearchForWeapons( void )
 		}
 	}
 
+	//trace the straight paths all at once, the closest one still wins and the lower entity number breaks ties
+	NAV_ClearPathsToPoints( NPCS.NPC, NPCS.NPC->r.mins, NPCS.NPC->r.maxs, unroutedOrigin, numUnrouted, NPCS.NPC->clipmask, ENTITYNUM_NONE, unroutedClear );
+	for ( i = 0; i < numUnrouted; i++ )
+	{
+		if ( !unroutedClear[i] )
+		{
+			continue;
+		}
+		if ( unroutedDist[i] < bestDist || ( unroutedDist[i] == bestDist && unrouted[i] < bestFound ) )
+		{//have a clear straight path to this one
+			bestDist = unroutedDist[i];
+			bestFound = unrouted[i];
+		}
+	}
+
 	return bestFound;
 }
 
@@ -2164,10 +2164,16 @@ int ScanForEnemies(bot_state_t *bs)
 	int i;
 	float hasEnemyDist = 0;
 	qboolean noAttackNonJM = qfalse;
+	int candidates[MAX_CLIENTS+1];
+	float candidateDist[MAX_CLIENTS+1];
+	traceRequest_t requests[MAX_CLIENTS+1];
+	trace_t results[MAX_CLIENTS+1];
+	int numCandidates;
 
 	closest = 999999;
 	i = 0;
 	bestindex = -1;
+	numCandidates = 0;
 
 	if (bs->currentEnemy)
 	{ //only switch to a new enemy if he's significantly closer
@@ -2195,6 +2201,7 @@ int ScanForEnemies(bot_state_t *bs)
 		}
 	}
 
+	//gather everyone we could see or hear, then do all the visibility traces in one go
 	while (i <= MAX_CLIENTS)
 	{
 		if (i != bs->client && g_entities[i].client && !OnSameTeam(&g_entities[bs->client], &g_entities[i]) && PassStandardEnemyChecks(bs, &g_entities[i]) && BotPVSCheck(g_entities[i].client->ps.origin, bs->eye) && PassLovedOneCheck(bs, &g_entities[i]))
@@ -2208,36 +2215,66 @@ int ScanForEnemies(bot_state_t *bs)
 				distcheck = 1;
 			}
 
-			if (distcheck < closest && ((InFieldOfVision(bs->viewangles, 90, a) && !BotMindTricked(bs->client, i)) || BotCanHear(bs, &g_entities[i], distcheck)) && OrgVisible(bs->eye, g_entities[i].client->ps.origin, -1))
+			if (distcheck < closest && ((InFieldOfVision(bs->viewangles, 90, a) && !BotMindTricked(bs->client, i)) || BotCanHear(bs, &g_entities[i], distcheck)))
 			{
-				if (BotMindTricked(bs->client, i))
-				{
-					if (distcheck < 256 || (level.time - g_entities[i].client->dangerTime) < 100)
-					{
-						if (!hasEnemyDist || distcheck < (hasEnemyDist - 128))
-						{ //if we have an enemy, only switch to closer if he is 128+ closer to avoid flipping out
-							if (!noAttackNonJM || g_entities[i].client->ps.isJediMaster)
-							{
-								closest = distcheck;
-								bestindex = i;
-							}
-						}
-					}
-				}
-				else
+				traceRequest_t *req = &requests[numCandidates];
+
+				memset(req, 0, sizeof(*req));
+				VectorCopy(bs->eye, req->start);
+				VectorCopy(g_entities[i].client->ps.origin, req->end);
+				req->passEntityNum = -1;
+				req->contentmask = MASK_SOLID;
+
+				candidates[numCandidates] = i;
+				candidateDist[numCandidates] = distcheck;
+				numCandidates++;
+			}
+		}
+		i++;
+	}
+
+	if (!numCandidates)
+	{
+		return -1;
+	}
+
+	trap->TraceBatch(results, requests, numCandidates);
+
+	for (i = 0; i < numCandidates; i++)
+	{
+		int ent = candidates[i];
+
+		distcheck = candidateDist[i];
+
+		//closest only shrinks, so this is the same test the gather pass made with the final value
+		if (distcheck < closest && results[i].fraction == 1)
+		{
+			if (BotMindTricked(bs->client, ent))
+			{
+				if (distcheck < 256 || (level.time - g_entities[ent].client->dangerTime) < 100)
 				{
 					if (!hasEnemyDist || distcheck < (hasEnemyDist - 128))
 					{ //if we have an enemy, only switch to closer if he is 128+ closer to avoid flipping out
-						if (!noAttackNonJM || g_entities[i].client->ps.isJediMaster)
+						if (!noAttackNonJM || g_entities[ent].client->ps.isJediMaster)
 						{
 							closest = distcheck;
-							bestindex = i;
+							bestindex = ent;
 						}
 					}
 				}
 			}
+			else
+			{
+				if (!hasEnemyDist || distcheck < (hasEnemyDist - 128))
+				{ //if we have an enemy, only switch to closer if he is 128+ closer to avoid flipping out
+					if (!noAttackNonJM || g_entities[ent].client->ps.isJediMaster)
+					{
+						closest = distcheck;
+						bestindex = ent;
+					}
+				}
+			}
 		}
-		i++;
 	}
 
 	return bestindex;
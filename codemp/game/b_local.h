@@ -298,6 +298,7 @@ extern qboolean NAV_HitNavGoal( vec3_t point, vec3_t mins, vec3_t maxs, vec3_t d
 extern void NPC_SetMoveGoal( gentity_t *ent, vec3_t point, int radius, qboolean isNavGoal, int combatPoint, gentity_t *targetEnt ); //isNavGoal = qfalse, combatPoint = -1, targetEnt = NULL
 
 extern qboolean NAV_ClearPathToPoint(gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3_t point, int clipmask, int okToHitEnt );
+extern void NAV_ClearPathsToPoints( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3_t *points, int numPoints, int clipmask, int okToHitEnt, qboolean *clear );
 extern void NPC_ApplyWeaponFireDelay(void);
 
 //NPC_FaceXXX suite
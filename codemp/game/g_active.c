@@ -3054,7 +3054,9 @@ void ClientThink_real( gentity_t *ent ) {
 #endif
 	}
 
+	trap->ProfileBegin( "Pmove" );
 	Pmove (&pmove);
+	trap->ProfileEnd();
 
 	if (ent->client->solidHack)
 	{
@@ -3058,6 +3058,7 @@ void G_RunFrame( int levelTime ) {
 #ifdef _G_FRAME_PERFANAL
 	trap->PrecisionTimer_Start(&timer_ItemRun);
 #endif
+	trap->ProfileBegin( "G_RunEntities" );
 	//
 	// go through all allocated objects
 	//
@@ -3342,6 +3343,7 @@ void G_RunFrame( int levelTime ) {
 			ClearNPCGlobals();
 		}
 	}
+	trap->ProfileEnd();
 #ifdef _G_FRAME_PERFANAL
 	iTimer_ItemRun = trap->PrecisionTimer_End(timer_ItemRun);
 #endif
@@ -3351,7 +3353,9 @@ void G_RunFrame( int levelTime ) {
 #ifdef _G_FRAME_PERFANAL
 	trap->PrecisionTimer_Start(&timer_ROFF);
 #endif
+	trap->ProfileBegin( "G_ROFFUpdate" );
 	trap->ROFF_UpdateEntities();
+	trap->ProfileEnd();
 #ifdef _G_FRAME_PERFANAL
 	iTimer_ROFF = trap->PrecisionTimer_End(timer_ROFF);
 #endif
@@ -3361,6 +3365,7 @@ void G_RunFrame( int levelTime ) {
 #ifdef _G_FRAME_PERFANAL
 	trap->PrecisionTimer_Start(&timer_ClientEndframe);
 #endif
+	trap->ProfileBegin( "G_ClientEndFrame" );
 	// perform final fixups on the players
 	ent = &g_entities[0];
 	for (i=0 ; i < level.maxclients ; i++, ent++ ) {
@@ -3368,6 +3373,7 @@ void G_RunFrame( int levelTime ) {
 			ClientEndFrame( ent );
 		}
 	}
+	trap->ProfileEnd();
 #ifdef _G_FRAME_PERFANAL
 	iTimer_ClientEndframe = trap->PrecisionTimer_End(timer_ClientEndframe);
 #endif
@@ -3377,6 +3383,7 @@ void G_RunFrame( int levelTime ) {
 #ifdef _G_FRAME_PERFANAL
 	trap->PrecisionTimer_Start(&timer_GameChecks);
 #endif
+	trap->ProfileBegin( "G_GameChecks" );
 	// see if it is time to do a tournament restart
 	CheckTournament();
 
@@ -3396,6 +3403,7 @@ void G_RunFrame( int levelTime ) {
 	// for tracking changes
 	CheckCvars();
 
+	trap->ProfileEnd();
 #ifdef _G_FRAME_PERFANAL
 	iTimer_GameChecks = trap->PrecisionTimer_End(timer_GameChecks);
 #endif
@@ -3405,6 +3413,7 @@ void G_RunFrame( int levelTime ) {
 #ifdef _G_FRAME_PERFANAL
 	trap->PrecisionTimer_Start(&timer_Queues);
 #endif
+	trap->ProfileBegin( "G_Queues" );
 	//At the end of the frame, send out the ghoul2 kill queue, if there is one
 	G_SendG2KillQueue();
 
@@ -3418,6 +3427,7 @@ void G_RunFrame( int levelTime ) {
 			gQueueScoreMessage = 0;
 		}
 	}
+	trap->ProfileEnd();
 #ifdef _G_FRAME_PERFANAL
 	iTimer_Queues = trap->PrecisionTimer_End(timer_Queues);
 #endif
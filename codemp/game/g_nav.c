@@ -237,22 +237,24 @@ qboolean NAV_HitNavGoal( vec3_t point, vec3_t mins, vec3_t maxs, vec3_t dest, in
 
 /*
 -------------------------
-NAV_ClearPathToPoint
+NAV_ClearPathRequest
+
+Sets up the trace NAV_ClearPathToPoint starts with, returns qfalse if the
+point can't be reached at all
 -------------------------
 */
 
-qboolean NAV_ClearPathToPoint( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3_t point, int clipmask, int okToHitEntNum )
+static qboolean NAV_ClearPathRequest( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3_t point, int clipmask, traceRequest_t *req )
 {
 //	trace_t	trace;
 //	return NAV_CheckAhead( self, point, trace, clipmask|CONTENTS_BOTCLIP );
 
-	vec3_t	mins, maxs;
-	trace_t	trace;
-
 	//Test if they're even conceivably close to one another
 	if ( !trap->InPVS( self->r.currentOrigin, point ) )
 		return qfalse;
 
+	memset( req, 0, sizeof( *req ) );
+
 	if ( self->flags & FL_NAVGOAL )
 	{
 		if ( !self->parent )
@@ -261,55 +263,85 @@ qboolean NAV_ClearPathToPoint( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3
 			assert(self->parent);
 			return qfalse;
 		}
-		VectorCopy( self->parent->r.mins, mins );
-		VectorCopy( self->parent->r.maxs, maxs );
+		VectorCopy( self->parent->r.mins, req->mins );
+		VectorCopy( self->parent->r.maxs, req->maxs );
 	}
 	else
 	{
-		VectorCopy( pmins, mins );
-		VectorCopy( pmaxs, maxs );
+		VectorCopy( pmins, req->mins );
+		VectorCopy( pmaxs, req->maxs );
 	}
 
 	if ( self->client || ( self->flags & FL_NAVGOAL ) )
 	{
 		//Clients can step up things, or if this is a navgoal check, a client will be using this info
-		mins[2] += STEPSIZE;
+		req->mins[2] += STEPSIZE;
 
 		//don't let box get inverted
-		if ( mins[2] > maxs[2] )
+		if ( req->mins[2] > req->maxs[2] )
 		{
-			mins[2] = maxs[2];
+			req->mins[2] = req->maxs[2];
 		}
 	}
 
 	if ( self->flags & FL_NAVGOAL )
 	{
 		//Trace from point to navgoal
-		trap->Trace( &trace, point, mins, maxs, self->r.currentOrigin, self->parent->s.number, (clipmask|CONTENTS_MONSTERCLIP|CONTENTS_BOTCLIP)&~CONTENTS_BODY, qfalse, 0, 0 );
-		if ( trace.startsolid&&(trace.contents&CONTENTS_BOTCLIP) )
-		{//started inside do not enter, so ignore them
-			clipmask &= ~CONTENTS_BOTCLIP;
-			trap->Trace( &trace, point, mins, maxs, self->r.currentOrigin, self->parent->s.number, (clipmask|CONTENTS_MONSTERCLIP)&~CONTENTS_BODY, qfalse, 0, 0 );
-		}
+		VectorCopy( point, req->start );
+		VectorCopy( self->r.currentOrigin, req->end );
+		req->passEntityNum = self->parent->s.number;
+		req->contentmask = (clipmask|CONTENTS_MONSTERCLIP|CONTENTS_BOTCLIP)&~CONTENTS_BODY;
+	}
+	else
+	{
+		VectorCopy( self->r.currentOrigin, req->start );
+		VectorCopy( point, req->end );
+		req->passEntityNum = self->s.number;
+		req->contentmask = clipmask|CONTENTS_MONSTERCLIP|CONTENTS_BOTCLIP;
+	}
+
+	return qtrue;
+}
+
+/*
+-------------------------
+NAV_ClearPathResult
 
-		if ( trace.startsolid || trace.allsolid )
+Finishes NAV_ClearPathToPoint with the result of its first trace
+-------------------------
+*/
+
+static qboolean NAV_ClearPathResult( gentity_t *self, vec3_t point, traceRequest_t *req, trace_t *trace, int okToHitEntNum )
+{
+	trace_t	retry;
+
+	if ( trace->startsolid&&(trace->contents&CONTENTS_BOTCLIP) )
+	{//started inside do not enter, so ignore them
+		req->contentmask &= ~CONTENTS_BOTCLIP;
+		trap->Trace( &retry, req->start, req->mins, req->maxs, req->end, req->passEntityNum, req->contentmask, qfalse, 0, 0 );
+		trace = &retry;
+	}
+
+	if ( self->flags & FL_NAVGOAL )
+	{
+		if ( trace->startsolid || trace->allsolid )
 		{
 			return qfalse;
 		}
 
 		//Made it
-		if ( trace.fraction == 1.0 )
+		if ( trace->fraction == 1.0 )
 		{
 			return qtrue;
 		}
 
-		if ( okToHitEntNum != ENTITYNUM_NONE && trace.entityNum == okToHitEntNum )
+		if ( okToHitEntNum != ENTITYNUM_NONE && trace->entityNum == okToHitEntNum )
 		{
 			return qtrue;
 		}
 
 		//Okay, didn't get all the way there, let's see if we got close enough:
-		if ( NAV_HitNavGoal( self->r.currentOrigin, self->parent->r.mins, self->parent->r.maxs, trace.endpos, NPCS.NPCInfo->goalRadius, FlyingCreature( self->parent ) ) )
+		if ( NAV_HitNavGoal( self->r.currentOrigin, self->parent->r.mins, self->parent->r.maxs, trace->endpos, NPCS.NPCInfo->goalRadius, FlyingCreature( self->parent ) ) )
 		{
 			return qtrue;
 		}
@@ -317,12 +349,12 @@ qboolean NAV_ClearPathToPoint( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3
 		{
 			if ( NAVDEBUG_showCollision )
 			{
-				if ( trace.entityNum < ENTITYNUM_WORLD && (&g_entities[trace.entityNum] != NULL) && g_entities[trace.entityNum].s.eType != ET_MOVER )
+				if ( trace->entityNum < ENTITYNUM_WORLD && (&g_entities[trace->entityNum] != NULL) && g_entities[trace->entityNum].s.eType != ET_MOVER )
 				{
 					vec3_t	p1, p2;
-					G_DrawEdge( point, trace.endpos, EDGE_PATH );
-					VectorAdd(g_entities[trace.entityNum].r.mins, g_entities[trace.entityNum].r.currentOrigin, p1);
-					VectorAdd(g_entities[trace.entityNum].r.maxs, g_entities[trace.entityNum].r.currentOrigin, p2);
+					G_DrawEdge( point, trace->endpos, EDGE_PATH );
+					VectorAdd(g_entities[trace->entityNum].r.mins, g_entities[trace->entityNum].r.currentOrigin, p1);
+					VectorAdd(g_entities[trace->entityNum].r.maxs, g_entities[trace->entityNum].r.currentOrigin, p2);
 					G_CubeOutline( p1, p2, FRAMETIME, 0x0000ff, 0.5 );
 				}
 				//FIXME: if it is a bmodel, light up the surf?
@@ -331,31 +363,24 @@ qboolean NAV_ClearPathToPoint( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3
 	}
 	else
 	{
-		trap->Trace( &trace, self->r.currentOrigin, mins, maxs, point, self->s.number, clipmask|CONTENTS_MONSTERCLIP|CONTENTS_BOTCLIP, qfalse, 0, 0);
-		if ( trace.startsolid&&(trace.contents&CONTENTS_BOTCLIP) )
-		{//started inside do not enter, so ignore them
-			clipmask &= ~CONTENTS_BOTCLIP;
-			trap->Trace( &trace, self->r.currentOrigin, mins, maxs, point, self->s.number, clipmask|CONTENTS_MONSTERCLIP, qfalse, 0, 0);
-		}
-
-		if( ( ( trace.startsolid == qfalse ) && ( trace.allsolid == qfalse ) ) && ( trace.fraction == 1.0f ) )
+		if( ( ( trace->startsolid == qfalse ) && ( trace->allsolid == qfalse ) ) && ( trace->fraction == 1.0f ) )
 		{//FIXME: check for drops
 			return qtrue;
 		}
 
-		if ( okToHitEntNum != ENTITYNUM_NONE && trace.entityNum == okToHitEntNum )
+		if ( okToHitEntNum != ENTITYNUM_NONE && trace->entityNum == okToHitEntNum )
 		{
 			return qtrue;
 		}
 
 		if ( NAVDEBUG_showCollision )
 		{
-			if ( trace.entityNum < ENTITYNUM_WORLD && (&g_entities[trace.entityNum] != NULL) && g_entities[trace.entityNum].s.eType != ET_MOVER )
+			if ( trace->entityNum < ENTITYNUM_WORLD && (&g_entities[trace->entityNum] != NULL) && g_entities[trace->entityNum].s.eType != ET_MOVER )
 			{
 				vec3_t	p1, p2;
-				G_DrawEdge( self->r.currentOrigin, trace.endpos, EDGE_PATH );
-				VectorAdd(g_entities[trace.entityNum].r.mins, g_entities[trace.entityNum].r.currentOrigin, p1);
-				VectorAdd(g_entities[trace.entityNum].r.maxs, g_entities[trace.entityNum].r.currentOrigin, p2);
+				G_DrawEdge( self->r.currentOrigin, trace->endpos, EDGE_PATH );
+				VectorAdd(g_entities[trace->entityNum].r.mins, g_entities[trace->entityNum].r.currentOrigin, p1);
+				VectorAdd(g_entities[trace->entityNum].r.maxs, g_entities[trace->entityNum].r.currentOrigin, p2);
 				G_CubeOutline( p1, p2, FRAMETIME, 0x0000ff, 0.5 );
 			}
 			//FIXME: if it is a bmodel, light up the surf?
@@ -365,6 +390,67 @@ qboolean NAV_ClearPathToPoint( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3
 	return qfalse;
 }
 
+/*
+-------------------------
+NAV_ClearPathToPoint
+-------------------------
+*/
+
+qboolean NAV_ClearPathToPoint( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3_t point, int clipmask, int okToHitEntNum )
+{
+	traceRequest_t	req;
+	trace_t			trace;
+
+	if ( !NAV_ClearPathRequest( self, pmins, pmaxs, point, clipmask, &req ) )
+		return qfalse;
+
+	trap->Trace( &trace, req.start, req.mins, req.maxs, req.end, req.passEntityNum, req.contentmask, qfalse, 0, 0 );
+	return NAV_ClearPathResult( self, point, &req, &trace, okToHitEntNum );
+}
+
+/*
+-------------------------
+NAV_ClearPathsToPoints
+
+NAV_ClearPathToPoint for a list of points, with the first trace of every
+point made in a single TraceBatch
+-------------------------
+*/
+
+#define	MAX_CLEARPATH_BATCH	64
+
+void NAV_ClearPathsToPoints( gentity_t *self, vec3_t pmins, vec3_t pmaxs, vec3_t *points, int numPoints, int clipmask, int okToHitEntNum, qboolean *clear )
+{
+	traceRequest_t	requests[MAX_CLEARPATH_BATCH];
+	trace_t			results[MAX_CLEARPATH_BATCH];
+	int				pointNums[MAX_CLEARPATH_BATCH];
+	int				i, numRequests;
+
+	while ( numPoints > 0 )
+	{
+		numRequests = 0;
+		for ( i = 0; i < numPoints && i < MAX_CLEARPATH_BATCH; i++ )
+		{
+			clear[i] = qfalse;
+			if ( NAV_ClearPathRequest( self, pmins, pmaxs, points[i], clipmask, &requests[numRequests] ) )
+			{
+				pointNums[numRequests++] = i;
+			}
+		}
+
+		trap->TraceBatch( results, requests, numRequests );
+
+		for ( i = 0; i < numRequests; i++ )
+		{
+			clear[pointNums[i]] = NAV_ClearPathResult( self, points[pointNums[i]], &requests[i], &results[i], okToHitEntNum );
+		}
+
+		points += MAX_CLEARPATH_BATCH;
+		clear += MAX_CLEARPATH_BATCH;
+		numPoints -= MAX_CLEARPATH_BATCH;
+	}
+}
+
 /*
 -------------------------
 NAV_FindClosestWaypointForEnt
@@ -29,7 +29,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #define Q3_INFINITE			16777216
 
-#define	GAME_API_VERSION	1
+#define	GAME_API_VERSION	3
 
 // entity->svFlags
 // the server does not know how to interpret most of the values
@@ -68,6 +68,17 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #define G2TRFLAG_GETSURFINDEX	0x00000004 //will replace surfaceFlags with the ghoul2 surface index that was hit, if any.
 #define G2TRFLAG_THICK			0x00000008 //assures that the trace radius will be significantly large regardless of the trace box size.
 
+// one trace of a TraceBatch call, the arguments of Trace without the result
+typedef struct traceRequest_s {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;
+	int			traceFlags;
+	int			useLod;
+} traceRequest_t;
+
 //===============================================================
 
 //this structure is shared by gameside and in-engine NPC nav routines.
@@ -711,7 +722,10 @@ typedef enum gameImportLegacy_e {
 	G_CM_REGISTER_TERRAIN,
 	G_RMG_INIT,
 	G_BOT_UPDATEWAYPOINTS,
-	G_BOT_CALCULATEPATHS
+	G_BOT_CALCULATEPATHS,
+	G_TRACEBATCH,
+	G_PROFILE_BEGIN,
+	G_PROFILE_END
 } gameImportLegacy_t;
 
 typedef enum gameExportLegacy_e {
@@ -1093,6 +1107,13 @@ typedef struct gameImport_s {
 	void		(*G2API_CleanEntAttachments)			( void );
 	qboolean	(*G2API_OverrideServer)					( void *serverInstance );
 	void		(*G2API_GetSurfaceName)					( void *ghoul2, int surfNumber, int modelIndex, char *fillBuf );
+
+	// same results as calling Trace for each request, but cheaper for batches close to each other
+	void		(*TraceBatch)							( trace_t *results, const traceRequest_t *requests, int numRequests );
+
+	// time a stretch of the frame for the server's sv_profile command, calls must pair up
+	void		(*ProfileBegin)							( const char *name );
+	void		(*ProfileEnd)							( void );
 } gameImport_t;
 
 typedef struct gameExport_s {
@@ -993,6 +993,15 @@ void trap_Bot_UpdateWaypoints(int wpnum, wpobject_t **wps) {
 void trap_Bot_CalculatePaths(int rmg) {
 	Q_syscall(G_BOT_CALCULATEPATHS, rmg);
 }
+void trap_TraceBatch( trace_t *results, const traceRequest_t *requests, int numRequests ) {
+	Q_syscall( G_TRACEBATCH, results, requests, numRequests );
+}
+void trap_ProfileBegin( const char *name ) {
+	Q_syscall( G_PROFILE_BEGIN, name );
+}
+void trap_ProfileEnd( void ) {
+	Q_syscall( G_PROFILE_END );
+}
 
 
 // Translate import table funcptrs to syscalls
@@ -1354,4 +1363,8 @@ static void TranslateSyscalls( void ) {
 	trap->G2API_CleanEntAttachments			= trap_G2API_CleanEntAttachments;
 	trap->G2API_OverrideServer				= trap_G2API_OverrideServer;
 	trap->G2API_GetSurfaceName				= trap_G2API_GetSurfaceName;
+
+	trap->TraceBatch						= trap_TraceBatch;
+	trap->ProfileBegin						= trap_ProfileBegin;
+	trap->ProfileEnd						= trap_ProfileEnd;
 }
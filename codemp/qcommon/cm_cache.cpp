@@ -0,0 +1,451 @@
+/*
+===========================================================================
+Copyright (C) 2013 - 2015, OpenJK contributors
+
+This file is part of the OpenJK source code.
+
+OpenJK is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+
+// cm_cache.cpp -- on-disk copies of fully built clip maps
+
+#include "cm_local.h"
+#include "cm_patch.h"
+
+/*
+===============================================================================
+
+The cache is the clipMap_t the lump loaders built, written out as one block
+of data in the same layout as memory.  Every pointer in it is stored as its
+offset into the data plus one, so NULL survives, and loading is a single
+read onto the hunk followed by adding the block's address back in.
+
+Area flood state and the entity string are not cached: the first is
+rebuilt by CM_FloodAreaConnections and the second may come from a .ent
+file, so both are still loaded the usual way.
+
+The format is whatever this build's structures look like, so a cache from
+a build with different structure sizes is simply rebuilt.
+
+===============================================================================
+*/
+
+#define	CM_CACHE_IDENT		(('C'<<24)+('A'<<16)+('M'<<8)+'C')		// "CMAC"
+#define	CM_CACHE_VERSION	1
+#define	CM_CACHE_ALIGN		16
+
+typedef struct cmCacheHeader_s {
+	int			ident;
+	int			version;
+	int			checksum;		// of the bsp the cache was built from
+	int			layout;			// structure sizes of the build that wrote it
+	int			size;			// of the data that follows
+	uint32_t	dataChecksum;
+	clipMap_t	cm;				// every pointer an offset into the data, plus one
+} cmCacheHeader_t;
+
+/*
+=================
+CM_CacheLayout
+
+Changes whenever a structure that ends up in the cache changes size
+=================
+*/
+static int CM_CacheLayout( void ) {
+	return (int)( sizeof( void * )
+		+ sizeof( clipMap_t ) * 3
+		+ sizeof( CCMShader ) * 5
+		+ sizeof( cLeaf_t ) * 7
+		+ sizeof( cplane_t ) * 11
+		+ sizeof( cbrushside_t ) * 13
+		+ sizeof( cbrush_t ) * 17
+		+ sizeof( cbrushplanes_t ) * 19
+		+ sizeof( cmodel_t ) * 23
+		+ sizeof( cNode_t ) * 29
+		+ sizeof( cArea_t ) * 31
+		+ sizeof( cPatch_t ) * 37
+		+ sizeof( patchCollide_t ) * 41
+		+ sizeof( patchPlane_t ) * 43
+		+ sizeof( facet_t ) * 47 );
+}
+
+/*
+=================
+CM_CachePath
+=================
+*/
+static void CM_CachePath( const char *name, char *path, int size ) {
+	char	stripped[MAX_QPATH];
+
+	COM_StripExtension( name, stripped, sizeof( stripped ) );
+	Com_sprintf( path, size, "cmcache/%s.cmc", stripped );
+}
+
+/*
+===============================================================================
+
+WRITING
+
+===============================================================================
+*/
+
+typedef struct cacheLayout_s {
+	int		shaders, leafs, leafBrushes, leafSurfaces, planes, brushSides;
+	int		brushes, brushPlanes, models, modelBrushes, modelSurfaces;
+	int		nodes, visibility, areas, areaPortals, surfaces;
+	int		patches, patchCollides, patchPlanes, facets;
+	int		size;
+} cacheLayout_t;
+
+static int CM_CacheReserve( cacheLayout_t &layout, int bytes ) {
+	const int ofs = layout.size;
+
+	layout.size = ( layout.size + bytes + CM_CACHE_ALIGN - 1 ) & ~( CM_CACHE_ALIGN - 1 );
+	return ofs;
+}
+
+#define	CACHE_OFS(layoutOfs, base, p)	( (layoutOfs) + (int)( (const byte *)(p) - (const byte *)(base) ) )
+
+template< typename T >
+static T *CM_CachePointer( int ofs ) {
+	return (T *)(intptr_t)( ofs + 1 );
+}
+
+static int CM_VisibilitySize( const clipMap_t &cm ) {
+	return cm.vised ? cm.numClusters * cm.clusterBytes : cm.clusterBytes;
+}
+
+/*
+=================
+CM_SaveMapCache
+
+Writes out a clip map straight after its lumps were loaded, before the
+box hull is set up in it
+=================
+*/
+void CM_SaveMapCache( const clipMap_t &cm, const char *name, int checksum ) {
+	cacheLayout_t	layout;
+	cmCacheHeader_t	header;
+	byte			*data;
+	char			path[MAX_QPATH];
+	int				i, j, numPatches, numPatchPlanes, numFacets, numModelBrushes, numModelSurfaces;
+	int				patchPlane, facet, modelBrush, modelSurface;
+	fileHandle_t	f;
+
+	numPatches = numPatchPlanes = numFacets = 0;
+	for ( i = 0 ; i < cm.numSurfaces ; i++ ) {
+		if ( cm.surfaces[i] ) {
+			numPatches++;
+			numPatchPlanes += cm.surfaces[i]->pc->numPlanes;
+			numFacets += cm.surfaces[i]->pc->numFacets;
+		}
+	}
+
+	numModelBrushes = numModelSurfaces = 0;
+	for ( i = 0 ; i < cm.numSubModels ; i++ ) {
+		if ( cm.cmodels[i].firstNode == -1 ) {
+			numModelBrushes += cm.cmodels[i].leaf.numLeafBrushes;
+			numModelSurfaces += cm.cmodels[i].leaf.numLeafSurfaces;
+		}
+	}
+
+	Com_Memset( &layout, 0, sizeof( layout ) );
+	layout.shaders = CM_CacheReserve( layout, ( 1 + cm.numShaders ) * sizeof( *cm.shaders ) );
+	layout.leafs = CM_CacheReserve( layout, ( BOX_LEAFS + cm.numLeafs ) * sizeof( *cm.leafs ) );
+	layout.leafBrushes = CM_CacheReserve( layout, ( BOX_BRUSHES + cm.numLeafBrushes ) * sizeof( *cm.leafbrushes ) );
+	layout.leafSurfaces = CM_CacheReserve( layout, cm.numLeafSurfaces * sizeof( *cm.leafsurfaces ) );
+	layout.planes = CM_CacheReserve( layout, ( BOX_PLANES + cm.numPlanes ) * sizeof( *cm.planes ) );
+	layout.brushSides = CM_CacheReserve( layout, ( BOX_SIDES + cm.numBrushSides ) * sizeof( *cm.brushsides ) );
+	layout.brushes = CM_CacheReserve( layout, ( BOX_BRUSHES + cm.numBrushes ) * sizeof( *cm.brushes ) );
+	layout.brushPlanes = CM_CacheReserve( layout, ( BRUSH_PLANE_BLOCKS( BOX_SIDES ) + cm.numBrushPlanes ) * sizeof( *cm.brushplanes ) );
+	layout.models = CM_CacheReserve( layout, cm.numSubModels * sizeof( *cm.cmodels ) );
+	layout.modelBrushes = CM_CacheReserve( layout, numModelBrushes * sizeof( int ) );
+	layout.modelSurfaces = CM_CacheReserve( layout, numModelSurfaces * sizeof( int ) );
+	layout.nodes = CM_CacheReserve( layout, cm.numNodes * sizeof( *cm.nodes ) );
+	layout.visibility = CM_CacheReserve( layout, CM_VisibilitySize( cm ) );
+	layout.areas = CM_CacheReserve( layout, cm.numAreas * sizeof( *cm.areas ) );
+	layout.areaPortals = CM_CacheReserve( layout, cm.numAreas * cm.numAreas * sizeof( *cm.areaPortals ) );
+	layout.surfaces = CM_CacheReserve( layout, cm.numSurfaces * sizeof( *cm.surfaces ) );
+	layout.patches = CM_CacheReserve( layout, numPatches * sizeof( cPatch_t ) );
+	layout.patchCollides = CM_CacheReserve( layout, numPatches * sizeof( patchCollide_t ) );
+	layout.patchPlanes = CM_CacheReserve( layout, numPatchPlanes * sizeof( patchPlane_t ) );
+	layout.facets = CM_CacheReserve( layout, numFacets * sizeof( facet_t ) );
+
+	data = (byte *)Z_Malloc( layout.size, TAG_TEMP_WORKSPACE, qtrue );
+
+	// the plain arrays, area flood state is left cleared
+	Com_Memcpy( data + layout.shaders, cm.shaders, cm.numShaders * sizeof( *cm.shaders ) );
+	Com_Memcpy( data + layout.leafs, cm.leafs, cm.numLeafs * sizeof( *cm.leafs ) );
+	Com_Memcpy( data + layout.leafBrushes, cm.leafbrushes, cm.numLeafBrushes * sizeof( *cm.leafbrushes ) );
+	Com_Memcpy( data + layout.leafSurfaces, cm.leafsurfaces, cm.numLeafSurfaces * sizeof( *cm.leafsurfaces ) );
+	Com_Memcpy( data + layout.planes, cm.planes, cm.numPlanes * sizeof( *cm.planes ) );
+	Com_Memcpy( data + layout.brushPlanes, cm.brushplanes, cm.numBrushPlanes * sizeof( *cm.brushplanes ) );
+	Com_Memcpy( data + layout.visibility, cm.visibility, CM_VisibilitySize( cm ) );
+
+	for ( i = 0 ; i < cm.numShaders ; i++ ) {
+		( (CCMShader *)( data + layout.shaders ) )[i].SetNext( NULL );
+	}
+
+	for ( i = 0 ; i < cm.numBrushSides ; i++ ) {
+		cbrushside_t *side = (cbrushside_t *)( data + layout.brushSides ) + i;
+
+		side->plane = CM_CachePointer< cplane_t >( CACHE_OFS( layout.planes, cm.planes, cm.brushsides[i].plane ) );
+		side->shaderNum = cm.brushsides[i].shaderNum;
+	}
+
+	for ( i = 0 ; i < cm.numBrushes ; i++ ) {
+		cbrush_t *brush = (cbrush_t *)( data + layout.brushes ) + i;
+
+		*brush = cm.brushes[i];
+		brush->sides = CM_CachePointer< cbrushside_t >( CACHE_OFS( layout.brushSides, cm.brushsides, cm.brushes[i].sides ) );
+		brush->planes = CM_CachePointer< cbrushplanes_t >( CACHE_OFS( layout.brushPlanes, cm.brushplanes, cm.brushes[i].planes ) );
+		brush->checkcount = 0;
+	}
+
+	// submodel brush and surface lists live apart from the leaf lists, but are
+	// still indexed from them
+	modelBrush = modelSurface = 0;
+	for ( i = 0 ; i < cm.numSubModels ; i++ ) {
+		cmodel_t *model = (cmodel_t *)( data + layout.models ) + i;
+
+		*model = cm.cmodels[i];
+		if ( model->firstNode != -1 ) {
+			continue;
+		}
+
+		Com_Memcpy( (int *)( data + layout.modelBrushes ) + modelBrush,
+			cm.leafbrushes + cm.cmodels[i].leaf.firstLeafBrush, model->leaf.numLeafBrushes * sizeof( int ) );
+		model->leaf.firstLeafBrush = ( layout.modelBrushes - layout.leafBrushes ) / (int)sizeof( int ) + modelBrush;
+		modelBrush += model->leaf.numLeafBrushes;
+
+		Com_Memcpy( (int *)( data + layout.modelSurfaces ) + modelSurface,
+			cm.leafsurfaces + cm.cmodels[i].leaf.firstLeafSurface, model->leaf.numLeafSurfaces * sizeof( int ) );
+		model->leaf.firstLeafSurface = ( layout.modelSurfaces - layout.leafSurfaces ) / (int)sizeof( int ) + modelSurface;
+		modelSurface += model->leaf.numLeafSurfaces;
+	}
+
+	for ( i = 0 ; i < cm.numNodes ; i++ ) {
+		cNode_t *node = (cNode_t *)( data + layout.nodes ) + i;
+
+		*node = cm.nodes[i];
+		node->plane = CM_CachePointer< cplane_t >( CACHE_OFS( layout.planes, cm.planes, cm.nodes[i].plane ) );
+	}
+
+	// patches get packed in surface order
+	patchPlane = facet = 0;
+	for ( i = 0, j = 0 ; i < cm.numSurfaces ; i++ ) {
+		const cPatch_t			*in = cm.surfaces[i];
+		cPatch_t				*patch;
+		patchCollide_t			*pc;
+
+		if ( !in ) {
+			continue;
+		}
+
+		patch = (cPatch_t *)( data + layout.patches ) + j;
+		pc = (patchCollide_t *)( data + layout.patchCollides ) + j;
+		( (cPatch_t **)( data + layout.surfaces ) )[i] = CM_CachePointer< cPatch_t >( layout.patches + j * (int)sizeof( *patch ) );
+
+		*patch = *in;
+		patch->checkcount = 0;
+		patch->pc = CM_CachePointer< patchCollide_t >( layout.patchCollides + j * (int)sizeof( *pc ) );
+
+		*pc = *in->pc;
+		pc->planes = NULL;
+		pc->facets = NULL;
+		if ( in->pc->numPlanes ) {
+			Com_Memcpy( (patchPlane_t *)( data + layout.patchPlanes ) + patchPlane, in->pc->planes, in->pc->numPlanes * sizeof( patchPlane_t ) );
+			pc->planes = CM_CachePointer< patchPlane_t >( layout.patchPlanes + patchPlane * (int)sizeof( patchPlane_t ) );
+			patchPlane += in->pc->numPlanes;
+		}
+		if ( in->pc->numFacets ) {
+			Com_Memcpy( (facet_t *)( data + layout.facets ) + facet, in->pc->facets, in->pc->numFacets * sizeof( facet_t ) );
+			pc->facets = CM_CachePointer< facet_t >( layout.facets + facet * (int)sizeof( facet_t ) );
+			facet += in->pc->numFacets;
+		}
+		j++;
+	}
+
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = CM_CACHE_IDENT;
+	header.version = CM_CACHE_VERSION;
+	header.checksum = checksum;
+	header.layout = CM_CacheLayout();
+	header.size = layout.size;
+	header.dataChecksum = Com_BlockChecksum( data, layout.size );
+
+	header.cm = cm;
+	header.cm.name[0] = '\0';
+	header.cm.entityString = NULL;
+	header.cm.numEntityChars = 0;
+	header.cm.floodvalid = 0;
+	header.cm.checkcount = 0;
+	header.cm.shaders = CM_CachePointer< CCMShader >( layout.shaders );
+	header.cm.leafs = CM_CachePointer< cLeaf_t >( layout.leafs );
+	header.cm.leafbrushes = CM_CachePointer< int >( layout.leafBrushes );
+	header.cm.leafsurfaces = CM_CachePointer< int >( layout.leafSurfaces );
+	header.cm.planes = CM_CachePointer< cplane_t >( layout.planes );
+	header.cm.brushsides = CM_CachePointer< cbrushside_t >( layout.brushSides );
+	header.cm.brushes = CM_CachePointer< cbrush_t >( layout.brushes );
+	header.cm.brushplanes = CM_CachePointer< cbrushplanes_t >( layout.brushPlanes );
+	header.cm.cmodels = CM_CachePointer< cmodel_t >( layout.models );
+	header.cm.nodes = CM_CachePointer< cNode_t >( layout.nodes );
+	header.cm.visibility = CM_CachePointer< byte >( layout.visibility );
+	header.cm.areas = CM_CachePointer< cArea_t >( layout.areas );
+	header.cm.areaPortals = CM_CachePointer< int >( layout.areaPortals );
+	header.cm.surfaces = CM_CachePointer< cPatch_t * >( layout.surfaces );
+
+	CM_CachePath( name, path, sizeof( path ) );
+	f = FS_FOpenFileWrite( path );
+	if ( !f ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: could not write collision cache %s\n", path );
+		Z_Free( data );
+		return;
+	}
+	FS_Write( &header, sizeof( header ), f );
+	FS_Write( data, layout.size, f );
+	FS_FCloseFile( f );
+
+	Com_DPrintf( "Wrote collision cache %s (%i bytes)\n", path, layout.size );
+	Z_Free( data );
+}
+
+/*
+===============================================================================
+
+READING
+
+===============================================================================
+*/
+
+template< typename T >
+static bool CM_RelocatePointer( T *&p, byte *data, int size ) {
+	const intptr_t ofs = (intptr_t)p - 1;
+
+	if ( !p ) {
+		return true;
+	}
+	if ( ofs < 0 || ofs + (intptr_t)sizeof( T ) > size ) {
+		p = NULL;
+		return false;
+	}
+	p = (T *)( data + ofs );
+	return true;
+}
+
+// a zero-length array can sit right at the end of the data
+template< typename T >
+static bool CM_RelocateArray( T *&p, int count, byte *data, int size ) {
+	const intptr_t ofs = (intptr_t)p - 1;
+
+	if ( !p ) {
+		return !count;
+	}
+	if ( ofs < 0 || count < 0 || ofs + (intptr_t)sizeof( T ) * count > size ) {
+		p = NULL;
+		return false;
+	}
+	p = (T *)( data + ofs );
+	return true;
+}
+
+/*
+=================
+CM_LoadMapCache
+
+Fills in cm from the cache if there is a valid one for this bsp.  The
+entity string and area connections are left for the caller.
+=================
+*/
+qboolean CM_LoadMapCache( clipMap_t &cm, const char *name, int checksum ) {
+	cmCacheHeader_t	header;
+	fileHandle_t	f;
+	char			path[MAX_QPATH];
+	byte			*data;
+	int				len, size, i;
+	bool			ok;
+
+	CM_CachePath( name, path, sizeof( path ) );
+	len = FS_FOpenFileRead( path, &f, qfalse );
+	if ( !f ) {
+		return qfalse;
+	}
+
+	if ( len < (int)sizeof( header ) || FS_Read( &header, sizeof( header ), f ) != sizeof( header )
+		|| header.ident != CM_CACHE_IDENT || header.version != CM_CACHE_VERSION
+		|| header.checksum != checksum || header.layout != CM_CacheLayout()
+		|| header.size != len - (int)sizeof( header ) ) {
+		Com_DPrintf( "Collision cache %s is out of date\n", path );
+		FS_FCloseFile( f );
+		return qfalse;
+	}
+
+	size = header.size;
+	data = (byte *)Hunk_Alloc( size, h_high );
+	if ( FS_Read( data, size, f ) != size || Com_BlockChecksum( data, size ) != header.dataChecksum ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: collision cache %s is damaged\n", path );
+		FS_FCloseFile( f );
+		Z_Free( data );
+		return qfalse;
+	}
+	FS_FCloseFile( f );
+
+	clipMap_t &in = header.cm;
+	ok = CM_RelocateArray( in.shaders, in.numShaders + 1, data, size )
+		&& CM_RelocateArray( in.leafs, in.numLeafs + BOX_LEAFS, data, size )
+		&& CM_RelocateArray( in.leafbrushes, in.numLeafBrushes + BOX_BRUSHES, data, size )
+		&& CM_RelocateArray( in.leafsurfaces, in.numLeafSurfaces, data, size )
+		&& CM_RelocateArray( in.planes, in.numPlanes + BOX_PLANES, data, size )
+		&& CM_RelocateArray( in.brushsides, in.numBrushSides + BOX_SIDES, data, size )
+		&& CM_RelocateArray( in.brushes, in.numBrushes + BOX_BRUSHES, data, size )
+		&& CM_RelocateArray( in.brushplanes, in.numBrushPlanes + BRUSH_PLANE_BLOCKS( BOX_SIDES ), data, size )
+		&& CM_RelocateArray( in.cmodels, in.numSubModels, data, size )
+		&& CM_RelocateArray( in.nodes, in.numNodes, data, size )
+		&& CM_RelocateArray( in.visibility, CM_VisibilitySize( in ), data, size )
+		&& CM_RelocateArray( in.areas, in.numAreas, data, size )
+		&& CM_RelocateArray( in.areaPortals, in.numAreas * in.numAreas, data, size )
+		&& CM_RelocateArray( in.surfaces, in.numSurfaces, data, size );
+
+	for ( i = 0 ; ok && i < in.numBrushSides ; i++ ) {
+		ok = CM_RelocatePointer( in.brushsides[i].plane, data, size );
+	}
+	for ( i = 0 ; ok && i < in.numBrushes ; i++ ) {
+		ok = CM_RelocateArray( in.brushes[i].sides, in.brushes[i].numsides, data, size )
+			&& CM_RelocateArray( in.brushes[i].planes, BRUSH_PLANE_BLOCKS( in.brushes[i].numsides ), data, size );
+	}
+	for ( i = 0 ; ok && i < in.numNodes ; i++ ) {
+		ok = CM_RelocatePointer( in.nodes[i].plane, data, size );
+	}
+	for ( i = 0 ; ok && i < in.numSurfaces ; i++ ) {
+		cPatch_t *&patch = in.surfaces[i];
+
+		if ( !patch ) {
+			continue;
+		}
+		ok = CM_RelocatePointer( patch, data, size )
+			&& CM_RelocatePointer( patch->pc, data, size )
+			&& CM_RelocateArray( patch->pc->planes, patch->pc->numPlanes, data, size )
+			&& CM_RelocateArray( patch->pc->facets, patch->pc->numFacets, data, size );
+	}
+
+	if ( !ok ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: collision cache %s is damaged\n", path );
+		Z_Free( data );
+		return qfalse;
+	}
+
+	cm = in;
+	Com_DPrintf( "Loaded collision map from %s\n", path );
+	return qtrue;
+}
@@ -43,13 +43,6 @@ void SetPlaneSignbits (cplane_t *out) {
 }
 #endif //BSPC
 
-// to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
-#define	BOX_LEAFS		2
-#define	BOX_PLANES		12
-
 #define	LL(x) x=LittleLong(x)
 
 
@@ -65,6 +58,7 @@ cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
 cvar_t		*cm_extraVerbose;
+cvar_t		*cm_mapCache;
 #endif
 
 cmodel_t	box_model;
@@ -284,6 +278,35 @@ void CM_BoundBrush( cbrush_t *b ) {
 	b->bounds[1][2] = b->sides[5].plane->dist;
 }
 
+/*
+=================
+CM_SetBrushPlanes
+
+Copies the side planes into the brush's lane blocks
+=================
+*/
+void CM_SetBrushPlanes( cbrush_t *b ) {
+	int				i, lane;
+	cbrushplanes_t	*block;
+	const cplane_t	*plane;
+
+	for ( i = 0 ; i < BRUSH_PLANE_BLOCKS( b->numsides ) * BRUSH_PLANE_LANES ; i++ ) {
+		block = &b->planes[i / BRUSH_PLANE_LANES];
+		lane = i % BRUSH_PLANE_LANES;
+
+		if ( i >= b->numsides ) {
+			block->normal[0][lane] = block->normal[1][lane] = block->normal[2][lane] = 0;
+			block->dist[lane] = BRUSH_PLANE_PAD_DIST;
+			continue;
+		}
+
+		plane = b->sides[i].plane;
+		block->normal[0][lane] = plane->normal[0];
+		block->normal[1][lane] = plane->normal[1];
+		block->normal[2][lane] = plane->normal[2];
+		block->dist[lane] = plane->dist;
+	}
+}
 
 /*
 =================
@@ -294,7 +317,7 @@ CMod_LoadBrushes
 void CMod_LoadBrushes( const lump_t *l, clipMap_t &cm ) {
 	dbrush_t	*in;
 	cbrush_t	*out;
-	int			i, count;
+	int			i, count, numBlocks;
 
 	in = (dbrush_t *)(cmod_base + l->fileofs);
 	if (l->filelen % sizeof(*in)) {
@@ -320,6 +343,21 @@ void CMod_LoadBrushes( const lump_t *l, clipMap_t &cm ) {
 		CM_BoundBrush( out );
 	}
 
+	// lay the planes out for the SIMD brush tests, with room for the box brush
+	numBlocks = BRUSH_PLANE_BLOCKS( BOX_SIDES );
+	for ( i=0, out=cm.brushes ; i<count ; i++, out++ ) {
+		numBlocks += BRUSH_PLANE_BLOCKS( out->numsides );
+	}
+
+	cm.brushplanes = (cbrushplanes_t *)Hunk_Alloc( numBlocks * sizeof( *cm.brushplanes ), h_high );
+	cm.numBrushPlanes = numBlocks - BRUSH_PLANE_BLOCKS( BOX_SIDES );
+
+	numBlocks = 0;
+	for ( i=0, out=cm.brushes ; i<count ; i++, out++ ) {
+		out->planes = cm.brushplanes + numBlocks;
+		numBlocks += BRUSH_PLANE_BLOCKS( out->numsides );
+		CM_SetBrushPlanes( out );
+	}
 }
 
 /*
@@ -671,6 +709,7 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	char			origName[MAX_OSPATH];
 	void			*newBuff = 0;
 	void			*patchedBuf = 0;
+	bool			patched = false;
 
 	if ( !name || !name[0] ) {
 		Com_Error( ERR_DROP, "CM_LoadMap: NULL name" );
@@ -681,6 +720,7 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
 	cm_extraVerbose = Cvar_Get ("cm_extraVerbose", "0", CVAR_TEMP );
+	cm_mapCache = Cvar_Get ("cm_mapCache", "0", CVAR_ARCHIVE, "Keep built collision maps on disk in cmcache/ to speed up map loads" );
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -775,6 +815,7 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 		if ( patchedBuf ) {
 			Z_Free( buf ); // free the old buffer
 			buf = ( int* )patchedBuf;
+			patched = true;
 
 			if ( &cm == &cmg )
 			{
@@ -802,19 +843,36 @@ static void CM_LoadMap_Actual( const char *name, qboolean clientload, int *check
 
 	cmod_base = (byte *)buf;
 
-	// load into heap
-	CMod_LoadShaders( &header.lumps[LUMP_SHADERS], cm );
-	CMod_LoadLeafs (&header.lumps[LUMP_LEAFS], cm);
-	CMod_LoadLeafBrushes (&header.lumps[LUMP_LEAFBRUSHES], cm);
-	CMod_LoadLeafSurfaces (&header.lumps[LUMP_LEAFSURFACES], cm);
-	CMod_LoadPlanes (&header.lumps[LUMP_PLANES], cm);
-	CMod_LoadBrushSides (&header.lumps[LUMP_BRUSHSIDES], cm);
-	CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES], cm);
-	CMod_LoadSubmodels (&header.lumps[LUMP_MODELS], cm);
-	CMod_LoadNodes (&header.lumps[LUMP_NODES], cm);
-	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES], cm, name);
-	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY], cm );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], cm );
+#ifndef BSPC
+	// the cache is keyed by the checksum, which a patch file doesn't change
+	const bool useCache = cm_mapCache->integer && &cm == &cmg && !patched;
+
+	if ( useCache && CM_LoadMapCache( cm, name, last_checksum ) ) {
+		CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES], cm, name);
+	}
+	else
+#endif
+	{
+		// load into heap
+		CMod_LoadShaders( &header.lumps[LUMP_SHADERS], cm );
+		CMod_LoadLeafs (&header.lumps[LUMP_LEAFS], cm);
+		CMod_LoadLeafBrushes (&header.lumps[LUMP_LEAFBRUSHES], cm);
+		CMod_LoadLeafSurfaces (&header.lumps[LUMP_LEAFSURFACES], cm);
+		CMod_LoadPlanes (&header.lumps[LUMP_PLANES], cm);
+		CMod_LoadBrushSides (&header.lumps[LUMP_BRUSHSIDES], cm);
+		CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES], cm);
+		CMod_LoadSubmodels (&header.lumps[LUMP_MODELS], cm);
+		CMod_LoadNodes (&header.lumps[LUMP_NODES], cm);
+		CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES], cm, name);
+		CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY], cm );
+		CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], cm );
+
+#ifndef BSPC
+		if ( useCache ) {
+			CM_SaveMapCache( cm, name, last_checksum );
+		}
+#endif
+	}
 
 	TotalSubModels += cm.numSubModels;
 
@@ -968,6 +1026,10 @@ char *CM_SubBSPEntityString( int index )
 	return SubBSP[index].entityString;
 }
 
+int		CM_NumClusters( void ) {
+	return cmg.numClusters;
+}
+
 int		CM_LeafCluster( int leafnum ) {
 	if (leafnum < 0 || leafnum >= cmg.numLeafs) {
 		Com_Error (ERR_DROP, "CM_LeafCluster: bad number");
@@ -1005,6 +1067,7 @@ void CM_InitBoxHull (void)
 	box_brush = &cmg.brushes[cmg.numBrushes];
 	box_brush->numsides = 6;
 	box_brush->sides = cmg.brushsides + cmg.numBrushSides;
+	box_brush->planes = cmg.brushplanes + cmg.numBrushPlanes;
 	box_brush->contents = CONTENTS_BODY;
 
 	box_model.firstNode = -1;
@@ -1037,6 +1100,8 @@ void CM_InitBoxHull (void)
 
 		SetPlaneSignbits( p );
 	}
+
+	CM_SetBrushPlanes( box_brush );
 }
 
 /*
@@ -1070,6 +1135,8 @@ clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
+	CM_SetBrushPlanes( box_brush );
+
 	VectorCopy( mins, box_brush->bounds[0] );
 	VectorCopy( maxs, box_brush->bounds[1] );
 
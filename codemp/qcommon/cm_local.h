@@ -27,6 +27,20 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "cm_public.h"
 #include "qcommon/qcommon.h"
 
+// the brush plane tests can check four planes at once where SSE2 is always there
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define CM_SIMD_SSE2	1
+#else
+#define CM_SIMD_SSE2	0
+#endif
+
+// to allow boxes to be treated as brush models, we allocate
+// some extra indexes along with those needed by the map
+#define	BOX_BRUSHES		1
+#define	BOX_SIDES		6
+#define	BOX_LEAFS		2
+#define	BOX_PLANES		12
+
 #define	MAX_SUBMODELS			512
 #define	BOX_MODEL_HANDLE		(MAX_SUBMODELS-1)
 #define CAPSULE_MODEL_HANDLE	(MAX_SUBMODELS-2)
@@ -63,11 +77,25 @@ typedef struct cbrushside_s {
 	int			shaderNum;
 } cbrushside_t;
 
+// the planes of a brush's sides, four at a time, for the SIMD brush tests.
+// unused lanes at the end have a zero normal and a huge dist, so they are
+// always behind and never cross
+#define BRUSH_PLANE_LANES		4
+#define BRUSH_PLANE_PAD_DIST	1e30f
+
+typedef struct cbrushplanes_s {
+	float				normal[3][BRUSH_PLANE_LANES];
+	float				dist[BRUSH_PLANE_LANES];
+} cbrushplanes_t;
+
+#define BRUSH_PLANE_BLOCKS(numsides)	( ( (numsides) + BRUSH_PLANE_LANES - 1 ) / BRUSH_PLANE_LANES )
+
 typedef struct cbrush_s {
 	int					shaderNum;		// the shader that determined the contents
 	int					contents;
 	vec3_t				bounds[2];
 	cbrushside_t		*sides;
+	cbrushplanes_t		*planes;		// BRUSH_PLANE_BLOCKS( numsides ) blocks
 	unsigned short		numsides;
 	unsigned short		checkcount;		// to avoid repeated testings
 } cbrush_t;
@@ -129,6 +157,9 @@ typedef struct clipMap_s {
 	int			numBrushes;
 	cbrush_t	*brushes;
 
+	int			numBrushPlanes;
+	cbrushplanes_t	*brushplanes;	// lane blocks for every brush, see CM_SetBrushPlanes
+
 	int			numClusters;
 	int			clusterBytes;
 	byte		*visibility;
@@ -160,6 +191,7 @@ extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
 extern	cvar_t		*cm_extraVerbose;
+extern	cvar_t		*cm_mapCache;
 
 // cm_test.c
 
@@ -232,3 +264,8 @@ void		CM_GetModelFormalName ( const char* model, const char* skin, char* name, i
 
 // cm_load.cpp
 void CM_GetWorldBounds ( vec3_t mins, vec3_t maxs );
+void CM_SetBrushPlanes( cbrush_t *b );
+
+// cm_cache.cpp
+qboolean CM_LoadMapCache( clipMap_t &cm, const char *name, int checksum );
+void CM_SaveMapCache( const clipMap_t &cm, const char *name, int checksum );
@@ -54,6 +54,7 @@ int			CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *boxList,
 		 					int listsize, int *lastLeaf );
 //rwwRMG - changed to boxList to not conflict with list type
 
+int			CM_NumClusters (void);
 int			CM_LeafCluster (int leafnum);
 int			CM_LeafArea (int leafnum);
 
@@ -23,6 +23,10 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "cm_local.h"
 
+#if CM_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -130,12 +134,14 @@ CM_TestBoxInBrush
 ================
 */
 void CM_TestBoxInBrush( traceWork_t *tw, trace_t &trace, cbrush_t *brush ) {
+#if !CM_SIMD_SSE2
 	int			i;
 	cplane_t	*plane;
 	float		dist;
 	float		d1;
 	cbrushside_t	*side;
 	float		t;
+#endif
 	vec3_t		startp;
 
 	if (!brush->numsides) {
@@ -153,6 +159,72 @@ void CM_TestBoxInBrush( traceWork_t *tw, trace_t &trace, cbrush_t *brush ) {
 		return;
 	}
 
+#if CM_SIMD_SSE2
+	{
+		const __m128	zero = _mm_setzero_ps();
+		const int		numBlocks = BRUSH_PLANE_BLOCKS( brush->numsides );
+		__m128			ax, ay, az;	// start, or start - sphere offset
+		__m128			bx, by, bz;	// size[1], or start + sphere offset
+		__m128			cx, cy, cz;	// size[0], or sphere offset
+		__m128			radius;
+		int				b, front;
+
+		if ( tw->sphere.use ) {
+			VectorSubtract( tw->start, tw->sphere.offset, startp );
+			ax = _mm_set1_ps( startp[0] ); ay = _mm_set1_ps( startp[1] ); az = _mm_set1_ps( startp[2] );
+			VectorAdd( tw->start, tw->sphere.offset, startp );
+			bx = _mm_set1_ps( startp[0] ); by = _mm_set1_ps( startp[1] ); bz = _mm_set1_ps( startp[2] );
+			cx = _mm_set1_ps( tw->sphere.offset[0] ); cy = _mm_set1_ps( tw->sphere.offset[1] ); cz = _mm_set1_ps( tw->sphere.offset[2] );
+			radius = _mm_set1_ps( tw->sphere.radius );
+		} else {
+			ax = _mm_set1_ps( tw->start[0] ); ay = _mm_set1_ps( tw->start[1] ); az = _mm_set1_ps( tw->start[2] );
+			bx = _mm_set1_ps( tw->size[1][0] ); by = _mm_set1_ps( tw->size[1][1] ); bz = _mm_set1_ps( tw->size[1][2] );
+			cx = _mm_set1_ps( tw->size[0][0] ); cy = _mm_set1_ps( tw->size[0][1] ); cz = _mm_set1_ps( tw->size[0][2] );
+			radius = zero;
+		}
+
+		// the first six planes are the axial planes, so we only
+		// need to test the remainder, which start in the second block
+		for ( b = 6 / BRUSH_PLANE_LANES ; b < numBlocks ; b++ ) {
+			const cbrushplanes_t *block = brush->planes + b;
+			const __m128	nx = _mm_loadu_ps( block->normal[0] );
+			const __m128	ny = _mm_loadu_ps( block->normal[1] );
+			const __m128	nz = _mm_loadu_ps( block->normal[2] );
+			__m128			d1;
+
+			if ( tw->sphere.use ) {
+				// find the closest point on the capsule to the plane
+				const __m128	t = _mm_cmpgt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, cx ), _mm_mul_ps( ny, cy ) ), _mm_mul_ps( nz, cz ) ), zero );
+				const __m128	px = _mm_or_ps( _mm_and_ps( t, ax ), _mm_andnot_ps( t, bx ) );
+				const __m128	py = _mm_or_ps( _mm_and_ps( t, ay ), _mm_andnot_ps( t, by ) );
+				const __m128	pz = _mm_or_ps( _mm_and_ps( t, az ), _mm_andnot_ps( t, bz ) );
+
+				// adjust the plane distance appropriately for radius
+				d1 = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( px, nx ), _mm_mul_ps( py, ny ) ), _mm_mul_ps( pz, nz ) ),
+					_mm_add_ps( _mm_loadu_ps( block->dist ), radius ) );
+			} else {
+				// adjust the plane distance appropriately for mins/maxs
+				const __m128	ox = _mm_or_ps( _mm_and_ps( _mm_cmplt_ps( nx, zero ), bx ), _mm_andnot_ps( _mm_cmplt_ps( nx, zero ), cx ) );
+				const __m128	oy = _mm_or_ps( _mm_and_ps( _mm_cmplt_ps( ny, zero ), by ), _mm_andnot_ps( _mm_cmplt_ps( ny, zero ), cy ) );
+				const __m128	oz = _mm_or_ps( _mm_and_ps( _mm_cmplt_ps( nz, zero ), bz ), _mm_andnot_ps( _mm_cmplt_ps( nz, zero ), cz ) );
+				const __m128	dist = _mm_sub_ps( _mm_loadu_ps( block->dist ),
+					_mm_add_ps( _mm_add_ps( _mm_mul_ps( ox, nx ), _mm_mul_ps( oy, ny ) ), _mm_mul_ps( oz, nz ) ) );
+
+				d1 = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, nx ), _mm_mul_ps( ay, ny ) ), _mm_mul_ps( az, nz ) ), dist );
+			}
+
+			front = _mm_movemask_ps( _mm_cmpgt_ps( d1, zero ) );
+			if ( b == 6 / BRUSH_PLANE_LANES ) {
+				front &= ~( ( 1 << ( 6 % BRUSH_PLANE_LANES ) ) - 1 );
+			}
+
+			// if completely in front of face, no intersection
+			if ( front ) {
+				return;
+			}
+		}
+	}
+#else
    if ( tw->sphere.use ) {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
@@ -196,6 +268,7 @@ void CM_TestBoxInBrush( traceWork_t *tw, trace_t &trace, cbrush_t *brush ) {
 			}
 		}
 	}
+#endif
 
 	// inside this brush
 	trace.startsolid = trace.allsolid = qtrue;
@@ -447,25 +520,19 @@ void CM_TraceThroughPatch( traceWork_t *tw, trace_t &trace, cPatch_t *patch ) {
 
 /*
 ================
-CM_PlaneCollision
+CM_PlaneCrossing
 
-  Returns false for a quick getout
+  Takes the start and end distances from a side's plane, already adjusted
+  for mins/maxs.  Returns false for a quick getout
 ================
 */
 
-bool CM_PlaneCollision(traceWork_t *tw, cbrushside_t *side)
+static inline bool CM_PlaneCrossing(traceWork_t *tw, cbrushside_t *side, float d1, float d2)
 {
-	float			dist, f;
-	float			d1, d2;
+	float			f;
 
 	cplane_t		*plane = side->plane;
 
-	// adjust the plane distance appropriately for mins/maxs
-	dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
-
-	d1 = DotProduct( tw->start, plane->normal ) - dist;
-	d2 = DotProduct( tw->end, plane->normal ) - dist;
-
 	if (d2 > 0.0f)
 	{
 		// endpoint is not in solid
@@ -528,6 +595,32 @@ bool CM_PlaneCollision(traceWork_t *tw, cbrushside_t *side)
 	return(true);
 }
 
+#if !CM_SIMD_SSE2
+/*
+================
+CM_PlaneCollision
+
+  Returns false for a quick getout
+================
+*/
+
+bool CM_PlaneCollision(traceWork_t *tw, cbrushside_t *side)
+{
+	float			dist;
+	float			d1, d2;
+
+	cplane_t		*plane = side->plane;
+
+	// adjust the plane distance appropriately for mins/maxs
+	dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
+
+	d1 = DotProduct( tw->start, plane->normal ) - dist;
+	d2 = DotProduct( tw->end, plane->normal ) - dist;
+
+	return CM_PlaneCrossing(tw, side, d1, d2);
+}
+#endif
+
 /*
 ================
 CM_TraceThroughBrush
@@ -569,6 +662,58 @@ void CM_TraceThroughBrush( traceWork_t *tw, trace_t &trace, cbrush_t *brush, boo
 	// find the latest time the trace crosses a plane towards the interior
 	// and the earliest time the trace crosses a plane towards the exterior
 	//
+#if CM_SIMD_SSE2
+	{
+		const __m128	zero = _mm_setzero_ps();
+		const __m128	epsilon = _mm_set1_ps( SURFACE_CLIP_EPSILON );
+		const __m128	size0x = _mm_set1_ps( tw->size[0][0] ), size1x = _mm_set1_ps( tw->size[1][0] );
+		const __m128	size0y = _mm_set1_ps( tw->size[0][1] ), size1y = _mm_set1_ps( tw->size[1][1] );
+		const __m128	size0z = _mm_set1_ps( tw->size[0][2] ), size1z = _mm_set1_ps( tw->size[1][2] );
+		const __m128	startx = _mm_set1_ps( tw->start[0] ), starty = _mm_set1_ps( tw->start[1] ), startz = _mm_set1_ps( tw->start[2] );
+		const __m128	endx = _mm_set1_ps( tw->end[0] ), endy = _mm_set1_ps( tw->end[1] ), endz = _mm_set1_ps( tw->end[2] );
+		const int		numBlocks = BRUSH_PLANE_BLOCKS( brush->numsides );
+		float			d1s[BRUSH_PLANE_LANES], d2s[BRUSH_PLANE_LANES];
+		int				b, lanes;
+
+		for (b = 0; b < numBlocks; b++)
+		{
+			const cbrushplanes_t *block = brush->planes + b;
+			const __m128	nx = _mm_loadu_ps( block->normal[0] );
+			const __m128	ny = _mm_loadu_ps( block->normal[1] );
+			const __m128	nz = _mm_loadu_ps( block->normal[2] );
+
+			// offsets[ signbits ] picks size[1] on each axis the normal points down
+			const __m128	ox = _mm_or_ps( _mm_and_ps( _mm_cmplt_ps( nx, zero ), size1x ), _mm_andnot_ps( _mm_cmplt_ps( nx, zero ), size0x ) );
+			const __m128	oy = _mm_or_ps( _mm_and_ps( _mm_cmplt_ps( ny, zero ), size1y ), _mm_andnot_ps( _mm_cmplt_ps( ny, zero ), size0y ) );
+			const __m128	oz = _mm_or_ps( _mm_and_ps( _mm_cmplt_ps( nz, zero ), size1z ), _mm_andnot_ps( _mm_cmplt_ps( nz, zero ), size0z ) );
+
+			// adjust the plane distance appropriately for mins/maxs
+			const __m128	dist = _mm_sub_ps( _mm_loadu_ps( block->dist ),
+				_mm_add_ps( _mm_add_ps( _mm_mul_ps( ox, nx ), _mm_mul_ps( oy, ny ) ), _mm_mul_ps( oz, nz ) ) );
+
+			const __m128	d1 = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( startx, nx ), _mm_mul_ps( starty, ny ) ), _mm_mul_ps( startz, nz ) ), dist );
+			const __m128	d2 = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( endx, nx ), _mm_mul_ps( endy, ny ) ), _mm_mul_ps( endz, nz ) ), dist );
+
+			// if completely in front of any face, no intersection with the entire brush
+			if ( _mm_movemask_ps( _mm_and_ps( _mm_cmpgt_ps( d1, zero ),
+				_mm_or_ps( _mm_cmpge_ps( d2, epsilon ), _mm_cmpge_ps( d2, d1 ) ) ) ) )
+			{
+				return;
+			}
+
+			_mm_storeu_ps( d1s, d1 );
+			_mm_storeu_ps( d2s, d2 );
+
+			// the fractions have to be found in side order to pick the same lead side
+			lanes = Q_min( BRUSH_PLANE_LANES, brush->numsides - b * BRUSH_PLANE_LANES );
+			for (i = 0; i < lanes; i++)
+			{
+				side = brush->sides + b * BRUSH_PLANE_LANES + i;
+				CM_PlaneCrossing(tw, side, d1s[i], d2s[i]);
+			}
+		}
+	}
+#else
 	for (i = 0; i < brush->numsides; i++)
 	{
 		side = brush->sides + i;
@@ -578,6 +723,7 @@ void CM_TraceThroughBrush( traceWork_t *tw, trace_t &trace, cbrush_t *brush, boo
 			return;
 		}
 	}
+#endif
 
 	//
 	// all planes have been checked, and the trace was not
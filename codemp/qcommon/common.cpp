@@ -34,6 +34,11 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include <windows.h>
 #endif
 
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 FILE *debuglogfile;
 fileHandle_t logfile;
 fileHandle_t	com_journalFile;			// events are written here
@@ -115,6 +120,43 @@ void Com_EndRedirect (void)
 	rd_flush = NULL;
 }
 
+/*
+Worker threads, such as the demo and avi writers, may end up in Com_Printf.
+The console, redirect buffer and log file all belong to the main thread, so
+their messages are queued and printed by the main thread, at its next print
+or frame.
+*/
+static std::thread::id			com_mainThread;		// unset until Com_Init
+static std::mutex				com_printMutex;
+static std::vector<std::string>	com_printQueue;
+
+static bool Com_OnMainThread( void ) {
+	return com_mainThread == std::thread::id() || com_mainThread == std::this_thread::get_id();
+}
+
+/*
+=============
+Com_FlushPrintQueue
+
+Prints what other threads queued.  Main thread only.
+=============
+*/
+static void Com_FlushPrintQueue( void ) {
+	std::vector<std::string> queued;
+
+	{
+		std::lock_guard<std::mutex> lock( com_printMutex );
+		if ( com_printQueue.empty() ) {
+			return;
+		}
+		queued.swap( com_printQueue );
+	}
+
+	for ( const std::string &msg : queued ) {
+		Com_Printf( "%s", msg.c_str() );
+	}
+}
+
 /*
 =============
 Com_Printf
@@ -134,6 +176,15 @@ void QDECL Com_Printf( const char *fmt, ... ) {
 	Q_vsnprintf (msg, sizeof(msg), fmt, argptr);
 	va_end (argptr);
 
+	if ( !Com_OnMainThread() ) {
+		std::lock_guard<std::mutex> lock( com_printMutex );
+		com_printQueue.push_back( msg );
+		return;
+	}
+
+	// keep the order other threads printed in
+	Com_FlushPrintQueue();
+
 	if ( rd_buffer ) {
 		if ((strlen (msg) + strlen(rd_buffer)) > (size_t)(rd_buffersize - 1)) {
 			rd_flush(rd_buffer);
@@ -1159,6 +1210,8 @@ void Com_Init( char *commandLine ) {
 	char	*s;
 	int		qport;
 
+	com_mainThread = std::this_thread::get_id();
+
 	Com_Printf( "%s %s %s\n", JK_VERSION, PLATFORM_STRING, SOURCE_DATE );
 
 	try
@@ -1522,6 +1575,9 @@ void Com_Frame( void ) {
 		int           timeBeforeClient = 0;
 		int           timeAfter = 0;
 
+		// print what other threads had to say since the last frame
+		Com_FlushPrintQueue();
+
 		// write config file if anything changed
 		Com_WriteConfiguration();
 
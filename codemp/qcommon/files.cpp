@@ -39,6 +39,12 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #endif
 #include <minizip/unzip.h>
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+
 #if defined(_WIN32)
 #include <windows.h>
 #endif
@@ -206,6 +212,9 @@ typedef struct pack_s {
 	char			pakBasename[MAX_OSPATH];	// assets0
 	char			pakGamename[MAX_OSPATH];	// base
 	unzFile			handle;						// handle to zip file
+	const byte		*mapped;					// the whole pk3 mapped read-only, or NULL
+	size_t			mappedLength;
+	size_t			mappedBase;					// bytes in front of the zip itself, as in self-extractors
 	int				checksum;					// regular checksum
 	int				pure_checksum;				// checksum for pure
 	int				numfiles;					// number of files in pk3
@@ -257,6 +266,7 @@ static int			fs_checksumFeed;
 typedef union qfile_gus {
 	FILE*		o;
 	unzFile		z;
+	const byte	*m;		// data of a pak file entry, read straight from the mapping
 } qfile_gut;
 
 typedef struct qfile_us {
@@ -271,11 +281,21 @@ typedef struct fileHandleData_s {
 	int			zipFilePos;
 	int			zipFileLen;
 	qboolean	zipFile;
+	int			zipChecksum;	// of the pak the file is in
+	qboolean	zipMapped;		// handleFiles.file.m is in use instead of minizip
+	int			zipMethod;		// 0 for stored, Z_DEFLATED
+	int			zipDataLen;		// compressed size
+	int			zipReadPos;		// uncompressed bytes read so far
+	z_stream	*zipStream;		// inflate state of a deflated entry
 	char		name[MAX_ZPATH];
 } fileHandleData_t;
 
 static fileHandleData_t	fsh[MAX_FILE_HANDLES];
 
+// buffers FS_ReadFileMapped handed out of a mapping, and how many times,
+// so FS_FreeFile can tell them from Z_Malloc'd ones
+static std::unordered_map<const void *, int>	fs_mappedBuffers;
+
 // TTimo - https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=540
 // wether we did a reorder on the current search path when joining the server
 static qboolean fs_reordered = qfalse;
@@ -284,6 +304,7 @@ static qboolean fs_reordered = qfalse;
 static int		fs_numServerPaks = 0;
 static int		fs_serverPaks[MAX_SEARCH_PATHS];				// checksums
 static char		*fs_serverPakNames[MAX_SEARCH_PATHS];			// pk3 names
+static int		fs_serverPaksGeneration;						// changes with the list
 
 // only used for autodownload, to make sure the client has at least
 // all the pk3 files that are referenced at the server side
@@ -357,6 +378,293 @@ qboolean FS_PakIsPure( pack_t *pack ) {
 	return qtrue;
 }
 
+/*
+=============================================================================
+
+FILE INDEX
+
+FS_Startup indexes every file in every pk3 by its whole name, with the
+copies of each name chained in search path order.  FS_FOpenFileRead then
+finds the pk3 a file comes from with one hash probe instead of walking
+every pak, and only tries the directories that come before it in the
+search path.  Which copy is visible depends on the pure list, so that is
+worked out again whenever fs_pureBypass or the server's pak list changes.
+
+Each pak's files are also kept sorted by name, so FS_ListFilteredFiles
+can find the ones under a path with a binary search.
+
+=============================================================================
+*/
+
+typedef struct fileIndexEntry_s {
+	fileInPack_t	*file;
+	int				search;			// position of its pak in fs_indexSearchPaths
+	int				next;			// next copy of the same name, -1 at the end
+} fileIndexEntry_t;
+
+typedef struct fileIndexName_s {
+	unsigned int	hash;
+	int				first;			// copies of the name, in search order
+	int				last;
+	int				visible;		// first copy in a pure pak, -1 if none
+	int				next;			// next name in the hash bucket
+} fileIndexName_t;
+
+static searchpath_t		**fs_indexSearchPaths;		// fs_searchpaths in order
+static qboolean			*fs_indexPure;				// FS_PakIsPure for each of them
+static int				fs_indexNumSearchPaths;
+static int				*fs_indexDirs;				// positions of the directories
+static int				fs_indexNumDirs;
+static fileIndexEntry_t	*fs_indexEntries;
+static int				fs_indexNumEntries;
+static fileIndexName_t	*fs_indexNames;
+static int				fs_indexNumNames;
+static int				*fs_indexHashTable;
+static int				fs_indexHashSize;			// power of two
+static int				*fs_indexSorted;			// buildBuffer positions, each pak sorted by name
+static int				*fs_indexSortedStart;		// per search path, into fs_indexSorted
+static int				fs_indexPureBypass;			// what visible was worked out for
+static int				fs_indexPureGeneration;
+
+/*
+================
+FS_IndexHash
+
+Case and separator insensitive, like FS_FilenameCompare
+================
+*/
+static unsigned int FS_IndexHash( const char *name ) {
+	unsigned int	hash = 2166136261u;
+	int				c;
+
+	for ( ; *name ; name++ ) {
+		c = *name;
+		if ( c >= 'a' && c <= 'z' ) {
+			c -= ( 'a' - 'A' );
+		}
+		if ( c == '\\' || c == ':' ) {
+			c = '/';
+		}
+		hash = ( hash ^ c ) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+================
+FS_FreeFileIndex
+================
+*/
+static void FS_FreeFileIndex( void ) {
+	if ( !fs_indexSearchPaths ) {
+		return;
+	}
+
+	Z_Free( fs_indexSearchPaths );
+	Z_Free( fs_indexPure );
+	Z_Free( fs_indexDirs );
+	Z_Free( fs_indexEntries );
+	Z_Free( fs_indexNames );
+	Z_Free( fs_indexHashTable );
+	Z_Free( fs_indexSorted );
+	Z_Free( fs_indexSortedStart );
+
+	fs_indexSearchPaths = NULL;
+	fs_indexPure = NULL;
+	fs_indexDirs = NULL;
+	fs_indexEntries = NULL;
+	fs_indexNames = NULL;
+	fs_indexHashTable = NULL;
+	fs_indexSorted = NULL;
+	fs_indexSortedStart = NULL;
+	fs_indexNumSearchPaths = fs_indexNumDirs = 0;
+	fs_indexNumEntries = fs_indexNumNames = 0;
+	fs_indexHashSize = 0;
+}
+
+/*
+================
+FS_BuildFileIndex
+
+Called once the search path is final
+================
+*/
+static void FS_BuildFileIndex( void ) {
+	searchpath_t	*search;
+	int				numFiles, numSorted;
+	int				s, i;
+
+	FS_FreeFileIndex();
+
+	numFiles = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			numFiles += search->pack->numfiles;
+		}
+		fs_indexNumSearchPaths++;
+	}
+
+	for ( fs_indexHashSize = 1 ; fs_indexHashSize < numFiles ; fs_indexHashSize <<= 1 ) {
+	}
+
+	fs_indexSearchPaths = (searchpath_t **)Z_Malloc( fs_indexNumSearchPaths * sizeof( *fs_indexSearchPaths ), TAG_FILESYS, qfalse );
+	fs_indexPure = (qboolean *)Z_Malloc( fs_indexNumSearchPaths * sizeof( *fs_indexPure ), TAG_FILESYS, qfalse );
+	fs_indexDirs = (int *)Z_Malloc( fs_indexNumSearchPaths * sizeof( *fs_indexDirs ), TAG_FILESYS, qfalse );
+	fs_indexEntries = (fileIndexEntry_t *)Z_Malloc( Q_max( numFiles, 1 ) * sizeof( *fs_indexEntries ), TAG_FILESYS, qfalse );
+	fs_indexNames = (fileIndexName_t *)Z_Malloc( Q_max( numFiles, 1 ) * sizeof( *fs_indexNames ), TAG_FILESYS, qfalse );
+	fs_indexHashTable = (int *)Z_Malloc( fs_indexHashSize * sizeof( *fs_indexHashTable ), TAG_FILESYS, qfalse );
+	fs_indexSorted = (int *)Z_Malloc( Q_max( numFiles, 1 ) * sizeof( *fs_indexSorted ), TAG_FILESYS, qfalse );
+	fs_indexSortedStart = (int *)Z_Malloc( ( fs_indexNumSearchPaths + 1 ) * sizeof( *fs_indexSortedStart ), TAG_FILESYS, qfalse );
+
+	for ( i = 0 ; i < fs_indexHashSize ; i++ ) {
+		fs_indexHashTable[i] = -1;
+	}
+
+	numSorted = 0;
+	for ( search = fs_searchpaths, s = 0 ; search ; search = search->next, s++ ) {
+		pack_t *pak = search->pack;
+
+		fs_indexSearchPaths[s] = search;
+		fs_indexSortedStart[s] = numSorted;
+
+		if ( !pak ) {
+			fs_indexDirs[fs_indexNumDirs++] = s;
+			continue;
+		}
+
+		// the pak's own hash chains put later entries first, so
+		// go backwards to keep the copy it would have found
+		for ( i = pak->numfiles - 1 ; i >= 0 ; i-- ) {
+			fileInPack_t	*file = &pak->buildBuffer[i];
+			unsigned int	hash;
+			int				n;
+
+			if ( !file->name ) {
+				continue;	// the zip directory ended early
+			}
+
+			fs_indexSorted[numSorted++] = i;
+
+			hash = FS_IndexHash( file->name );
+			for ( n = fs_indexHashTable[hash & ( fs_indexHashSize - 1 )] ; n >= 0 ; n = fs_indexNames[n].next ) {
+				if ( fs_indexNames[n].hash == hash && !FS_FilenameCompare( fs_indexEntries[fs_indexNames[n].first].file->name, file->name ) ) {
+					break;
+				}
+			}
+
+			if ( n < 0 ) {
+				n = fs_indexNumNames++;
+				fs_indexNames[n].hash = hash;
+				fs_indexNames[n].first = -1;
+				fs_indexNames[n].last = -1;
+				fs_indexNames[n].visible = -1;
+				fs_indexNames[n].next = fs_indexHashTable[hash & ( fs_indexHashSize - 1 )];
+				fs_indexHashTable[hash & ( fs_indexHashSize - 1 )] = n;
+			} else if ( fs_indexEntries[fs_indexNames[n].last].search == s ) {
+				continue;	// the same name twice in one pak
+			}
+
+			fileIndexEntry_t *entry = &fs_indexEntries[fs_indexNumEntries];
+
+			entry->file = file;
+			entry->search = s;
+			entry->next = -1;
+			if ( fs_indexNames[n].last >= 0 ) {
+				fs_indexEntries[fs_indexNames[n].last].next = fs_indexNumEntries;
+			} else {
+				fs_indexNames[n].first = fs_indexNumEntries;
+			}
+			fs_indexNames[n].last = fs_indexNumEntries;
+			fs_indexNumEntries++;
+		}
+
+		const fileInPack_t *files = pak->buildBuffer;
+		std::sort( fs_indexSorted + fs_indexSortedStart[s], fs_indexSorted + numSorted, [files]( int a, int b ) {
+			return Q_stricmp( files[a].name, files[b].name ) < 0;
+		} );
+	}
+	fs_indexSortedStart[s] = numSorted;
+
+	// work out the visible copies on first use
+	fs_indexPureGeneration = fs_serverPaksGeneration - 1;
+}
+
+/*
+================
+FS_ResolveFileIndex
+
+Picks the copy of each name that FS_FOpenFileRead may use
+================
+*/
+static void FS_ResolveFileIndex( void ) {
+	int s, n, e;
+
+	if ( fs_indexPureBypass == fs_pureBypass->integer && fs_indexPureGeneration == fs_serverPaksGeneration ) {
+		return;
+	}
+	fs_indexPureBypass = fs_pureBypass->integer;
+	fs_indexPureGeneration = fs_serverPaksGeneration;
+
+	for ( s = 0 ; s < fs_indexNumSearchPaths ; s++ ) {
+		pack_t *pak = fs_indexSearchPaths[s]->pack;
+
+		fs_indexPure[s] = pak ? FS_PakIsPure( pak ) : qfalse;
+	}
+
+	for ( n = 0 ; n < fs_indexNumNames ; n++ ) {
+		for ( e = fs_indexNames[n].first ; e >= 0 && !fs_indexPure[fs_indexEntries[e].search] ; e = fs_indexEntries[e].next ) {
+		}
+		fs_indexNames[n].visible = e;
+	}
+}
+
+/*
+================
+FS_FindIndexedFile
+
+Returns the copy of filename in a pure pak that comes first in the
+search path, or NULL if there isn't one
+================
+*/
+static const fileIndexEntry_t *FS_FindIndexedFile( const char *filename ) {
+	const unsigned int	hash = FS_IndexHash( filename );
+	int					n;
+
+	FS_ResolveFileIndex();
+
+	for ( n = fs_indexHashTable[hash & ( fs_indexHashSize - 1 )] ; n >= 0 ; n = fs_indexNames[n].next ) {
+		if ( fs_indexNames[n].hash == hash && !FS_FilenameCompare( fs_indexEntries[fs_indexNames[n].first].file->name, filename ) ) {
+			return fs_indexNames[n].visible >= 0 ? &fs_indexEntries[fs_indexNames[n].visible] : NULL;
+		}
+	}
+	return NULL;
+}
+
+/*
+================
+FS_IndexedFilesInPath
+
+Fills files with the positions in the pak's buildBuffer of every file whose
+name starts with the first pathLength characters of path, in zip order
+================
+*/
+static void FS_IndexedFilesInPath( int search, const char *path, int pathLength, std::vector<int> &files ) {
+	const fileInPack_t	*buildBuffer = fs_indexSearchPaths[search]->pack->buildBuffer;
+	const int			*first = fs_indexSorted + fs_indexSortedStart[search];
+	const int			*last = fs_indexSorted + fs_indexSortedStart[search + 1];
+	const int			*it;
+
+	it = std::lower_bound( first, last, path, [buildBuffer, pathLength]( int a, const char *p ) {
+		return Q_stricmpn( buildBuffer[a].name, p, pathLength ) < 0;
+	} );
+
+	files.clear();
+	for ( ; it != last && !Q_stricmpn( buildBuffer[*it].name, path, pathLength ) ; it++ ) {
+		files.push_back( *it );
+	}
+	std::sort( files.begin(), files.end() );
+}
+
 /*
 ================
 return a hash value for the filename
@@ -457,6 +765,30 @@ int FS_filelength( fileHandle_t f ) {
 		return FS_fplength(h);
 }
 
+/*
+================
+FS_FileOrigin
+
+Describes where an open file was read from, the checksum of its pak or
+the size and modification time of a loose file, so anything built from
+it can tell when it changes.
+================
+*/
+const char *FS_FileOrigin( fileHandle_t f ) {
+	struct stat	buf;
+
+	if ( f < 1 || f >= MAX_FILE_HANDLES ) {
+		Com_Error( ERR_DROP, "FS_FileOrigin: out of range" );
+	}
+	if ( fsh[f].zipFile == qtrue ) {
+		return va( "pak %i", fsh[f].zipChecksum );
+	}
+	if ( fstat( fileno( FS_FileForHandle( f ) ), &buf ) ) {
+		return "file";
+	}
+	return va( "file %lld %lld", (long long)buf.st_size, (long long)buf.st_mtime );
+}
+
 /*
 ====================
 FS_ReplaceSeparators
@@ -968,16 +1300,198 @@ void FS_Rename( const char *from, const char *to ) {
 	}
 }
 
+/*
+===========
+FS_ZipShort / FS_ZipLong
+
+Little endian fields of the zip headers in a mapped pak
+===========
+*/
+static unsigned int FS_ZipShort( const byte *p ) {
+	return p[0] | ( p[1] << 8 );
+}
+
+static unsigned int FS_ZipLong( const byte *p ) {
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (unsigned int)p[3] << 24 );
+}
+
+/*
+===========
+FS_MappedFileData
+
+Finds the data of a pak file entry in the pak's mapping, going from its
+central directory record to its local header.  Returns NULL for anything
+minizip has to read instead: unmapped paks, encrypted or zip64 entries
+and compression methods other than stored and deflated.
+===========
+*/
+static const byte *FS_MappedFileData( const pack_t *pak, const fileInPack_t *pakFile, int *method, int *dataLen ) {
+	const byte		*central, *local;
+	size_t			pos;
+	unsigned int	compressedLen, uncompressedLen, localPos;
+
+	if ( !pak->mapped ) {
+		return NULL;
+	}
+
+	pos = pak->mappedBase + pakFile->pos;
+	if ( pos + 46 > pak->mappedLength ) {
+		return NULL;
+	}
+	central = pak->mapped + pos;
+	if ( FS_ZipLong( central ) != 0x02014b50 || ( FS_ZipShort( central + 8 ) & 1 ) ) {
+		return NULL;
+	}
+
+	*method = FS_ZipShort( central + 10 );
+	compressedLen = FS_ZipLong( central + 20 );
+	uncompressedLen = FS_ZipLong( central + 24 );
+	localPos = FS_ZipLong( central + 42 );
+	if ( *method != 0 && *method != Z_DEFLATED ) {
+		return NULL;
+	}
+	if ( compressedLen > 0x7fffffff || uncompressedLen != pakFile->len || localPos == 0xffffffff ) {
+		return NULL;
+	}
+	if ( *method == 0 && compressedLen != uncompressedLen ) {
+		return NULL;
+	}
+
+	pos = pak->mappedBase + localPos;
+	if ( pos + 30 > pak->mappedLength ) {
+		return NULL;
+	}
+	local = pak->mapped + pos;
+	if ( FS_ZipLong( local ) != 0x04034b50 ) {
+		return NULL;
+	}
+	pos += 30 + FS_ZipShort( local + 26 ) + FS_ZipShort( local + 28 );
+	if ( pos + compressedLen > pak->mappedLength ) {
+		return NULL;
+	}
+
+	*dataLen = compressedLen;
+	return pak->mapped + pos;
+}
+
+/*
+===========
+FS_RewindMappedFile
+
+Starts a mapped pak file over from its first byte
+===========
+*/
+static qboolean FS_RewindMappedFile( fileHandle_t f ) {
+	z_stream *stream = fsh[f].zipStream;
+
+	fsh[f].zipReadPos = 0;
+	if ( !stream ) {
+		return qtrue;
+	}
+
+	stream->next_in = (Bytef *)fsh[f].handleFiles.file.m;
+	stream->avail_in = fsh[f].zipDataLen;
+	return (qboolean)( inflateReset( stream ) == Z_OK );
+}
+
+/*
+===========
+FS_OpenMappedFile
+
+Sets up a handle to read a pak file entry straight out of the mapping,
+inflating deflated entries from it without going through minizip
+===========
+*/
+static qboolean FS_OpenMappedFile( fileHandle_t f, const byte *data, int method, int dataLen ) {
+	fsh[f].handleFiles.file.m = data;
+	fsh[f].zipMapped = qtrue;
+	fsh[f].zipMethod = method;
+	fsh[f].zipDataLen = dataLen;
+	fsh[f].zipStream = NULL;
+
+	if ( method == Z_DEFLATED ) {
+		z_stream *stream = (z_stream *)Z_Malloc( sizeof( *stream ), TAG_FILESYS, qtrue );
+
+		// raw deflate data, as zip stores it
+		if ( inflateInit2( stream, -MAX_WBITS ) != Z_OK ) {
+			Z_Free( stream );
+			fsh[f].handleFiles.file.m = NULL;
+			fsh[f].zipMapped = qfalse;
+			return qfalse;
+		}
+		fsh[f].zipStream = stream;
+	}
+
+	return FS_RewindMappedFile( f );
+}
+
+/*
+===========
+FS_CloseMappedFile
+===========
+*/
+static void FS_CloseMappedFile( fileHandle_t f ) {
+	if ( fsh[f].zipStream ) {
+		inflateEnd( fsh[f].zipStream );
+		Z_Free( fsh[f].zipStream );
+	}
+}
+
+/*
+===========
+FS_ReadMappedFile
+
+Copies stored entries out of the mapping and inflates deflated ones
+directly into the caller's buffer
+===========
+*/
+static int FS_ReadMappedFile( void *buffer, int len, fileHandle_t f ) {
+	z_stream	*stream = fsh[f].zipStream;
+	int			read;
+
+	len = Q_min( len, fsh[f].zipFileLen - fsh[f].zipReadPos );
+	if ( len <= 0 ) {
+		return 0;
+	}
+
+	if ( !stream ) {
+		Com_Memcpy( buffer, fsh[f].handleFiles.file.m + fsh[f].zipReadPos, len );
+		fsh[f].zipReadPos += len;
+		return len;
+	}
+
+	stream->next_out = (Bytef *)buffer;
+	stream->avail_out = len;
+	while ( stream->avail_out ) {
+		const int err = inflate( stream, Z_SYNC_FLUSH );
+
+		if ( err == Z_STREAM_END ) {
+			break;
+		}
+		if ( err != Z_OK ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: %s is corrupt in its pk3\n", fsh[f].name );
+			break;
+		}
+	}
+
+	read = len - stream->avail_out;
+	fsh[f].zipReadPos += read;
+	return read;
+}
+
 /*
 ===========
 FS_FCloseFile
 
 Close a file.
 
-There are three cases handled:
+There are four cases handled:
 
   * normal file: closed with fclose.
 
+  * file in a mapped pak3 archive: only its inflate state, if it has one,
+    needs freeing.
+
   * file in pak3 archive: subfile is closed with unzCloseCurrentFile, but the
     minizip handle to the pak3 remains open.
 
@@ -991,6 +1505,11 @@ void FS_FCloseFile( fileHandle_t f ) {
 	FS_AssertInitialised();
 
 	if (fsh[f].zipFile == qtrue) {
+		if ( fsh[f].zipMapped ) {
+			FS_CloseMappedFile( f );
+			Com_Memset( &fsh[f], 0, sizeof( fsh[f] ) );
+			return;
+		}
 		unzCloseCurrentFile( fsh[f].handleFiles.file.z );
 		if ( fsh[f].handleFiles.unique ) {
 			unzClose( fsh[f].handleFiles.file.z );
@@ -1250,6 +1769,254 @@ bool FS_FileCacheable(const char* const filename)
 	return( strchr(filename, '/') != 0 );
 }
 
+/*
+===========
+FS_FOpenFileInPak
+
+Opens a file FS_FOpenFileRead found in a pak on the handle it allocated
+===========
+*/
+static long FS_FOpenFileInPak( const char *filename, pack_t *pak, fileInPack_t *pakFile, fileHandle_t *file, qboolean uniqueFILE ) {
+	const byte	*data;
+	int			method, dataLen;
+	int			l;
+
+	// mark the pak as having been referenced and mark specifics on cgame and ui
+	// shaders, txt, arena files  by themselves do not count as a reference as
+	// these are loaded from all pk3s
+	// from every pk3 file..
+
+	// The x86.dll suffixes are needed in order for sv_pure to continue to
+	// work on non-x86/windows systems...
+
+	l = strlen( filename );
+	if ( !(pak->referenced & FS_GENERAL_REF)) {
+		if( !FS_IsExt(filename, ".shader", l) &&
+		    !FS_IsExt(filename, ".txt", l) &&
+		    !FS_IsExt(filename, ".str", l) &&
+		    !FS_IsExt(filename, ".cfg", l) &&
+		    !FS_IsExt(filename, ".config", l) &&
+		    !FS_IsExt(filename, ".bot", l) &&
+		    !FS_IsExt(filename, ".arena", l) &&
+		    !FS_IsExt(filename, ".menu", l) &&
+		    !FS_IsExt(filename, ".fcf", l) &&
+		    Q_stricmp(filename, "jampgamex86.dll") != 0 &&
+		    //Q_stricmp(filename, "vm/qagame.qvm") != 0 &&
+		    !strstr(filename, "levelshots"))
+		{
+			pak->referenced |= FS_GENERAL_REF;
+		}
+	}
+
+	if (!(pak->referenced & FS_CGAME_REF))
+	{
+		if ( Q_stricmp( filename, "cgame.qvm" ) == 0 ||
+				Q_stricmp( filename, "cgamex86.dll" ) == 0 )
+		{
+			pak->referenced |= FS_CGAME_REF;
+		}
+	}
+
+	if (!(pak->referenced & FS_UI_REF))
+	{
+		if ( Q_stricmp( filename, "ui.qvm" ) == 0 ||
+				Q_stricmp( filename, "uix86.dll" ) == 0 )
+		{
+			pak->referenced |= FS_UI_REF;
+		}
+	}
+
+	Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
+	fsh[*file].zipFile = qtrue;
+	fsh[*file].zipChecksum = pak->checksum;
+	fsh[*file].zipFilePos = pakFile->pos;
+	fsh[*file].zipFileLen = pakFile->len;
+
+	// mapped paks need no zip handle of their own, unique or not
+	data = FS_MappedFileData( pak, pakFile, &method, &dataLen );
+	if ( !data || !FS_OpenMappedFile( *file, data, method, dataLen ) ) {
+		if ( uniqueFILE ) {
+			// open a new file on the pakfile
+			fsh[*file].handleFiles.file.z = unzOpen (pak->pakFilename);
+			if (fsh[*file].handleFiles.file.z == NULL) {
+				Com_Error (ERR_FATAL, "Couldn't open %s", pak->pakFilename);
+			}
+		} else {
+			fsh[*file].handleFiles.file.z = pak->handle;
+		}
+
+		// set the file position in the zip file (also sets the current file info)
+		unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
+
+		// open the file in the zip
+		unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
+
+#if 0
+		zfi = (unz_s *)fsh[*file].handleFiles.file.z;
+		// in case the file was new
+		temp = zfi->filestream;
+		// set the file position in the zip file (also sets the current file info)
+		unzSetOffset(pak->handle, pakFile->pos);
+		// copy the file info into the unzip structure
+		Com_Memcpy( zfi, pak->handle, sizeof(unz_s) );
+		// we copy this back into the structure
+		zfi->filestream = temp;
+		// open the file in the zip
+		unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
+#endif
+	}
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n",
+			filename, pak->pakFilename );
+	}
+#ifndef DEDICATED
+#ifndef FINAL_BUILD
+	// Check for unprecached files when in game but not in the menus
+	if((cls.state == CA_ACTIVE) && !(Key_GetCatcher( ) & KEYCATCH_UI))
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: File %s not precached\n", filename);
+	}
+#endif
+#endif // DEDICATED
+	return pakFile->len;
+}
+
+/*
+===========
+FS_FOpenFileInDir
+
+Tries to open a file in one search path directory on the handle
+FS_FOpenFileRead allocated.  Returns -1 if the search should go on,
+with reopen set if it has to start over to pick up a fresh local copy.
+===========
+*/
+static long FS_FOpenFileInDir( const char *filename, directory_t *dir, fileHandle_t *file, qboolean *reopen ) {
+	char	*netpath;
+	int		l;
+
+	// if we are running restricted, the only files we
+	// will allow to come from the directory are .cfg files
+	l = strlen( filename );
+  // FIXME TTimo I'm not sure about the fs_numServerPaks test
+  // if you are using FS_ReadFile to find out if a file exists,
+  //   this test can make the search fail although the file is in the directory
+  // I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
+  // turned out I used FS_FileExists instead
+	if ( fs_numServerPaks ) {
+		if ( !FS_IsExt( filename, ".cfg", l ) &&		// for config files
+		    !FS_IsExt( filename, ".fcf", l ) &&		// force configuration files
+		    !FS_IsExt( filename, ".menu", l ) &&		// menu files
+		    !FS_IsExt( filename, ".game", l ) &&		// menu files
+		    !FS_IsExt( filename, ".dat", l ) &&		// for journal files
+		    !FS_IsDemoExt( filename, l ) ) {			// demos
+			return -1;
+		}
+	}
+
+	netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+	fsh[*file].handleFiles.file.o = fopen (netpath, "rb");
+	if ( !fsh[*file].handleFiles.file.o ) {
+		return -1;
+	}
+
+	if ( !FS_IsExt( filename, ".cfg", l ) &&		// for config files
+		!FS_IsExt( filename, ".fcf", l ) &&		// force configuration files
+		!FS_IsExt( filename, ".menu", l ) &&		// menu files
+		!FS_IsExt( filename, ".game", l ) &&		// menu files
+		!FS_IsExt( filename, ".dat", l ) &&		// for journal files
+		!FS_IsDemoExt( filename, l ) ) {			// demos
+		fs_fakeChkSum = Q_flrand(0.0f, 1.0f);
+	}
+#ifdef _WIN32
+	// if running with fs_copyfiles 2, and search path == local, then we need to fail to open
+	//	if the time/date stamp != the network version (so it'll loop round again and use the network path,
+	//	which comes later in the search order)
+	//
+	if ( fs_copyfiles->integer == 2 && fs_cdpath->string[0] && !Q_stricmp( dir->path, fs_basepath->string )
+		&& FS_FileCacheable(filename) )
+	{
+		if ( Sys_FileOutOfDate( netpath, FS_BuildOSPath( fs_cdpath->string, dir->gamedir, filename ) ))
+		{
+			fclose(fsh[*file].handleFiles.file.o);
+			fsh[*file].handleFiles.file.o = 0;
+			return -1;	//carry on to find the cdpath version.
+		}
+	}
+#endif
+	Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
+	fsh[*file].zipFile = qfalse;
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileRead: %s (found in '%s%c%s')\n", filename,
+			dir->path, PATH_SEP, dir->gamedir );
+	}
+
+#ifdef _WIN32
+	// if we are getting it from the cdpath, optionally copy it
+	//  to the basepath
+	if ( fs_copyfiles->integer && !Q_stricmp( dir->path, fs_cdpath->string ) ) {
+		char	*copypath;
+
+		copypath = FS_BuildOSPath( fs_basepath->string, dir->gamedir, filename );
+		switch ( fs_copyfiles->integer )
+		{
+			default:
+			case 1:
+			{
+				FS_CopyFile( netpath, copypath );
+			}
+			break;
+
+			case 2:
+			{
+
+				if (FS_FileCacheable(filename) )
+				{
+					// maybe change this to Com_DPrintf?   On the other hand...
+					//
+					Com_Printf( "fs_copyfiles(2), Copying: %s to %s\n", netpath, copypath );
+
+					FS_CreatePath( copypath );
+
+					bool bOk = true;
+					if (!CopyFile( netpath, copypath, FALSE ))
+					{
+						DWORD dwAttrs = GetFileAttributes(copypath);
+						SetFileAttributes(copypath, dwAttrs & ~FILE_ATTRIBUTE_READONLY);
+						bOk = !!CopyFile( netpath, copypath, FALSE );
+					}
+
+					if (bOk)
+					{
+						// clear this handle and setup for re-opening of the new local copy...
+						//
+						*reopen = qtrue;
+						fclose(fsh[*file].handleFiles.file.o);
+						fsh[*file].handleFiles.file.o = NULL;
+					}
+				}
+			}
+			break;
+		}
+	}
+#endif
+	if (*reopen)
+	{
+		return -1;	// and re-read the local copy, not the net version
+	}
+
+#ifndef DEDICATED
+#ifndef FINAL_BUILD
+	// Check for unprecached files when in game but not in the menus
+	if((cls.state == CA_ACTIVE) && !(Key_GetCatcher( ) & KEYCATCH_UI))
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: File %s not precached\n", filename);
+	}
+#endif
+#endif // dedicated
+	return FS_fplength(fsh[*file].handleFiles.file.o);
+}
+
 /*
 ===========
 FS_FOpenFileRead
@@ -1264,14 +2031,10 @@ extern qboolean		com_fullyInitialized;
 
 long FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
 	searchpath_t	*search;
-	char			*netpath;
 	pack_t			*pak;
 	fileInPack_t	*pakFile;
-	directory_t		*dir;
 	long			hash;
-	//unz_s			*zfi;
-	//void			*temp;
-	int				l;
+	long			len;
 	bool			isUserConfig = false;
 
 	hash = 0;
@@ -1326,6 +2089,28 @@ long FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean unique
 	{
 		bFasterToReOpenUsingNewLocalFile = qfalse;
 
+		if ( fs_indexSearchPaths ) {
+			// autoexec.cfg and openjk.cfg can only be loaded outside of pk3 files.
+			const fileIndexEntry_t	*entry = isUserConfig ? NULL : FS_FindIndexedFile( filename );
+			const int				end = entry ? entry->search : fs_indexNumSearchPaths;
+
+			// only the directories ahead of that pak can have it first
+			for ( int i = 0 ; i < fs_indexNumDirs && fs_indexDirs[i] < end ; i++ ) {
+				len = FS_FOpenFileInDir( filename, fs_indexSearchPaths[fs_indexDirs[i]]->dir, file, &bFasterToReOpenUsingNewLocalFile );
+				if ( len >= 0 ) {
+					return len;
+				}
+				if ( bFasterToReOpenUsingNewLocalFile ) {
+					break;
+				}
+			}
+
+			if ( entry && !bFasterToReOpenUsingNewLocalFile ) {
+				return FS_FOpenFileInPak( filename, fs_indexSearchPaths[entry->search]->pack, entry->file, file, uniqueFILE );
+			}
+			continue;
+		}
+
 		for ( search = fs_searchpaths ; search ; search = search->next ) {
 			//
 			if ( search->pack ) {
@@ -1350,228 +2135,19 @@ long FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean unique
 					// case and separator insensitive comparisons
 					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
 						// found it!
-
-						// mark the pak as having been referenced and mark specifics on cgame and ui
-						// shaders, txt, arena files  by themselves do not count as a reference as
-						// these are loaded from all pk3s
-						// from every pk3 file..
-
-						// The x86.dll suffixes are needed in order for sv_pure to continue to
-						// work on non-x86/windows systems...
-
-						l = strlen( filename );
-						if ( !(pak->referenced & FS_GENERAL_REF)) {
-							if( !FS_IsExt(filename, ".shader", l) &&
-							    !FS_IsExt(filename, ".txt", l) &&
-							    !FS_IsExt(filename, ".str", l) &&
-							    !FS_IsExt(filename, ".cfg", l) &&
-							    !FS_IsExt(filename, ".config", l) &&
-							    !FS_IsExt(filename, ".bot", l) &&
-							    !FS_IsExt(filename, ".arena", l) &&
-							    !FS_IsExt(filename, ".menu", l) &&
-							    !FS_IsExt(filename, ".fcf", l) &&
-							    Q_stricmp(filename, "jampgamex86.dll") != 0 &&
-							    //Q_stricmp(filename, "vm/qagame.qvm") != 0 &&
-							    !strstr(filename, "levelshots"))
-							{
-								pak->referenced |= FS_GENERAL_REF;
-							}
-						}
-
-						if (!(pak->referenced & FS_CGAME_REF))
-						{
-							if ( Q_stricmp( filename, "cgame.qvm" ) == 0 ||
-									Q_stricmp( filename, "cgamex86.dll" ) == 0 )
-							{
-								pak->referenced |= FS_CGAME_REF;
-							}
-						}
-
-						if (!(pak->referenced & FS_UI_REF))
-						{
-							if ( Q_stricmp( filename, "ui.qvm" ) == 0 ||
-									Q_stricmp( filename, "uix86.dll" ) == 0 )
-							{
-								pak->referenced |= FS_UI_REF;
-							}
-						}
-
-						if ( uniqueFILE ) {
-							// open a new file on the pakfile
-							fsh[*file].handleFiles.file.z = unzOpen (pak->pakFilename);
-							if (fsh[*file].handleFiles.file.z == NULL) {
-								Com_Error (ERR_FATAL, "Couldn't open %s", pak->pakFilename);
-							}
-						} else {
-							fsh[*file].handleFiles.file.z = pak->handle;
-						}
-						Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-						fsh[*file].zipFile = qtrue;
-
-						// set the file position in the zip file (also sets the current file info)
-						unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
-
-						// open the file in the zip
-						unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
-
-#if 0
-						zfi = (unz_s *)fsh[*file].handleFiles.file.z;
-						// in case the file was new
-						temp = zfi->filestream;
-						// set the file position in the zip file (also sets the current file info)
-						unzSetOffset(pak->handle, pakFile->pos);
-						// copy the file info into the unzip structure
-						Com_Memcpy( zfi, pak->handle, sizeof(unz_s) );
-						// we copy this back into the structure
-						zfi->filestream = temp;
-						// open the file in the zip
-						unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
-#endif
-						fsh[*file].zipFilePos = pakFile->pos;
-						fsh[*file].zipFileLen = pakFile->len;
-
-						if ( fs_debug->integer ) {
-							Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n",
-								filename, pak->pakFilename );
-						}
-	#ifndef DEDICATED
-	#ifndef FINAL_BUILD
-						// Check for unprecached files when in game but not in the menus
-						if((cls.state == CA_ACTIVE) && !(Key_GetCatcher( ) & KEYCATCH_UI))
-						{
-							Com_Printf(S_COLOR_YELLOW "WARNING: File %s not precached\n", filename);
-						}
-	#endif
-	#endif // DEDICATED
-						return pakFile->len;
+						return FS_FOpenFileInPak( filename, pak, pakFile, file, uniqueFILE );
 					}
 					pakFile = pakFile->next;
 				} while(pakFile != NULL);
 			} else if ( search->dir ) {
 				// check a file in the directory tree
-
-				// if we are running restricted, the only files we
-				// will allow to come from the directory are .cfg files
-				l = strlen( filename );
-		  // FIXME TTimo I'm not sure about the fs_numServerPaks test
-		  // if you are using FS_ReadFile to find out if a file exists,
-		  //   this test can make the search fail although the file is in the directory
-		  // I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
-		  // turned out I used FS_FileExists instead
-				if ( fs_numServerPaks ) {
-					if ( !FS_IsExt( filename, ".cfg", l ) &&		// for config files
-					    !FS_IsExt( filename, ".fcf", l ) &&		// force configuration files
-					    !FS_IsExt( filename, ".menu", l ) &&		// menu files
-					    !FS_IsExt( filename, ".game", l ) &&		// menu files
-					    !FS_IsExt( filename, ".dat", l ) &&		// for journal files
-					    !FS_IsDemoExt( filename, l ) ) {			// demos
-						continue;
-					}
+				len = FS_FOpenFileInDir( filename, search->dir, file, &bFasterToReOpenUsingNewLocalFile );
+				if ( len >= 0 ) {
+					return len;
 				}
-
-				dir = search->dir;
-
-				netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-				fsh[*file].handleFiles.file.o = fopen (netpath, "rb");
-				if ( !fsh[*file].handleFiles.file.o ) {
-					continue;
-				}
-
-				if ( !FS_IsExt( filename, ".cfg", l ) &&		// for config files
-					!FS_IsExt( filename, ".fcf", l ) &&		// force configuration files
-					!FS_IsExt( filename, ".menu", l ) &&		// menu files
-					!FS_IsExt( filename, ".game", l ) &&		// menu files
-					!FS_IsExt( filename, ".dat", l ) &&		// for journal files
-					!FS_IsDemoExt( filename, l ) ) {			// demos
-					fs_fakeChkSum = Q_flrand(0.0f, 1.0f);
-				}
-#ifdef _WIN32
-				// if running with fs_copyfiles 2, and search path == local, then we need to fail to open
-				//	if the time/date stamp != the network version (so it'll loop round again and use the network path,
-				//	which comes later in the search order)
-				//
-				if ( fs_copyfiles->integer == 2 && fs_cdpath->string[0] && !Q_stricmp( dir->path, fs_basepath->string )
-					&& FS_FileCacheable(filename) )
-				{
-					if ( Sys_FileOutOfDate( netpath, FS_BuildOSPath( fs_cdpath->string, dir->gamedir, filename ) ))
-					{
-						fclose(fsh[*file].handleFiles.file.o);
-						fsh[*file].handleFiles.file.o = 0;
-						continue;	//carry on to find the cdpath version.
-					}
-				}
-#endif
-				Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-				fsh[*file].zipFile = qfalse;
-				if ( fs_debug->integer ) {
-					Com_Printf( "FS_FOpenFileRead: %s (found in '%s%c%s')\n", filename,
-						dir->path, PATH_SEP, dir->gamedir );
-				}
-
-#ifdef _WIN32
-				// if we are getting it from the cdpath, optionally copy it
-				//  to the basepath
-				if ( fs_copyfiles->integer && !Q_stricmp( dir->path, fs_cdpath->string ) ) {
-					char	*copypath;
-
-					copypath = FS_BuildOSPath( fs_basepath->string, dir->gamedir, filename );
-					switch ( fs_copyfiles->integer )
-					{
-						default:
-						case 1:
-						{
-							FS_CopyFile( netpath, copypath );
-						}
-						break;
-
-						case 2:
-						{
-
-							if (FS_FileCacheable(filename) )
-							{
-								// maybe change this to Com_DPrintf?   On the other hand...
-								//
-								Com_Printf( "fs_copyfiles(2), Copying: %s to %s\n", netpath, copypath );
-
-								FS_CreatePath( copypath );
-
-								bool bOk = true;
-								if (!CopyFile( netpath, copypath, FALSE ))
-								{
-									DWORD dwAttrs = GetFileAttributes(copypath);
-									SetFileAttributes(copypath, dwAttrs & ~FILE_ATTRIBUTE_READONLY);
-									bOk = !!CopyFile( netpath, copypath, FALSE );
-								}
-
-								if (bOk)
-								{
-									// clear this handle and setup for re-opening of the new local copy...
-									//
-									bFasterToReOpenUsingNewLocalFile = qtrue;
-									fclose(fsh[*file].handleFiles.file.o);
-									fsh[*file].handleFiles.file.o = NULL;
-								}
-							}
-						}
-						break;
-					}
-				}
-#endif
-				if (bFasterToReOpenUsingNewLocalFile)
-				{
-					break;	// and re-read the local copy, not the net version
-				}
-
-	#ifndef DEDICATED
-	#ifndef FINAL_BUILD
-				// Check for unprecached files when in game but not in the menus
-				if((cls.state == CA_ACTIVE) && !(Key_GetCatcher( ) & KEYCATCH_UI))
-				{
-					Com_Printf(S_COLOR_YELLOW "WARNING: File %s not precached\n", filename);
+				if ( bFasterToReOpenUsingNewLocalFile ) {
+					break;
 				}
-	#endif
-	#endif // dedicated
-				return FS_fplength(fsh[*file].handleFiles.file.o);
 			}
 		}
 	}
@@ -1656,6 +2232,8 @@ int FS_Read( void *buffer, int len, fileHandle_t f ) {
 			buf += read;
 		}
 		return len;
+	} else if (fsh[f].zipMapped) {
+		return FS_ReadMappedFile(buffer, len, f);
 	} else {
 		return unzReadCurrentFile(fsh[f].handleFiles.file.z, buffer, len);
 	}
@@ -1772,13 +2350,26 @@ int FS_Seek( fileHandle_t f, long offset, int origin ) {
 			}
 		}
 
+		// stored entries in a mapped pak can go anywhere directly
+		if ( fsh[f].zipMapped && !fsh[f].zipStream && ( origin == FS_SEEK_SET || origin == FS_SEEK_CUR || origin == FS_SEEK_END ) ) {
+			if ( origin != FS_SEEK_SET ) {
+				remainder += currentPosition;
+			}
+			fsh[f].zipReadPos = Q_min( remainder, fsh[f].zipFileLen );
+			return offset;
+		}
+
 		switch( origin ) {
 			case FS_SEEK_SET:
 				if ( remainder == currentPosition ) {
 					return offset;
 				}
-				unzSetOffset(fsh[f].handleFiles.file.z, fsh[f].zipFilePos);
-				unzOpenCurrentFile(fsh[f].handleFiles.file.z);
+				if ( fsh[f].zipMapped ) {
+					FS_RewindMappedFile( f );
+				} else {
+					unzSetOffset(fsh[f].handleFiles.file.z, fsh[f].zipFilePos);
+					unzOpenCurrentFile(fsh[f].handleFiles.file.z);
+				}
 				//fallthrough
 
 			case FS_SEEK_END:
@@ -1849,6 +2440,18 @@ int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 		return -1;
 	}
 
+	if ( fs_indexSearchPaths ) {
+		const fileIndexEntry_t *entry = FS_FindIndexedFile( filename );
+
+		if ( !entry ) {
+			return -1;
+		}
+		if ( pChecksum ) {
+			*pChecksum = fs_indexSearchPaths[entry->search]->pack->pure_checksum;
+		}
+		return 1;
+	}
+
 	//
 	// search through the path, one element at a time
 	//
@@ -1999,6 +2602,55 @@ long FS_ReadFile( const char *qpath, void **buffer ) {
 	return len;
 }
 
+/*
+============
+FS_ReadFileMapped
+
+Loads a file the way FS_ReadFile does, except that files stored
+uncompressed in a mapped pk3 aren't copied at all
+============
+*/
+long FS_ReadFileMapped( const char *qpath, const void **buffer ) {
+	fileHandle_t	h;
+	byte			*buf;
+	long			len;
+
+	FS_AssertInitialised();
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileMapped with empty name\n" );
+	}
+
+	// config files may come from the journal, which FS_ReadFile deals with
+	if ( !buffer || strstr( qpath, ".cfg" ) ) {
+		return FS_ReadFile( qpath, (void **)buffer );
+	}
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		*buffer = NULL;
+		return -1;
+	}
+
+	fs_loadCount++;
+
+	if ( fsh[h].zipMapped && !fsh[h].zipStream ) {
+		*buffer = fsh[h].handleFiles.file.m;
+		fs_mappedBuffers[*buffer]++;
+		fs_readCount += len;
+		FS_FCloseFile( h );
+		return len;
+	}
+
+	buf = (byte *)Z_Malloc( len+1, TAG_FILESYS, qfalse );
+	FS_Read( buf, len, h );
+	buf[len] = 0;
+	FS_FCloseFile( h );
+
+	*buffer = buf;
+	return len;
+}
+
 /*
 =============
 FS_FreeFile
@@ -2010,6 +2662,18 @@ void FS_FreeFile( void *buffer ) {
 		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
 	}
 
+	// FS_ReadFileMapped may have handed out the mapping itself
+	if ( !fs_mappedBuffers.empty() ) {
+		auto it = fs_mappedBuffers.find( buffer );
+
+		if ( it != fs_mappedBuffers.end() ) {
+			if ( !--it->second ) {
+				fs_mappedBuffers.erase( it );
+			}
+			return;
+		}
+	}
+
 	Z_Free( buffer );
 }
 
@@ -2048,6 +2712,47 @@ ZIP FILE LOADING
 ==========================================================================
 */
 
+/*
+=================
+FS_MapZipFile
+
+Maps the whole pk3 so its files can be read without minizip.  The zip
+offsets are relative to the end of central directory record, so find it
+the way minizip does to know how much is in front of the zip.
+=================
+*/
+static void FS_MapZipFile( pack_t *pack )
+{
+	const byte		*mapped;
+	size_t			length, eocd, stop;
+	unsigned int	centralLen, centralPos;
+
+	mapped = (const byte *)Sys_MapFile( pack->pakFilename, &length );
+	if ( !mapped ) {
+		return;
+	}
+
+	if ( length >= 22 ) {
+		// the record ends the file, unless the zip has a comment
+		stop = length > 22 + 0xffff ? length - 22 - 0xffff : 0;
+		for ( eocd = length - 22 ; eocd > stop && FS_ZipLong( mapped + eocd ) != 0x06054b50 ; eocd-- ) {
+		}
+
+		if ( FS_ZipLong( mapped + eocd ) == 0x06054b50 ) {
+			centralLen = FS_ZipLong( mapped + eocd + 12 );
+			centralPos = FS_ZipLong( mapped + eocd + 16 );
+			if ( centralPos != 0xffffffff && (size_t)centralPos + centralLen <= eocd ) {
+				pack->mapped = mapped;
+				pack->mappedLength = length;
+				pack->mappedBase = eocd - centralPos - centralLen;
+				return;
+			}
+		}
+	}
+
+	Sys_UnmapFile( (void *)mapped, length );
+}
+
 /*
 =================
 FS_LoadZipFile
@@ -2122,6 +2827,7 @@ static pack_t *FS_LoadZipFile( const char *zipfile, const char *basename )
 
 	pack->handle = uf;
 	pack->numfiles = gi.number_entry;
+	FS_MapZipFile( pack );
 	unzGoToFirstFile(uf);
 
 	for (i = 0; i < gi.number_entry; i++)
@@ -2168,6 +2874,20 @@ Frees a pak structure and releases all associated resources
 void FS_FreePak(pack_t *thepak)
 {
 	unzClose(thepak->handle);
+
+	// anything still out of the mapping is gone with it, and its address may come back from Z_Malloc
+	if (thepak->mapped) {
+		for (auto it = fs_mappedBuffers.begin(); it != fs_mappedBuffers.end(); ) {
+			const byte *mapped = (const byte *)it->first;
+
+			if (mapped >= thepak->mapped && mapped < thepak->mapped + thepak->mappedLength) {
+				it = fs_mappedBuffers.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+	Sys_UnmapFile((void *)thepak->mapped, thepak->mappedLength);
 	Z_Free(thepak->buildBuffer);
 	Z_Free(thepak);
 }
@@ -2276,6 +2996,8 @@ char **FS_ListFilteredFiles( const char *path, const char *extension, char *filt
 	pack_t			*pak;
 	fileInPack_t	*buildBuffer;
 	char			zpath[MAX_ZPATH];
+	int				s;
+	std::vector<int>	pathFiles;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
@@ -2300,7 +3022,7 @@ char **FS_ListFilteredFiles( const char *path, const char *extension, char *filt
 	//
 	// search through the path, one element at a time, adding to list
 	//
-	for (search = fs_searchpaths ; search ; search = search->next) {
+	for (search = fs_searchpaths, s = 0 ; search ; search = search->next, s++) {
 		// is the element a pak file?
 		if (search->pack) {
 
@@ -2313,10 +3035,20 @@ char **FS_ListFilteredFiles( const char *path, const char *extension, char *filt
 			// look through all the pak file elements
 			pak = search->pack;
 			buildBuffer = pak->buildBuffer;
-			for (i = 0; i < pak->numfiles; i++) {
+
+			// only the files under path can match without a filter
+			const bool indexed = !filter && fs_indexSearchPaths;
+			if ( indexed ) {
+				FS_IndexedFilesInPath( s, path, pathLength, pathFiles );
+			}
+
+			const int count = indexed ? (int)pathFiles.size() : pak->numfiles;
+			for (int j = 0; j < count; j++) {
 				char	*name;
 				int		zpathLen, depth;
 
+				i = indexed ? pathFiles[j] : j;
+
 				// check for directory match
 				name = buildBuffer[i].name;
 				//
@@ -3250,6 +3982,8 @@ void FS_Shutdown( qboolean closemfp ) {
 	}
 
 	// free everything
+	FS_FreeFileIndex();
+
 	for ( p = fs_searchpaths ; p ; p = next ) {
 		next = p->next;
 
@@ -3484,6 +4218,8 @@ void FS_Startup( const char *gameName ) {
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks();
 
+	FS_BuildFileIndex();
+
 	// print the current search paths
 	FS_Path_f();
 
@@ -3809,6 +4545,7 @@ void FS_PureServerSetLoadedPaks( const char *pakSums, const char *pakNames ) {
 	for ( i = 0 ; i < c ; i++ ) {
 		fs_serverPaks[i] = atoi( Cmd_Argv( i ) );
 	}
+	fs_serverPaksGeneration++;
 
 	if (fs_numServerPaks) {
 		Com_DPrintf( "Connected to a pure server.\n" );
@@ -4094,7 +4831,9 @@ int		FS_FOpenFileByMode( const char *qpath, fileHandle_t *f, fsMode_t mode ) {
 
 int		FS_FTell( fileHandle_t f ) {
 	int pos;
-	if (fsh[f].zipFile == qtrue) {
+	if (fsh[f].zipMapped == qtrue) {
+		pos = fsh[f].zipReadPos;
+	} else if (fsh[f].zipFile == qtrue) {
 		pos = unztell(fsh[f].handleFiles.file.z);
 	} else {
 		pos = ftell(fsh[f].handleFiles.file.o);
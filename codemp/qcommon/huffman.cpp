@@ -29,23 +29,22 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 static int			bloc = 0;
 
+// the offset variants below are used by the msg_t bit stream and keep
+// their position in the caller's offset rather than in bloc, so messages
+// for different clients can be encoded on different threads
 void	Huff_putBit( int bit, byte *fout, int *offset) {
-	bloc = *offset;
-	if ((bloc&7) == 0) {
-		fout[(bloc>>3)] = 0;
+	int loc = *offset;
+	if ((loc&7) == 0) {
+		fout[(loc>>3)] = 0;
 	}
-	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
-	*offset = bloc;
+	fout[(loc>>3)] |= bit << (loc&7);
+	*offset = loc + 1;
 }
 
 int		Huff_getBit( byte *fin, int *offset) {
-	int t;
-	bloc = *offset;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
-	*offset = bloc;
-	return t;
+	int loc = *offset;
+	*offset = loc + 1;
+	return (fin[(loc>>3)] >> (loc&7)) & 0x1;
 }
 
 /* Add a bit to the output file (buffered) */
@@ -270,13 +269,14 @@ int Huff_Receive (node_t *node, int *ch, byte *fin) {
 
 /* Get a symbol */
 void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
-	bloc = *offset;
+	int loc = *offset;
 	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
+		if ((fin[(loc>>3)] >> (loc&7)) & 0x1) {
 			node = node->right;
 		} else {
 			node = node->left;
 		}
+		loc++;
 	}
 	if (!node) {
 		*ch = 0;
@@ -284,7 +284,7 @@ void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
 //		Com_Error(ERR_DROP, "Illegal tree!\n");
 	}
 	*ch = node->symbol;
-	*offset = bloc;
+	*offset = loc;
 }
 
 /* Send the prefix code for this node */
@@ -315,10 +315,160 @@ void Huff_transmit (huff_t *huff, int ch, byte *fout) {
 	}
 }
 
+/* Send the prefix code for this node, tracking the position in offset */
+static void offsetSend(node_t *node, node_t *child, byte *fout, int *offset) {
+	if (node->parent) {
+		offsetSend(node->parent, node, fout, offset);
+	}
+	if (child) {
+		Huff_putBit(node->right == child ? 1 : 0, fout, offset);
+	}
+}
+
 void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset) {
-	bloc = *offset;
-	send(huff->loc[ch], NULL, fout);
-	*offset = bloc;
+	offsetSend(huff->loc[ch], NULL, fout, offset);
+}
+
+/* Write up to 32 bits, first bit in bit 0 of value */
+void Huff_putBits( unsigned int value, int bits, byte *fout, int *offset ) {
+	int loc = *offset;
+	int shift, n;
+
+	while (bits > 0) {
+		shift = loc&7;
+		if (shift == 0) {
+			fout[(loc>>3)] = 0;
+		}
+		n = 8 - shift;
+		if (n > bits) {
+			n = bits;
+		}
+		fout[(loc>>3)] |= (byte)((value & ((1u<<n)-1)) << shift);
+		value >>= n;
+		loc += n;
+		bits -= n;
+	}
+	*offset = loc;
+}
+
+/* Read up to 32 bits, first bit in bit 0 of the result */
+unsigned int Huff_getBits( byte *fin, int bits, int *offset ) {
+	int loc = *offset;
+	unsigned int value = 0;
+	int shift, n, got = 0;
+
+	while (got < bits) {
+		shift = loc&7;
+		n = 8 - shift;
+		if (n > bits - got) {
+			n = bits - got;
+		}
+		value |= (unsigned int)((fin[(loc>>3)] >> shift) & ((1u<<n)-1)) << got;
+		loc += n;
+		got += n;
+	}
+	*offset = loc;
+	return value;
+}
+
+/*
+ * Table driven coding for trees that don't change anymore, like the msg_t one.
+ * The codes are exactly the ones the tree walks above produce, they are just
+ * looked up instead: a symbol is sent as one precomputed code, and received
+ * by looking up the next HUFF_LOOKUP_BITS bits, walking the tree only for the
+ * rare codes that are longer than that.
+ */
+void Huff_BuildTables( huff_t *huff, huffTables_t *tables ) {
+	node_t			*node, *child;
+	huffLookup_t	*entry;
+	unsigned int	code;
+	int				ch, len, i;
+
+	Com_Memset(tables, 0, sizeof(*tables));
+	tables->huff = huff;
+
+	for (ch = 0; ch <= HMAX; ch++) {
+		if (!huff->loc[ch]) {
+			continue;
+		}
+		// collect the code from the leaf up, so the first bit sent ends up in bit 0
+		code = 0;
+		len = 0;
+		for (child = huff->loc[ch], node = child->parent; node; child = node, node = node->parent) {
+			if (len == 32) {
+				break;
+			}
+			code = (code << 1) | (node->right == child ? 1 : 0);
+			len++;
+		}
+		if (node) {
+			continue;	// too long, leave it to the tree
+		}
+		tables->code[ch] = code;
+		tables->codeLength[ch] = len;
+	}
+
+	for (i = 0; i < (1<<HUFF_LOOKUP_BITS); i++) {
+		entry = &tables->lookup[i];
+		node = huff->tree;
+		for (len = 0; node && node->symbol == INTERNAL_NODE && len < HUFF_LOOKUP_BITS; len++) {
+			node = ((i >> len) & 1) ? node->right : node->left;
+		}
+		if (!node) {
+			entry->symbol = -1;
+		} else if (node->symbol == INTERNAL_NODE) {
+			entry->node = node;
+			entry->length = len;
+		} else {
+			entry->symbol = node->symbol;
+			entry->length = len;
+		}
+	}
+}
+
+void Huff_tableTransmit( const huffTables_t *tables, int ch, byte *fout, int *offset ) {
+	if (!tables->codeLength[ch]) {
+		Huff_offsetTransmit(tables->huff, ch, fout, offset);
+		return;
+	}
+	Huff_putBits(tables->code[ch], tables->codeLength[ch], fout, offset);
+}
+
+/* maxBytes is the size of fin, so looking ahead doesn't read past it */
+void Huff_tableReceive( const huffTables_t *tables, int *ch, byte *fin, int maxBytes, int *offset ) {
+	const huffLookup_t	*entry;
+	int					loc = *offset;
+	int					byteNum = loc>>3;
+	unsigned int		peek;
+
+	if (byteNum + 2 < maxBytes) {
+		peek = fin[byteNum] | (fin[byteNum+1] << 8) | (fin[byteNum+2] << 16);
+	} else {
+		peek = 0;
+		if (byteNum < maxBytes) {
+			peek |= fin[byteNum];
+		}
+		if (byteNum + 1 < maxBytes) {
+			peek |= fin[byteNum+1] << 8;
+		}
+	}
+	entry = &tables->lookup[(peek >> (loc&7)) & ((1<<HUFF_LOOKUP_BITS)-1)];
+
+	if (entry->node) {
+		// an illegal tree leaves the offset where it was, like the tree walk does
+		int next = loc + entry->length;
+		Huff_offsetReceive(entry->node, ch, fin, &next);
+		if (next != loc + entry->length) {
+			*offset = next;
+		}
+		return;
+	}
+	if (entry->symbol < 0) {
+		*ch = 0;
+		return;
+	}
+	*ch = entry->symbol;
+	*offset = loc + entry->length;
 }
 
 void Huff_Decompress(msg_t *mbuf, int offset) {
@@ -373,8 +523,6 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern 	int oldsize;
-
 void Huff_Compress(msg_t *mbuf, int offset) {
 	int			i, ch, size;
 	byte		seq[65536];
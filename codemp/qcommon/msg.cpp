@@ -26,10 +26,13 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "qcommon/qcommon.h"
 #include "server/server.h"
 
+#include <atomic>
+
 //#define _NEWHUFFTABLE_		// Build "c:\\netchan.bin"
 //#define _USINGNEWHUFFTABLE_		// Build a new frequency table to cut and paste.
 
 static huffman_t		msgHuff;
+static huffTables_t		msgHuffTables;	// built from msgHuff once it's loaded
 
 static qboolean			msgInit = qfalse;
 #ifdef _NEWHUFFTABLE_
@@ -45,11 +48,12 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
+// per thread, as the server encodes snapshots on several threads at once
 #ifndef FINAL_BUILD
-	int gLastBitIndex = 0;
+	static thread_local int gLastBitIndex = 0;
 #endif
 
-int oldsize = 0;
+static thread_local int oldsize = 0;
 
 bool g_nOverrideChecked = false;
 void MSG_CheckNETFPSFOverrides(qboolean psfOverrides);
@@ -131,7 +135,7 @@ bit functions
 =============================================================================
 */
 
-int	overflows;
+static thread_local int	overflows;
 
 // negative bit values include signs
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
@@ -197,10 +201,8 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 		if (bits&7) {
 			int nbits;
 			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				Huff_putBit((value&1), msg->data, &msg->bit);
-				value = (value>>1);
-			}
+			Huff_putBits(value, nbits, msg->data, &msg->bit);
+			value = (value>>nbits);
 			bits = bits - nbits;
 		}
 		if (bits) {
@@ -208,7 +210,7 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 #ifdef _NEWHUFFTABLE_
 				fwrite(&value, 1, 1, fp);
 #endif // _NEWHUFFTABLE_
-				Huff_offsetTransmit (&msgHuff.compressor, (value&0xff), msg->data, &msg->bit);
+				Huff_tableTransmit (&msgHuffTables, (value&0xff), msg->data, &msg->bit);
 				value = (value>>8);
 			}
 		}
@@ -216,6 +218,41 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	}
 }
 
+/*
+==================
+MSG_WriteBitstream
+
+Appends bits that were written to another bitstream message starting at
+bit 0. Huffman codes don't depend on where they start, so this gives the
+same result as repeating the writes that produced them. The caller is
+responsible for making sure they fit.
+==================
+*/
+void MSG_WriteBitstream( msg_t *msg, const byte *data, int bits ) {
+	int		i, shift, numBytes;
+	byte	*out;
+
+	assert( !msg->oob );
+
+	if ( bits <= 0 ) {
+		return;
+	}
+
+	shift = msg->bit & 7;
+	out = msg->data + ( msg->bit >> 3 );
+	numBytes = ( bits + 7 ) >> 3;
+	if ( !shift ) {
+		Com_Memcpy( out, data, numBytes );
+	} else {
+		for ( i = 0 ; i < numBytes ; i++ ) {
+			out[i] |= data[i] << shift;
+			out[i + 1] = data[i] >> ( 8 - shift );
+		}
+	}
+	msg->bit += bits;
+	msg->cursize = ( msg->bit >> 3 ) + 1;
+}
+
 int MSG_ReadBits( msg_t *msg, int bits ) {
 	int			value;
 	int			get;
@@ -253,14 +290,12 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		nbits = 0;
 		if (bits&7) {
 			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				value |= (Huff_getBit(msg->data, &msg->bit)<<i);
-			}
+			value = Huff_getBits(msg->data, nbits, &msg->bit);
 			bits = bits - nbits;
 		}
 		if (bits) {
 			for(i=0;i<bits;i+=8) {
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				Huff_tableReceive (&msgHuffTables, &get, msg->data, msg->maxsize, &msg->bit);
 #ifdef _NEWHUFFTABLE_
 				fwrite(&get, 1, 1, fp);
 #endif // _NEWHUFFTABLE_
@@ -788,7 +823,7 @@ typedef struct netField_s {
 	size_t	offset;
 	int		bits;		// 0 = float
 #ifndef FINAL_BUILD
-	unsigned	mCount;
+	std::atomic<unsigned>	mCount;		// bumped by every thread that encodes deltas
 #endif
 } netField_t;
 
@@ -1045,7 +1080,7 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 		if ( *fromF != *toF ) {
 			lc = i+1;
 #ifndef FINAL_BUILD
-			field->mCount++;
+			field->mCount.fetch_add( 1, std::memory_order_relaxed );
 #endif
 		}
 	}
@@ -2120,7 +2155,7 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 		if ( *fromF != *toF ) {
 			lc = i+1;
 #ifndef FINAL_BUILD
-			field->mCount++;
+			field->mCount.fetch_add( 1, std::memory_order_relaxed );
 #endif
 		}
 	}
@@ -3043,6 +3078,7 @@ void MSG_initHuffman() {
 			Huff_addRef(&msgHuff.decompressor,	(byte)i);			// Do update
 		}
 	}
+	Huff_BuildTables(&msgHuff.decompressor, &msgHuffTables);
 }
 
 #else
@@ -3077,6 +3113,7 @@ void MSG_initHuffman() {
 		Com_Printf("%d,			// %d\n", array[i], i);
 	}
 	Com_Printf("};\n");
+	Huff_BuildTables(&msgHuff.decompressor, &msgHuffTables);
 	FS_FreeFile( data );
 	Cbuf_AddText( "condump dump.txt\n" );
 }
@@ -3110,16 +3147,14 @@ void MSG_ReportChangeVectors_f( void ) {
 	Com_Printf("Entity State Fields:\n");
 	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ )
 	{
-		Com_Printf("%s\t\t%d\n", field->name, field->mCount);
-		field->mCount = 0;
+		Com_Printf("%s\t\t%u\n", field->name, field->mCount.exchange( 0 ));
 	}
 
 	Com_Printf("\nPlayer State Fields:\n");
 	numFields = (int)ARRAY_LEN( playerStateFields );
 	for ( i = 0, field = playerStateFields ; i < numFields ; i++, field++ )
 	{
-		Com_Printf("%s\t\t%d\n", field->name, field->mCount);
-		field->mCount = 0;
+		Com_Printf("%s\t\t%u\n", field->name, field->mCount.exchange( 0 ));
 	}
 
 }
@@ -78,6 +78,11 @@ typedef int SOCKET;
 #define ioctlsocket                                ioctl
 #define socketError                                errno
 
+#ifdef __linux__
+	// recvmmsg/sendmmsg move a whole batch of datagrams per syscall
+	#define NET_MMSG
+#endif
+
 #endif
 
 static qboolean usingSocks = qfalse;
@@ -97,6 +102,24 @@ static cvar_t	*net_port;
 
 static cvar_t	*net_dropsim;
 
+#ifdef NET_MMSG
+static cvar_t	*net_batchPackets;
+
+#define	NET_MMSG_BATCH		64		// datagrams per recvmmsg/sendmmsg call
+#define	NET_MMSG_PACKETLEN	1500	// larger datagrams are sent on their own
+
+typedef struct {
+	byte				data[NET_MMSG_PACKETLEN];
+	int					length;
+	struct sockaddr_in	addr;
+	qboolean			broadcast;
+} queuedPacket_t;
+
+static qboolean			sendBatchActive;
+static int				numQueuedPackets;
+static queuedPacket_t	queuedPackets[NET_MMSG_BATCH];
+#endif
+
 static struct sockaddr_in	socksRelayAddr;
 
 static SOCKET	ip_socket = INVALID_SOCKET;
@@ -236,6 +259,43 @@ qboolean Sys_StringToAdr( const char *s, netadr_t *a ) {
 
 //=============================================================================
 
+/*
+==================
+NET_FinishPacket
+
+Sets up a received datagram for parsing, unwrapping it if it came
+through the socks relay
+==================
+*/
+static qboolean NET_FinishPacket( struct sockaddr_in *from, socklen_t fromlen, int ret, netadr_t *net_from, msg_t *net_message ) {
+	memset( from->sin_zero, 0, 8 );
+
+	if ( usingSocks && memcmp( from, &socksRelayAddr, fromlen ) == 0 ) {
+		if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
+			return qfalse;
+		}
+		net_from->type = NA_IP;
+		net_from->ip[0] = net_message->data[4];
+		net_from->ip[1] = net_message->data[5];
+		net_from->ip[2] = net_message->data[6];
+		net_from->ip[3] = net_message->data[7];
+		memcpy( &net_from->port, &net_message->data[8], 2 );
+		net_message->readcount = 10;
+	}
+	else {
+		SockadrToNetadr( from, net_from );
+		net_message->readcount = 0;
+	}
+
+	if( ret >= net_message->maxsize ) {
+		Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
+		return qfalse;
+	}
+
+	net_message->cursize = ret;
+	return qtrue;
+}
+
 /*
 ==================
 NET_GetPacket
@@ -272,38 +332,160 @@ qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, fd_set *fdr ) {
 		return qfalse;
 	}
 
-	memset( from.sin_zero, 0, 8 );
+	return NET_FinishPacket( &from, fromlen, ret, net_from, net_message );
+}
+
+#ifdef NET_MMSG
+static byte					recvBuffers[NET_MMSG_BATCH][MAX_MSGLEN + 1];
+static struct sockaddr_in	recvAddrs[NET_MMSG_BATCH];
 
-	if ( usingSocks && memcmp( &from, &socksRelayAddr, fromlen ) == 0 ) {
-		if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
-			return qfalse;
-		}
-		net_from->type = NA_IP;
-		net_from->ip[0] = net_message->data[4];
-		net_from->ip[1] = net_message->data[5];
-		net_from->ip[2] = net_message->data[6];
-		net_from->ip[3] = net_message->data[7];
-		memcpy( &net_from->port, &net_message->data[8], 2 );
-		net_message->readcount = 10;
+/*
+==================
+NET_GetPacketBatch
+
+Receive up to NET_MMSG_BATCH packets with one recvmmsg.  Returns the number
+of datagrams read from the socket, the packets that survive
+NET_FinishPacket are stored in net_from/net_messages and counted in
+*numPackets.
+==================
+*/
+static int NET_GetPacketBatch( netadr_t *net_from, msg_t *net_messages, int *numPackets, fd_set *fdr ) {
+	struct mmsghdr	hdrs[NET_MMSG_BATCH];
+	struct iovec	iov[NET_MMSG_BATCH];
+	int				i, ret, err;
+
+	*numPackets = 0;
+
+	if ( ip_socket == INVALID_SOCKET || !FD_ISSET(ip_socket, fdr) ) {
+		return 0;
 	}
-	else {
-		SockadrToNetadr( &from, net_from );
-		net_message->readcount = 0;
+
+	memset( hdrs, 0, sizeof( hdrs ) );
+	for ( i = 0 ; i < NET_MMSG_BATCH ; i++ ) {
+		iov[i].iov_base = recvBuffers[i];
+		iov[i].iov_len = sizeof( recvBuffers[i] );
+		hdrs[i].msg_hdr.msg_name = &recvAddrs[i];
+		hdrs[i].msg_hdr.msg_namelen = sizeof( recvAddrs[i] );
+		hdrs[i].msg_hdr.msg_iov = &iov[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
 	}
 
-	if( ret >= net_message->maxsize ) {
-		Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
-		return qfalse;
+#ifdef _DEBUG
+	recvfromCount++;		// performance check
+#endif
+	ret = recvmmsg( ip_socket, hdrs, NET_MMSG_BATCH, MSG_DONTWAIT, NULL );
+
+	if ( ret == SOCKET_ERROR ) {
+		err = socketError;
+
+		if( err == EAGAIN || err == ECONNRESET )
+			return 0;
+
+		Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
+		return 0;
 	}
 
-	net_message->cursize = ret;
-	return qtrue;
+	for ( i = 0 ; i < ret ; i++ ) {
+		msg_t *net_message = &net_messages[*numPackets];
+
+		MSG_Init( net_message, recvBuffers[i], sizeof( recvBuffers[i] ) );
+		if ( NET_FinishPacket( &recvAddrs[i], hdrs[i].msg_hdr.msg_namelen, hdrs[i].msg_len, &net_from[*numPackets], net_message ) ) {
+			(*numPackets)++;
+		}
+	}
+
+	return ret;
 }
+#endif
 
 //=============================================================================
 
 static char socksBuf[4096];
 
+/*
+==================
+NET_SendError
+==================
+*/
+static void NET_SendError( qboolean broadcast ) {
+	int err = socketError;
+
+	// wouldblock is silent
+	if( err == EAGAIN ) {
+		return;
+	}
+
+	// some PPP links do not allow broadcasts and return an error
+	if( err == EADDRNOTAVAIL && broadcast ) {
+		return;
+	}
+
+	Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+}
+
+/*
+==================
+NET_BeginSendBatch
+
+Packets sent until the next NET_FlushSendBatch are queued and handed to
+the kernel together.  Anything still queued is flushed by NET_Sleep, so
+an error thrown in between can't strand packets.
+==================
+*/
+void NET_BeginSendBatch( void ) {
+#ifdef NET_MMSG
+	sendBatchActive = net_batchPackets && net_batchPackets->integer ? qtrue : qfalse;
+#endif
+}
+
+/*
+==================
+NET_FlushSendBatch
+==================
+*/
+void NET_FlushSendBatch( void ) {
+#ifdef NET_MMSG
+	struct mmsghdr	hdrs[NET_MMSG_BATCH];
+	struct iovec	iov[NET_MMSG_BATCH];
+	int				i, ret, sent;
+
+	sendBatchActive = qfalse;
+
+	if ( !numQueuedPackets ) {
+		return;
+	}
+
+	if ( ip_socket == INVALID_SOCKET ) {
+		numQueuedPackets = 0;
+		return;
+	}
+
+	memset( hdrs, 0, numQueuedPackets * sizeof( hdrs[0] ) );
+	for ( i = 0 ; i < numQueuedPackets ; i++ ) {
+		iov[i].iov_base = queuedPackets[i].data;
+		iov[i].iov_len = queuedPackets[i].length;
+		hdrs[i].msg_hdr.msg_name = &queuedPackets[i].addr;
+		hdrs[i].msg_hdr.msg_namelen = sizeof( queuedPackets[i].addr );
+		hdrs[i].msg_hdr.msg_iov = &iov[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	// sendmmsg stops at the first datagram that fails, so report that one
+	// the way sendto would have and carry on with the rest
+	for ( sent = 0 ; sent < numQueuedPackets ; ) {
+		ret = sendmmsg( ip_socket, hdrs + sent, numQueuedPackets - sent, 0 );
+		if ( ret == SOCKET_ERROR ) {
+			NET_SendError( queuedPackets[sent].broadcast );
+			sent++;
+		} else {
+			sent += ret;
+		}
+	}
+
+	numQueuedPackets = 0;
+#endif
+}
+
 /*
 ==================
 Sys_SendPacket
@@ -312,6 +494,7 @@ Sys_SendPacket
 void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 	int					ret;
 	struct sockaddr_in	addr;
+	struct sockaddr_in	*dest;
 
 	if ( to.type != NA_BROADCAST && to.type != NA_IP ) {
 		Com_Error( ERR_FATAL, "Sys_SendPacket: bad address type" );
@@ -323,6 +506,7 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 	}
 
 	NetadrToSockadr( &to, &addr );
+	dest = &addr;
 
 	if( usingSocks && to.type == NA_IP ) {
 		socksBuf[0] = 0;	// reserved
@@ -332,25 +516,35 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 		memcpy( &socksBuf[4], &addr.sin_addr, 4 );
 		memcpy( &socksBuf[8], &addr.sin_port, 2 );
 		memcpy( &socksBuf[10], data, length );
-		ret = sendto( ip_socket, socksBuf, length+10, 0, (sockaddr *)&socksRelayAddr, sizeof(socksRelayAddr) );
-	}
-	else {
-		ret = sendto( ip_socket, (const char *)data, length, 0, (sockaddr *)&addr, sizeof(addr) );
+		data = socksBuf;
+		length += 10;
+		dest = &socksRelayAddr;
 	}
-	if( ret == SOCKET_ERROR ) {
-		int err = socketError;
 
-		// wouldblock is silent
-		if( err == EAGAIN ) {
-			return;
+#ifdef NET_MMSG
+	if ( sendBatchActive ) {
+		queuedPacket_t *packet;
+
+		if ( numQueuedPackets == NET_MMSG_BATCH || length > NET_MMSG_PACKETLEN ) {
+			// keep the packets in order
+			NET_FlushSendBatch();
+			sendBatchActive = qtrue;
 		}
 
-		// some PPP links do not allow broadcasts and return an error
-		if( err == EADDRNOTAVAIL && to.type == NA_BROADCAST ) {
+		if ( length <= NET_MMSG_PACKETLEN ) {
+			packet = &queuedPackets[numQueuedPackets++];
+			memcpy( packet->data, data, length );
+			packet->length = length;
+			packet->addr = *dest;
+			packet->broadcast = ( to.type == NA_BROADCAST ) ? qtrue : qfalse;
 			return;
 		}
+	}
+#endif
 
-		Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+	ret = sendto( ip_socket, (const char *)data, length, 0, (sockaddr *)dest, sizeof(*dest) );
+	if( ret == SOCKET_ERROR ) {
+		NET_SendError( to.type == NA_BROADCAST ? qtrue : qfalse );
 	}
 }
 
@@ -893,6 +1087,10 @@ static qboolean NET_GetCvars( void ) {
 
 	net_dropsim = Cvar_Get( "net_dropsim", "", CVAR_TEMP);
 
+#ifdef NET_MMSG
+	net_batchPackets = Cvar_Get( "net_batchPackets", "1", CVAR_ARCHIVE, "Receive and send datagrams in batches with recvmmsg/sendmmsg" );
+#endif
+
 	return modified ? qtrue : qfalse;
 }
 
@@ -939,6 +1137,8 @@ void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if ( stop ) {
+		NET_FlushSendBatch();
+
 		if ( ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
@@ -995,6 +1195,26 @@ void NET_Shutdown( void ) {
 #endif
 }
 
+/*
+====================
+NET_DispatchPacket
+====================
+*/
+static void NET_DispatchPacket( netadr_t *from, msg_t *netmsg )
+{
+	if(net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f)
+	{
+		// com_dropsim->value percent of incoming packets get dropped.
+		if(rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value))
+			return;          // drop this packet
+	}
+
+	if(com_sv_running->integer)
+		Com_RunAndTimeServerPacket(from, netmsg);
+	else
+		CL_PacketEvent(*from, netmsg);
+}
+
 /*
 ====================
 NET_Event
@@ -1009,24 +1229,32 @@ void NET_Event(fd_set *fdr)
 	netadr_t from;
 	msg_t netmsg;
 
+#ifdef NET_MMSG
+	if(net_batchPackets->integer)
+	{
+		netadr_t batchFrom[NET_MMSG_BATCH];
+		msg_t batchMsgs[NET_MMSG_BATCH];
+		int i, numRead, numPackets;
+
+		// replies to a flood of queries go out batched as well
+		NET_BeginSendBatch();
+		do
+		{
+			numRead = NET_GetPacketBatch(batchFrom, batchMsgs, &numPackets, fdr);
+			for(i = 0; i < numPackets; i++)
+				NET_DispatchPacket(&batchFrom[i], &batchMsgs[i]);
+		} while(numRead == NET_MMSG_BATCH);
+		NET_FlushSendBatch();
+		return;
+	}
+#endif
+
 	while(1)
 	{
 		MSG_Init(&netmsg, bufData, sizeof(bufData));
 
 		if(NET_GetPacket(&from, &netmsg, fdr))
-		{
-			if(net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f)
-			{
-				// com_dropsim->value percent of incoming packets get dropped.
-				if(rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value))
-					continue;          // drop this packet
-			}
-
-			if(com_sv_running->integer)
-				Com_RunAndTimeServerPacket(&from, &netmsg);
-			else
-				CL_PacketEvent(from, &netmsg);
-		}
+			NET_DispatchPacket(&from, &netmsg);
 		else
 			break;
 	}
@@ -1048,6 +1276,9 @@ void NET_Sleep( int msec ) {
 	if (msec < 0)
 		msec = 0;
 
+	// don't sit on anything queued while we wait
+	NET_FlushSendBatch();
+
 	FD_ZERO(&fdset);
 	if (ip_socket != INVALID_SOCKET) {
 		FD_SET(ip_socket, &fdset); // network socket
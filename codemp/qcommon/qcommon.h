@@ -56,6 +56,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteBitstream( msg_t *msg, const byte *data, int bits );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -148,6 +149,8 @@ const char	*NET_AdrToString (netadr_t a);
 qboolean	NET_StringToAdr ( const char *s, netadr_t *a);
 qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, msg_t *net_message);
 void		NET_Sleep(int msec);
+void		NET_BeginSendBatch( void );
+void		NET_FlushSendBatch( void );
 
 void		Sys_SendPacket( int length, const void *data, netadr_t to );
 //Does NOT parse port numbers, only base addresses.
@@ -626,6 +629,9 @@ long		FS_FOpenFileRead( const char *qpath, fileHandle_t *file, qboolean uniqueFI
 int		FS_FileIsInPAK(const char *filename, int *pChecksum );
 // returns 1 if a file is in the PAK file, otherwise -1
 
+const char *FS_FileOrigin( fileHandle_t f );
+// the checksum of the pak an open file came from, or the size and modification time of a loose file
+
 qboolean FS_FindPureDLL(const char *name);
 
 int		FS_Write( const void *buffer, int len, fileHandle_t f );
@@ -644,11 +650,17 @@ long		FS_ReadFile( const char *qpath, void **buffer );
 // the buffer should be considered read-only, because it may be cached
 // for other uses.
 
+long		FS_ReadFileMapped( const char *qpath, const void **buffer );
+// like FS_ReadFile, but files stored uncompressed in a mapped pk3 come
+// back as pointers straight into the mapping.  Those are truly read-only,
+// have no trailing 0 and only stay valid until the file system restarts.
+// Free the buffer with FS_FreeFile either way.
+
 void	FS_ForceFlush( fileHandle_t f );
 // forces flush on files we're writing to.
 
 void	FS_FreeFile( void *buffer );
-// frees the memory returned by FS_ReadFile
+// frees the memory returned by FS_ReadFile or FS_ReadFileMapped
 
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
@@ -1038,6 +1050,22 @@ typedef struct huffman_s {
 	huff_t		decompressor;
 } huffman_t;
 
+#define HUFF_LOOKUP_BITS 11
+
+typedef struct huffLookup_s {
+	node_t		*node;		// code is longer than HUFF_LOOKUP_BITS, keep walking from here
+	short		symbol;		// -1 if the tree is illegal
+	byte		length;		// bits used
+} huffLookup_t;
+
+// lookup tables for a tree that isn't updated anymore
+typedef struct huffTables_s {
+	huff_t			*huff;
+	unsigned int	code[HMAX+1];		// first bit sent in bit 0
+	byte			codeLength[HMAX+1];	// 0 if the code has to be sent from the tree
+	huffLookup_t	lookup[1<<HUFF_LOOKUP_BITS];
+} huffTables_t;
+
 void	Huff_Compress(msg_t *buf, int offset);
 void	Huff_Decompress(msg_t *buf, int offset);
 void	Huff_Init(huffman_t *huff);
@@ -1048,6 +1076,11 @@ void	Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset);
 void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_putBit( int bit, byte *fout, int *offset);
 int		Huff_getBit( byte *fout, int *offset);
+void	Huff_putBits( unsigned int value, int bits, byte *fout, int *offset );
+unsigned int Huff_getBits( byte *fin, int bits, int *offset );
+void	Huff_BuildTables( huff_t *huff, huffTables_t *tables );
+void	Huff_tableTransmit( const huffTables_t *tables, int ch, byte *fout, int *offset );
+void	Huff_tableReceive( const huffTables_t *tables, int *ch, byte *fin, int maxBytes, int *offset );
 
 extern huffman_t clientHuffTables;
 
@@ -23,6 +23,10 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 // Created 3/13/03 by Brian Osman (VV) - Split Zone/Hunk from common
 
 #include "client/client.h" // hi i'm bad
+#include "qcommon/slab.h"
+
+#include <atomic>
+#include <mutex>
 
 ////////////////////////////////////////////////
 //
@@ -42,7 +46,10 @@ void CIN_CloseAllVideos();
 
 
 // This handles zone memory allocation.
-// It is a wrapper around malloc with a tag id and a magic number at the start
+// It is a wrapper around malloc with a tag id and a magic number at the start.
+// Blocks that fit in ZonePool (header and tail included) come from its size
+// classes instead, everything else from malloc. Which one a block came from
+// follows from its size, so nothing else is stored for it.
 
 #define ZONE_MAGIC			0x21436587
 
@@ -85,9 +92,36 @@ typedef struct zoneStats_s
 
 } zoneStats_t;
 
+// the live copy of zoneStats_t, updated without holding zoneMutex. Each total
+//	keeps a block count in its top 32 bits and their bytes in the bottom 32, so
+//	a block is counted with one atomic add per total rather than two.
+typedef struct zoneCounters_s
+{
+	std::atomic<int64_t>	iTotal;
+	std::atomic<int>		iPeak;
+
+	std::atomic<int64_t>	iTotalsPerTag[TAG_COUNT];
+
+} zoneCounters_t;
+
+static inline int64_t Zone_PackTotal(int iCount, int iSize)
+{
+	return ((int64_t)iCount << 32) + iSize;
+}
+
+static inline int Zone_TotalCount(int64_t iTotal)
+{
+	return (int)(iTotal >> 32);
+}
+
+static inline int Zone_TotalSize(int64_t iTotal)
+{
+	return (int)(iTotal & 0xffffffff);
+}
+
 typedef struct zone_s
 {
-	zoneStats_t				Stats;
+	zoneCounters_t			Stats;
 	zoneHeader_t			Header;
 } zone_t;
 
@@ -95,6 +129,47 @@ cvar_t	*com_validateZone;
 
 zone_t	TheZone = {};
 
+// guards TheZone's block list, blocks may be allocated and freed on any thread
+static std::mutex		zoneMutex;
+
+// where blocks of up to Q::SlabAllocator::maxSize bytes come from, header and tail included
+static Q::SlabAllocator	ZonePool;
+
+static inline bool Zone_IsPooled(int iRealSize)
+{
+	return iRealSize <= (int)Q::SlabAllocator::maxSize;
+}
+
+// adds iCount blocks totalling iSize bytes to eTag's stats, negative to take them away
+static void Zone_CountBlocks(memtag_t eTag, int iSize, int iCount)
+{
+	const int64_t iDelta = Zone_PackTotal(iCount, iSize);
+	TheZone.Stats.iTotalsPerTag[eTag].fetch_add(iDelta, std::memory_order_relaxed);
+
+	int iCurrent = Zone_TotalSize(TheZone.Stats.iTotal.fetch_add(iDelta, std::memory_order_relaxed)) + iSize;
+	int iPeak = TheZone.Stats.iPeak.load(std::memory_order_relaxed);
+	while (iCurrent > iPeak && !TheZone.Stats.iPeak.compare_exchange_weak(iPeak, iCurrent, std::memory_order_relaxed))
+	{
+	}
+}
+
+// takes zoneMutex, so the copy isn't made halfway through a Z_TagFree
+static void Zone_CopyStats(zoneStats_t *pStats)
+{
+	std::lock_guard<std::mutex> lock(zoneMutex);
+
+	int64_t iTotal = TheZone.Stats.iTotal.load(std::memory_order_relaxed);
+	pStats->iCount		= Zone_TotalCount(iTotal);
+	pStats->iCurrent	= Zone_TotalSize(iTotal);
+	pStats->iPeak		= TheZone.Stats.iPeak.load(std::memory_order_relaxed);
+	for (int i=0; i<TAG_COUNT; i++)
+	{
+		iTotal = TheZone.Stats.iTotalsPerTag[i].load(std::memory_order_relaxed);
+		pStats->iSizesPerTag	[i] = Zone_TotalSize(iTotal);
+		pStats->iCountsPerTag	[i] = Zone_TotalCount(iTotal);
+	}
+}
+
 
 // Scans through the linked list of mallocs and makes sure no data has been overwritten
 
@@ -105,6 +180,8 @@ void Z_Validate(void)
 		return;
 	}
 
+	std::lock_guard<std::mutex> lock(zoneMutex);
+
 	zoneHeader_t *pMemory = TheZone.Header.pNext;
 	while (pMemory)
 	{
@@ -195,7 +272,12 @@ void *Z_Malloc(int iSize, memtag_t eTag, qboolean bZeroit /* = qfalse */, int iU
 			Sys_Sleep(1000);	// sleep for a second, so Windows has a chance to shuffle mem to de-swiss-cheese it
 		}
 
-		if (bZeroit) {
+		if (Zone_IsPooled(iRealSize)) {
+			pMemory = (zoneHeader_t *) ZonePool.alloc( iRealSize );
+			if (pMemory && bZeroit) {
+				memset(pMemory, 0, iRealSize);
+			}
+		} else if (bZeroit) {
 			pMemory = (zoneHeader_t *) calloc ( iRealSize, 1 );
 		} else {
 			pMemory = (zoneHeader_t *) malloc ( iRealSize );
@@ -282,17 +364,9 @@ void *Z_Malloc(int iSize, memtag_t eTag, qboolean bZeroit /* = qfalse */, int iU
 		}
 	}
 
-	// Link in
 	pMemory->iMagic	= ZONE_MAGIC;
 	pMemory->eTag	= eTag;
 	pMemory->iSize	= iSize;
-	pMemory->pNext  = TheZone.Header.pNext;
-	TheZone.Header.pNext = pMemory;
-	if (pMemory->pNext)
-	{
-		pMemory->pNext->pPrev = pMemory;
-	}
-	pMemory->pPrev = &TheZone.Header;
 	//
 	// add tail...
 	//
@@ -300,19 +374,22 @@ void *Z_Malloc(int iSize, memtag_t eTag, qboolean bZeroit /* = qfalse */, int iU
 
 	// Update stats...
 	//
-	TheZone.Stats.iCurrent += iSize;
-	TheZone.Stats.iCount++;
-	TheZone.Stats.iSizesPerTag	[eTag] += iSize;
-	TheZone.Stats.iCountsPerTag	[eTag]++;
+	Zone_CountBlocks(eTag, iSize, 1);
 
-	if (TheZone.Stats.iCurrent > TheZone.Stats.iPeak)
+	// Link in
+	std::unique_lock<std::mutex> lock(zoneMutex);
+	pMemory->pNext  = TheZone.Header.pNext;
+	TheZone.Header.pNext = pMemory;
+	if (pMemory->pNext)
 	{
-		TheZone.Stats.iPeak	= TheZone.Stats.iCurrent;
+		pMemory->pNext->pPrev = pMemory;
 	}
+	pMemory->pPrev = &TheZone.Header;
 
 #ifdef DETAILED_ZONE_DEBUG_CODE
 	mapAllocatedZones[pMemory]++;
 #endif
+	lock.unlock();
 
 	Z_Validate();	// check for corruption
 
@@ -349,61 +426,64 @@ void Z_MorphMallocTag( void *pvAddress, memtag_t eDesiredTag )
 		return;	// won't get here
 	}
 
-	// DEC existing tag stats...
-	//
-//	TheZone.Stats.iCurrent	- unchanged
-//	TheZone.Stats.iCount	- unchanged
-	TheZone.Stats.iSizesPerTag	[pMemory->eTag] -= pMemory->iSize;
-	TheZone.Stats.iCountsPerTag	[pMemory->eTag]--;
-
-	// morph...
+	// morph... (under the lock, as Z_TagFree picks blocks by their tag)
 	//
+	std::unique_lock<std::mutex> lock(zoneMutex);
+	memtag_t eOldTag = pMemory->eTag;
 	pMemory->eTag = eDesiredTag;
+	lock.unlock();
 
-	// INC new tag stats...
+	// DEC existing tag stats, INC new tag stats...
 	//
 //	TheZone.Stats.iCurrent	- unchanged
 //	TheZone.Stats.iCount	- unchanged
-	TheZone.Stats.iSizesPerTag	[pMemory->eTag] += pMemory->iSize;
-	TheZone.Stats.iCountsPerTag	[pMemory->eTag]++;
+	const int64_t iDelta = Zone_PackTotal(1, pMemory->iSize);
+	TheZone.Stats.iTotalsPerTag[eOldTag].fetch_sub(iDelta, std::memory_order_relaxed);
+	TheZone.Stats.iTotalsPerTag[eDesiredTag].fetch_add(iDelta, std::memory_order_relaxed);
 }
 
-static void Zone_FreeBlock(zoneHeader_t *pMemory)
+// Takes a block out of the list, zoneMutex must be held. Hand it to
+//	Zone_ReleaseBlock once the lock is dropped.
+static void Zone_UnlinkBlock(zoneHeader_t *pMemory)
 {
-	if (pMemory->eTag != TAG_STATIC)	// belt and braces, should never hit this though
+	// Sanity checks...
+	//
+	assert(pMemory->pPrev->pNext == pMemory);
+	assert(!pMemory->pNext || (pMemory->pNext->pPrev == pMemory));
+
+	// Unlink...
+	//
+	pMemory->pPrev->pNext = pMemory->pNext;
+	if(pMemory->pNext)
 	{
-		// Update stats...
-		//
-		TheZone.Stats.iCount--;
-		TheZone.Stats.iCurrent -= pMemory->iSize;
-		TheZone.Stats.iSizesPerTag	[pMemory->eTag] -= pMemory->iSize;
-		TheZone.Stats.iCountsPerTag	[pMemory->eTag]--;
-
-		// Sanity checks...
-		//
-		assert(pMemory->pPrev->pNext == pMemory);
-		assert(!pMemory->pNext || (pMemory->pNext->pPrev == pMemory));
-
-		// Unlink and free...
-		//
-		pMemory->pPrev->pNext = pMemory->pNext;
-		if(pMemory->pNext)
-		{
-			pMemory->pNext->pPrev = pMemory->pPrev;
-		}
-		free (pMemory);
+		pMemory->pNext->pPrev = pMemory->pPrev;
+	}
 
+	#ifdef DETAILED_ZONE_DEBUG_CODE
+	// this has already been checked for in execution order, but wtf?
+	int& iAllocCount = mapAllocatedZones[pMemory];
+	if (iAllocCount == 0)
+	{
+		Com_Error(ERR_FATAL, "Zone_UnlinkBlock(): Double-freeing block!");
+		return;
+	}
+	iAllocCount--;
+	#endif
+}
 
-		#ifdef DETAILED_ZONE_DEBUG_CODE
-		// this has already been checked for in execution order, but wtf?
-		int& iAllocCount = mapAllocatedZones[pMemory];
-		if (iAllocCount == 0)
-		{
-			Com_Error(ERR_FATAL, "Zone_FreeBlock(): Double-freeing block!");
-			return;
-		}
-		iAllocCount--;
-		#endif
+// Updates the stats for an unlinked block and frees it, without zoneMutex held
+static void Zone_ReleaseBlock(zoneHeader_t *pMemory)
+{
+	Zone_CountBlocks(pMemory->eTag, -pMemory->iSize, -1);
+
+	int iRealSize = pMemory->iSize + sizeof(zoneHeader_t) + sizeof(zoneTail_t);
+	if (Zone_IsPooled(iRealSize))
+	{
+		ZonePool.free(pMemory, iRealSize);
+	}
+	else
+	{
+		free (pMemory);
 	}
 }
 
@@ -445,6 +525,8 @@ void Z_Free(void *pvAddress)
 		return;
 	}
 
+	std::unique_lock<std::mutex> lock(zoneMutex);
+
 	#ifdef DETAILED_ZONE_DEBUG_CODE
 	//
 	// check this error *before* barfing on bad magics...
@@ -468,13 +550,16 @@ void Z_Free(void *pvAddress)
 		return;
 	}
 
-	Zone_FreeBlock(pMemory);
+	Zone_UnlinkBlock(pMemory);
+	lock.unlock();
+
+	Zone_ReleaseBlock(pMemory);
 }
 
 
 int Z_MemSize(memtag_t eTag)
 {
-	return TheZone.Stats.iSizesPerTag[eTag];
+	return Zone_TotalSize(TheZone.Stats.iTotalsPerTag[eTag].load(std::memory_order_relaxed));
 }
 
 // Frees all blocks with the specified tag...
@@ -485,17 +570,35 @@ void Z_TagFree(memtag_t eTag)
 //	int iZoneBlocks = TheZone.Stats.iCount;
 //#endif
 
+	// unlink the blocks under the lock, chaining them through pNext, then free them without it
+	//
+	zoneHeader_t *pFreed = NULL;
+
+	std::unique_lock<std::mutex> lock(zoneMutex);
+
 	zoneHeader_t *pMemory = TheZone.Header.pNext;
 	while (pMemory)
 	{
 		zoneHeader_t *pNext = pMemory->pNext;
-		if ( (eTag == TAG_ALL) || (pMemory->eTag == eTag))
+		if ( pMemory->eTag != TAG_STATIC &&	// belt and braces, should never hit this though
+			((eTag == TAG_ALL) || (pMemory->eTag == eTag)))
 		{
-			Zone_FreeBlock(pMemory);
+			Zone_UnlinkBlock(pMemory);
+			pMemory->pNext = pFreed;
+			pFreed = pMemory;
 		}
 		pMemory = pNext;
 	}
 
+	lock.unlock();
+
+	while (pFreed)
+	{
+		zoneHeader_t *pNext = pFreed->pNext;
+		Zone_ReleaseBlock(pFreed);
+		pFreed = pNext;
+	}
+
 // these stupid pragmas don't work here???!?!?!
 //
 //#ifdef _DEBUG
@@ -534,33 +637,52 @@ static void Z_MemRecoverTest_f(void)
 
 
 
-// Gives a summary of the zone memory usage
+// Gives a summary of the zone memory usage, printed from a copy as Com_Printf may allocate
 
-static void Z_Stats_f(void)
+static void Zone_PrintStats(const zoneStats_t *pStats)
 {
 	Com_Printf("\nThe zone is using %d bytes (%.2fMB) in %d memory blocks\n",
-								  TheZone.Stats.iCurrent,
-									        (float)TheZone.Stats.iCurrent / 1024.0f / 1024.0f,
-													  TheZone.Stats.iCount
+								  pStats->iCurrent,
+									        (float)pStats->iCurrent / 1024.0f / 1024.0f,
+													  pStats->iCount
 				);
 
 	Com_Printf("The zone peaked at %d bytes (%.2fMB)\n",
-									TheZone.Stats.iPeak,
-									         (float)TheZone.Stats.iPeak / 1024.0f / 1024.0f
+									pStats->iPeak,
+									         (float)pStats->iPeak / 1024.0f / 1024.0f
 				);
+
+	Q::SlabAllocator::Stats poolStats = ZonePool.stats();
+	Com_Printf("%d blocks of up to %d bytes use %.2fMB of %.2fMB in %d pool pages\n",
+									poolStats.numChunks,
+									(int)Q::SlabAllocator::maxSize,
+									(float)poolStats.usedBytes / 1024.0f / 1024.0f,
+									(float)poolStats.pageBytes / 1024.0f / 1024.0f,
+									poolStats.numPages
+				);
+}
+
+static void Z_Stats_f(void)
+{
+	zoneStats_t Stats;
+	Zone_CopyStats(&Stats);
+	Zone_PrintStats(&Stats);
 }
 
 // Gives a detailed breakdown of the memory blocks in the zone
 
 static void Z_Details_f(void)
 {
+	zoneStats_t Stats;
+	Zone_CopyStats(&Stats);
+
 	Com_Printf("---------------------------------------------------------------------------\n");
 	Com_Printf("%20s %9s\n","Zone Tag","Bytes");
 	Com_Printf("%20s %9s\n","--------","-----");
 	for (int i=0; i<TAG_COUNT; i++)
 	{
-		int iThisCount = TheZone.Stats.iCountsPerTag[i];
-		int iThisSize  = TheZone.Stats.iSizesPerTag	[i];
+		int iThisCount = Stats.iCountsPerTag[i];
+		int iThisSize  = Stats.iSizesPerTag	[i];
 
 		if (iThisCount)
 		{
@@ -580,7 +702,7 @@ static void Z_Details_f(void)
 	}
 	Com_Printf("---------------------------------------------------------------------------\n");
 
-	Z_Stats_f();
+	Zone_PrintStats(&Stats);
 }
 
 // Shuts down the zone memory system and frees up all memory
@@ -591,21 +713,30 @@ void Com_ShutdownZoneMemory(void)
 	Cmd_RemoveCommand("zone_stats");
 	Cmd_RemoveCommand("zone_details");
 
-	if(TheZone.Stats.iCount)
+	zoneStats_t Stats;
+	Zone_CopyStats(&Stats);
+	if(Stats.iCount)
 	{
-		Com_Printf("Automatically freeing %d blocks making up %d bytes\n", TheZone.Stats.iCount, TheZone.Stats.iCurrent);
+		Com_Printf("Automatically freeing %d blocks making up %d bytes\n", Stats.iCount, Stats.iCurrent);
 		Z_TagFree(TAG_ALL);
 
-		assert(!TheZone.Stats.iCount);
-		assert(!TheZone.Stats.iCurrent);
+		assert(!TheZone.Stats.iTotal.load());
 	}
+
+	ZonePool.releaseAll();
 }
 
 // Initialises the zone memory system
 
 void Com_InitZoneMemory( void )
 {
-	memset(&TheZone, 0, sizeof(TheZone));
+	TheZone.Stats.iTotal	= 0;
+	TheZone.Stats.iPeak		= 0;
+	for (int i=0; i<TAG_COUNT; i++)
+	{
+		TheZone.Stats.iTotalsPerTag[i] = 0;
+	}
+	memset(&TheZone.Header, 0, sizeof(TheZone.Header));
 	TheZone.Header.iMagic = ZONE_MAGIC;
 }
 
@@ -673,6 +804,8 @@ void Com_TouchMemory( void ) {
 
 	sum = 0;
 
+	std::lock_guard<std::mutex> lock(zoneMutex);
+
 	zoneHeader_t *pMemory = TheZone.Header.pNext;
 	while (pMemory)
 	{
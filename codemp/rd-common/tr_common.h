@@ -53,21 +53,34 @@ void R_ImageLoader_Init();
 
 typedef void (*ImageLoaderFn)( const char *filename, byte **pic, int *width, int *height );
 
+// Decodes an image file that has already been read into memory. Decoders only
+// touch the memory they are given, so they may run on any thread. Anything
+// worth printing is left in message, which is always filled in on failure.
+typedef qboolean (*ImageDecoderFn)( const byte *buffer, int len, byte **pic, int *width, int *height, char *message, int messageSize );
+
 // Adds a new image loader to handle a new image type. The extension should not
 // begin with a period (a full stop).
-qboolean R_ImageLoader_Add( const char *extension, ImageLoaderFn imageLoader );
+qboolean R_ImageLoader_Add( const char *extension, ImageLoaderFn imageLoader, ImageDecoderFn imageDecoder );
 
-// Load an image from file.
+// Load an image from file. The pixels are allocated with malloc, release them with free.
 void R_LoadImage( const char *shortname, byte **pic, int *width, int *height );
 
+// Read the file R_LoadImage would load, without decoding it. The buffer
+// may point straight into a pk3, so it's read-only. Release it with
+// ri->FS_FreeFile.
+qboolean R_ReadImage( const char *shortname, const void **buffer, int *len, ImageDecoderFn *decoder );
+
 // Load raw image data from TGA image.
 void LoadTGA( const char *name, byte **pic, int *width, int *height );
+qboolean DecodeTGA( const byte *buffer, int len, byte **pic, int *width, int *height, char *message, int messageSize );
 
 // Load raw image data from JPEG image.
 void LoadJPG( const char *filename, byte **pic, int *width, int *height );
+qboolean DecodeJPG( const byte *buffer, int len, byte **pic, int *width, int *height, char *message, int messageSize );
 
 // Load raw image data from PNG image.
 void LoadPNG( const char *filename, byte **data, int *width, int *height );
+qboolean DecodePNG( const byte *buffer, int len, byte **data, int *width, int *height, char *message, int messageSize );
 
 
 /*
@@ -75,8 +88,8 @@ void LoadPNG( const char *filename, byte **data, int *width, int *height );
  Image saving
 ================================================================================
 */
-// Convert raw image data to JPEG format and store in buffer.
-size_t RE_SaveJPGToBuffer( byte *buffer, size_t bufSize, int quality, int image_width, int image_height, byte *image_buffer, int padding );
+// Convert raw image data to JPEG format and store in buffer. Returns 0, with the reason in message, on failure.
+size_t RE_SaveJPGToBuffer( byte *buffer, size_t bufSize, int quality, int image_width, int image_height, byte *image_buffer, int padding, char *message, int messageSize );
 
 // Save raw image data as JPEG image file.
 void RE_SaveJPG( const char * filename, int quality, int image_width, int image_height, byte *image_buffer, int padding );
@@ -33,31 +33,39 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
 #include <jpeglib.h>
+#include <setjmp.h>
 
-static void R_JPGErrorExit(j_common_ptr cinfo)
+/*
+ * Error handling for DecodeJPG and RE_SaveJPGToBuffer.  Both may be running
+ * off the main thread, so instead of printing anything the library's
+ * messages are kept for the caller, and fatal errors jump back out of the
+ * library.
+ */
+typedef struct {
+	struct jpeg_error_mgr	pub;
+	jmp_buf					jump;
+	char					*message;
+	int						messageSize;
+} jpegError_t;
+
+static void R_JPGOutputMessage(j_common_ptr cinfo)
 {
+	jpegError_t *err = (jpegError_t *)cinfo->err;
 	char buffer[JMSG_LENGTH_MAX];
 
 	(*cinfo->err->format_message) (cinfo, buffer);
-
-	/* Let the memory manager delete any temp files before we die */
-	jpeg_destroy(cinfo);
-
-	Com_Printf("%s", buffer);
+	Q_strncpyz(err->message, buffer, err->messageSize);
 }
 
-static void R_JPGOutputMessage(j_common_ptr cinfo)
+static void R_JPGErrorExit(j_common_ptr cinfo)
 {
-	char buffer[JMSG_LENGTH_MAX];
-
-	/* Create the message */
-	(*cinfo->err->format_message) (cinfo, buffer);
+	jpegError_t *err = (jpegError_t *)cinfo->err;
 
-	/* Send it to stderr, adding a newline */
-	Com_Printf("%s\n", buffer);
+	R_JPGOutputMessage(cinfo);
+	longjmp(err->jump, 1);
 }
 
-void LoadJPG( const char *filename, unsigned char **pic, int *width, int *height ) {
+qboolean DecodeJPG( const byte *data, int len, byte **pic, int *width, int *height, char *message, int messageSize ) {
 	/* This struct contains the JPEG decompression parameters and pointers to
 	* working space (which is allocated as needed by the JPEG library).
 	*/
@@ -66,33 +74,17 @@ void LoadJPG( const char *filename, unsigned char **pic, int *width, int *height
 	* Note that this struct must live as long as the main JPEG parameter
 	* struct, to avoid dangling-pointer problems.
 	*/
-	/* This struct represents a JPEG error handler.  It is declared separately
-	* because applications often want to supply a specialized error handler
-	* (see the second half of this file for an example).  But here we just
-	* take the easy way out and use the standard error handler, which will
-	* print a message on stderr and call exit() if compression fails.
-	* Note that this struct must live as long as the main JPEG parameter
-	* struct, to avoid dangling-pointer problems.
-	*/
-	struct jpeg_error_mgr jerr;
+	jpegError_t jerr;
 	/* More stuff */
 	JSAMPARRAY buffer;		/* Output row buffer */
 	unsigned int row_stride;  /* physical row width in output buffer */
 	unsigned int pixelcount, memcount;
 	unsigned int sindex, dindex;
-	byte *out;
-	fileBuffer_t fbuffer;
+	byte * volatile out = NULL;
 	byte  *buf;
-	/* In this example we want to open the input file before doing anything else,
-	* so that the setjmp() error recovery below can assume the file is open.
-	* VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
-	* requires it in order to read binary files.
-	*/
 
-	int len = ri->FS_ReadFile ( ( char * ) filename, &fbuffer.v);
-	if (!fbuffer.b || len < 0) {
-		return;
-	}
+	*pic = NULL;
+	message[0] = '\0';
 
 	/* Step 1: allocate and initialize JPEG decompression object */
 
@@ -101,16 +93,25 @@ void LoadJPG( const char *filename, unsigned char **pic, int *width, int *height
 	* This routine fills in the contents of struct jerr, and returns jerr's
 	* address which we place into the link field in cinfo.
 	*/
-	cinfo.err = jpeg_std_error(&jerr);
+	cinfo.err = jpeg_std_error(&jerr.pub);
 	cinfo.err->error_exit = R_JPGErrorExit;
 	cinfo.err->output_message = R_JPGOutputMessage;
+	jerr.message = message;
+	jerr.messageSize = messageSize;
+
+	if (setjmp(jerr.jump)) {
+		/* The library hit a fatal error and jumped back here */
+		jpeg_destroy_decompress(&cinfo);
+		free(out);
+		return qfalse;
+	}
 
 	/* Now we can initialize the JPEG decompression object. */
 	jpeg_create_decompress(&cinfo);
 
 	/* Step 2: specify data source (eg, a file) */
 
-	jpeg_mem_src(&cinfo, fbuffer.b, len);
+	jpeg_mem_src(&cinfo, (unsigned char *)data, len);
 
 	/* Step 3: read file parameters with jpeg_read_header() */
 
@@ -149,22 +150,21 @@ void LoadJPG( const char *filename, unsigned char **pic, int *width, int *height
 		|| pixelcount > 0x1FFFFFFF || cinfo.output_components != 3
 		)
 	{
-		// Free the memory to make sure we don't leak memory
-		ri->FS_FreeFile (fbuffer.v);
-		jpeg_destroy_decompress(&cinfo);
-
-		Com_Printf("LoadJPG: %s has an invalid image format: %dx%d*4=%d, components: %d", filename,
+		Com_sprintf(message, messageSize, "invalid image format: %dx%d*4=%d, components: %d",
 			cinfo.output_width, cinfo.output_height, pixelcount * 4, cinfo.output_components);
-		return;
+		jpeg_destroy_decompress(&cinfo);
+		return qfalse;
 	}
 
 	memcount = pixelcount * 4;
 	row_stride = cinfo.output_width * cinfo.output_components;
 
-	out = (byte *)Z_Malloc(memcount, TAG_TEMP_WORKSPACE, qfalse);
-
-	*width = cinfo.output_width;
-	*height = cinfo.output_height;
+	out = (byte *)malloc(memcount);
+	if (!out) {
+		Q_strncpyz(message, "out of memory", messageSize);
+		jpeg_destroy_decompress(&cinfo);
+		return qfalse;
+	}
 
 	/* Step 6: while (scan lines remain to be read) */
 	/*           jpeg_read_scanlines(...); */
@@ -194,8 +194,6 @@ void LoadJPG( const char *filename, unsigned char **pic, int *width, int *height
 		buf[--dindex] = buf[--sindex];
 	} while(sindex);
 
-	*pic = out;
-
 	/* Step 7: Finish decompression */
 
 	(void) jpeg_finish_decompress(&cinfo);
@@ -208,17 +206,36 @@ void LoadJPG( const char *filename, unsigned char **pic, int *width, int *height
 	/* This is an important step since it will release a good deal of memory. */
 	jpeg_destroy_decompress(&cinfo);
 
-	/* After finish_decompress, we can close the input file.
-	* Here we postpone it until after no more JPEG errors are possible,
-	* so as to simplify the setjmp error logic above.  (Actually, I don't
-	* think that jpeg_destroy can do an error exit, but why assume anything...)
-	*/
-	ri->FS_FreeFile (fbuffer.v);
 	/* At this point you may want to check to see whether any corrupt-data
 	* warnings occurred (test whether jerr.pub.num_warnings is nonzero).
 	*/
 
+	*pic = out;
+	*width = cinfo.output_width;
+	*height = cinfo.output_height;
+
 	/* And we're done! */
+	return qtrue;
+}
+
+void LoadJPG( const char *filename, unsigned char **pic, int *width, int *height ) {
+	fileBuffer_t fbuffer;
+	char message[JMSG_LENGTH_MAX];
+
+	*pic = NULL;
+
+	int len = ri->FS_ReadFile ( ( char * ) filename, &fbuffer.v);
+	if (!fbuffer.b || len < 0) {
+		return;
+	}
+
+	if ( !DecodeJPG (fbuffer.b, len, pic, width, height, message, sizeof (message)) ) {
+		Com_Printf("LoadJPG: %s: %s\n", filename, message);
+	} else if ( message[0] ) {
+		Com_Printf("%s\n", message);
+	}
+
+	ri->FS_FreeFile (fbuffer.v);
 }
 
 
@@ -274,11 +291,11 @@ static void init_destination (j_compress_ptr cinfo)
 static boolean empty_output_buffer (j_compress_ptr cinfo)
 {
 	my_dest_ptr dest = (my_dest_ptr) cinfo->dest;
+	jpegError_t *err = (jpegError_t *)cinfo->err;
 
-	jpeg_destroy_compress(cinfo);
-
-	// Make crash fatal or we would probably leak memory.
-	Com_Error(ERR_FATAL, "Output buffer for encoded JPEG image has insufficient size of %d bytes", dest->size);
+	// RE_SaveJPGToBuffer gives up on the image
+	Com_sprintf(err->message, err->messageSize, "Output buffer for encoded JPEG image has insufficient size of %d bytes", dest->size);
+	longjmp(err->jump, 1);
 
 	return FALSE;
 }
@@ -332,14 +349,16 @@ static void jpegDest (j_compress_ptr cinfo, byte* outfile, int size)
 SaveJPGToBuffer
 
 Encodes JPEG from image in image_buffer and writes to buffer.
-Expects RGB input data
+Expects RGB input data.  Returns 0 with the reason in message if the image
+couldn't be encoded; a warning may be left in message either way.
 =================
 */
 size_t RE_SaveJPGToBuffer(byte *buffer, size_t bufSize, int quality,
-	int image_width, int image_height, byte *image_buffer, int padding)
+	int image_width, int image_height, byte *image_buffer, int padding,
+	char *message, int messageSize)
 {
-	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr jerr;
+	struct jpeg_compress_struct cinfo = { NULL };
+	jpegError_t jerr;
 	JSAMPROW row_pointer[1];	/* pointer to JSAMPLE row[s] */
 	my_dest_ptr dest;
 	int row_stride;		/* physical row width in image buffer */
@@ -347,9 +366,18 @@ size_t RE_SaveJPGToBuffer(byte *buffer, size_t bufSize, int quality,
 
 	/* Step 1: allocate and initialize JPEG compression object */
 
-	cinfo.err = jpeg_std_error(&jerr);
+	cinfo.err = jpeg_std_error(&jerr.pub);
 	cinfo.err->error_exit = R_JPGErrorExit;
 	cinfo.err->output_message = R_JPGOutputMessage;
+	jerr.message = message;
+	jerr.messageSize = messageSize;
+	message[0] = '\0';
+
+	if (setjmp(jerr.jump)) {
+		/* The library hit a fatal error, or the buffer filled up */
+		jpeg_destroy_compress(&cinfo);
+		return 0;
+	}
 
 	/* Now we can initialize the JPEG compression object. */
 	jpeg_create_compress(&cinfo);
@@ -409,12 +437,20 @@ void RE_SaveJPG(const char * filename, int quality, int image_width, int image_h
 {
 	byte *out;
 	size_t bufSize;
+	char message[JMSG_LENGTH_MAX];
 
 	bufSize = image_width * image_height * 3;
 	out = (byte *)Hunk_AllocateTempMemory(bufSize);
 
-	bufSize = RE_SaveJPGToBuffer(out, bufSize, quality, image_width, image_height, image_buffer, padding);
-	ri->FS_WriteFile(filename, out, bufSize);
+	bufSize = RE_SaveJPGToBuffer(out, bufSize, quality, image_width, image_height, image_buffer, padding, message, sizeof(message));
+	if (!bufSize) {
+		Com_Printf("SaveJPG: %s: %s\n", filename, message);
+	} else {
+		if (message[0]) {
+			Com_Printf("%s\n", message);
+		}
+		ri->FS_WriteFile(filename, out, bufSize);
+	}
 
 	Hunk_FreeTempMemory(out);
 }
@@ -29,6 +29,7 @@ struct ImageLoaderMap
 {
 	const char *extension;
 	ImageLoaderFn loader;
+	ImageDecoderFn decoder;
 } imageLoaders[MAX_IMAGE_LOADERS];
 int numImageLoaders;
 
@@ -56,7 +57,7 @@ Adds a new image loader to load the specified image file extension.
 The 'extension' string should not begin with a period (full stop).
 =================
 */
-qboolean R_ImageLoader_Add ( const char *extension, ImageLoaderFn imageLoader )
+qboolean R_ImageLoader_Add ( const char *extension, ImageLoaderFn imageLoader, ImageDecoderFn imageDecoder )
 {
 	if ( numImageLoaders >= MAX_IMAGE_LOADERS )
 	{
@@ -73,6 +74,7 @@ qboolean R_ImageLoader_Add ( const char *extension, ImageLoaderFn imageLoader )
 	ImageLoaderMap *newImageLoader = &imageLoaders[numImageLoaders];
 	newImageLoader->extension = extension;
 	newImageLoader->loader = imageLoader;
+	newImageLoader->decoder = imageDecoder;
 
 	numImageLoaders++;
 
@@ -90,9 +92,9 @@ void R_ImageLoader_Init()
 	Com_Memset (imageLoaders, 0, sizeof (imageLoaders));
 	numImageLoaders = 0;
 
-	R_ImageLoader_Add ("jpg", LoadJPG);
-	R_ImageLoader_Add ("png", LoadPNG);
-	R_ImageLoader_Add ("tga", LoadTGA);
+	R_ImageLoader_Add ("jpg", LoadJPG, DecodeJPG);
+	R_ImageLoader_Add ("png", LoadPNG, DecodePNG);
+	R_ImageLoader_Add ("tga", LoadTGA, DecodeTGA);
 }
 
 /*
@@ -138,3 +140,51 @@ void R_LoadImage( const char *shortname, byte **pic, int *width, int *height ) {
 		}
 	}
 }
+
+/*
+=================
+Reads the file R_LoadImage would pick for this name, trying the
+extensions in the same order, and returns the decoder for it
+instead of decoding it.  Images stored uncompressed in a pk3 aren't
+even copied.
+=================
+*/
+qboolean R_ReadImage( const char *shortname, const void **buffer, int *len, ImageDecoderFn *decoder ) {
+	*buffer = NULL;
+	*len = 0;
+	*decoder = NULL;
+
+	// Try the original extension first (if possible).
+	const char *extension = COM_GetExtension (shortname);
+	const ImageLoaderMap *imageLoader = FindImageLoader (extension);
+	if ( imageLoader != NULL )
+	{
+		*len = ri->FS_ReadFileMapped (shortname, buffer);
+		if ( *buffer )
+		{
+			*decoder = imageLoader->decoder;
+			return qtrue;
+		}
+	}
+
+	char extensionlessName[MAX_QPATH];
+	COM_StripExtension(shortname, extensionlessName, sizeof( extensionlessName ));
+	for ( int i = 0; i < numImageLoaders; i++ )
+	{
+		const ImageLoaderMap *tryLoader = &imageLoaders[i];
+		if ( tryLoader == imageLoader )
+		{
+			// Already tried this one.
+			continue;
+		}
+
+		*len = ri->FS_ReadFileMapped (va ("%s.%s", extensionlessName, tryLoader->extension), buffer);
+		if ( *buffer )
+		{
+			*decoder = tryLoader->decoder;
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
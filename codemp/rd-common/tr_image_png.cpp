@@ -123,24 +123,22 @@ fopen_failed:
 }
 
 void user_read_data( png_structp png_ptr, png_bytep data, png_size_t length );
-void png_print_error ( png_structp png_ptr, png_const_charp err )
-{
-	ri->Printf (PRINT_ERROR, "%s\n", err);
-}
-
-void png_print_warning ( png_structp png_ptr, png_const_charp warning )
-{
-	ri->Printf (PRINT_WARNING, "%s\n", warning);
-}
+void png_decode_error ( png_structp png_ptr, png_const_charp err );
+void png_decode_warning ( png_structp png_ptr, png_const_charp warning );
 
 bool IsPowerOfTwo ( int i ) { return (i & (i - 1)) == 0; }
 
+// Decodes PNG data from memory. Problems are kept in the message buffer rather
+// than printed, since this may be running off the main thread.
 struct PNGFileReader
 {
-	PNGFileReader ( char *buf ) : buf(buf), offset(0), png_ptr(NULL), info_ptr(NULL) {}
+	PNGFileReader ( const byte *buf, size_t len, char *message, int messageSize )
+		: buf(buf), len(len), offset(0), png_ptr(NULL), info_ptr(NULL), message(message), messageSize(messageSize)
+	{
+		message[0] = '\0';
+	}
 	~PNGFileReader()
 	{
-		ri->FS_FreeFile (buf);
 		png_destroy_read_struct (&png_ptr, &info_ptr, NULL);
 	}
 
@@ -154,19 +152,16 @@ struct PNGFileReader
 		// Make sure we're actually reading PNG data.
 		const int SIGNATURE_LEN = 8;
 
-		byte ident[SIGNATURE_LEN];
-		memcpy (ident, buf, SIGNATURE_LEN);
-
-		if ( !png_check_sig (ident, SIGNATURE_LEN) )
+		if ( len < SIGNATURE_LEN || !png_check_sig (buf, SIGNATURE_LEN) )
 		{
-			ri->Printf (PRINT_ERROR, "PNG signature not found in given image.");
+			SetMessage ("PNG signature not found in given image.");
 			return 0;
 		}
 
-		png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, png_print_error, png_print_warning);
+		png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, (png_voidp)this, png_decode_error, png_decode_warning);
 		if ( png_ptr == NULL )
 		{
-			ri->Printf (PRINT_ERROR, "Could not allocate enough memory to load the image.");
+			SetMessage ("Could not allocate enough memory to load the image.");
 			return 0;
 		}
 
@@ -199,7 +194,7 @@ struct PNGFileReader
 		// so that the graphics driver doesn't have to fiddle about with the texture when uploading.
 		if ( !IsPowerOfTwo (width_) || !IsPowerOfTwo (height_) )
 		{
-			ri->Printf (PRINT_ERROR, "Width or height is not a power-of-two.\n");
+			SetMessage ("Width or height is not a power-of-two.");
 			return 0;
 		}
 
@@ -209,7 +204,7 @@ struct PNGFileReader
 		// PNG_COLOR_TYPE_GRAY.
 		if ( colortype != PNG_COLOR_TYPE_RGB && colortype != PNG_COLOR_TYPE_RGBA )
 		{
-			ri->Printf (PRINT_ERROR, "Image is not 24-bit or 32-bit.");
+			SetMessage ("Image is not 24-bit or 32-bit.");
 			return 0;
 		}
 
@@ -223,20 +218,20 @@ struct PNGFileReader
 		png_read_update_info (png_ptr, info_ptr);
 
 		// We always assume there are 4 channels. RGB channels are expanded to RGBA when read.
-		byte *tempData = (byte *)ri->Z_Malloc (width_ * height_ * 4, TAG_TEMP_PNG, qfalse, 4);
+		byte *tempData = (byte *)malloc (width_ * height_ * 4);
 		if ( !tempData )
 		{
-			ri->Printf (PRINT_ERROR, "Could not allocate enough memory to load the image.");
+			SetMessage ("Could not allocate enough memory to load the image.");
 			return 0;
 		}
 
 		// Dynamic array of row pointers, with 'height' elements, initialized to NULL.
-		byte **row_pointers = (byte **)ri->Hunk_AllocateTempMemory (sizeof (byte *) * height_);
+		byte **row_pointers = (byte **)malloc (sizeof (byte *) * height_);
 		if ( !row_pointers )
 		{
-			ri->Printf (PRINT_ERROR, "Could not allocate enough memory to load the image.");
+			SetMessage ("Could not allocate enough memory to load the image.");
 
-			ri->Z_Free (tempData);
+			free (tempData);
 
 			return 0;
 		}
@@ -244,8 +239,8 @@ struct PNGFileReader
 		// Re-set the jmp so that these new memory allocations can be reclaimed
 		if ( setjmp (png_jmpbuf (png_ptr)) )
 		{
-			ri->Hunk_FreeTempMemory (row_pointers);
-			ri->Z_Free (tempData);
+			free (row_pointers);
+			free (tempData);
 			return 0;
 		}
 
@@ -259,7 +254,7 @@ struct PNGFileReader
 		// Finish reading
 		png_read_end (png_ptr, NULL);
 
-		ri->Hunk_FreeTempMemory (row_pointers);
+		free (row_pointers);
 
 		// Finally assign all the parameters
 		*data = tempData;
@@ -269,17 +264,29 @@ struct PNGFileReader
 		return 1;
 	}
 
-	void ReadBytes ( void *dest, size_t len )
+	void ReadBytes ( void *dest, size_t count )
 	{
-		memcpy (dest, buf + offset, len);
-		offset += len;
+		if ( count > len - offset )
+		{
+			png_error (png_ptr, "Unexpected end of file.");
+		}
+		memcpy (dest, buf + offset, count);
+		offset += count;
+	}
+
+	void SetMessage ( const char *text )
+	{
+		Q_strncpyz (message, text, messageSize);
 	}
 
 private:
-	char *buf;
+	const byte *buf;
+	size_t len;
 	size_t offset;
 	png_structp png_ptr;
 	png_infop info_ptr;
+	char *message;
+	int messageSize;
 };
 
 void user_read_data( png_structp png_ptr, png_bytep data, png_size_t length ) {
@@ -288,17 +295,48 @@ void user_read_data( png_structp png_ptr, png_bytep data, png_size_t length ) {
 	reader->ReadBytes (data, length);
 }
 
+void png_decode_error ( png_structp png_ptr, png_const_charp err )
+{
+	PNGFileReader *reader = (PNGFileReader *)png_get_error_ptr (png_ptr);
+	reader->SetMessage (err);
+	png_longjmp (png_ptr, 1);
+}
+
+void png_decode_warning ( png_structp png_ptr, png_const_charp warning )
+{
+	PNGFileReader *reader = (PNGFileReader *)png_get_error_ptr (png_ptr);
+	reader->SetMessage (warning);
+}
+
+// Decodes a PNG image that has already been read into memory.
+qboolean DecodePNG ( const byte *buffer, int len, byte **data, int *width, int *height, char *message, int messageSize )
+{
+	PNGFileReader reader (buffer, len, message, messageSize);
+	return (qboolean)reader.Read (data, width, height);
+}
+
 // Loads a PNG image from file.
 void LoadPNG ( const char *filename, byte **data, int *width, int *height )
 {
+	char message[1024];
 	char *buf = NULL;
+
+	*data = NULL;
+
 	int len = ri->FS_ReadFile (filename, (void **)&buf);
 	if ( len < 0 || buf == NULL )
 	{
 		return;
 	}
 
-	PNGFileReader reader (buf);
-	reader.Read (data, width, height);
-}
+	if ( !DecodePNG ((byte *)buf, len, data, width, height, message, sizeof (message)) )
+	{
+		ri->Printf (PRINT_ERROR, "%s\n", message);
+	}
+	else if ( message[0] )
+	{
+		ri->Printf (PRINT_WARNING, "%s\n", message);
+	}
 
+	ri->FS_FreeFile (buf);
+}
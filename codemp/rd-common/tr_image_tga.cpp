@@ -50,36 +50,36 @@ typedef struct TGAHeader_s {
 
 // *pic == pic, else NULL for failed.
 //
-//  returns false if found but had a format error, else true for either OK or not-found (there's a reason for this)
+// Decodes TGA data that has already been read into memory. Format errors are
+//	left in sErrorString rather than reported, since this may be running off the main thread.
 //
 
-void LoadTGA ( const char *name, byte **pic, int *width, int *height)
+qboolean DecodeTGA ( const byte *buffer, int len, byte **pic, int *width, int *height, char *sErrorString, int iErrorStringSize )
 {
-	char sErrorString[1024];
 	bool bFormatErrors = false;
 
 	// these don't need to be declared or initialised until later, but the compiler whines that 'goto' skips them.
 	//
 	byte *pRGBA = NULL;
 	byte *pOut	= NULL;
-	byte *pIn	= NULL;
+	const byte *pIn	= NULL;
+	const byte *pInEnd = NULL;
+	int iBytesPerPixel = 0;
 
 
 	*pic = NULL;
+	sErrorString[0] = '\0';
 
-#define TGA_FORMAT_ERROR(blah) {sprintf(sErrorString,blah); bFormatErrors = true; goto TGADone;}
+#define TGA_FORMAT_ERROR(blah) {Q_strncpyz(sErrorString,blah,iErrorStringSize); bFormatErrors = true; goto TGADone;}
 //#define TGA_FORMAT_ERROR(blah) Com_Error( ERR_DROP, blah );
 
-	//
-	// load the file
-	//
-	byte *pTempLoadedBuffer = 0;
-	ri->FS_ReadFile ( ( char * ) name, (void **)&pTempLoadedBuffer);
-	if (!pTempLoadedBuffer) {
-		return;
+	if (len < (int)sizeof(TGAHeader_t)) {
+		Q_strncpyz(sErrorString, "LoadTGA: file is too short\n", iErrorStringSize);
+		return qfalse;
 	}
 
-	TGAHeader_t *pHeader = (TGAHeader_t *) pTempLoadedBuffer;
+	TGAHeader_t header = *(const TGAHeader_t *) buffer;
+	TGAHeader_t *pHeader = &header;
 
 	pHeader->wColourMapLength = LittleShort(pHeader->wColourMapLength);
 	pHeader->wImageWidth = LittleShort(pHeader->wImageWidth);
@@ -200,10 +200,14 @@ void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 	if (height)
 		*height = pHeader->wImageHeight;
 
-	pRGBA	= (byte *) Z_Malloc (pHeader->wImageWidth * pHeader->wImageHeight * 4, TAG_TEMP_WORKSPACE, qfalse);
+	pRGBA	= (byte *) malloc (pHeader->wImageWidth * pHeader->wImageHeight * 4);
+	if (!pRGBA)
+	{
+		TGA_FORMAT_ERROR("LoadTGA: out of memory\n");
+	}
 	*pic	= pRGBA;
 	pOut	= pRGBA;
-	pIn		= pTempLoadedBuffer + sizeof(*pHeader);
+	pIn		= buffer + sizeof(*pHeader);
 
 	// I don't know if this ID-thing here is right, since comments that I've seen are at the end of the file,
 	//	with a zero in this field. However, may as well...
@@ -211,6 +215,15 @@ void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 	if (pHeader->byIDFieldLength != 0)
 		pIn += pHeader->byIDFieldLength;	// skip TARGA image comment
 
+	// the file may come from anywhere, so don't read past the end of it
+	pInEnd = buffer + len;
+	iBytesPerPixel = pHeader->byImagePlanes / 8;
+
+	if ( pHeader->byImageType != 10 && pIn + pHeader->wImageWidth * pHeader->wImageHeight * iBytesPerPixel > pInEnd )
+	{
+		TGA_FORMAT_ERROR("LoadTGA: file is truncated\n");
+	}
+
 	byte red,green,blue,alpha;
 
 	if ( pHeader->byImageType == 2 || pHeader->byImageType == 3 )	// RGB or greyscale
@@ -274,8 +287,16 @@ void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 			pOut = pRGBA + y * pHeader->wImageWidth *4;
 			for (int x=0; x<pHeader->wImageWidth;)
 			{
+				if (pIn >= pInEnd)
+				{
+					TGA_FORMAT_ERROR("LoadTGA: file is truncated\n");
+				}
 				packetHeader = *pIn++;
 				packetSize   = 1 + (packetHeader & 0x7f);
+				if (pIn + ((packetHeader & 0x80) ? 1 : packetSize) * iBytesPerPixel > pInEnd)
+				{
+					TGA_FORMAT_ERROR("LoadTGA: file is truncated\n");
+				}
 				if (packetHeader & 0x80)         // run-length packet
 				{
 					switch (pHeader->byImagePlanes)
@@ -373,11 +394,37 @@ void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 
 TGADone:
 
+	if (bFormatErrors)
+	{
+		free(pRGBA);
+		*pic = NULL;
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+void LoadTGA ( const char *name, byte **pic, int *width, int *height)
+{
+	char sErrorString[1024];
+
+	*pic = NULL;
+
+	//
+	// load the file
+	//
+	byte *pTempLoadedBuffer = 0;
+	int len = ri->FS_ReadFile ( ( char * ) name, (void **)&pTempLoadedBuffer);
+	if (!pTempLoadedBuffer) {
+		return;
+	}
+
+	qboolean bDecoded = DecodeTGA (pTempLoadedBuffer, len, pic, width, height, sErrorString, sizeof(sErrorString));
+
 	ri->FS_FreeFile (pTempLoadedBuffer);
 
-	if (bFormatErrors)
+	if (!bDecoded)
 	{
 		Com_Error( ERR_DROP, "%s( File: \"%s\" )\n",sErrorString,name);
 	}
 }
-
@@ -30,7 +30,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "../qcommon/qcommon.h"
 #include "../ghoul2/ghoul2_shared.h"
 
-#define	REF_API_VERSION 9
+#define	REF_API_VERSION 14
 
 //
 // these are the functions exported by the refresh module
@@ -139,7 +139,8 @@ typedef struct refexport_s {
 	qboolean			(*RegisterModels_LevelLoadEnd)			( qboolean bDeleteEverythingNotUsedThisLevel );
 
 	// AVI recording
-	void				(*TakeVideoFrame)						( int h, int w, byte* captureBuffer, byte *encodeBuffer, qboolean motionJpeg );
+	void				(*TakeVideoFrame)						( int h, int w, qboolean motionJpeg );
+	void				(*FlushVideoFrames)						( void );	// waits until every frame taken has gone to CL_WriteAVIVideoFrame
 
 	// G2 stuff
 	void				(*InitSkins)							( void );
@@ -291,6 +292,7 @@ typedef struct refimport_s {
 	void			(*FS_FreeFileList)					( char **fileList );
 	int				(*FS_Read)							( void *buffer, int len, fileHandle_t f );
 	long			(*FS_ReadFile)						( const char *qpath, void **buffer );
+	long			(*FS_ReadFileMapped)				( const char *qpath, const void **buffer );
 	void			(*FS_FCloseFile)					( fileHandle_t f );
 	long			(*FS_FOpenFileRead)					( const char *qpath, fileHandle_t *file, qboolean uniqueFILE );
 	fileHandle_t	(*FS_FOpenFileWrite)				( const char *qpath, qboolean safe );
@@ -300,6 +302,8 @@ typedef struct refimport_s {
 	char **			(*FS_ListFiles)						( const char *directory, const char *extension, int *numfiles );
 	int				(*FS_Write)							( const void *buffer, int len, fileHandle_t f );
 	void			(*FS_WriteFile)						( const char *qpath, const void *buffer, int size );
+	const char *	(*FS_LoadedPakChecksums)			( void );
+	const char *	(*FS_FileOrigin)					( fileHandle_t f );
 	void			(*CM_BoxTrace)						( trace_t *results, const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask, int capsule );
 	void			(*CM_DrawDebugSurface)				( void (*drawPoly)(int color, int numPoints, float *points) );
 	bool			(*CM_CullWorldBox)					( const cplane_t *frustum, const vec3pair_t bounds );
@@ -314,7 +318,7 @@ typedef struct refimport_s {
 	e_status		(*CIN_RunCinematic)					( int handle );
 	int				(*CIN_PlayCinematic)				( const char *arg0, int xpos, int ypos, int width, int height, int bits );
 	void			(*CIN_UploadCinematic)				( int handle );
-	void			(*CL_WriteAVIVideoFrame)			( const byte *imageBuffer, int size );
+	void			(*CL_WriteAVIVideoFrame)			( const byte *imageBuffer, int size );	// any thread, NULL for a frame that couldn't be taken
 
 	// g2 data access
 	char *			(*GetSharedMemory)					( void ); // cl.mSharedMemory
@@ -328,11 +332,14 @@ typedef struct refimport_s {
 	window_t		(*WIN_Init)                         ( const windowDesc_t *desc, glconfig_t *glConfig );
 	void			(*WIN_SetGamma)						( glconfig_t *glConfig, byte red[256], byte green[256], byte blue[256] );
 	void			(*WIN_Present)						( window_t *window );
+	void			(*WIN_SwapBuffers)					( window_t *window );	// WIN_Present without the window updates, safe off the main thread
+	void			(*WIN_UpdateWindow)					( window_t *window );	// the rest of WIN_Present, main thread only
 	void            (*WIN_Shutdown)                     ( void );
 
 	// OpenGL-specific
 	void *			(*GL_GetProcAddress)				( const char *name );
 	qboolean		(*GL_ExtensionSupported)			( const char *extension );
+	qboolean		(*GL_MakeCurrent)					( qboolean current );	// binds or releases the context on the calling thread
 
 	// gpvCachedMapDiskImage
 	void *			(*CM_GetCachedMapDiskImage)			( void );
@@ -52,9 +52,8 @@ static inline void DestroyGoreTexCoordinates(int tag)
 	{
 		return;
 	}
-	gTC->~GoreTextureCoordinates();
-	//I don't know what's going on here, it should call the destructor for
-	//this when it erases the record but sometimes it doesn't. -rww
+	// the back end may still be drawing them
+	R_RetireGoreTexCoordinates(gTC);
 }
 
 //TODO: This needs to be set via a scalability cvar with some reasonable minimum value if pgore is used at all
@@ -73,7 +72,7 @@ int AllocGoreRecord()
 
 		if (gTC)
 		{
-			gTC->~GoreTextureCoordinates();
+			R_RetireGoreTexCoordinates(gTC);
 		}
 		GoreRecords.erase(GoreRecords.begin());
 		while (GoreRecords.size())
@@ -87,7 +86,7 @@ int AllocGoreRecord()
 
 			if (gTC)
 			{
-				gTC->~GoreTextureCoordinates();
+				R_RetireGoreTexCoordinates(gTC);
 			}
 			GoreRecords.erase(GoreRecords.begin());
 		}
@@ -37,10 +37,21 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "Ravl/CVec.h"
 #include "Ratl/vector_vs.h"
-#include "Ratl/bits_vs.h"
 
 #include "glext.h"
 
+#include "qcommon/jobs.h"
+
+#include <vector>
+
+// particles are stepped four at a time where SSE is always there
+#if defined(__SSE__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+#define WE_SIMD_SSE	1
+#include <xmmintrin.h>
+#else
+#define WE_SIMD_SSE	0
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////
 // Defines
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -52,6 +63,8 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #define POINTCACHE_CELL_SIZE	96.0f
 
+#define PARTICLE_JOB_SIZE		1024		// particles per worker job, a multiple of 4
+
 
 ////////////////////////////////////////////////////////////////////////////////////////
 // Globals
@@ -195,7 +208,7 @@ struct	SVecRange
 		}
 	}
 
-	inline bool In(const CVec3& V)
+	inline bool In(const CVec3& V) const
 	{
 		return (V>mMins && V<mMaxs);
 	}
@@ -246,30 +259,40 @@ struct	SIntRange
 
 
 ////////////////////////////////////////////////////////////////////////////////////////
-// The Particle Class
+// The Particles
+//
+// A cloud keeps its particles as one array per field rather than an array of
+// particle structs, so the physics can step four of them at once.
 ////////////////////////////////////////////////////////////////////////////////////////
-class	CWeatherParticle
+enum
 {
-public:
-	enum
-	{
-		FLAG_RENDER = 0,
-
-		FLAG_FADEIN,
-		FLAG_FADEOUT,
-		FLAG_RESPAWN,
+	PARTICLE_RENDER		= (1<<0),
+	PARTICLE_FADEIN		= (1<<1),
+	PARTICLE_FADEOUT	= (1<<2),
+};
 
-		FLAG_MAX
-	};
-	typedef		ratl::bits_vs<FLAG_MAX>		TFlags;
+////////////////////////////////////////////////////////////////////////////////////////
+// Particle updates may run on the weather workers, and rand() is not thread safe,
+// so each batch of particles draws from its own generator
+////////////////////////////////////////////////////////////////////////////////////////
+struct	SWeatherRandom
+{
+	uint32_t	mState;
 
-	float	mAlpha;
-	TFlags	mFlags;
-	CVec3	mPosition;
-	CVec3	mVelocity;
-	float	mMass;			// A higher number will more greatly resist force and result in greater gravity
+	inline float Range(float min, float max)
+	{
+		mState ^= mState << 13;
+		mState ^= mState >> 17;
+		mState ^= mState << 5;
+		return ((mState >> 8) * (1.0f / 16777216.0f)) * (max - min) + min;
+	}
 };
 
+// only ever touched by the back end, which may be on its own thread
+static Q::JobPool				weatherPool;
+static std::vector<int>			weatherJobRendered;
+static std::vector<uint32_t>	weatherJobSeed;
+
 
 
 
@@ -406,7 +429,7 @@ private:
 		////////////////////////////////////////////////////////////////////////////////////
 		// Convert To Cell
 		////////////////////////////////////////////////////////////////////////////////////
-		inline	void	ConvertToCell(const CVec3& pos, int& x, int& y, int& z, int& bit)
+		inline	void	ConvertToCell(const CVec3& pos, int& x, int& y, int& z, int& bit) const
 		{
 			x = (int)((pos[0] / POINTCACHE_CELL_SIZE) - mSize.mMins[0]);
 			y = (int)((pos[1] / POINTCACHE_CELL_SIZE) - mSize.mMins[1]);
@@ -419,7 +442,7 @@ private:
 		////////////////////////////////////////////////////////////////////////////////////
 		// CellOutside - Test to see if a given cell is outside
 		////////////////////////////////////////////////////////////////////////////////////
-		inline	bool	CellOutside(int x, int y, int z, int bit)
+		inline	bool	CellOutside(int x, int y, int z, int bit) const
 		{
 			if ((x < 0 || x >= mWidth) || (y < 0 || y >= mHeight) || (z < 0 || z >= mDepth) || (bit < 0 || bit >= 32))
 			{
@@ -430,21 +453,19 @@ private:
 	};
 	ratl::vector_vs<SWeatherZone, MAX_WEATHER_ZONES>	mWeatherZones;
 
-
-private:
 	////////////////////////////////////////////////////////////////////////////////////
-	// Iteration Variables
+	// Span Masks - For particles at least a cell across, a bit per cell that is set
+	// when every cell the particle would cover from there is outside, so testing a
+	// particle is one lookup instead of a walk over its neighbourhood.  Built on the
+	// back end, which may be on its own thread, so they stay off the zone.
 	////////////////////////////////////////////////////////////////////////////////////
-	int				mWCells;
-	int				mHCells;
-
-	int				mXCell;
-	int				mYCell;
-	int				mZBit;
-
-	int				mXMax;
-	int				mYMax;
-	int				mZMax;
+	struct SSpanMask
+	{
+		int			mWCells;
+		int			mHCells;
+		uint32_t*	mCells[MAX_WEATHER_ZONES];
+	};
+	ratl::vector_vs<SSpanMask, MAX_PARTICLE_CLOUDS>		mSpanMasks;
 
 
 private:
@@ -453,7 +474,7 @@ private:
 	////////////////////////////////////////////////////////////////////////////////////
 	// Contents Outside
 	////////////////////////////////////////////////////////////////////////////////////
-	inline	bool	ContentsOutside(int contents)
+	inline	bool	ContentsOutside(int contents) const
 	{
 		if (contents&CONTENTS_WATER || contents&CONTENTS_SOLID)
 		{
@@ -489,6 +510,19 @@ public:
 			mWeatherZones[wz].mPointCache = 0;
 		}
 		mWeatherZones.clear();
+		ClearSpanMasks();
+	}
+
+	void ClearSpanMasks()
+	{
+		for (int sm=0; sm<mSpanMasks.size(); sm++)
+		{
+			for (int wz=0; wz<MAX_WEATHER_ZONES; wz++)
+			{
+				delete [] mSpanMasks[sm].mCells[wz];
+			}
+		}
+		mSpanMasks.clear();
 	}
 
 	COutside()
@@ -634,11 +668,121 @@ public:
 
 
 
+private:
+	////////////////////////////////////////////////////////////////////////////////////
+	// Erode - Clears every bit of a row whose neighbours within reach aren't all set,
+	// treating anything past the ends as fill
+	////////////////////////////////////////////////////////////////////////////////////
+	static void		ErodeRow(const uint32_t* in, uint32_t* out, int count, int stride, int reach, uint32_t fill)
+	{
+		for (int i=0; i<count; i++)
+		{
+			uint32_t	cell = ~0u;
+			for (int n=i-reach; n<=i+reach; n++)
+			{
+				cell &= (n<0 || n>=count)?(fill):(in[n*stride]);
+			}
+			out[i*stride] = cell;
+		}
+	}
+
+	static uint32_t	ErodeBits(uint32_t word, int reach, bool fill)
+	{
+		uint32_t	result = word;
+		for (int k=1; k<=reach; k++)
+		{
+			if (k>=32)
+			{
+				return (fill)?(result):(0);
+			}
+			const uint32_t	high = (fill)?(~0u << (32-k)):(0);
+			const uint32_t	low  = (fill)?(~0u >> (32-k)):(0);
+			result &= ((word >> k) | high) & ((word << k) | low);
+		}
+		return result;
+	}
+
 public:
+	////////////////////////////////////////////////////////////////////////////////////
+	// PrepareSpanMask - Builds the span mask for particles of the given size, if they
+	// need one and it doesn't exist yet.  Must not run while particles are updating.
+	////////////////////////////////////////////////////////////////////////////////////
+	void			PrepareSpanMask(float width, float height)
+	{
+		if (!mCacheInit || width<POINTCACHE_CELL_SIZE || height<POINTCACHE_CELL_SIZE)
+		{
+			return;
+		}
+
+		const int	wCells = ((int)width  / POINTCACHE_CELL_SIZE);
+		const int	hCells = ((int)height / POINTCACHE_CELL_SIZE);
+		for (int sm=0; sm<mSpanMasks.size(); sm++)
+		{
+			if (mSpanMasks[sm].mWCells==wCells && mSpanMasks[sm].mHCells==hCells)
+			{
+				return;
+			}
+		}
+		if (mSpanMasks.full())
+		{
+			ClearSpanMasks();
+		}
+
+		SSpanMask&	span = mSpanMasks.push_back();
+		span.mWCells = wCells;
+		span.mHCells = hCells;
+
+		// Cells past the edges of a zone count as inside when the map marks outside, and the other way around
+		//------------------------------------------------------------------------------------------------------
+		const bool		fill		= !(SWeatherZone::mMarkedOutside);
+		const uint32_t	fillWord	= (fill)?(~0u):(0);
+
+		for (int zone=0; zone<MAX_WEATHER_ZONES; zone++)
+		{
+			span.mCells[zone] = 0;
+			if (zone>=mWeatherZones.size())
+			{
+				continue;
+			}
+
+			const SWeatherZone&	wz = mWeatherZones[zone];
+			const int	rowSize		= wz.mWidth;
+			const int	layerSize	= wz.mWidth * wz.mHeight;
+			const int	arraySize	= layerSize * wz.mDepth;
+			uint32_t*	cells		= new uint32_t[arraySize];
+			uint32_t*	temp		= new uint32_t[arraySize];
+
+			// Outside Cells, Then Erode Up And Down Within Each Word
+			//--------------------------------------------------------
+			for (int i=0; i<arraySize; i++)
+			{
+				const uint32_t	outside = (SWeatherZone::mMarkedOutside)?(wz.mPointCache[i]):(~wz.mPointCache[i]);
+				cells[i] = ErodeBits(outside, hCells, fill);
+			}
+
+			// Then Across X And Y
+			//---------------------
+			for (int z=0; z<wz.mDepth; z++)
+			{
+				for (int y=0; y<wz.mHeight; y++)
+				{
+					ErodeRow(cells + z*layerSize + y*rowSize, temp + z*layerSize + y*rowSize, wz.mWidth, 1, wCells, fillWord);
+				}
+				for (int x=0; x<wz.mWidth; x++)
+				{
+					ErodeRow(temp + z*layerSize + x, cells + z*layerSize + x, wz.mHeight, rowSize, wCells, fillWord);
+				}
+			}
+
+			delete [] temp;
+			span.mCells[zone] = cells;
+		}
+	}
+
 	////////////////////////////////////////////////////////////////////////////////////
 	// PointOutside - Test to see if a given point is outside
 	////////////////////////////////////////////////////////////////////////////////////
-	inline	bool	PointOutside(const CVec3& pos)
+	inline	bool	PointOutside(const CVec3& pos) const
 	{
 		if (!mCacheInit)
 		{
@@ -646,7 +790,7 @@ public:
 		}
 		for (int zone=0; zone<mWeatherZones.size(); zone++)
 		{
-			SWeatherZone	wz = mWeatherZones[zone];
+			const SWeatherZone&	wz = mWeatherZones[zone];
 			if (wz.mExtents.In(pos))
 			{
 				int		bit, x, y, z;
@@ -660,13 +804,14 @@ public:
 
 
 	////////////////////////////////////////////////////////////////////////////////////
-	// PointOutside - Test to see if a given bounded plane is outside
+	// PointOutside - Test to see if a given bounded plane is outside.  Safe to call from
+	// several threads at once.
 	////////////////////////////////////////////////////////////////////////////////////
-	inline	bool	PointOutside(const CVec3& pos, float width, float height)
+	inline	bool	PointOutside(const CVec3& pos, float width, float height) const
 	{
 		for (int zone=0; zone<mWeatherZones.size(); zone++)
 		{
-			SWeatherZone	wz = mWeatherZones[zone];
+			const SWeatherZone&	wz = mWeatherZones[zone];
 			if (wz.mExtents.In(pos))
 			{
 				int		bit, x, y, z;
@@ -676,20 +821,32 @@ public:
  					return (wz.CellOutside(x, y, z, bit));
 				}
 
-				mWCells = ((int)width  / POINTCACHE_CELL_SIZE);
-				mHCells = ((int)height / POINTCACHE_CELL_SIZE);
+				const int	wCells = ((int)width  / POINTCACHE_CELL_SIZE);
+				const int	hCells = ((int)height / POINTCACHE_CELL_SIZE);
 
-				mXMax = x + mWCells;
-				mYMax = y + mWCells;
-				mZMax = bit + mHCells;
+				// One Lookup In The Span Mask, If There Is One
+				//----------------------------------------------
+				if (x>=0 && x<wz.mWidth && y>=0 && y<wz.mHeight && z>=0 && z<wz.mDepth)
+				{
+					for (int sm=0; sm<mSpanMasks.size(); sm++)
+					{
+						const SSpanMask&	span = mSpanMasks[sm];
+						if (span.mWCells==wCells && span.mHCells==hCells && span.mCells[zone])
+						{
+							return !!(span.mCells[zone][((z * wz.mWidth * wz.mHeight) + (y * wz.mWidth) + x)]&(1 << bit));
+						}
+					}
+				}
 
-				for (mXCell=x-mWCells; mXCell<=mXMax; mXCell++)
+				// Otherwise Walk The Neighbourhood
+				//----------------------------------
+				for (int xCell=x-wCells; xCell<=x+wCells; xCell++)
 				{
-					for (mYCell=y-mWCells; mYCell<=mYMax; mYCell++)
+					for (int yCell=y-wCells; yCell<=y+wCells; yCell++)
 					{
-						for (mZBit=bit-mHCells; mZBit<=mZMax; mZBit++)
+						for (int zBit=bit-hCells; zBit<=bit+hCells; zBit++)
 						{
-							if (!wz.CellOutside(mXCell, mYCell, z, mZBit))
+							if (!wz.CellOutside(xCell, yCell, z, zBit))
 							{
 								return false;
 							}
@@ -737,7 +894,15 @@ private:
 	// DYNAMIC MEMORY
 	////////////////////////////////////////////////////////////////////////////////////
 	image_t*	mImage;
-	CWeatherParticle*	mParticles;
+	float*		mParticleData;		// all the arrays below, in one block
+
+	// One Entry Per Particle, Padded To A Multiple Of Four
+	//------------------------------------------------------
+	float*		mParticlePosition[3];
+	float*		mParticleVelocity[3];
+	float*		mParticleMass;		// A higher number will more greatly resist force and result in greater gravity
+	float*		mParticleAlpha;
+	byte*		mParticleFlags;
 
 private:
 	////////////////////////////////////////////////////////////////////////////////////
@@ -808,7 +973,7 @@ public:
 	void	Initialize(int count, const char* texturePath, int VertexCount=4)
 	{
 		Reset();
-		assert(mParticleCount==0 && mParticles==0);
+		assert(mParticleCount==0 && mParticleData==0);
 		assert(mImage==0);
 
 		// Create The Image
@@ -826,18 +991,29 @@ public:
 		// Create The Particles
 		//----------------------
 		mParticleCount	= count;
-		mParticles		= new CWeatherParticle[mParticleCount];
-
 
+		const int	padded	= (mParticleCount + 3) & ~3;
+		mParticleData	= new float[padded * 9];
+		memset(mParticleData, 0, padded * 9 * sizeof(float));
+		for (int dim=0; dim<3; dim++)
+		{
+			mParticlePosition[dim]	= mParticleData + padded * dim;
+			mParticleVelocity[dim]	= mParticleData + padded * (3 + dim);
+		}
+		mParticleMass	= mParticleData + padded * 6;
+		mParticleAlpha	= mParticleData + padded * 7;
+		mParticleFlags	= (byte*)(mParticleData + padded * 8);
 
-		CWeatherParticle*	part=0;
-		for (int particleNum=0; particleNum<mParticleCount; particleNum++)
+		for (int particleNum=0; particleNum<padded; particleNum++)
 		{
-			part = &(mParticles[particleNum]);
-			part->mPosition.Clear();
-			part->mVelocity.Clear();
-			part->mAlpha	= 0.0f;
-			mMass.Pick(part->mMass);
+			if (particleNum<mParticleCount)
+			{
+				mMass.Pick(mParticleMass[particleNum]);
+			}
+			else
+			{
+				mParticleMass[particleNum] = 1.0f;		// padding, stepped but never used
+			}
 		}
 
 		mVertexCount = VertexCount;
@@ -858,10 +1034,10 @@ public:
 		mImage				= 0;
 		if (mParticleCount)
 		{
-			delete [] mParticles;
+			delete [] mParticleData;
 		}
 		mParticleCount		= 0;
-		mParticles			= 0;
+		mParticleData		= 0;
 
 		mPopulated			= 0;
 
@@ -939,17 +1115,6 @@ public:
 	////////////////////////////////////////////////////////////////////////////////////
 	void		Update()
 	{
-		CWeatherParticle*	part=0;
-		CVec3		partForce;
-		CVec3		partMoved;
-		CVec3		partToCamera;
-		bool		partRendering;
-		bool		partOutside;
-		bool		partInRange;
-		bool		partInView;
-		int			particleNum;
-		float		particleFade = (mFade * mSecondsElapsed);
-
 /* TODO: Non Global Wind Zones
 		CWindZone*	wind=0;
 		int			windNum;
@@ -1071,148 +1236,282 @@ public:
 
 
 
-		// Now Update All Particles
-		//--------------------------
-		mParticleCountRender = 0;
-		for (particleNum=0; particleNum<mParticleCount; particleNum++)
+		// First Time Spawn Locations
+		//----------------------------
+		if (!mPopulated)
 		{
-			part			= &mParticles[particleNum];
-
-			if (!mPopulated)
+			CVec3	pos;
+			for (int particleNum=0; particleNum<mParticleCount; particleNum++)
 			{
-				mRange.Pick(part->mPosition);		// First Time Spawn Location
+				mRange.Pick(pos);
+				mParticlePosition[0][particleNum] = pos[0];
+				mParticlePosition[1][particleNum] = pos[1];
+				mParticlePosition[2][particleNum] = pos[2];
 			}
+		}
 
-			// Grab The Force And Apply Non Global Wind
-			//------------------------------------------
-			partForce = force;
-			partForce /= part->mMass;
 
+		// Now Update All Particles, Spread Over The Weather Workers When There Are Enough
+		//----------------------------------------------------------------------------------
+		mOutside.PrepareSpanMask(mWidth, mHeight);
 
-			// Apply The Force
-			//-----------------
-			part->mVelocity		+= partForce;
-			part->mVelocity		*= mFrictionInverse;
+		const int	numJobs = (mParticleCount + PARTICLE_JOB_SIZE - 1) / PARTICLE_JOB_SIZE;
+		std::vector<int>&		jobRendered	= weatherJobRendered;
+		std::vector<uint32_t>&	jobSeed		= weatherJobSeed;
 
-			part->mPosition.ScaleAdd(part->mVelocity, mSecondsElapsed);
+		jobRendered.resize(numJobs);
+		jobSeed.resize(numJobs);
+		for (int job=0; job<numJobs; job++)
+		{
+			jobSeed[job] = ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ 0x9e3779b9u;
+		}
 
-			partToCamera	= (part->mPosition - mCameraPosition);
-			partRendering	= part->mFlags.get_bit(CWeatherParticle::FLAG_RENDER);
-			partOutside		= mOutside.PointOutside(part->mPosition, mWidth, mHeight);
-			partInRange		= mRange.In(part->mPosition);
-			partInView		= (partOutside && partInRange && (partToCamera.Dot(mCameraForward)>0.0f));
+		const Q::JobPool::Job	updateJob = [&](int job)
+		{
+			const int	first	= job * PARTICLE_JOB_SIZE;
+			const int	last	= Q_min(first + PARTICLE_JOB_SIZE, mParticleCount);
+			jobRendered[job] = UpdateParticles(first, last, force, jobSeed[job]);
+		};
+		if (weatherPool.numWorkers()!=r_weatherThreads->integer)
+		{
+			weatherPool.setNumWorkers(r_weatherThreads->integer);
+		}
+		weatherPool.parallelFor(numJobs, updateJob);
 
-			// Process Respawn
-			//-----------------
-			if (!partInRange && !partRendering)
+		mParticleCountRender = 0;
+		for (int job=0; job<numJobs; job++)
+		{
+			mParticleCountRender += jobRendered[job];
+		}
+		mPopulated = true;
+	}
+
+private:
+	////////////////////////////////////////////////////////////////////////////////////
+	// UpdateParticleState - Respawn And Fade One Particle, Once It Has Moved
+	////////////////////////////////////////////////////////////////////////////////////
+	inline bool	UpdateParticleState(int particleNum, bool partInRange, bool partInFront, float particleFade, SWeatherRandom& random)
+	{
+		byte&	flags			= mParticleFlags[particleNum];
+		float&	alpha			= mParticleAlpha[particleNum];
+		bool	partRendering	= !!(flags & PARTICLE_RENDER);
+		bool	partInView;
+
+		{
+			CVec3	pos(mParticlePosition[0][particleNum], mParticlePosition[1][particleNum], mParticlePosition[2][particleNum]);
+			partInView = (partInRange && partInFront && mOutside.PointOutside(pos, mWidth, mHeight));
+		}
+
+		// Process Respawn
+		//-----------------
+		if (!partInRange && !partRendering)
+		{
+			CVec3	pos;
+
+			mParticleVelocity[0][particleNum] = 0.0f;
+			mParticleVelocity[1][particleNum] = 0.0f;
+			mParticleVelocity[2][particleNum] = 0.0f;
+
+			// Reselect A Position On The Spawn Plane
+			//----------------------------------------
+			if (UseSpawnPlane())
 			{
-				part->mVelocity.Clear();
+				pos		= mCameraPosition;
+				pos		-= (mSpawnPlaneNorm* mSpawnPlaneDistance);
+				pos		+= (mSpawnPlaneRight*random.Range(-mSpawnPlaneSize, mSpawnPlaneSize));
+				pos		+= (mSpawnPlaneUp*   random.Range(-mSpawnPlaneSize, mSpawnPlaneSize));
+			}
 
-				// Reselect A Position On The Spawn Plane
-				//----------------------------------------
-				if (UseSpawnPlane())
-				{
-					part->mPosition		= mCameraPosition;
-					part->mPosition		-= (mSpawnPlaneNorm* mSpawnPlaneDistance);
-					part->mPosition		+= (mSpawnPlaneRight*WE_flrand(-mSpawnPlaneSize, mSpawnPlaneSize));
-					part->mPosition		+= (mSpawnPlaneUp*   WE_flrand(-mSpawnPlaneSize, mSpawnPlaneSize));
-				}
+			// Otherwise, Just Wrap Around To The Other End Of The Range
+			//-----------------------------------------------------------
+			else
+			{
+				pos.Set(mParticlePosition[0][particleNum], mParticlePosition[1][particleNum], mParticlePosition[2][particleNum]);
+				mRange.Wrap(pos, mSpawnRange);
+			}
 
-				// Otherwise, Just Wrap Around To The Other End Of The Range
-				//-----------------------------------------------------------
-				else
-				{
-					mRange.Wrap(part->mPosition, mSpawnRange);
-				}
-				partInRange = true;
+			mParticlePosition[0][particleNum] = pos[0];
+			mParticlePosition[1][particleNum] = pos[1];
+			mParticlePosition[2][particleNum] = pos[2];
+		}
+
+		// Process Fade
+		//--------------
+		{
+			// Start A Fade Out
+			//------------------
+			if		(partRendering && !partInView)
+			{
+				flags &= ~PARTICLE_FADEIN;
+				flags |= PARTICLE_FADEOUT;
 			}
 
-			// Process Fade
-			//--------------
+			// Switch From Fade Out To Fade In
+			//---------------------------------
+			else if (partRendering && partInView && (flags & PARTICLE_FADEOUT))
 			{
-				// Start A Fade Out
-				//------------------
-				if		(partRendering && !partInView)
-				{
-					part->mFlags.clear_bit(CWeatherParticle::FLAG_FADEIN);
-					part->mFlags.set_bit(CWeatherParticle::FLAG_FADEOUT);
-				}
+				flags |= PARTICLE_FADEIN;
+				flags &= ~PARTICLE_FADEOUT;
+			}
 
-				// Switch From Fade Out To Fade In
-				//---------------------------------
-				else if (partRendering && partInView && part->mFlags.get_bit(CWeatherParticle::FLAG_FADEOUT))
-				{
-					part->mFlags.set_bit(CWeatherParticle::FLAG_FADEIN);
-					part->mFlags.clear_bit(CWeatherParticle::FLAG_FADEOUT);
-				}
+			// Start A Fade In
+			//-----------------
+			else if (!partRendering && partInView)
+			{
+				partRendering = true;
+				alpha = 0.0f;
+				flags |= (PARTICLE_RENDER | PARTICLE_FADEIN);
+				flags &= ~PARTICLE_FADEOUT;
+			}
 
-				// Start A Fade In
-				//-----------------
-				else if (!partRendering && partInView)
-				{
-					partRendering = true;
-					part->mAlpha = 0.0f;
-					part->mFlags.set_bit(CWeatherParticle::FLAG_RENDER);
-					part->mFlags.set_bit(CWeatherParticle::FLAG_FADEIN);
-					part->mFlags.clear_bit(CWeatherParticle::FLAG_FADEOUT);
-				}
+			// Update Fade
+			//-------------
+			if (partRendering)
+			{
 
-				// Update Fade
-				//-------------
-				if (partRendering)
+				// Update Fade Out
+				//-----------------
+				if (flags & PARTICLE_FADEOUT)
 				{
-
-					// Update Fade Out
-					//-----------------
-					if (part->mFlags.get_bit(CWeatherParticle::FLAG_FADEOUT))
+					alpha -= particleFade;
+					if (alpha<=0.0f)
 					{
-						part->mAlpha -= particleFade;
-						if (part->mAlpha<=0.0f)
-						{
-							part->mAlpha = 0.0f;
-							part->mFlags.clear_bit(CWeatherParticle::FLAG_FADEOUT);
-							part->mFlags.clear_bit(CWeatherParticle::FLAG_FADEIN);
-							part->mFlags.clear_bit(CWeatherParticle::FLAG_RENDER);
-							partRendering = false;
-						}
+						alpha = 0.0f;
+						flags &= ~(PARTICLE_FADEOUT | PARTICLE_FADEIN | PARTICLE_RENDER);
+						partRendering = false;
 					}
+				}
 
-					// Update Fade In
-					//----------------
-					else if (part->mFlags.get_bit(CWeatherParticle::FLAG_FADEIN))
+				// Update Fade In
+				//----------------
+				else if (flags & PARTICLE_FADEIN)
+				{
+					alpha += particleFade;
+					if (alpha>=mColor[3])
 					{
-						part->mAlpha += particleFade;
-						if (part->mAlpha>=mColor[3])
-						{
-							part->mFlags.clear_bit(CWeatherParticle::FLAG_FADEIN);
-							part->mAlpha = mColor[3];
-						}
+						flags &= ~PARTICLE_FADEIN;
+						alpha = mColor[3];
 					}
 				}
 			}
+		}
 
-			// Keep Track Of The Number Of Particles To Render
-			//-------------------------------------------------
-			if (part->mFlags.get_bit(CWeatherParticle::FLAG_RENDER))
-			{
-				mParticleCountRender ++;
-			}
+		return !!(flags & PARTICLE_RENDER);
+	}
 
+	////////////////////////////////////////////////////////////////////////////////////
+	// UpdateParticles - Applies The Forces To Particles [first, last) And Works Out
+	// Which Of Them Are In Range And In Front Of The Camera, Four At A Time Where It
+	// Can.  Returns How Many Of Them Will Render.
+	////////////////////////////////////////////////////////////////////////////////////
+	int			UpdateParticles(int first, int last, const CVec3& force, uint32_t seed)
+	{
+		SWeatherRandom	random;
+		const float		particleFade = (mFade * mSecondsElapsed);
+		int				rendered = 0;
+
+		random.mState = seed ? seed : 1;
+
+#if WE_SIMD_SSE
+		const __m128	forceX		= _mm_set1_ps(force[0]);
+		const __m128	forceY		= _mm_set1_ps(force[1]);
+		const __m128	forceZ		= _mm_set1_ps(force[2]);
+		const __m128	friction	= _mm_set1_ps(mFrictionInverse);
+		const __m128	seconds		= _mm_set1_ps(mSecondsElapsed);
+		const __m128	minsX		= _mm_set1_ps(mRange.mMins[0]);
+		const __m128	minsY		= _mm_set1_ps(mRange.mMins[1]);
+		const __m128	minsZ		= _mm_set1_ps(mRange.mMins[2]);
+		const __m128	maxsX		= _mm_set1_ps(mRange.mMaxs[0]);
+		const __m128	maxsY		= _mm_set1_ps(mRange.mMaxs[1]);
+		const __m128	maxsZ		= _mm_set1_ps(mRange.mMaxs[2]);
+		const __m128	cameraX		= _mm_set1_ps(mCameraPosition[0]);
+		const __m128	cameraY		= _mm_set1_ps(mCameraPosition[1]);
+		const __m128	cameraZ		= _mm_set1_ps(mCameraPosition[2]);
+		const __m128	forwardX	= _mm_set1_ps(mCameraForward[0]);
+		const __m128	forwardY	= _mm_set1_ps(mCameraForward[1]);
+		const __m128	forwardZ	= _mm_set1_ps(mCameraForward[2]);
+
+		for (int particleNum=first; particleNum<last; particleNum+=4)
+		{
+			const __m128	mass = _mm_loadu_ps(mParticleMass + particleNum);
+			__m128			velX, velY, velZ, posX, posY, posZ, inRange, inFront;
 
+			// Apply The Force
+			//-----------------
+			velX = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(mParticleVelocity[0] + particleNum), _mm_div_ps(forceX, mass)), friction);
+			velY = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(mParticleVelocity[1] + particleNum), _mm_div_ps(forceY, mass)), friction);
+			velZ = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(mParticleVelocity[2] + particleNum), _mm_div_ps(forceZ, mass)), friction);
+			posX = _mm_add_ps(_mm_loadu_ps(mParticlePosition[0] + particleNum), _mm_mul_ps(velX, seconds));
+			posY = _mm_add_ps(_mm_loadu_ps(mParticlePosition[1] + particleNum), _mm_mul_ps(velY, seconds));
+			posZ = _mm_add_ps(_mm_loadu_ps(mParticlePosition[2] + particleNum), _mm_mul_ps(velZ, seconds));
+			_mm_storeu_ps(mParticleVelocity[0] + particleNum, velX);
+			_mm_storeu_ps(mParticleVelocity[1] + particleNum, velY);
+			_mm_storeu_ps(mParticleVelocity[2] + particleNum, velZ);
+			_mm_storeu_ps(mParticlePosition[0] + particleNum, posX);
+			_mm_storeu_ps(mParticlePosition[1] + particleNum, posY);
+			_mm_storeu_ps(mParticlePosition[2] + particleNum, posZ);
+
+			// Range And Facing
+			//------------------
+			inRange = _mm_and_ps(_mm_cmpgt_ps(posX, minsX), _mm_cmplt_ps(posX, maxsX));
+			inRange = _mm_and_ps(inRange, _mm_and_ps(_mm_cmpgt_ps(posY, minsY), _mm_cmplt_ps(posY, maxsY)));
+			inRange = _mm_and_ps(inRange, _mm_and_ps(_mm_cmpgt_ps(posZ, minsZ), _mm_cmplt_ps(posZ, maxsZ)));
+			inFront = _mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(_mm_sub_ps(posX, cameraX), forwardX),
+						_mm_mul_ps(_mm_sub_ps(posY, cameraY), forwardY)),
+						_mm_mul_ps(_mm_sub_ps(posZ, cameraZ), forwardZ));
+			inFront = _mm_cmpgt_ps(inFront, _mm_setzero_ps());
+
+			const int	rangeBits = _mm_movemask_ps(inRange);
+			const int	frontBits = _mm_movemask_ps(inFront);
+			const int	count = Q_min(4, last - particleNum);
+			for (int i=0; i<count; i++)
+			{
+				if (UpdateParticleState(particleNum + i, !!(rangeBits & (1<<i)), !!(frontBits & (1<<i)), particleFade, random))
+				{
+					rendered++;
+				}
+			}
+		}
+#else
+		for (int particleNum=first; particleNum<last; particleNum++)
+		{
+			CVec3	vel(mParticleVelocity[0][particleNum], mParticleVelocity[1][particleNum], mParticleVelocity[2][particleNum]);
+			CVec3	pos(mParticlePosition[0][particleNum], mParticlePosition[1][particleNum], mParticlePosition[2][particleNum]);
+			CVec3	partForce(force);
 
+			// Apply The Force
+			//-----------------
+			partForce /= mParticleMass[particleNum];
+			vel += partForce;
+			vel *= mFrictionInverse;
+			pos.ScaleAdd(vel, mSecondsElapsed);
 
+			for (int dim=0; dim<3; dim++)
+			{
+				mParticleVelocity[dim][particleNum] = vel[dim];
+				mParticlePosition[dim][particleNum] = pos[dim];
+			}
 
+			if (UpdateParticleState(particleNum, mRange.In(pos), ((pos - mCameraPosition).Dot(mCameraForward)>0.0f), particleFade, random))
+			{
+				rendered++;
+			}
 		}
-		mPopulated = true;
+#endif
+
+		return rendered;
 	}
 
+public:
 	////////////////////////////////////////////////////////////////////////////////////
 	// Render -
 	////////////////////////////////////////////////////////////////////////////////////
 	void		Render()
 	{
-		CWeatherParticle*	part=0;
 		int			particleNum;
+		float		alpha;
+		CVec3		pos;
 
 
 		// Set The GL State And Image Binding
@@ -1243,24 +1542,25 @@ public:
 		qglBegin(mGLModeEnum);
 		for (particleNum=0; particleNum<mParticleCount; particleNum++)
 		{
-			part = &(mParticles[particleNum]);
-			if (!part->mFlags.get_bit(CWeatherParticle::FLAG_RENDER))
+			if (!(mParticleFlags[particleNum] & PARTICLE_RENDER))
 			{
 				continue;
 			}
+			alpha = mParticleAlpha[particleNum];
+			pos.Set(mParticlePosition[0][particleNum], mParticlePosition[1][particleNum], mParticlePosition[2][particleNum]);
 
 			// Blend Mode Zero -> Apply Alpha Just To Alpha Channel
 			//------------------------------------------------------
 			if (mBlendMode==0)
 			{
-				qglColor4f(mColor[0], mColor[1], mColor[2], part->mAlpha);
+				qglColor4f(mColor[0], mColor[1], mColor[2], alpha);
 			}
 
 			// Otherwise Apply Alpha To All Channels
 			//---------------------------------------
 			else
 			{
-				qglColor4f(mColor[0]*part->mAlpha, mColor[1]*part->mAlpha, mColor[2]*part->mAlpha, mColor[3]*part->mAlpha);
+				qglColor4f(mColor[0]*alpha, mColor[1]*alpha, mColor[2]*alpha, mColor[3]*alpha);
 			}
 
 			// Render A Triangle
@@ -1268,19 +1568,19 @@ public:
 			if (mVertexCount==3)
 			{
  				qglTexCoord2f(1.0, 0.0);
-				qglVertex3f(part->mPosition[0],
-							part->mPosition[1],
-							part->mPosition[2]);
+				qglVertex3f(pos[0],
+							pos[1],
+							pos[2]);
 
 				qglTexCoord2f(0.0, 1.0);
-				qglVertex3f(part->mPosition[0] + mCameraLeft[0],
-							part->mPosition[1] + mCameraLeft[1],
-							part->mPosition[2] + mCameraLeft[2]);
+				qglVertex3f(pos[0] + mCameraLeft[0],
+							pos[1] + mCameraLeft[1],
+							pos[2] + mCameraLeft[2]);
 
 				qglTexCoord2f(0.0, 0.0);
-				qglVertex3f(part->mPosition[0] + mCameraLeftPlusUp[0],
-							part->mPosition[1] + mCameraLeftPlusUp[1],
-							part->mPosition[2] + mCameraLeftPlusUp[2]);
+				qglVertex3f(pos[0] + mCameraLeftPlusUp[0],
+							pos[1] + mCameraLeftPlusUp[1],
+							pos[2] + mCameraLeftPlusUp[2]);
 			}
 
 			// Render A Quad
@@ -1289,27 +1589,27 @@ public:
 			{
 				// Left bottom.
 				qglTexCoord2f( 0.0, 0.0 );
-				qglVertex3f(part->mPosition[0] - mCameraLeftMinusUp[0],
-							part->mPosition[1] - mCameraLeftMinusUp[1],
-							part->mPosition[2] - mCameraLeftMinusUp[2] );
+				qglVertex3f(pos[0] - mCameraLeftMinusUp[0],
+							pos[1] - mCameraLeftMinusUp[1],
+							pos[2] - mCameraLeftMinusUp[2] );
 
 				// Right bottom.
 				qglTexCoord2f( 1.0, 0.0 );
-				qglVertex3f(part->mPosition[0] - mCameraLeftPlusUp[0],
-							part->mPosition[1] - mCameraLeftPlusUp[1],
-							part->mPosition[2] - mCameraLeftPlusUp[2] );
+				qglVertex3f(pos[0] - mCameraLeftPlusUp[0],
+							pos[1] - mCameraLeftPlusUp[1],
+							pos[2] - mCameraLeftPlusUp[2] );
 
 				// Right top.
 				qglTexCoord2f( 1.0, 1.0 );
-				qglVertex3f(part->mPosition[0] + mCameraLeftMinusUp[0],
-							part->mPosition[1] + mCameraLeftMinusUp[1],
-							part->mPosition[2] + mCameraLeftMinusUp[2] );
+				qglVertex3f(pos[0] + mCameraLeftMinusUp[0],
+							pos[1] + mCameraLeftMinusUp[1],
+							pos[2] + mCameraLeftMinusUp[2] );
 
 				// Left top.
 				qglTexCoord2f( 0.0, 1.0 );
-				qglVertex3f(part->mPosition[0] + mCameraLeftPlusUp[0],
-							part->mPosition[1] + mCameraLeftPlusUp[1],
-							part->mPosition[2] + mCameraLeftPlusUp[2] );
+				qglVertex3f(pos[0] + mCameraLeftPlusUp[0],
+							pos[1] + mCameraLeftPlusUp[1],
+							pos[2] + mCameraLeftPlusUp[2] );
 			}
 		}
 		qglEnd();
@@ -1347,6 +1647,7 @@ void R_InitWorldEffects(void)
 void R_ShutdownWorldEffects(void)
 {
 	R_InitWorldEffects();
+	weatherPool.setNumWorkers(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -26,6 +26,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "tr_WorldEffects.h"
 
 backEndData_t	*backEndData;
+backEndData_t	*backEndFrameData[SMP_FRAMES];
 backEndState_t	backEnd;
 
 bool tr_stencilled = false;
@@ -691,6 +692,8 @@ void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 	// clear the z buffer, set the modelview, etc
 	RB_BeginDrawingView ();
 
+	RB_SkinGhoulSurfaces( drawSurfs, numDrawSurfs );
+
 	// draw everything
 	oldEntityNum = -1;
 	backEnd.currentEntity = &tr.worldEntity;
@@ -1282,6 +1285,8 @@ void RE_StretchRaw (int x, int y, int w, int h, int cols, int rows, const byte *
 
 void RE_UploadCinematic (int cols, int rows, const byte *data, int client, qboolean dirty) {
 
+	R_SyncRenderThread();
+
 	GL_Bind( tr.scratchImage[client] );
 
 	// if the scratchImage isn't in the format we want, specify it as a new texture
@@ -1915,7 +1920,13 @@ const void	*RB_SwapBuffers( const void *data ) {
 
     GLimp_LogComment( "***************** RB_SwapBuffers *****************\n\n\n" );
 
-    ri->WIN_Present(&window);
+	// the window itself can only be touched from the main thread,
+	// so RE_EndFrame takes care of that when the back end has its own
+	if ( glConfigExt.smpActive ) {
+		ri->WIN_SwapBuffers( &window );
+	} else {
+		ri->WIN_Present( &window );
+	}
 
 	backEnd.projection2D = qfalse;
 
@@ -1954,6 +1965,13 @@ void RB_ExecuteRenderCommands( const void *data ) {
 
 	t1 = ri->Milliseconds()*ri->Cvar_VariableValue( "timescale" );
 
+	// the front end may already be filling the other frame's surface dlightBits
+	if ( data == backEndFrameData[0]->commands.cmds ) {
+		backEnd.smpFrame = 0;
+	} else {
+		backEnd.smpFrame = 1;
+	}
+
 	while ( 1 ) {
 		data = PADP(data, sizeof(void *));
 
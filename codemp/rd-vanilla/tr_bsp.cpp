@@ -1554,6 +1554,23 @@ static	void R_LoadNodesAndLeafs (lump_t *nodeLump, lump_t *leafLump, world_t &wo
 
 	// chain decendants
 	R_SetParent (worldData.nodes, NULL);
+
+	// compact bounds for the front end's frustum walk
+	worldData.nodeBounds = (mnodeBounds_t *)Hunk_Alloc ( worldData.numnodes * sizeof(mnodeBounds_t), h_low);
+	for ( i=0 ; i<worldData.numnodes ; i++ )
+	{
+		for (j=0 ; j<3 ; j++)
+		{
+			worldData.nodeBounds[i].mins[j] = worldData.nodes[i].mins[j];
+			worldData.nodeBounds[i].maxs[j] = worldData.nodes[i].maxs[j];
+		}
+	}
+
+	for ( i=0 ; i<MARKLEAVES_CACHE_SIZE ; i++ )
+	{
+		worldData.markLeavesCache[i].cluster = -2;
+		worldData.markLeavesCache[i].marked = (int *)Hunk_Alloc ( worldData.numnodes * sizeof(int), h_low);
+	}
 }
 
 //=============================================================================
@@ -2032,6 +2049,7 @@ void RE_LoadWorldMap_Actual( const char *name, world_t &worldData, int index )
 		// clear tr.world so if the level fails to load, the next
 		// try will not look at the partially loaded version
 		tr.world = NULL;
+		R_DeleteWorldVBO();
 	}
 
 	// check for cached disk file from the server first...
@@ -2077,6 +2095,7 @@ void RE_LoadWorldMap_Actual( const char *name, world_t &worldData, int index )
 
 	// load into heap
 	R_LoadShaders( &header->lumps[LUMP_SHADERS], worldData );
+	R_DecodeShaderImages( worldData.shaders, worldData.numShaders );
 	R_LoadLightmaps( &header->lumps[LUMP_LIGHTMAPS], name, worldData );
 	R_LoadPlanes (&header->lumps[LUMP_PLANES], worldData);
 	R_LoadFogs( &header->lumps[LUMP_FOGS], &header->lumps[LUMP_BRUSHES], &header->lumps[LUMP_BRUSHSIDES], worldData, index );
@@ -2096,6 +2115,8 @@ void RE_LoadWorldMap_Actual( const char *name, world_t &worldData, int index )
 
 		// only set tr.world now that we know the entire level has loaded properly
 		tr.world = &worldData;
+
+		R_BuildWorldVBO( &worldData );
 	}
 
 	if (ri->CM_GetCachedMapDiskImage())
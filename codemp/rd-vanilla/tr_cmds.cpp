@@ -23,6 +23,12 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "tr_local.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 
 /*
 =====================
@@ -76,11 +82,340 @@ void R_PerformanceCounters( void ) {
 		ri->Printf( PRINT_ALL,  "Tex MB %.2f + buffers %.2f MB = Total %.2fMB\n",
 			texSize, backBuff*2+depthBuff+stencilBuff, texSize+backBuff*2+depthBuff+stencilBuff);
 	}
+	else if (r_speeds->integer == 8 )
+	{
+		ri->Printf( PRINT_ALL, "ghoul2 skeletons: %i built in parallel, %i rebuilt %i reused on demand\n",
+			tr.pc.c_ghoul2Skeletons, tr.pc.c_ghoul2SkeletonsRebuilt, tr.pc.c_ghoul2SkeletonsReused );
+	}
 
 	memset( &tr.pc, 0, sizeof( tr.pc ) );
 	memset( &backEnd.pc, 0, sizeof( backEnd.pc ) );
 }
 
+/*
+=============================================================================
+
+RENDER THREAD
+
+With r_smp 1 the back end runs on a thread of its own.  R_IssueRenderCommands
+hands it the command list of a finished frame, and the front end goes on to
+fill the other backEndFrameData while it draws.
+
+The GL context is current on the render thread while it works.  Main thread
+code that calls GL has to call R_SyncRenderThread first, which waits for the
+back end to finish and moves the context back.  Front end code that only
+shares memory with the back end can use R_WaitRenderThread instead, which
+leaves the context where it is.
+
+The engine's Printf and Error may only be called from the main thread, so ri
+points at a copy of the imports that queues what the render thread prints and
+stops the back end at the first error.  The main thread prints and raises
+those once it has waited for the back end.
+
+=============================================================================
+*/
+
+static std::thread				renderThread;
+static std::mutex				renderMutex;
+static std::condition_variable	renderWake;				// work for the render thread
+static std::condition_variable	renderIdle;				// the render thread finished something
+static const void				*renderCommands;		// list being drawn, NULL while idle
+static bool						renderReleaseContext;	// main thread wants the context back
+static bool						renderQuit;
+static bool						frontEndHasContext;		// otherwise the render thread has it
+
+static int						smpBackEndMsec;			// back end time of the last finished frame
+
+typedef struct renderMessage_s {
+	int			printLevel;
+	std::string	text;
+} renderMessage_t;
+
+// unwinds the back end after an error, see R_ImportError
+struct renderThreadError_t {};
+
+static refimport_t					*engineImport;		// what the engine passed to GetRefAPI
+static refimport_t					renderImport;		// ri
+static thread_local bool			onRenderThread;
+static std::vector<renderMessage_t>	renderMessages;		// printed on the render thread, not yet on the console
+static std::string					renderError;		// the back end stopped on this, empty if it didn't
+static int							renderErrorLevel;
+
+/*
+===============
+R_ImportPrintf
+===============
+*/
+static void QDECL R_ImportPrintf( int printLevel, const char *fmt, ... ) {
+	va_list	argptr;
+	char	text[MAXPRINTMSG];
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+	va_end( argptr );
+
+	if ( !onRenderThread ) {
+		engineImport->Printf( printLevel, "%s", text );
+		return;
+	}
+
+	renderMessage_t message;
+	message.printLevel = printLevel;
+	message.text = text;
+
+	std::lock_guard<std::mutex> lock( renderMutex );
+	renderMessages.push_back( message );
+}
+
+/*
+===============
+R_ImportError
+===============
+*/
+static void NORETURN QDECL R_ImportError( int errorLevel, const char *fmt, ... ) {
+	va_list	argptr;
+	char	text[MAXPRINTMSG];
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+	va_end( argptr );
+
+	if ( !onRenderThread ) {
+		engineImport->Error( errorLevel, "%s", text );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( renderMutex );
+		if ( renderError.empty() ) {
+			renderError = text;
+			renderErrorLevel = errorLevel;
+		}
+	}
+	throw renderThreadError_t();
+}
+
+/*
+===============
+R_RenderThreadImports
+
+Returns the imports ri should point at
+===============
+*/
+refimport_t *R_RenderThreadImports( refimport_t *rimp ) {
+	engineImport = rimp;
+	renderImport = *rimp;
+	renderImport.Printf = R_ImportPrintf;
+	renderImport.Error = R_ImportError;
+	return &renderImport;
+}
+
+/*
+===============
+R_ReportRenderThread
+
+Prints what the render thread queued, then raises the error it stopped on,
+or only prints that as well when raiseError is false
+===============
+*/
+static void R_ReportRenderThread( bool raiseError ) {
+	std::vector<renderMessage_t>	messages;
+	std::string						error;
+	int								errorLevel;
+
+	{
+		std::lock_guard<std::mutex> lock( renderMutex );
+		messages.swap( renderMessages );
+		error.swap( renderError );
+		errorLevel = renderErrorLevel;
+	}
+
+	for ( size_t i = 0; i < messages.size(); i++ ) {
+		engineImport->Printf( messages[i].printLevel, "%s", messages[i].text.c_str() );
+	}
+	if ( error.empty() ) {
+		return;
+	}
+	if ( raiseError ) {
+		engineImport->Error( errorLevel, "%s", error.c_str() );
+	}
+	engineImport->Printf( PRINT_ERROR, "%s\n", error.c_str() );
+}
+
+/*
+===============
+RB_RenderThread
+===============
+*/
+static void RB_RenderThread( void ) {
+	std::unique_lock<std::mutex>	lock( renderMutex );
+	bool							hasContext = false;
+
+	onRenderThread = true;
+
+	for ( ;; ) {
+		renderWake.wait( lock, [] { return renderCommands || renderReleaseContext || renderQuit; } );
+
+		if ( renderCommands ) {
+			const void *data = renderCommands;
+
+			lock.unlock();
+			if ( !hasContext ) {
+				ri->GL_MakeCurrent( qtrue );
+				hasContext = true;
+			}
+			try {
+				RB_ExecuteRenderCommands( data );
+			} catch ( const renderThreadError_t & ) {
+				// the rest of the list is dropped, R_ReportRenderThread raises the error
+			}
+			lock.lock();
+
+			renderCommands = NULL;
+			renderIdle.notify_all();
+			continue;
+		}
+
+		if ( hasContext ) {
+			ri->GL_MakeCurrent( qfalse );
+			hasContext = false;
+		}
+		renderReleaseContext = false;
+		renderIdle.notify_all();
+
+		if ( renderQuit ) {
+			return;
+		}
+	}
+}
+
+/*
+===============
+R_OnRenderThread
+===============
+*/
+static bool R_OnRenderThread( void ) {
+	return onRenderThread;
+}
+
+/*
+===============
+R_SpawnRenderThread
+
+The main thread keeps the context until the first frame is issued
+===============
+*/
+void R_SpawnRenderThread( void ) {
+	if ( glConfigExt.smpActive ) {
+		return;
+	}
+	if ( backEndFrameData[0] == backEndFrameData[1] ) {
+		ri->Printf( PRINT_WARNING, "R_SpawnRenderThread: only one frame of back end data\n" );
+		return;
+	}
+
+	renderCommands = NULL;
+	renderReleaseContext = false;
+	renderQuit = false;
+	frontEndHasContext = true;
+	smpBackEndMsec = 0;
+
+	renderThread = std::thread( RB_RenderThread );
+	glConfigExt.smpActive = qtrue;
+}
+
+/*
+===============
+R_ShutdownRenderThread
+
+Waits for the last frame and stops the thread, leaving the context on the
+main thread.  Commands that haven't been issued yet stay in backEndData
+and run on the main thread from then on.
+===============
+*/
+void R_ShutdownRenderThread( void ) {
+	if ( !glConfigExt.smpActive ) {
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock( renderMutex );
+
+		renderIdle.wait( lock, [] { return !renderCommands; } );
+		renderQuit = true;
+		renderWake.notify_one();
+	}
+	renderThread.join();
+	glConfigExt.smpActive = qfalse;
+
+	if ( !frontEndHasContext ) {
+		ri->GL_MakeCurrent( qtrue );
+		frontEndHasContext = true;
+	}
+
+	// this may be part of handling another error already
+	R_ReportRenderThread( false );
+}
+
+/*
+===============
+R_WaitRenderThread
+
+Waits until the back end has finished the list it was given, without
+taking the context away from it
+===============
+*/
+void R_WaitRenderThread( void ) {
+	if ( !glConfigExt.smpActive || R_OnRenderThread() ) {
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock( renderMutex );
+		renderIdle.wait( lock, [] { return !renderCommands; } );
+	}
+	R_ReportRenderThread( true );
+}
+
+/*
+===============
+R_AcquireContext
+===============
+*/
+static void R_AcquireContext( void ) {
+	{
+		std::unique_lock<std::mutex> lock( renderMutex );
+
+		renderIdle.wait( lock, [] { return !renderCommands; } );
+		if ( !frontEndHasContext ) {
+			renderReleaseContext = true;
+			renderWake.notify_one();
+			renderIdle.wait( lock, [] { return !renderReleaseContext; } );
+		}
+	}
+
+	if ( !frontEndHasContext ) {
+		ri->GL_MakeCurrent( qtrue );
+		frontEndHasContext = true;
+	}
+	R_ReportRenderThread( true );
+}
+
+/*
+===============
+R_WakeRenderThread
+===============
+*/
+static void R_WakeRenderThread( const void *data ) {
+	if ( frontEndHasContext ) {
+		ri->GL_MakeCurrent( qfalse );
+		frontEndHasContext = false;
+	}
+
+	std::lock_guard<std::mutex> lock( renderMutex );
+	renderCommands = data;
+	renderWake.notify_one();
+}
+
 /*
 ====================
 R_IssueRenderCommands
@@ -88,6 +423,7 @@ R_IssueRenderCommands
 */
 void R_IssueRenderCommands( qboolean runPerformanceCounters ) {
 	renderCommandList_t	*cmdList;
+	qboolean			empty;
 
 	cmdList = &backEndData->commands;
 	assert(cmdList);
@@ -96,8 +432,15 @@ void R_IssueRenderCommands( qboolean runPerformanceCounters ) {
 	ba->ui = RC_END_OF_LIST;
 
 	// clear it out, in case this is a sync and not a buffer flip
+	empty = (qboolean)( cmdList->used == 0 );
 	cmdList->used = 0;
 
+	if ( glConfigExt.smpActive ) {
+		// the render thread only takes one list at a time
+		R_WaitRenderThread();
+		smpBackEndMsec = backEnd.pc.msec;
+	}
+
 	// at this point, the back end thread is idle, so it is ok
 	// to look at it's performance counters
 	if ( runPerformanceCounters ) {
@@ -106,8 +449,12 @@ void R_IssueRenderCommands( qboolean runPerformanceCounters ) {
 
 	// actually start the commands going
 	if ( !r_skipBackEnd->integer ) {
-		// let it start on the new batch
-		RB_ExecuteRenderCommands( cmdList->cmds );
+		if ( !glConfigExt.smpActive ) {
+			RB_ExecuteRenderCommands( cmdList->cmds );
+		} else if ( !empty ) {
+			// let it start on the new batch
+			R_WakeRenderThread( cmdList->cmds );
+		}
 	}
 }
 
@@ -123,7 +470,29 @@ void R_IssuePendingRenderCommands( void ) {
 	if ( !tr.registered ) {
 		return;
 	}
+	if ( R_OnRenderThread() ) {
+		return;
+	}
 	R_IssueRenderCommands( qfalse );
+
+	if ( glConfigExt.smpActive ) {
+		R_AcquireContext();
+	}
+}
+
+/*
+====================
+R_SyncRenderThread
+
+For main thread code about to call GL, which doesn't need pending commands
+issued unless the render thread is running
+====================
+*/
+void R_SyncRenderThread( void ) {
+	if ( !glConfigExt.smpActive || R_OnRenderThread() ) {
+		return;
+	}
+	R_IssuePendingRenderCommands();
 }
 
 /*
@@ -450,6 +819,10 @@ void RE_EndFrame( int *frontEndMsec, int *backEndMsec ) {
 
 	R_IssueRenderCommands( qtrue );
 
+	if ( glConfigExt.smpActive ) {
+		ri->WIN_UpdateWindow( &window );
+	}
+
 	// use the other buffers next frame, because another CPU
 	// may still be rendering into the current ones
 	R_InitNextFrame();
@@ -458,10 +831,17 @@ void RE_EndFrame( int *frontEndMsec, int *backEndMsec ) {
 		*frontEndMsec = tr.frontEndMsec;
 	}
 	tr.frontEndMsec = 0;
-	if ( backEndMsec ) {
-		*backEndMsec = backEnd.pc.msec;
+	if ( glConfigExt.smpActive ) {
+		// the frame just issued is still being drawn
+		if ( backEndMsec ) {
+			*backEndMsec = smpBackEndMsec;
+		}
+	} else {
+		if ( backEndMsec ) {
+			*backEndMsec = backEnd.pc.msec;
+		}
+		backEnd.pc.msec = 0;
 	}
-	backEnd.pc.msec = 0;
 }
 
 /*
@@ -469,22 +849,27 @@ void RE_EndFrame( int *frontEndMsec, int *backEndMsec ) {
 RE_TakeVideoFrame
 =============
 */
-void RE_TakeVideoFrame( int width, int height, byte *captureBuffer, byte *encodeBuffer, qboolean motionJpeg )
+void RE_TakeVideoFrame( int width, int height, qboolean motionJpeg )
 {
 	videoFrameCommand_t *cmd;
 
-	if ( !tr.registered )
+	R_ReportVideoCapture();
+
+	// the client is holding a place in the file for every frame it asks for
+	if ( !tr.registered ) {
+		ri->CL_WriteAVIVideoFrame( NULL, 0 );
 		return;
+	}
 
 	cmd = (videoFrameCommand_t *)R_GetCommandBuffer( sizeof( *cmd ) );
-	if ( !cmd )
+	if ( !cmd ) {
+		ri->CL_WriteAVIVideoFrame( NULL, 0 );
 		return;
+	}
 
 	cmd->commandId = RC_VIDEOFRAME;
 
 	cmd->width = width;
 	cmd->height = height;
-	cmd->captureBuffer = captureBuffer;
-	cmd->encodeBuffer = encodeBuffer;
 	cmd->motionJpeg = motionJpeg;
 }
@@ -30,8 +30,21 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "ghoul2/G2_gore.h"
 #endif
 
+#include "qcommon/jobs.h"
+
+#include <algorithm>
+#include <new>
+
 #include "qcommon/disablewarnings.h"
 
+// a vertex can be skinned four components at a time where SSE2 is always there
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define G2_SIMD_SSE2	1
+#include <emmintrin.h>
+#else
+#define G2_SIMD_SSE2	0
+#endif
+
 #define	LL(x) x=LittleLong(x)
 #define	LS(x) x=LittleShort(x)
 #define	LF(x) x=LittleFloat(x)
@@ -340,6 +353,12 @@ public:
 	bool			mUnsquash;
 	float			mSmoothFactor;
 
+	// the render bones as R_GetGhoulRenderBones last copied them to the back end
+	mdxaBone_t		*mRenderBones;
+	int				mRenderBonesFrame;
+	int				mRenderBonesTouch;
+	std::vector<byte>	mRenderBonesCopied;
+
 	CBoneCache(const model_t *amod,const mdxaHeader_t *aheader) :
 		header(aheader),
 		mod(amod)
@@ -349,11 +368,15 @@ public:
 		mSmoothingActive=false;
 		mUnsquash=false;
 		mSmoothFactor=0.0f;
+		mRenderBones=NULL;
+		mRenderBonesFrame=0;
+		mRenderBonesTouch=0;
 
 		int numBones=header->numBones;
 		mBones.resize(numBones);
 		mFinalBones.resize(numBones);
 		mSmoothBones.resize(numBones);
+		mRenderBonesCopied.resize(numBones);
 //		mSkels.resize(numBones);
 		//rww - removed mSkels
 		mdxaSkelOffsets_t *offsets;
@@ -473,6 +496,15 @@ public:
 		return mFinalBones[index].boneMatrix;
 	}
 	//rww - RAGDOLL_END
+	// evaluates every bone the way EvalRender would, so that nothing is
+	// left to build when the surfaces come to use them
+	void EvalAllRender()
+	{
+		for (int i=0;i<(int)mBones.size();i++)
+		{
+			EvalRender(i);
+		}
+	}
 	//rww - RAGDOLL_BEGIN
 	bool WasRendered(int index)
 	{
@@ -786,21 +818,136 @@ public:
 	{}
 };
 
+/*
+=============================================================================
+
+GHOUL2 FRAME DATA
+
+The back end may still be drawing the last frame while the front end adds
+surfaces to this one, so every CRenderableSurface, and a copy of the bones it
+is skinned by, lives in the backEndData of its frame instead of pointing into
+bone caches the front end goes on rebuilding and freeing.  Gore texture
+coordinates the front end lets go of are only freed when their frame comes
+around again, by which time the back end has drawn every frame that may still
+use them.
+
+=============================================================================
+*/
+
+static int					ghoulFrameNum;
+static std::vector<void *>	ghoulRetired[SMP_FRAMES];
+
+/*
+==============
+R_InitGhoulFrame
+
+Called whenever backEndData starts a new frame
+==============
+*/
+void R_InitGhoulFrame( void )
+{
+	ghoulFrameNum++;
+	backEndData->numGhoulSurfs = 0;
+	backEndData->numGhoulBones = 0;
+
+	std::vector<void *> &retired = ghoulRetired[tr.smpFrame];
+	for ( size_t i = 0 ; i < retired.size() ; i++ )
+	{
+		Z_Free( retired[i] );
+	}
+	retired.clear();
+}
+
 #ifdef _G2_GORE
-#define MAX_RENDER_SURFACES (2048)
-static CRenderableSurface RSStorage[MAX_RENDER_SURFACES];
-static unsigned int NextRS=0;
+/*
+==============
+R_RetireGoreTexCoordinates
 
-CRenderableSurface *AllocRS()
+Takes the texture coordinates away from a gore record, to be freed once the
+back end can no longer be drawing them
+==============
+*/
+void R_RetireGoreTexCoordinates( GoreTextureCoordinates *gTC )
 {
-	CRenderableSurface *ret=&RSStorage[NextRS];
-	ret->Init();
-	NextRS++;
-	NextRS%=MAX_RENDER_SURFACES;
-	return ret;
+	for ( int i = 0 ; i < MAX_LODS ; i++ )
+	{
+		if ( gTC->tex[i] )
+		{
+			ghoulRetired[tr.smpFrame].push_back( gTC->tex[i] );
+			gTC->tex[i] = NULL;
+		}
+	}
 }
 #endif
 
+/*
+==============
+R_GetGhoulRenderBones
+
+Makes sure the render bones a surface references are in the copy of its bone
+cache this frame's backEndData holds, and returns that copy.  A cache gets a
+new copy once per frame and evaluation, NULL if the frame has no room left.
+Only referenced bones are evaluated, as the back end used to, so WasRendered
+still only reports bones that were drawn.
+==============
+*/
+static const mdxaBone_t *R_GetGhoulRenderBones( CBoneCache *boneCache, const mdxmSurface_t *surface )
+{
+	const int	*piBoneReferences = (const int *)((const byte *)surface + surface->ofsBoneReferences);
+	const int	numBoneReferences = Q_min( surface->numBoneReferences, iMAX_G2_BONEREFS_PER_SURFACE );
+
+	if ( !boneCache->mRenderBones || boneCache->mRenderBonesFrame != ghoulFrameNum || boneCache->mRenderBonesTouch != boneCache->mCurrentTouch )
+	{
+		const int numBones = (int)boneCache->mBones.size();
+
+		if ( backEndData->numGhoulBones + numBones > MAX_GHOUL2_BONES )
+		{
+			ri->Printf( PRINT_DEVELOPER, "WARNING: R_GetGhoulRenderBones: MAX_GHOUL2_BONES reached\n" );
+			boneCache->mRenderBones = NULL;
+			return NULL;
+		}
+		boneCache->mRenderBones = &backEndData->ghoulBones[backEndData->numGhoulBones];
+		boneCache->mRenderBonesFrame = ghoulFrameNum;
+		boneCache->mRenderBonesTouch = boneCache->mCurrentTouch;
+		std::fill( boneCache->mRenderBonesCopied.begin(), boneCache->mRenderBonesCopied.end(), 0 );
+		backEndData->numGhoulBones += numBones;
+	}
+
+	for ( int i = 0 ; i < numBoneReferences ; i++ )
+	{
+		const int index = piBoneReferences[i];
+
+		if ( !boneCache->mRenderBonesCopied[index] )
+		{
+			boneCache->mRenderBones[index] = boneCache->EvalRender( index );
+			boneCache->mRenderBonesCopied[index] = 1;
+		}
+	}
+	return boneCache->mRenderBones;
+}
+
+/*
+==============
+R_AllocGhoulSurface
+==============
+*/
+static CRenderableSurface *R_AllocGhoulSurface( const mdxaBone_t *bones )
+{
+	if ( !bones )
+	{
+		return NULL;
+	}
+	if ( backEndData->numGhoulSurfs >= MAX_GHOUL2_SURFS )
+	{
+		ri->Printf( PRINT_DEVELOPER, "WARNING: R_AllocGhoulSurface: MAX_GHOUL2_SURFS reached\n" );
+		return NULL;
+	}
+
+	CRenderableSurface *surf = new ( &backEndData->ghoulSurfs[backEndData->numGhoulSurfs++] ) CRenderableSurface;
+	surf->bones = bones;
+	return surf;
+}
+
 /*
 
 All bones should be an identity orientation to display the mesh exactly
@@ -1469,15 +1616,15 @@ void G2_RagGetAnimMatrix(CGhoul2Info &ghoul2, const int boneNum, mdxaBone_t &mat
 void G2_TransformBone (int child,CBoneCache &BC)
 {
 	SBoneCalc &TB=BC.mBones[child];
-	static mdxaBone_t		tbone[6];
+	mdxaBone_t		tbone[6];
 // 	mdxaFrame_t		*aFrame=0;
 //	mdxaFrame_t		*bFrame=0;
 //	mdxaFrame_t		*aoldFrame=0;
 //	mdxaFrame_t		*boldFrame=0;
-	static mdxaSkel_t		*skel;
-	static mdxaSkelOffsets_t *offsets;
+	mdxaSkel_t		*skel;
+	mdxaSkelOffsets_t *offsets;
 	boneInfo_v		&boneList = *BC.rootBoneList;
-	static int				j, boneListIndex;
+	int				j, boneListIndex;
 	int				angleOverride = 0;
 
 #if DEBUG_G2_TIMING
@@ -1725,7 +1872,7 @@ void G2_TransformBone (int child,CBoneCache &BC)
 			// this is crazy, we are gonna drive the animation to ID while we are doing post mults to compensate.
 			Multiply_3x4Matrix(&temp,&firstPass, &skel->BasePoseMat);
 			float	matrixScale = VectorLength((float*)&temp);
-			static mdxaBone_t		toMatrix =
+			mdxaBone_t		toMatrix =
 			{
 				{
 					{ 1.0f, 0.0f, 0.0f, 0.0f },
@@ -2436,6 +2583,9 @@ void RenderSurfaces(CRenderSurface &RS) //also ended up just ripping right from
 	// if this surface is not off, add it to the shader render list
 	if (!offFlags)
 	{
+		const mdxaBone_t	*bones = R_GetGhoulRenderBones( RS.boneCache, surface );
+		CRenderableSurface	*newSurf;
+
  		if ( RS.cust_shader )
 		{
 			shader = RS.cust_shader;
@@ -2472,19 +2622,19 @@ void RenderSurfaces(CRenderSurface &RS) //also ended up just ripping right from
 //			&& RS.fogNum == 0
 			&& (RS.renderfx & RF_SHADOW_PLANE )
 			&& !(RS.renderfx & ( RF_NOSHADOW | RF_DEPTHHACK ) )
-			&& shader->sort == SS_OPAQUE )
+			&& shader->sort == SS_OPAQUE
+			&& (newSurf = R_AllocGhoulSurface( bones )) != NULL )
 		{		// set the surface info to point at the where the transformed bone list is going to be for when the surface gets rendered out
-			CRenderableSurface *newSurf = new CRenderableSurface;
 			if (surface->numVerts >= SHADER_MAX_VERTEXES/2)
 			{ //we need numVerts*2 xyz slots free in tess to do shadow, if this surf is going to exceed that then let's try the lowest lod -rww
 				mdxmSurface_t *lowsurface = (mdxmSurface_t *)G2_FindSurface(RS.currentModel, RS.surfaceNum, RS.currentModel->numLods-1);
+				R_GetGhoulRenderBones( RS.boneCache, lowsurface );
 				newSurf->surfaceData = lowsurface;
 			}
 			else
 			{
 				newSurf->surfaceData = surface;
 			}
-			newSurf->boneCache = RS.boneCache;
 			R_AddDrawSurf( (surfaceType_t *)newSurf, tr.shadowShader, 0, qfalse );
 		}
 
@@ -2492,20 +2642,18 @@ void RenderSurfaces(CRenderSurface &RS) //also ended up just ripping right from
 		if ( r_shadows->integer == 3
 //			&& RS.fogNum == 0
 			&& (RS.renderfx & RF_SHADOW_PLANE )
-			&& shader->sort == SS_OPAQUE )
+			&& shader->sort == SS_OPAQUE
+			&& (newSurf = R_AllocGhoulSurface( bones )) != NULL )
 		{		// set the surface info to point at the where the transformed bone list is going to be for when the surface gets rendered out
-			CRenderableSurface *newSurf = new CRenderableSurface;
 			newSurf->surfaceData = surface;
-			newSurf->boneCache = RS.boneCache;
 			R_AddDrawSurf( (surfaceType_t *)newSurf, tr.projectionShadowShader, 0, qfalse );
 		}
 
 		// don't add third_person objects if not viewing through a portal
-		if ( !RS.personalModel )
+		if ( !RS.personalModel
+			&& (newSurf = R_AllocGhoulSurface( bones )) != NULL )
 		{		// set the surface info to point at the where the transformed bone list is going to be for when the surface gets rendered out
-			CRenderableSurface *newSurf = new CRenderableSurface;
 			newSurf->surfaceData = surface;
-			newSurf->boneCache = RS.boneCache;
 			R_AddDrawSurf( (surfaceType_t *)newSurf, (shader_t *)shader, RS.fogNum, qfalse );
 
 #ifdef _G2_GORE
@@ -2526,16 +2674,18 @@ void RenderSurfaces(CRenderSurface &RS) //also ended up just ripping right from
 					{
 						if (tex)
 						{
-							(*tex).~GoreTextureCoordinates();
-							//I don't know what's going on here, it should call the destructor for
-							//this when it erases the record but sometimes it doesn't. -rww
+							R_RetireGoreTexCoordinates(tex);
 						}
 
 						RS.gore_set->mGoreRecords.erase(kcur);
 					}
 					else if (tex->tex[RS.lod])
 					{
-						CRenderableSurface *newSurf2 = AllocRS();
+						CRenderableSurface *newSurf2 = R_AllocGhoulSurface( bones );
+						if (!newSurf2)
+						{
+							break;
+						}
 						*newSurf2=*newSurf;
 						newSurf2->goreChain=0;
 						newSurf2->alternateTex=tex->tex[RS.lod];
@@ -3216,38 +3366,30 @@ static inline bool bInShadowRange(vec3_t location)
 
 /*
 ==============
-R_AddGHOULSurfaces
+R_TransformGhoulModels
+
+Sets up the bone caches of every model of an entity that is going to be
+drawn, returns false if none of it is in view
 ==============
 */
-void R_AddGhoulSurfaces( trRefEntity_t *ent ) {
-#ifdef G2_PERFORMANCE_ANALYSIS
-	G2PerformanceTimer_R_AddGHOULSurfaces.Start();
-#endif
-	shader_t		*cust_shader = 0;
-#ifdef _G2_GORE
-	shader_t		*gore_shader = 0;
-#endif
-	int				fogNum = 0;
-	qboolean		personalModel;
-	int				cull;
-	int				i, whichLod, j;
-	skin_t			*skin;
+static bool R_TransformGhoulModels( trRefEntity_t *ent ) {
+	int				i, j;
 	int				modelCount;
 	mdxaBone_t		rootMatrix;
 	CGhoul2Info_v	&ghoul2 = *((CGhoul2Info_v *)ent->e.ghoul2);
 
 	if ( !ghoul2.IsValid() )
 	{
-		return;
+		return false;
 	}
 	// if we don't want server ghoul2 models and this is one, or we just don't want ghoul2 models at all, then return
 	if (r_noServerGhoul2->integer)
 	{
-		return;
+		return false;
 	}
 	if (!G2_SetupModelPointers(ghoul2))
 	{
-		return;
+		return false;
 	}
 
 	int currentTime=G2API_GetTime(tr.refdef.time);
@@ -3255,15 +3397,77 @@ void R_AddGhoulSurfaces( trRefEntity_t *ent ) {
 
 	// cull the entire model if merged bounding box of both frames
 	// is outside the view frustum.
-	cull = R_GCullModel (ent );
-	if ( cull == CULL_OUT )
+	if ( R_GCullModel (ent ) == CULL_OUT )
 	{
-		return;
+		return false;
 	}
 	HackadelicOnClient=true;
 	// are any of these models setting a new origin?
 	RootMatrix(ghoul2,currentTime, ent->e.modelScale,rootMatrix);
 
+	int modelList[256];
+	assert(ghoul2.size()<=255);
+	modelList[255]=548;
+
+	// order sort the ghoul 2 models so bolt ons get bolted to the right model
+	G2_Sort_Models(ghoul2, modelList, &modelCount);
+	assert(modelList[255]==548);
+
+	for (j=0; j<modelCount; j++)
+	{
+		i = modelList[j];
+		if (ghoul2[i].mValid&&!(ghoul2[i].mFlags & GHOUL2_NOMODEL)&&!(ghoul2[i].mFlags & GHOUL2_NORENDER))
+		{
+			if (j&&ghoul2[i].mModelBoltLink != -1)
+			{
+				int	boltMod = (ghoul2[i].mModelBoltLink >> MODEL_SHIFT) & MODEL_AND;
+				int	boltNum = (ghoul2[i].mModelBoltLink >> BOLT_SHIFT) & BOLT_AND;
+				mdxaBone_t bolt;
+				G2_GetBoltMatrixLow(ghoul2[boltMod],boltNum,ent->e.modelScale,bolt);
+				G2_TransformGhoulBones(ghoul2[i].mBlist,bolt, ghoul2[i],currentTime);
+			}
+			else
+			{
+				G2_TransformGhoulBones(ghoul2[i].mBlist, rootMatrix, ghoul2[i],currentTime);
+			}
+		}
+	}
+	return true;
+}
+
+/*
+==============
+R_AddGHOULSurfaces
+==============
+*/
+void R_AddGhoulSurfaces( trRefEntity_t *ent ) {
+#ifdef G2_PERFORMANCE_ANALYSIS
+	G2PerformanceTimer_R_AddGHOULSurfaces.Start();
+#endif
+	shader_t		*cust_shader = 0;
+#ifdef _G2_GORE
+	shader_t		*gore_shader = 0;
+#endif
+	int				fogNum = 0;
+	qboolean		personalModel;
+	int				i, whichLod, j;
+	skin_t			*skin;
+	int				modelCount;
+	CGhoul2Info_v	&ghoul2 = *((CGhoul2Info_v *)ent->e.ghoul2);
+	const int		skeleton = ent->ghoul2Skeleton;
+
+	// R_BuildGhoulSkeletons may have done the bones already
+	ent->ghoul2Skeleton = G2SKELETON_NONE;
+	if ( skeleton == G2SKELETON_CULLED )
+	{
+		return;
+	}
+	if ( skeleton == G2SKELETON_NONE && !R_TransformGhoulModels( ent ) )
+	{
+		return;
+	}
+	HackadelicOnClient=true;
+
    	// don't add third_person objects if not in a portal
 	personalModel = (qboolean)((ent->e.renderfx & RF_THIRD_PERSON) && !tr.viewParms.isPortal);
 
@@ -3325,18 +3529,6 @@ void R_AddGhoulSurfaces( trRefEntity_t *ent ) {
 				}
 			}
 
-			if (j&&ghoul2[i].mModelBoltLink != -1)
-			{
-				int	boltMod = (ghoul2[i].mModelBoltLink >> MODEL_SHIFT) & MODEL_AND;
-				int	boltNum = (ghoul2[i].mModelBoltLink >> BOLT_SHIFT) & BOLT_AND;
-				mdxaBone_t bolt;
-				G2_GetBoltMatrixLow(ghoul2[boltMod],boltNum,ent->e.modelScale,bolt);
-				G2_TransformGhoulBones(ghoul2[i].mBlist,bolt, ghoul2[i],currentTime);
-			}
-			else
-			{
-				G2_TransformGhoulBones(ghoul2[i].mBlist, rootMatrix, ghoul2[i],currentTime);
-			}
 			whichLod = G2_ComputeLOD( ent, ghoul2[i].currentModel, ghoul2[i].mLodBias );
 			G2_FindOverrideSurface(-1,ghoul2[i].mSlist); //reset the quick surface override lookup;
 
@@ -3369,6 +3561,115 @@ void R_AddGhoulSurfaces( trRefEntity_t *ent ) {
 #endif
 }
 
+/*
+=============================================================================
+
+PARALLEL SKELETONS
+
+With r_ghoul2SkeletonThreads set, R_BuildGhoulSkeletons sets up the bone
+caches of every Ghoul2 entity in the view before any of their surfaces are
+added, then evaluates all of their bones on a worker pool.  Every bone cache
+belongs to a single model instance, so the caches can be evaluated side by
+side; the setup before that stays on this thread, as bolted models read the
+bones of the model they are bolted to.  R_AddGhoulSurfaces then finds the
+bones it needs already built.
+
+=============================================================================
+*/
+
+static Q::JobPool				ghoulSkeletonPool;
+static std::vector<CBoneCache *>	ghoulSkeletonJobs;
+
+/*
+==============
+R_BuildGhoulSkeletons
+==============
+*/
+void R_BuildGhoulSkeletons( void ) {
+	trRefEntity_t	*ent;
+	model_t			*model;
+	int				i;
+
+	if ( r_ghoul2SkeletonThreads->integer <= 0 )
+	{
+		ghoulSkeletonPool.setNumWorkers( 0 );
+		return;
+	}
+	if ( ghoulSkeletonPool.numWorkers() != r_ghoul2SkeletonThreads->integer )
+	{
+		ghoulSkeletonPool.setNumWorkers( r_ghoul2SkeletonThreads->integer );
+	}
+
+	// same tests R_AddEntitySurfaces makes before it gets to R_AddGhoulSurfaces
+	ghoulSkeletonJobs.clear();
+	for ( i = 0 ; i < tr.refdef.num_entities ; i++ )
+	{
+		ent = &tr.refdef.entities[i];
+		ent->ghoul2Skeleton = G2SKELETON_NONE;
+
+		if ( ent->e.reType != RT_MODEL || !ent->e.ghoul2 )
+		{
+			continue;
+		}
+		if ( (ent->e.renderfx & RF_FIRST_PERSON) && tr.viewParms.isPortal )
+		{
+			continue;
+		}
+		model = R_GetModelByHandle( ent->e.hModel );
+		if ( !model )
+		{
+			continue;
+		}
+		if ( model->type == MOD_BAD )
+		{
+			if ( (ent->e.renderfx & RF_THIRD_PERSON) && !tr.viewParms.isPortal && !(ent->e.renderfx & RF_SHADOW_ONLY) )
+			{
+				continue;
+			}
+			if ( !G2API_HaveWeGhoul2Models( *((CGhoul2Info_v *)ent->e.ghoul2) ) )
+			{
+				continue;
+			}
+		}
+		else if ( model->type != MOD_MDXM )
+		{
+			continue;
+		}
+
+		// culling needs tr.ori
+		tr.currentEntityNum = i;
+		tr.currentEntity = ent;
+		R_RotateForEntity( ent, &tr.viewParms, &tr.ori );
+
+		if ( !R_TransformGhoulModels( ent ) )
+		{
+			ent->ghoul2Skeleton = G2SKELETON_CULLED;
+			continue;
+		}
+		ent->ghoul2Skeleton = G2SKELETON_BUILT;
+
+		CGhoul2Info_v &ghoul2 = *((CGhoul2Info_v *)ent->e.ghoul2);
+		for ( int j = 0 ; j < ghoul2.size() ; j++ )
+		{
+			if ( ghoul2[j].mValid && ghoul2[j].mBoneCache && !(ghoul2[j].mFlags & (GHOUL2_NOMODEL|GHOUL2_NORENDER)) )
+			{
+				ghoulSkeletonJobs.push_back( ghoul2[j].mBoneCache );
+			}
+		}
+	}
+
+	// entities can share a model instance, evaluate each cache once
+	std::sort( ghoulSkeletonJobs.begin(), ghoulSkeletonJobs.end() );
+	ghoulSkeletonJobs.erase( std::unique( ghoulSkeletonJobs.begin(), ghoulSkeletonJobs.end() ), ghoulSkeletonJobs.end() );
+
+	ghoulSkeletonPool.parallelFor( (int)ghoulSkeletonJobs.size(), []( int index ) {
+		ghoulSkeletonJobs[index]->EvalAllRender();
+	} );
+	HackadelicOnClient=false;
+
+	tr.pc.c_ghoul2Skeletons += (int)ghoulSkeletonJobs.size();
+}
+
 #ifdef _G2_LISTEN_SERVER_OPT
 qboolean G2API_OverrideServerWithClientData(CGhoul2Info *serverInstance);
 #endif
@@ -3389,8 +3690,10 @@ bool G2_NeedsRecalc(CGhoul2Info *ghlInfo,int frameNum)
 		}
 #endif
 		ghlInfo->mSkelFrameNum=frameNum;
+		tr.pc.c_ghoul2SkeletonsRebuilt++;
 		return true;
 	}
+	tr.pc.c_ghoul2SkeletonsReused++;
 	return false;
 }
 
@@ -3455,17 +3758,288 @@ void G2_ConstructGhoulSkeleton( CGhoul2Info_v &ghoul2,const int frameNum,bool ch
 #endif
 }
 
-static inline float G2_GetVertBoneWeightNotSlow( const mdxmVertex_t *pVert, const int iWeightNum)
+/*
+=============================================================================
+
+GHOUL2 VERTEX SKINNING
+
+Every vertex is the weighted sum of up to four bone transforms, the last weight
+being whatever the stored ones leave over, and its normal is turned by the
+first bone only.  The bones a surface references are looked up once per
+surface instead of once per weight, from the copy R_GetGhoulRenderBones made
+for the frame, and the blended transform is then applied to a whole vertex at
+a time.
+
+With r_ghoul2SkinThreads set, RB_SkinGhoulSurfaces skins every Ghoul2 surface
+of a draw list on a worker pool before the list is drawn, and RB_SurfaceGhoul
+only copies the results into tess.
+
+=============================================================================
+*/
+
+/*
+=================
+G2_DecodeVertWeights
+
+Unpacks the bones and weights of a vertex, returns how many there are
+=================
+*/
+static inline int G2_DecodeVertWeights( const mdxmVertex_t *v, const mdxaBone_t * const *surfBones, const mdxaBone_t **vertBones, float *weights )
 {
-	float fBoneWeight;
+	const int	numWeights = G2_GetVertWeights( v );
+	float		totalWeight = 0.0f;
+	int			k;
+
+	for ( k = 0 ; k < numWeights - 1 ; k++ )
+	{
+		int iTemp = v->BoneWeightings[k];
+		iTemp |= ( v->uiNmWeightsAndBoneIndexes >> ( iG2_BONEWEIGHT_TOPBITS_SHIFT + ( k * 2 ) ) ) & iG2_BONEWEIGHT_TOPBITS_AND;
 
-	int iTemp = pVert->BoneWeightings[iWeightNum];
+		vertBones[k] = surfBones[G2_GetVertBoneIndex( v, k )];
+		weights[k] = fG2_BONEWEIGHT_RECIPROCAL_MULT * iTemp;
+		totalWeight += weights[k];
+	}
+	vertBones[k] = surfBones[G2_GetVertBoneIndex( v, k )];
+	weights[k] = 1.0f - totalWeight;
+
+	return numWeights;
+}
 
-	iTemp|= (pVert->uiNmWeightsAndBoneIndexes >> (iG2_BONEWEIGHT_TOPBITS_SHIFT+(iWeightNum*2)) ) & iG2_BONEWEIGHT_TOPBITS_AND;
+/*
+=================
+RB_GetGhoulSurfaceBones
 
-	fBoneWeight = fG2_BONEWEIGHT_RECIPROCAL_MULT * iTemp;
+Looks up the bone transforms a surface references
+=================
+*/
+static void RB_GetGhoulSurfaceBones( const mdxmSurface_t *surface, const mdxaBone_t *bones, const mdxaBone_t **surfBones )
+{
+	const int	*piBoneReferences = (const int *)((const byte *)surface + surface->ofsBoneReferences);
+	const int	numBoneReferences = Q_min( surface->numBoneReferences, iMAX_G2_BONEREFS_PER_SURFACE );
 
-	return fBoneWeight;
+	for ( int i = 0 ; i < numBoneReferences ; i++ )
+	{
+		surfBones[i] = &bones[piBoneReferences[i]];
+	}
+}
+
+/*
+=================
+RB_SkinGhoulVerts
+
+Deforms the vertexes of a surface by its bones, safe to run on any thread
+=================
+*/
+static void RB_SkinGhoulVerts( const mdxmSurface_t *surface, const mdxaBone_t * const *surfBones, vec4_t *xyz, vec4_t *normal )
+{
+	const mdxmVertex_t	*v = (const mdxmVertex_t *)((const byte *)surface + surface->ofsVerts);
+	const int			numVerts = surface->numVerts;
+	const mdxaBone_t	*vertBones[iMAX_G2_BONEWEIGHTS_PER_VERT];
+	float				weights[iMAX_G2_BONEWEIGHTS_PER_VERT];
+
+	for ( int j = 0 ; j < numVerts ; j++, v++ )
+	{
+		const int numWeights = G2_DecodeVertWeights( v, surfBones, vertBones, weights );
+#if G2_SIMD_SSE2
+		__m128	c0, c1, c2, c3;
+
+		// the normal only follows the first bone, columns of its transform
+		c0 = _mm_loadu_ps( vertBones[0]->matrix[0] );
+		c1 = _mm_loadu_ps( vertBones[0]->matrix[1] );
+		c2 = _mm_loadu_ps( vertBones[0]->matrix[2] );
+		c3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+		_mm_storeu_ps( normal[j], _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( c0, _mm_set1_ps( v->normal[0] ) ),
+			_mm_mul_ps( c1, _mm_set1_ps( v->normal[1] ) ) ),
+			_mm_mul_ps( c2, _mm_set1_ps( v->normal[2] ) ) ) );
+
+		if ( numWeights > 1 )
+		{
+			__m128 w = _mm_set1_ps( weights[0] );
+
+			c0 = _mm_mul_ps( w, _mm_loadu_ps( vertBones[0]->matrix[0] ) );
+			c1 = _mm_mul_ps( w, _mm_loadu_ps( vertBones[0]->matrix[1] ) );
+			c2 = _mm_mul_ps( w, _mm_loadu_ps( vertBones[0]->matrix[2] ) );
+			for ( int k = 1 ; k < numWeights ; k++ )
+			{
+				w = _mm_set1_ps( weights[k] );
+				c0 = _mm_add_ps( c0, _mm_mul_ps( w, _mm_loadu_ps( vertBones[k]->matrix[0] ) ) );
+				c1 = _mm_add_ps( c1, _mm_mul_ps( w, _mm_loadu_ps( vertBones[k]->matrix[1] ) ) );
+				c2 = _mm_add_ps( c2, _mm_mul_ps( w, _mm_loadu_ps( vertBones[k]->matrix[2] ) ) );
+			}
+			c3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+		}
+
+		_mm_storeu_ps( xyz[j], _mm_add_ps( _mm_add_ps(
+			_mm_add_ps( _mm_mul_ps( c0, _mm_set1_ps( v->vertCoords[0] ) ), c3 ),
+			_mm_mul_ps( c1, _mm_set1_ps( v->vertCoords[1] ) ) ),
+			_mm_mul_ps( c2, _mm_set1_ps( v->vertCoords[2] ) ) ) );
+#else
+		const mdxaBone_t	*bone = vertBones[0];
+		mdxaBone_t			blended;
+
+		normal[j][0] = DotProduct( bone->matrix[0], v->normal );
+		normal[j][1] = DotProduct( bone->matrix[1], v->normal );
+		normal[j][2] = DotProduct( bone->matrix[2], v->normal );
+
+		if ( numWeights > 1 )
+		{
+			for ( int i = 0 ; i < 3 ; i++ )
+			{
+				VectorScale4( vertBones[0]->matrix[i], weights[0], blended.matrix[i] );
+				for ( int k = 1 ; k < numWeights ; k++ )
+				{
+					for ( int c = 0 ; c < 4 ; c++ )
+					{
+						blended.matrix[i][c] += weights[k] * vertBones[k]->matrix[i][c];
+					}
+				}
+			}
+			bone = &blended;
+		}
+
+		xyz[j][0] = DotProduct( bone->matrix[0], v->vertCoords ) + bone->matrix[0][3];
+		xyz[j][1] = DotProduct( bone->matrix[1], v->vertCoords ) + bone->matrix[1][3];
+		xyz[j][2] = DotProduct( bone->matrix[2], v->vertCoords ) + bone->matrix[2][3];
+#endif
+	}
+}
+
+// only ever touched by the back end, which may be on its own thread, so
+// these stay off the zone
+static Q::JobPool							ghoulSkinPool;
+static std::vector<CRenderableSurface *>	ghoulSkinJobs;
+static std::vector<float>					ghoulSkinVerts;
+
+/*
+=================
+RB_SkinGhoulSurfaces
+
+Skins the Ghoul2 surfaces of a draw list on the worker pool, so that
+RB_SurfaceGhoul only has to copy them
+=================
+*/
+void RB_SkinGhoulSurfaces( drawSurf_t *drawSurfs, int numDrawSurfs )
+{
+	extern bool	g_bRenderGlowingObjects;
+	int			i, numJobs, numVerts;
+	drawSurf_t	*drawSurf;
+
+	if ( r_ghoul2SkinThreads->integer <= 0 )
+	{
+		ghoulSkinPool.setNumWorkers( 0 );
+		return;
+	}
+	if ( ghoulSkinPool.numWorkers() != r_ghoul2SkinThreads->integer )
+	{
+		ghoulSkinPool.setNumWorkers( r_ghoul2SkinThreads->integer );
+	}
+
+	// count the surfaces this pass will draw, and forget about anything
+	// skinned for an earlier pass
+	numJobs = numVerts = 0;
+	for ( i = 0, drawSurf = drawSurfs ; i < numDrawSurfs ; i++, drawSurf++ )
+	{
+		CRenderableSurface	*surf;
+		shader_t			*shader;
+		int					entityNum, fogNum, dlighted;
+
+		if ( *drawSurf->surface != SF_MDX )
+		{
+			continue;
+		}
+		surf = (CRenderableSurface *)drawSurf->surface;
+		surf->skinnedVerts = NULL;
+#ifdef _G2_GORE
+		if ( surf->alternateTex )
+		{
+			continue;
+		}
+#endif
+		R_DecomposeSort( drawSurf->sort, &entityNum, &shader, &fogNum, &dlighted );
+		if ( g_bRenderGlowingObjects && !shader->hasGlow )
+		{
+			continue;
+		}
+		numJobs++;
+		numVerts += surf->surfaceData->numVerts;
+	}
+	if ( !numJobs )
+	{
+		return;
+	}
+
+	if ( (int)ghoulSkinJobs.size() < numJobs )
+	{
+		ghoulSkinJobs.resize( numJobs );
+	}
+	if ( (int)ghoulSkinVerts.size() < numVerts * 8 )
+	{
+		ghoulSkinVerts.resize( numVerts * 8 );
+	}
+
+	numJobs = numVerts = 0;
+	for ( i = 0, drawSurf = drawSurfs ; i < numDrawSurfs ; i++, drawSurf++ )
+	{
+		CRenderableSurface	*surf;
+		shader_t			*shader;
+		int					entityNum, fogNum, dlighted;
+
+		if ( *drawSurf->surface != SF_MDX )
+		{
+			continue;
+		}
+		surf = (CRenderableSurface *)drawSurf->surface;
+#ifdef _G2_GORE
+		if ( surf->alternateTex )
+		{
+			continue;
+		}
+#endif
+		R_DecomposeSort( drawSurf->sort, &entityNum, &shader, &fogNum, &dlighted );
+		if ( g_bRenderGlowingObjects && !shader->hasGlow )
+		{
+			continue;
+		}
+
+		ghoulSkinJobs[numJobs++] = surf;
+		surf->skinnedVerts = (vec4_t *)&ghoulSkinVerts[numVerts * 8];
+		numVerts += surf->surfaceData->numVerts;
+	}
+
+	ghoulSkinPool.parallelFor( numJobs, []( int index ) {
+		const CRenderableSurface	*surf = ghoulSkinJobs[index];
+		const mdxaBone_t			*surfBones[iMAX_G2_BONEREFS_PER_SURFACE];
+
+		RB_GetGhoulSurfaceBones( surf->surfaceData, surf->bones, surfBones );
+		RB_SkinGhoulVerts( surf->surfaceData, surfBones, surf->skinnedVerts, surf->skinnedVerts + surf->surfaceData->numVerts );
+	} );
+}
+
+/*
+=================
+R_ShutdownGhoulWorkers
+=================
+*/
+void R_ShutdownGhoulWorkers( void )
+{
+	ghoulSkeletonPool.setNumWorkers( 0 );
+	std::vector<CBoneCache *>().swap( ghoulSkeletonJobs );
+	ghoulSkinPool.setNumWorkers( 0 );
+	std::vector<CRenderableSurface *>().swap( ghoulSkinJobs );
+	std::vector<float>().swap( ghoulSkinVerts );
+
+	// the render thread is gone, nothing draws the frames these belonged to
+	for ( int i = 0 ; i < SMP_FRAMES ; i++ )
+	{
+		for ( size_t j = 0 ; j < ghoulRetired[i].size() ; j++ )
+		{
+			Z_Free( ghoulRetired[i][j] );
+		}
+		std::vector<void *>().swap( ghoulRetired[i] );
+	}
 }
 
 //This is a slightly mangled version of the same function from the sof2sp base.
@@ -3476,15 +4050,12 @@ void RB_SurfaceGhoul( CRenderableSurface *surf )
 	G2PerformanceTimer_RB_SurfaceGhoul.Start();
 #endif
 
-	static int				j, k;
-	static int				baseIndex, baseVertex;
-	static int				numVerts;
-	static mdxmVertex_t 	*v;
-	static int				*triangles;
-	static int				indexes;
-	static glIndex_t		*tessIndexes;
-	static mdxmVertexTexCoord_t *pTexCoords;
-	static int				*piBoneReferences;
+	int				j;
+	int				baseIndex, baseVertex;
+	int				numVerts;
+	int				*triangles;
+	int				indexes;
+	glIndex_t		*tessIndexes;
 
 #ifdef _G2_GORE
 	if (surf->alternateTex)
@@ -3555,8 +4126,7 @@ void RB_SurfaceGhoul( CRenderableSurface *surf )
 		//now check for fade overrides -rww
 		if (surf->fade)
 		{
-			static int lFade;
-			static int j;
+			int lFade;
 
 			if (surf->fade<1.0)
 			{
@@ -3601,11 +4171,8 @@ void RB_SurfaceGhoul( CRenderableSurface *surf )
 	// grab the pointer to the surface info within the loaded mesh file
 	mdxmSurface_t	*surface = surf->surfaceData;
 
-	CBoneCache *bones = surf->boneCache;
-
-#ifndef _G2_GORE //we use this later, for gore
-	delete surf;
-#endif
+	const mdxaBone_t *bones = surf->bones;
+	vec4_t *skinnedVerts = surf->skinnedVerts;
 
 	// first up, sanity check our numbers
 	RB_CheckOverflow( surface->numVerts, surface->numTriangles );
@@ -3618,13 +4185,6 @@ void RB_SurfaceGhoul( CRenderableSurface *surf )
 	baseVertex = tess.numVertexes;
 	triangles = (int *) ((byte *)surface + surface->ofsTriangles);
 	baseIndex = tess.numIndexes;
-#if 0
-	indexes = surface->numTriangles * 3;
-	for (j = 0 ; j < indexes ; j++) {
-		tess.indexes[baseIndex + j] = baseVertex + triangles[j];
-	}
-	tess.numIndexes += indexes;
-#else
 	indexes = surface->numTriangles; //*3;	//unrolled 3 times, don't multiply
 	tessIndexes = &tess.indexes[baseIndex];
 	for (j = 0 ; j < indexes ; j++) {
@@ -3633,139 +4193,28 @@ void RB_SurfaceGhoul( CRenderableSurface *surf )
 		*tessIndexes++ = baseVertex + *triangles++;
 	}
 	tess.numIndexes += indexes*3;
-#endif
 
 	numVerts = surface->numVerts;
 
-	piBoneReferences = (int*) ((byte*)surface + surface->ofsBoneReferences);
-	baseVertex = tess.numVertexes;
-	v = (mdxmVertex_t *) ((byte *)surface + surface->ofsVerts);
-	pTexCoords = (mdxmVertexTexCoord_t *) &v[numVerts];
-
-//	if (r_ghoul2fastnormals&&r_ghoul2fastnormals->integer==0)
-#if 0
-	if (0)
+	if ( skinnedVerts )
 	{
-		for ( j = 0; j < numVerts; j++, baseVertex++,v++ )
-		{
-			const int iNumWeights = G2_GetVertWeights( v );
-
-			float fTotalWeight = 0.0f;
-
-			k=0;
-			int		iBoneIndex = G2_GetVertBoneIndex( v, k );
-			float	fBoneWeight = G2_GetVertBoneWeight( v, k, fTotalWeight, iNumWeights );
-			const mdxaBone_t *bone = &bones->EvalRender(piBoneReferences[iBoneIndex]);
-
-			tess.xyz[baseVertex][0] = fBoneWeight * ( DotProduct( bone->matrix[0], v->vertCoords ) + bone->matrix[0][3] );
-			tess.xyz[baseVertex][1] = fBoneWeight * ( DotProduct( bone->matrix[1], v->vertCoords ) + bone->matrix[1][3] );
-			tess.xyz[baseVertex][2] = fBoneWeight * ( DotProduct( bone->matrix[2], v->vertCoords ) + bone->matrix[2][3] );
-
-			tess.normal[baseVertex][0] = fBoneWeight * DotProduct( bone->matrix[0], v->normal );
-			tess.normal[baseVertex][1] = fBoneWeight * DotProduct( bone->matrix[1], v->normal );
-			tess.normal[baseVertex][2] = fBoneWeight * DotProduct( bone->matrix[2], v->normal );
-
-			for ( k++ ; k < iNumWeights ; k++)
-			{
-				iBoneIndex	= G2_GetVertBoneIndex( v, k );
-				fBoneWeight	= G2_GetVertBoneWeight( v, k, fTotalWeight, iNumWeights );
-
-				bone = &bones->EvalRender(piBoneReferences[iBoneIndex]);
-
-				tess.xyz[baseVertex][0] += fBoneWeight * ( DotProduct( bone->matrix[0], v->vertCoords ) + bone->matrix[0][3] );
-				tess.xyz[baseVertex][1] += fBoneWeight * ( DotProduct( bone->matrix[1], v->vertCoords ) + bone->matrix[1][3] );
-				tess.xyz[baseVertex][2] += fBoneWeight * ( DotProduct( bone->matrix[2], v->vertCoords ) + bone->matrix[2][3] );
-
-				tess.normal[baseVertex][0] += fBoneWeight * DotProduct( bone->matrix[0], v->normal );
-				tess.normal[baseVertex][1] += fBoneWeight * DotProduct( bone->matrix[1], v->normal );
-				tess.normal[baseVertex][2] += fBoneWeight * DotProduct( bone->matrix[2], v->normal );
-			}
-
-			tess.texCoords[baseVertex][0][0] = pTexCoords[j].texCoords[0];
-			tess.texCoords[baseVertex][0][1] = pTexCoords[j].texCoords[1];
-		}
+		memcpy( tess.xyz[baseVertex], skinnedVerts, sizeof( vec4_t ) * numVerts );
+		memcpy( tess.normal[baseVertex], skinnedVerts + numVerts, sizeof( vec4_t ) * numVerts );
 	}
 	else
 	{
-#endif
-		float fTotalWeight;
-		float fBoneWeight;
-		float t1;
-		float t2;
-		const mdxaBone_t *bone;
-		const mdxaBone_t *bone2;
-		for ( j = 0; j < numVerts; j++, baseVertex++,v++ )
-		{
-
-			bone = &bones->EvalRender(piBoneReferences[G2_GetVertBoneIndex( v, 0 )]);
-			int iNumWeights = G2_GetVertWeights( v );
-			tess.normal[baseVertex][0] = DotProduct( bone->matrix[0], v->normal );
-			tess.normal[baseVertex][1] = DotProduct( bone->matrix[1], v->normal );
-			tess.normal[baseVertex][2] = DotProduct( bone->matrix[2], v->normal );
-
-			if (iNumWeights==1)
-			{
-				tess.xyz[baseVertex][0] = ( DotProduct( bone->matrix[0], v->vertCoords ) + bone->matrix[0][3] );
-				tess.xyz[baseVertex][1] = ( DotProduct( bone->matrix[1], v->vertCoords ) + bone->matrix[1][3] );
-				tess.xyz[baseVertex][2] = ( DotProduct( bone->matrix[2], v->vertCoords ) + bone->matrix[2][3] );
-			}
-			else
-			{
-				fBoneWeight = G2_GetVertBoneWeightNotSlow( v, 0);
-				if (iNumWeights==2)
-				{
-					bone2 = &bones->EvalRender(piBoneReferences[G2_GetVertBoneIndex( v, 1 )]);
-					/*
-					useless transposition
-					tess.xyz[baseVertex][0] =
-					v[0]*(w*(bone->matrix[0][0]-bone2->matrix[0][0])+bone2->matrix[0][0])+
-					v[1]*(w*(bone->matrix[0][1]-bone2->matrix[0][1])+bone2->matrix[0][1])+
-					v[2]*(w*(bone->matrix[0][2]-bone2->matrix[0][2])+bone2->matrix[0][2])+
-					w*(bone->matrix[0][3]-bone2->matrix[0][3]) + bone2->matrix[0][3];
-					*/
-					t1 = ( DotProduct( bone->matrix[0], v->vertCoords ) + bone->matrix[0][3] );
-					t2 = ( DotProduct( bone2->matrix[0], v->vertCoords ) + bone2->matrix[0][3] );
-					tess.xyz[baseVertex][0] = fBoneWeight * (t1-t2) + t2;
-					t1 = ( DotProduct( bone->matrix[1], v->vertCoords ) + bone->matrix[1][3] );
-					t2 = ( DotProduct( bone2->matrix[1], v->vertCoords ) + bone2->matrix[1][3] );
-					tess.xyz[baseVertex][1] = fBoneWeight * (t1-t2) + t2;
-					t1 = ( DotProduct( bone->matrix[2], v->vertCoords ) + bone->matrix[2][3] );
-					t2 = ( DotProduct( bone2->matrix[2], v->vertCoords ) + bone2->matrix[2][3] );
-					tess.xyz[baseVertex][2] = fBoneWeight * (t1-t2) + t2;
-				}
-				else
-				{
+		const mdxaBone_t *surfBones[iMAX_G2_BONEREFS_PER_SURFACE];
 
-					tess.xyz[baseVertex][0] = fBoneWeight * ( DotProduct( bone->matrix[0], v->vertCoords ) + bone->matrix[0][3] );
-					tess.xyz[baseVertex][1] = fBoneWeight * ( DotProduct( bone->matrix[1], v->vertCoords ) + bone->matrix[1][3] );
-					tess.xyz[baseVertex][2] = fBoneWeight * ( DotProduct( bone->matrix[2], v->vertCoords ) + bone->matrix[2][3] );
-
-					fTotalWeight=fBoneWeight;
-					for (k=1; k < iNumWeights-1 ; k++)
-					{
-						bone = &bones->EvalRender(piBoneReferences[G2_GetVertBoneIndex( v, k )]);
-						fBoneWeight = G2_GetVertBoneWeightNotSlow( v, k);
-						fTotalWeight += fBoneWeight;
-
-						tess.xyz[baseVertex][0] += fBoneWeight * ( DotProduct( bone->matrix[0], v->vertCoords ) + bone->matrix[0][3] );
-						tess.xyz[baseVertex][1] += fBoneWeight * ( DotProduct( bone->matrix[1], v->vertCoords ) + bone->matrix[1][3] );
-						tess.xyz[baseVertex][2] += fBoneWeight * ( DotProduct( bone->matrix[2], v->vertCoords ) + bone->matrix[2][3] );
-					}
-					bone = &bones->EvalRender(piBoneReferences[G2_GetVertBoneIndex( v, k )]);
-					fBoneWeight	= 1.0f-fTotalWeight;
-
-					tess.xyz[baseVertex][0] += fBoneWeight * ( DotProduct( bone->matrix[0], v->vertCoords ) + bone->matrix[0][3] );
-					tess.xyz[baseVertex][1] += fBoneWeight * ( DotProduct( bone->matrix[1], v->vertCoords ) + bone->matrix[1][3] );
-					tess.xyz[baseVertex][2] += fBoneWeight * ( DotProduct( bone->matrix[2], v->vertCoords ) + bone->matrix[2][3] );
-				}
-			}
+		RB_GetGhoulSurfaceBones( surface, bones, surfBones );
+		RB_SkinGhoulVerts( surface, surfBones, &tess.xyz[baseVertex], &tess.normal[baseVertex] );
+	}
 
-			tess.texCoords[baseVertex][0][0] = pTexCoords[j].texCoords[0];
-			tess.texCoords[baseVertex][0][1] = pTexCoords[j].texCoords[1];
-		}
-#if 0
+	const mdxmVertexTexCoord_t *pTexCoords = (mdxmVertexTexCoord_t *) ((byte *)surface + surface->ofsVerts + numVerts * sizeof( mdxmVertex_t ));
+	for ( j = 0; j < numVerts; j++, baseVertex++ )
+	{
+		tess.texCoords[baseVertex][0][0] = pTexCoords[j].texCoords[0];
+		tess.texCoords[baseVertex][0][1] = pTexCoords[j].texCoords[1];
 	}
-#endif
 
 #ifdef _G2_GORE
 	CRenderableSurface *storeSurf = surf;
@@ -27,6 +27,10 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "glext.h"
 
 #include <map>
+#include <string>
+#include <vector>
+
+#include "qcommon/jobs.h"
 
 static byte			 s_intensitytable[256];
 static unsigned char s_gammatable[256];
@@ -371,6 +375,9 @@ R_MipMap2
 
 Operates in place, quartering the size of the texture
 Proper linear filter
+
+Also runs on the image decode workers, so the temp buffer
+comes from the C heap rather than the hunk
 ================
 */
 static void R_MipMap2( unsigned *in, int inWidth, int inHeight ) {
@@ -383,7 +390,7 @@ static void R_MipMap2( unsigned *in, int inWidth, int inHeight ) {
 
 	outWidth = inWidth >> 1;
 	outHeight = inHeight >> 1;
-	temp = (unsigned int *)Hunk_AllocateTempMemory( outWidth * outHeight * 4 );
+	temp = (unsigned int *)malloc( outWidth * outHeight * 4 );
 
 	inWidthMask = inWidth - 1;
 	inHeightMask = inHeight - 1;
@@ -418,7 +425,7 @@ static void R_MipMap2( unsigned *in, int inWidth, int inHeight ) {
 	}
 
 	memcpy( in, temp, outWidth * outHeight * 4 );
-	Hunk_FreeTempMemory( temp );
+	free( temp );
 }
 
 /*
@@ -555,6 +562,7 @@ static void R_Images_DeleteImageContents( image_t *pImage )
 	assert(pImage);	// should never be called with NULL
 	if (pImage)
 	{
+		R_SyncRenderThread();
 		qglDeleteTextures( 1, &pImage->texnum );
 		Z_Free(pImage);
 	}
@@ -564,26 +572,36 @@ static void R_Images_DeleteImageContents( image_t *pImage )
 
 
 
+// an image after all the CPU work of an upload, ready to be handed to GL
+typedef struct preparedImage_s {
+	int		width, height;		// of the first level
+	int		internalFormat;
+	int		numLevels;			// 0 if there is nothing to upload
+	byte	*levels;			// every level back to back, from malloc
+} preparedImage_t;
+
 /*
 ===============
-Upload32
+R_PrepareImage32
 
+Everything Upload32 does before it talks to GL: picmip, clamping
+to the maximum texture size, picking the internal format, light
+scaling and building the mip chain.  data is used as scratch
+space.  Only reads cvars and the gamma tables, so the image
+decode workers run it too.
 ===============
 */
-static void Upload32( unsigned *data,
+static void R_PrepareImage32( unsigned *data, int width, int height,
 						 GLenum format,
 						 qboolean mipmap,
 						 qboolean picmip,
 						 qboolean isLightmap,
 						 qboolean allowTC,
-						 int *pformat,
-						 word *pUploadWidth, word *pUploadHeight, bool bRectangle = false )
+						 preparedImage_t *prepared )
 {
-	GLuint uiTarget = GL_TEXTURE_2D;
-	if ( bRectangle )
-	{
-		uiTarget = GL_TEXTURE_RECTANGLE_ARB;
-	}
+	memset( prepared, 0, sizeof( *prepared ) );
+	prepared->width = width;
+	prepared->height = height;
 
 	if (format == GL_RGBA)
 	{
@@ -591,8 +609,8 @@ static void Upload32( unsigned *data,
 		int			i, c;
 		byte		*scan;
 		float		rMax = 0, gMax = 0, bMax = 0;
-		int			width = *pUploadWidth;
-		int			height = *pUploadHeight;
+		int			levelsSize;
+		byte		*level;
 
 		//
 		// perform optional picmip operation
@@ -655,15 +673,15 @@ static void Upload32( unsigned *data,
 		{
 			if ( glConfig.textureCompression == TC_S3TC && allowTC )
 			{
-				*pformat = GL_RGB4_S3TC;
+				prepared->internalFormat = GL_RGB4_S3TC;
 			}
 			else if ( glConfig.textureCompression == TC_S3TC_DXT && allowTC )
 			{	// Compress purely color - no alpha
 				if ( r_texturebits->integer == 16 ) {
-					*pformat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;	//this format cuts to 16 bit
+					prepared->internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;	//this format cuts to 16 bit
 				}
 				else {//if we aren't using 16 bit then, use 32 bit compression
-					*pformat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+					prepared->internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
 				}
 			}
 			else if ( isLightmap && r_texturebitslm->integer > 0 )
@@ -671,87 +689,139 @@ static void Upload32( unsigned *data,
 				int lmBits = r_texturebitslm->integer & 0x30; // 16 or 32
 				// Allow different bit depth when we are a lightmap
 				if ( lmBits == 16 )
-					*pformat = GL_RGB5;
+					prepared->internalFormat = GL_RGB5;
 				else
-					*pformat = GL_RGB8;
+					prepared->internalFormat = GL_RGB8;
 			}
 			else if ( r_texturebits->integer == 16 )
 			{
-				*pformat = GL_RGB5;
+				prepared->internalFormat = GL_RGB5;
 			}
 			else if ( r_texturebits->integer == 32 )
 			{
-				*pformat = GL_RGB8;
+				prepared->internalFormat = GL_RGB8;
 			}
 			else
 			{
-				*pformat = 3;
+				prepared->internalFormat = 3;
 			}
 		}
 		else if ( samples == 4 )
 		{
 			if ( glConfig.textureCompression == TC_S3TC_DXT && allowTC)
 			{	// Compress both alpha and color
-				*pformat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+				prepared->internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
 			}
 			else if ( r_texturebits->integer == 16 )
 			{
-				*pformat = GL_RGBA4;
+				prepared->internalFormat = GL_RGBA4;
 			}
 			else if ( r_texturebits->integer == 32 )
 			{
-				*pformat = GL_RGBA8;
+				prepared->internalFormat = GL_RGBA8;
 			}
 			else
 			{
-				*pformat = 4;
+				prepared->internalFormat = 4;
 			}
 		}
 
-		*pUploadWidth = width;
-		*pUploadHeight = height;
+		prepared->width = width;
+		prepared->height = height;
 
-		// copy or resample data as appropriate for first MIP level
-		if (!mipmap)
+		// size the whole chain up front
+		levelsSize = width * height * 4;
+		prepared->numLevels = 1;
+		if (mipmap)
 		{
-			qglTexImage2D( uiTarget, 0, *pformat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
-			goto done;
-		}
+			int w = width, h = height;
 
-		R_LightScaleTexture (data, width, height, (qboolean)!mipmap );
-
-		qglTexImage2D( uiTarget, 0, *pformat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
+			while (w > 1 || h > 1)
+			{
+				w = Q_max( w >> 1, 1 );
+				h = Q_max( h >> 1, 1 );
+				levelsSize += w * h * 4;
+				prepared->numLevels++;
+			}
+		}
+		prepared->levels = (byte *)malloc( levelsSize );
+		if ( !prepared->levels )
+		{
+			prepared->numLevels = 0;
+			return;
+		}
 
+		// copy or resample data as appropriate for first MIP level
 		if (mipmap)
 		{
-			int		miplevel;
+			R_LightScaleTexture (data, width, height, (qboolean)!mipmap );
+		}
 
-			miplevel = 0;
-			while (width > 1 || height > 1)
-			{
-				R_MipMap( (byte *)data, width, height );
-				width >>= 1;
-				height >>= 1;
-				if (width < 1)
-					width = 1;
-				if (height < 1)
-					height = 1;
-				miplevel++;
+		level = prepared->levels;
+		memcpy( level, data, width * height * 4 );
+		level += width * height * 4;
 
-				if ( r_colorMipLevels->integer )
-				{
-					R_BlendOverTexture( (byte *)data, width * height, mipBlendColors[miplevel] );
-				}
+		for ( int miplevel = 1; miplevel < prepared->numLevels; miplevel++ )
+		{
+			R_MipMap( (byte *)data, width, height );
+			width >>= 1;
+			height >>= 1;
+			if (width < 1)
+				width = 1;
+			if (height < 1)
+				height = 1;
 
-				qglTexImage2D( uiTarget, miplevel, *pformat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
+			if ( r_colorMipLevels->integer )
+			{
+				R_BlendOverTexture( (byte *)data, width * height, mipBlendColors[miplevel] );
 			}
+
+			memcpy( level, data, width * height * 4 );
+			level += width * height * 4;
 		}
 	}
 	else
 	{
 	}
+}
+
+/*
+===============
+R_UploadPreparedImage
+
+The GL half of Upload32
+===============
+*/
+static void R_UploadPreparedImage( const preparedImage_t *prepared,
+						 qboolean mipmap,
+						 int *pformat,
+						 word *pUploadWidth, word *pUploadHeight, bool bRectangle = false )
+{
+	GLuint uiTarget = GL_TEXTURE_2D;
+	if ( bRectangle )
+	{
+		uiTarget = GL_TEXTURE_RECTANGLE_ARB;
+	}
+
+	if ( prepared->numLevels )
+	{
+		int		width = prepared->width;
+		int		height = prepared->height;
+		byte	*level = prepared->levels;
 
-done:
+		*pformat = prepared->internalFormat;
+		*pUploadWidth = width;
+		*pUploadHeight = height;
+
+		for ( int miplevel = 0; miplevel < prepared->numLevels; miplevel++ )
+		{
+			qglTexImage2D( uiTarget, miplevel, *pformat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level );
+
+			level += width * height * 4;
+			width = Q_max( width >> 1, 1 );
+			height = Q_max( height >> 1, 1 );
+		}
+	}
 
 	if (mipmap)
 	{
@@ -771,6 +841,28 @@ done:
 	GL_CheckErrors();
 }
 
+/*
+===============
+Upload32
+
+===============
+*/
+static void Upload32( unsigned *data,
+						 GLenum format,
+						 qboolean mipmap,
+						 qboolean picmip,
+						 qboolean isLightmap,
+						 qboolean allowTC,
+						 int *pformat,
+						 word *pUploadWidth, word *pUploadHeight, bool bRectangle = false )
+{
+	preparedImage_t prepared;
+
+	R_PrepareImage32( data, *pUploadWidth, *pUploadHeight, format, mipmap, picmip, isLightmap, allowTC, &prepared );
+	R_UploadPreparedImage( &prepared, mipmap, pformat, pUploadWidth, pUploadHeight, bRectangle );
+	free( prepared.levels );
+}
+
 static void GL_ResetBinds(void)
 {
 	memset( glState.currenttextures, 0, sizeof( glState.currenttextures ) );
@@ -971,12 +1063,13 @@ static image_t *R_FindImageFile_NoLoad(const char *name, qboolean mipmap, qboole
 
 /*
 ================
-R_CreateImage
+R_CreateImage_Internal
 
-This is the only way any image_t are created
+Creates the image from pic, or from an image the decode workers
+have already prepared for upload
 ================
 */
-image_t *R_CreateImage( const char *name, const byte *pic, int width, int height,
+static image_t *R_CreateImage_Internal( const char *name, const byte *pic, const preparedImage_t *prepared, int width, int height,
 					   GLenum format, qboolean mipmap, qboolean allowPicmip, qboolean allowTC, int glWrapClampMode, bool bRectangle )
 {
 	image_t		*image;
@@ -986,6 +1079,9 @@ image_t *R_CreateImage( const char *name, const byte *pic, int width, int height
 		Com_Error (ERR_DROP, "R_CreateImage: \"%s\" is too long\n", name);
 	}
 
+	// we are about to upload
+	R_SyncRenderThread();
+
 	if(glConfig.clampToEdgeAvailable && glWrapClampMode == GL_CLAMP) {
 		glWrapClampMode = GL_CLAMP_TO_EDGE;
 	}
@@ -1044,7 +1140,16 @@ image_t *R_CreateImage( const char *name, const byte *pic, int width, int height
 		GL_Bind(image);
 	}
 
-	Upload32( (unsigned *)pic,	format,
+	if ( prepared )
+	{
+		R_UploadPreparedImage( prepared, (qboolean)image->mipmap,
+								&image->internalFormat,
+								&image->width,
+								&image->height, bRectangle );
+	}
+	else
+	{
+		Upload32( (unsigned *)pic,	format,
 								(qboolean)image->mipmap,
 								allowPicmip,
 								isLightmap,
@@ -1052,6 +1157,7 @@ image_t *R_CreateImage( const char *name, const byte *pic, int width, int height
 								&image->internalFormat,
 								&image->width,
 								&image->height, bRectangle );
+	}
 
 	qglTexParameterf( uiTarget, GL_TEXTURE_WRAP_S, glWrapClampMode );
 	qglTexParameterf( uiTarget, GL_TEXTURE_WRAP_T, glWrapClampMode );
@@ -1072,6 +1178,19 @@ image_t *R_CreateImage( const char *name, const byte *pic, int width, int height
 	return image;
 }
 
+/*
+================
+R_CreateImage
+
+This is the only way any image_t are created
+================
+*/
+image_t *R_CreateImage( const char *name, const byte *pic, int width, int height,
+					   GLenum format, qboolean mipmap, qboolean allowPicmip, qboolean allowTC, int glWrapClampMode, bool bRectangle )
+{
+	return R_CreateImage_Internal( name, pic, NULL, width, height, format, mipmap, allowPicmip, allowTC, glWrapClampMode, bRectangle );
+}
+
 /*
 ===============
 R_FindImageFile
@@ -1116,15 +1235,176 @@ image_t	*R_FindImageFile( const char *name, qboolean mipmap, qboolean allowPicmi
 	if ( (width&(width-1)) || (height&(height-1)) )
 	{
 		ri->Printf( PRINT_ALL, "Refusing to load non-power-2-dims(%d,%d) pic \"%s\"...\n", width,height,name );
+		free( pic );
 		return NULL;
 	}
 
 	image = R_CreateImage( ( char * ) name, pic, width, height, GL_RGBA, mipmap, allowPicmip, allowTC, glWrapClampMode );
-	Z_Free( pic );
+	free( pic );
 	return image;
 }
 
 
+/*
+=============================================================================
+
+LEVEL LOAD IMAGE DECODING
+
+R_FindImageFile decodes, resamples and mipmaps each image on the main
+thread as the shader parser asks for it, one after another, which is
+where most of a map's load time goes.  With r_imageDecodeThreads set,
+the map's shaders are scanned up front for the images they are going
+to ask for, and R_DecodeImages does all the CPU work for those on a
+worker pool, in batches to bound the memory held at once.  The files
+are still read on the main thread, since the file system isn't thread
+safe, and the GL uploads happen there too.  The images are created
+with the parameters the shader parser will ask for, so its
+R_FindImageFile calls simply find them.  Anything that fails to
+decode is left for R_FindImageFile to load and report as usual.
+
+=============================================================================
+*/
+
+#define	IMAGE_DECODE_BATCH		64
+
+typedef struct imageDecodeJob_s {
+	const imageRequest_t	*request;
+	const void				*file;
+	int						fileLen;
+	ImageDecoderFn			decoder;
+	int						width, height;	// as decoded
+	preparedImage_t			prepared;
+	qboolean				decoded;
+	char					message[256];
+} imageDecodeJob_t;
+
+/*
+===============
+R_DecodeImageJob
+
+Runs on the decode workers
+===============
+*/
+static void R_DecodeImageJob( imageDecodeJob_t *job )
+{
+	byte	*pic;
+
+	if ( !job->file || !job->decoder ) {
+		return;
+	}
+	if ( !job->decoder( (const byte *)job->file, job->fileLen, &pic, &job->width, &job->height, job->message, sizeof( job->message ) ) ) {
+		return;
+	}
+
+	// R_FindImageFile refuses these, and can say so
+	if ( (job->width&(job->width-1)) || (job->height&(job->height-1)) ) {
+		free( pic );
+		return;
+	}
+
+	R_PrepareImage32( (unsigned *)pic, job->width, job->height, GL_RGBA, job->request->mipmap, job->request->allowPicmip, qfalse, job->request->allowTC, &job->prepared );
+	free( pic );
+	job->decoded = (qboolean)( job->prepared.numLevels > 0 );
+}
+
+/*
+===============
+R_DecodeImages
+
+Loads the given images ahead of the R_FindImageFile calls that will ask for them
+===============
+*/
+void R_DecodeImages( const imageRequest_t *requests, int numRequests )
+{
+	std::vector<imageRequest_t>			pending;
+	std::map<std::string, size_t>		pendingNames;
+	imageDecodeJob_t					jobs[IMAGE_DECODE_BATCH];
+	Q::JobPool							pool;
+	int									numDecoded = 0;
+
+	if ( ri->Cvar_VariableIntegerValue( "dedicated" ) ) {
+		return;
+	}
+
+	// skip images we already have, and ones asked for in more than one way, since
+	// which way wins is up to the order R_FindImageFile sees them in
+	for ( int i = 0; i < numRequests; i++ ) {
+		imageRequest_t	request = requests[i];
+		const char		*name;
+
+		if ( glConfig.clampToEdgeAvailable && request.glWrapClampMode == GL_CLAMP ) {
+			request.glWrapClampMode = GL_CLAMP_TO_EDGE;
+		}
+
+		name = GenerateImageMappingName( request.name );
+		if ( AllocatedImages.find( name ) != AllocatedImages.end() ) {
+			continue;
+		}
+
+		std::map<std::string, size_t>::iterator it = pendingNames.find( name );
+		if ( it != pendingNames.end() ) {
+			imageRequest_t *other = &pending[it->second];
+
+			if ( other->mipmap != request.mipmap || other->allowPicmip != request.allowPicmip ||
+				other->allowTC != request.allowTC || other->glWrapClampMode != request.glWrapClampMode ) {
+				other->name[0] = '\0';
+			}
+			continue;
+		}
+
+		pendingNames[name] = pending.size();
+		pending.push_back( request );
+	}
+
+	if ( pending.empty() ) {
+		return;
+	}
+
+	pool.setNumWorkers( r_imageDecodeThreads->integer );
+
+	for ( size_t first = 0; first < pending.size(); first += IMAGE_DECODE_BATCH ) {
+		const int count = (int)Q_min( pending.size() - first, (size_t)IMAGE_DECODE_BATCH );
+
+		memset( jobs, 0, sizeof( jobs ) );
+		for ( int i = 0; i < count; i++ ) {
+			jobs[i].request = &pending[first + i];
+			if ( jobs[i].request->name[0] ) {
+				R_ReadImage( jobs[i].request->name, &jobs[i].file, &jobs[i].fileLen, &jobs[i].decoder );
+			}
+		}
+
+		pool.parallelFor( count, [&jobs]( int i ) {
+			R_DecodeImageJob( &jobs[i] );
+		} );
+
+		for ( int i = 0; i < count; i++ ) {
+			imageDecodeJob_t *job = &jobs[i];
+
+			if ( job->file ) {
+				ri->FS_FreeFile( (void *)job->file );
+			}
+			if ( !job->decoded ) {
+				continue;
+			}
+			if ( job->message[0] ) {
+				ri->Printf( PRINT_WARNING, "%s: %s\n", job->request->name, job->message );
+			}
+
+			image_t *image = R_CreateImage_Internal( job->request->name, NULL, &job->prepared, job->width, job->height, GL_RGBA,
+				job->request->mipmap, job->request->allowPicmip, job->request->allowTC, job->request->glWrapClampMode, false );
+			free( job->prepared.levels );
+
+			// nothing is using it yet. R_FindImageFile_NoLoad will mark it when the shader
+			// parser asks for it, and RE_RegisterImages_LevelLoadEnd dumps it if nothing does
+			image->iLastLevelUsedOn = RE_RegisterMedia_GetLevel() - 1;
+			numDecoded++;
+		}
+	}
+
+	ri->Printf( PRINT_DEVELOPER, "R_DecodeImages: %i of %i images decoded on %i threads\n", numDecoded, (int)pending.size(), pool.numWorkers() + 1 );
+}
+
+
 /*
 ================
 R_CreateDlightImage
@@ -1140,7 +1420,7 @@ static void R_CreateDlightImage( void )
 	if (pic)
 	{
 		tr.dlightImage = R_CreateImage("*dlight", pic, width, height, GL_RGBA, qfalse, qfalse, qfalse, GL_CLAMP );
-		Z_Free(pic);
+		free(pic);
 	}
 	else
 	{	// if we dont get a successful load
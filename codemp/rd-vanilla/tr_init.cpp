@@ -46,6 +46,7 @@ cvar_t	*r_detailTextures;
 cvar_t	*r_znear;
 
 cvar_t	*r_skipBackEnd;
+cvar_t	*r_smp;
 
 cvar_t	*r_measureOverdraw;
 
@@ -84,6 +85,8 @@ cvar_t	*r_autoMapDisable; //don't calc it (since it's slow in debug) -rww
 cvar_t	*r_dlightStyle;
 cvar_t	*r_surfaceSprites;
 cvar_t	*r_surfaceWeather;
+cvar_t	*r_surfaceSpriteCache;
+cvar_t	*r_weatherThreads;
 
 cvar_t	*r_windSpeed;
 cvar_t	*r_windAngle;
@@ -118,6 +121,7 @@ cvar_t	*r_DynamicGlowHeight;
 cvar_t	*r_ignoreGLErrors;
 cvar_t	*r_logFile;
 
+cvar_t	*r_worldVBO;
 cvar_t	*r_primitives;
 cvar_t	*r_texturebits;
 cvar_t	*r_texturebitslm;
@@ -157,6 +161,8 @@ cvar_t	*r_mapOverBrightBits;
 
 cvar_t	*r_debugSurface;
 cvar_t	*r_simpleMipMaps;
+cvar_t	*r_imageDecodeThreads;
+cvar_t	*r_shaderCache;
 
 cvar_t	*r_showImages;
 
@@ -189,6 +195,8 @@ cvar_t	*r_noPrecacheGLA;
 #endif
 
 cvar_t	*r_noServerGhoul2;
+cvar_t	*r_ghoul2SkinThreads;
+cvar_t	*r_ghoul2SkeletonThreads;
 cvar_t	*r_Ghoul2AnimSmooth=0;
 cvar_t	*r_Ghoul2UnSqashAfterSmooth=0;
 //cvar_t	*r_Ghoul2UnSqash;
@@ -218,6 +226,7 @@ Ghoul2 Insert End
 cvar_t *se_language;
 
 cvar_t *r_aviMotionJpegQuality;
+cvar_t *r_aviEncodeThreads;
 cvar_t *r_screenshotJpegQuality;
 
 PFNGLACTIVETEXTUREARBPROC qglActiveTextureARB;
@@ -266,6 +275,13 @@ PFNGLISPROGRAMARBPROC qglIsProgramARB;
 PFNGLLOCKARRAYSEXTPROC qglLockArraysEXT;
 PFNGLUNLOCKARRAYSEXTPROC qglUnlockArraysEXT;
 
+PFNGLGENBUFFERSARBPROC qglGenBuffersARB;
+PFNGLBINDBUFFERARBPROC qglBindBufferARB;
+PFNGLBUFFERDATAARBPROC qglBufferDataARB;
+PFNGLDELETEBUFFERSARBPROC qglDeleteBuffersARB;
+PFNGLMAPBUFFERARBPROC qglMapBufferARB;
+PFNGLUNMAPBUFFERARBPROC qglUnmapBufferARB;
+
 bool g_bTextureRectangleHack = false;
 
 void RE_SetLightStyle(int style, int color);
@@ -570,6 +586,52 @@ static void GLimp_InitExtensions( void )
 		Com_Printf ("...GL_EXT_compiled_vertex_array not found\n" );
 	}
 
+	// GL_ARB_vertex_buffer_object
+	qglGenBuffersARB = NULL;
+	qglBindBufferARB = NULL;
+	qglBufferDataARB = NULL;
+	qglDeleteBuffersARB = NULL;
+	qglMapBufferARB = NULL;
+	qglUnmapBufferARB = NULL;
+	if ( ri->GL_ExtensionSupported( "GL_ARB_vertex_buffer_object" ) )
+	{
+		Com_Printf ("...using GL_ARB_vertex_buffer_object\n" );
+		qglGenBuffersARB = ( PFNGLGENBUFFERSARBPROC ) ri->GL_GetProcAddress( "glGenBuffersARB" );
+		qglBindBufferARB = ( PFNGLBINDBUFFERARBPROC ) ri->GL_GetProcAddress( "glBindBufferARB" );
+		qglBufferDataARB = ( PFNGLBUFFERDATAARBPROC ) ri->GL_GetProcAddress( "glBufferDataARB" );
+		qglDeleteBuffersARB = ( PFNGLDELETEBUFFERSARBPROC ) ri->GL_GetProcAddress( "glDeleteBuffersARB" );
+		qglMapBufferARB = ( PFNGLMAPBUFFERARBPROC ) ri->GL_GetProcAddress( "glMapBufferARB" );
+		qglUnmapBufferARB = ( PFNGLUNMAPBUFFERARBPROC ) ri->GL_GetProcAddress( "glUnmapBufferARB" );
+		if ( !qglGenBuffersARB || !qglBindBufferARB || !qglBufferDataARB || !qglDeleteBuffersARB )
+		{
+			qglGenBuffersARB = NULL;
+			Com_Printf ("...GL_ARB_vertex_buffer_object entry points missing\n" );
+		}
+	}
+	else
+	{
+		Com_Printf ("...GL_ARB_vertex_buffer_object not found\n" );
+	}
+
+	// GL_ARB_pixel_buffer_object
+	glConfigExt.pixelBufferObjects = qfalse;
+	if ( ri->GL_ExtensionSupported( "GL_ARB_pixel_buffer_object" ) )
+	{
+		if ( qglGenBuffersARB && qglMapBufferARB && qglUnmapBufferARB )
+		{
+			Com_Printf ("...using GL_ARB_pixel_buffer_object\n" );
+			glConfigExt.pixelBufferObjects = qtrue;
+		}
+		else
+		{
+			Com_Printf ("...GL_ARB_pixel_buffer_object entry points missing\n" );
+		}
+	}
+	else
+	{
+		Com_Printf ("...GL_ARB_pixel_buffer_object not found\n" );
+	}
+
 	bool bNVRegisterCombiners = false;
 	// Register Combiners.
 	if ( ri->GL_ExtensionSupported( "GL_NV_register_combiners" ) )
@@ -902,6 +964,8 @@ byte *RB_ReadPixels(int x, int y, int width, int height, size_t *offset, int *pa
 	int padwidth, linelen;
 	GLint packAlign;
 
+	R_SyncRenderThread();
+
 	qglGetIntegerv(GL_PACK_ALIGNMENT, &packAlign);
 
 	linelen = width * 3;
@@ -1226,83 +1290,6 @@ void R_ScreenShot_f (void) {
 		ri->Printf( PRINT_ALL, "[skipnotify]Wrote %s\n", checkname );
 }
 
-/*
-==================
-RB_TakeVideoFrameCmd
-==================
-*/
-const void *RB_TakeVideoFrameCmd( const void *data )
-{
-	const videoFrameCommand_t	*cmd;
-	byte				*cBuf;
-	size_t				memcount, linelen;
-	int				padwidth, avipadwidth, padlen, avipadlen;
-	GLint packAlign;
-
-	cmd = (const videoFrameCommand_t *)data;
-
-	qglGetIntegerv(GL_PACK_ALIGNMENT, &packAlign);
-
-	linelen = cmd->width * 3;
-
-	// Alignment stuff for glReadPixels
-	padwidth = PAD(linelen, packAlign);
-	padlen = padwidth - linelen;
-	// AVI line padding
-	avipadwidth = PAD(linelen, AVI_LINE_PADDING);
-	avipadlen = avipadwidth - linelen;
-
-	cBuf = (byte *)PADP(cmd->captureBuffer, packAlign);
-
-	qglReadPixels(0, 0, cmd->width, cmd->height, GL_RGB,
-		GL_UNSIGNED_BYTE, cBuf);
-
-	memcount = padwidth * cmd->height;
-
-	// gamma correct
-	if(glConfig.deviceSupportsGamma && !glConfigExt.doGammaCorrectionWithShaders)
-		R_GammaCorrect(cBuf, memcount);
-
-	if(cmd->motionJpeg)
-	{
-		memcount = RE_SaveJPGToBuffer(cmd->encodeBuffer, linelen * cmd->height,
-			r_aviMotionJpegQuality->integer,
-			cmd->width, cmd->height, cBuf, padlen);
-		ri->CL_WriteAVIVideoFrame(cmd->encodeBuffer, memcount);
-	}
-	else
-	{
-		byte *lineend, *memend;
-		byte *srcptr, *destptr;
-
-		srcptr = cBuf;
-		destptr = cmd->encodeBuffer;
-		memend = srcptr + memcount;
-
-		// swap R and B and remove line paddings
-		while(srcptr < memend)
-		{
-			lineend = srcptr + linelen;
-			while(srcptr < lineend)
-			{
-				*destptr++ = srcptr[2];
-				*destptr++ = srcptr[1];
-				*destptr++ = srcptr[0];
-				srcptr += 3;
-			}
-
-			Com_Memset(destptr, '\0', avipadlen);
-			destptr += avipadlen;
-
-			srcptr += padlen;
-		}
-
-		ri->CL_WriteAVIVideoFrame(cmd->encodeBuffer, avipadwidth * cmd->height);
-	}
-
-	return (const void *)(cmd + 1);
-}
-
 //============================================================================
 
 /*
@@ -1487,6 +1474,8 @@ void GfxInfo_f( void )
 		ri->Printf( PRINT_ALL, "lightmap texture bits: %d\n", r_texturebitslm->integer );
 	ri->Printf( PRINT_ALL, "multitexture: %s\n", enablestrings[qglActiveTextureARB != 0] );
 	ri->Printf( PRINT_ALL, "compiled vertex arrays: %s\n", enablestrings[qglLockArraysEXT != 0 ] );
+	ri->Printf( PRINT_ALL, "world vertex buffer: %s\n", enablestrings[tr.worldVertexBuffer != 0] );
+	ri->Printf( PRINT_ALL, "render thread: %s\n", enablestrings[glConfigExt.smpActive != qfalse] );
 	ri->Printf( PRINT_ALL, "texenv add: %s\n", enablestrings[glConfig.textureEnvAddAvailable != 0] );
 	ri->Printf( PRINT_ALL, "compressed textures: %s\n", enablestrings[glConfig.textureCompression != TC_NONE] );
 	ri->Printf( PRINT_ALL, "compressed lightmaps: %s\n", enablestrings[(r_ext_compressed_lightmaps->integer != 0 && glConfig.textureCompression != TC_NONE)] );
@@ -1595,6 +1584,9 @@ void R_Register( void )
 	r_overBrightBits					= ri->Cvar_Get( "r_overBrightBits",					"0",						CVAR_ARCHIVE|CVAR_LATCH, "" );
 	r_mapOverBrightBits					= ri->Cvar_Get( "r_mapOverBrightBits",				"0",						CVAR_ARCHIVE|CVAR_LATCH, "" );
 	r_simpleMipMaps						= ri->Cvar_Get( "r_simpleMipMaps",					"1",						CVAR_ARCHIVE|CVAR_LATCH, "" );
+	r_imageDecodeThreads				= ri->Cvar_Get( "r_imageDecodeThreads",				"0",						CVAR_ARCHIVE, "" );
+	ri->Cvar_CheckRange( r_imageDecodeThreads, 0, 32, qtrue );
+	r_shaderCache						= ri->Cvar_Get( "r_shaderCache",					"1",						CVAR_ARCHIVE, "" );
 	r_vertexLight						= ri->Cvar_Get( "r_vertexLight",					"0",						CVAR_ARCHIVE|CVAR_LATCH, "" );
 	r_uiFullScreen						= ri->Cvar_Get( "r_uifullscreen",					"0",						CVAR_NONE, "" );
 	r_subdivisions						= ri->Cvar_Get( "r_subdivisions",					"4",						CVAR_ARCHIVE|CVAR_LATCH, "" );
@@ -1631,6 +1623,7 @@ void R_Register( void )
 	r_cullRoofFaces						= ri->Cvar_Get( "r_cullRoofFaces",					"0",						CVAR_CHEAT, "" ); //attempted smart method of culling out upwards facing surfaces on roofs for automap shots -rww
 	r_roofCullCeilDist					= ri->Cvar_Get( "r_roofCullCeilDist",				"256",						CVAR_CHEAT, "" ); //attempted smart method of culling out upwards facing surfaces on roofs for automap shots -rww
 	r_roofCullFloorDist					= ri->Cvar_Get( "r_roofCeilFloorDist",				"128",						CVAR_CHEAT, "" ); //attempted smart method of culling out upwards facing surfaces on roofs for automap shots -rww
+	r_worldVBO							= ri->Cvar_Get( "r_worldVBO",						"0",						CVAR_ARCHIVE|CVAR_LATCH, "" );
 	r_primitives						= ri->Cvar_Get( "r_primitives",						"0",						CVAR_ARCHIVE, "" );
 	ri->Cvar_CheckRange( r_primitives, MIN_PRIMITIVES, MAX_PRIMITIVES, qtrue );
 	r_ambientScale						= ri->Cvar_Get( "r_ambientScale",					"0.6",						CVAR_CHEAT, "" );
@@ -1644,6 +1637,9 @@ void R_Register( void )
 	r_dlightStyle						= ri->Cvar_Get( "r_dlightStyle",					"1",						CVAR_TEMP, "" );
 	r_surfaceSprites					= ri->Cvar_Get( "r_surfaceSprites",					"1",						CVAR_ARCHIVE, "" );
 	r_surfaceWeather					= ri->Cvar_Get( "r_surfaceWeather",					"0",						CVAR_TEMP, "" );
+	r_surfaceSpriteCache				= ri->Cvar_Get( "r_surfaceSpriteCache",				"1",						CVAR_ARCHIVE, "" );
+	r_weatherThreads					= ri->Cvar_Get( "r_weatherThreads",					"0",						CVAR_ARCHIVE, "" );
+	ri->Cvar_CheckRange( r_weatherThreads, 0, 32, qtrue );
 	r_windSpeed							= ri->Cvar_Get( "r_windSpeed",						"0",						CVAR_NONE, "" );
 	r_windAngle							= ri->Cvar_Get( "r_windAngle",						"0",						CVAR_NONE, "" );
 	r_windGust							= ri->Cvar_Get( "r_windGust",						"0",						CVAR_NONE, "" );
@@ -1656,6 +1652,7 @@ void R_Register( void )
 	r_drawfog							= ri->Cvar_Get( "r_drawfog",						"2",						CVAR_CHEAT, "" );
 	r_lightmap							= ri->Cvar_Get( "r_lightmap",						"0",						CVAR_CHEAT, "" );
 	r_portalOnly						= ri->Cvar_Get( "r_portalOnly",						"0",						CVAR_CHEAT, "" );
+	r_smp								= ri->Cvar_Get( "r_smp",							"0",						CVAR_ARCHIVE|CVAR_LATCH, "" );
 	r_skipBackEnd						= ri->Cvar_Get( "r_skipBackEnd",					"0",						CVAR_CHEAT, "" );
 	r_measureOverdraw					= ri->Cvar_Get( "r_measureOverdraw",				"0",						CVAR_CHEAT, "" );
 	r_lodscale							= ri->Cvar_Get( "r_lodscale",						"5",						CVAR_NONE, "" );
@@ -1697,6 +1694,10 @@ Ghoul2 Insert Start
 	r_noServerGhoul2					= ri->Cvar_Get( "r_noserverghoul2",					"0",						CVAR_CHEAT, "" );
 	r_Ghoul2AnimSmooth					= ri->Cvar_Get( "r_ghoul2animsmooth",				"0.3",						CVAR_NONE, "" );
 	r_Ghoul2UnSqashAfterSmooth			= ri->Cvar_Get( "r_ghoul2unsqashaftersmooth",		"1",						CVAR_NONE, "" );
+	r_ghoul2SkinThreads					= ri->Cvar_Get( "r_ghoul2SkinThreads",				"0",						CVAR_ARCHIVE, "" );
+	ri->Cvar_CheckRange( r_ghoul2SkinThreads, 0, 32, qtrue );
+	r_ghoul2SkeletonThreads				= ri->Cvar_Get( "r_ghoul2SkeletonThreads",			"0",						CVAR_ARCHIVE, "" );
+	ri->Cvar_CheckRange( r_ghoul2SkeletonThreads, 0, 32, qtrue );
 	broadsword							= ri->Cvar_Get( "broadsword",						"0",						CVAR_ARCHIVE, "" );
 	broadsword_kickbones				= ri->Cvar_Get( "broadsword_kickbones",				"1",						CVAR_NONE, "" );
 	broadsword_kickorigin				= ri->Cvar_Get( "broadsword_kickorigin",			"1",						CVAR_NONE, "" );
@@ -1717,9 +1718,11 @@ Ghoul2 Insert End
 		ri->Cvar_Set("r_modelpoolmegs", "0");
 
 	r_aviMotionJpegQuality				= ri->Cvar_Get( "r_aviMotionJpegQuality",			"100",						CVAR_ARCHIVE, "" );
+	r_aviEncodeThreads					= ri->Cvar_Get( "r_aviEncodeThreads",				"0",						CVAR_ARCHIVE, "" );
 	r_screenshotJpegQuality				= ri->Cvar_Get( "r_screenshotJpegQuality",			"100",						CVAR_ARCHIVE, "" );
 
 	ri->Cvar_CheckRange( r_aviMotionJpegQuality, 10, 100, qtrue );
+	ri->Cvar_CheckRange( r_aviEncodeThreads, 0, 32, qtrue );
 	ri->Cvar_CheckRange( r_screenshotJpegQuality, 10, 100, qtrue );
 
 	for ( size_t i = 0; i < numCommands; i++ )
@@ -1815,10 +1818,25 @@ void R_Init( void ) {
 	max_polys = Q_min( r_maxpolys->integer, DEFAULT_MAX_POLYS );
 	max_polyverts = Q_min( r_maxpolyverts->integer, DEFAULT_MAX_POLYVERTS );
 
-	ptr = (byte *)Hunk_Alloc( sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts, h_low);
-	backEndData = (backEndData_t *) ptr;
-	backEndData->polys = (srfPoly_t *) ((char *) ptr + sizeof( *backEndData ));
-	backEndData->polyVerts = (polyVert_t *) ((char *) ptr + sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys);
+	// the render thread draws one frame while the front end fills the other
+	for ( i = 0; i < SMP_FRAMES; i++ ) {
+		if ( i && !r_smp->integer ) {
+			backEndFrameData[i] = backEndFrameData[0];
+			continue;
+		}
+		ptr = (byte *)Hunk_Alloc( sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts
+			+ sizeof(CRenderableSurface) * MAX_GHOUL2_SURFS + sizeof(mdxaBone_t) * MAX_GHOUL2_BONES, h_low);
+		backEndFrameData[i] = (backEndData_t *) ptr;
+		ptr += sizeof( *backEndData );
+		backEndFrameData[i]->polys = (srfPoly_t *) ptr;
+		ptr += sizeof(srfPoly_t) * max_polys;
+		backEndFrameData[i]->polyVerts = (polyVert_t *) ptr;
+		ptr += sizeof(polyVert_t) * max_polyverts;
+		backEndFrameData[i]->ghoulSurfs = (CRenderableSurface *) ptr;
+		ptr += sizeof(CRenderableSurface) * MAX_GHOUL2_SURFS;
+		backEndFrameData[i]->ghoulBones = (mdxaBone_t *) ptr;
+	}
+	backEndData = backEndFrameData[0];
 
 	R_InitNextFrame();
 
@@ -1848,6 +1866,11 @@ void R_Init( void ) {
 #endif
 
 	RestoreGhoul2InfoArray();
+
+	if ( r_smp->integer ) {
+		R_SpawnRenderThread();
+	}
+
 	// print info
 	GfxInfo_f();
 
@@ -1866,6 +1889,11 @@ void RE_Shutdown( qboolean destroyWindow, qboolean restarting ) {
 	for ( size_t i = 0; i < numCommands; i++ )
 		ri->Cmd_RemoveCommand( commands[i].cmd );
 
+	// everything below runs on this thread
+	R_ShutdownRenderThread();
+	R_ShutdownGhoulWorkers();
+	R_ShutdownVideoCapture();
+
 	if ( r_DynamicGlow && r_DynamicGlow->integer )
 	{
 		// Release the Glow Vertex Shader.
@@ -1915,6 +1943,7 @@ void RE_Shutdown( qboolean destroyWindow, qboolean restarting ) {
 	R_ShutdownFonts();
 	if ( tr.registered ) {
 		R_IssuePendingRenderCommands();
+		R_DeleteWorldVBO();
 		if (destroyWindow)
 		{
 			R_DeleteTextures();		// only do this for vid_restart now, not during things like map load
@@ -2020,7 +2049,7 @@ Q_EXPORT refexport_t* QDECL GetRefAPI( int apiVersion, refimport_t *rimp ) {
 	static refexport_t re;
 
 	assert( rimp );
-	ri = rimp;
+	ri = R_RenderThreadImports( rimp );
 
 	memset( &re, 0, sizeof( re ) );
 
@@ -2100,6 +2129,7 @@ Q_EXPORT refexport_t* QDECL GetRefAPI( int apiVersion, refimport_t *rimp ) {
 
 	// AVI recording
 	re.TakeVideoFrame						= RE_TakeVideoFrame;
+	re.FlushVideoFrames						= RE_FlushVideoFrames;
 
 	// G2 stuff
 	re.InitSkins							= R_InitSkins;
@@ -97,8 +97,15 @@ typedef struct trRefEntity_s {
 	int			ambientLightInt;	// 32 bit rgba packed
 	vec3_t		directedLight;
 	int			dlightBits;
+	int			ghoul2Skeleton;	// G2SKELETON_*, what R_BuildGhoulSkeletons did for this view
 } trRefEntity_t;
 
+enum {
+	G2SKELETON_NONE,			// R_AddGhoulSurfaces has to set up the bones itself
+	G2SKELETON_BUILT,			// bones are built
+	G2SKELETON_CULLED			// nothing of it is in view
+};
+
 
 typedef struct orientationr_s {
 	vec3_t		origin;			// in world coordinates
@@ -642,11 +649,14 @@ typedef struct srfFlare_s {
 
 #define	VERTEX_FINAL_COLOR	(5+(MAXLIGHTMAPS*3))
 
+// frames the front end and the render thread can be working on at once
+#define	SMP_FRAMES		2
+
 typedef struct srfGridMesh_s {
 	surfaceType_t	surfaceType;
 
-	// dynamic lighting information
-	int				dlightBits;
+	// dynamic lighting information, for each frame the front end can be ahead of the back end by
+	int				dlightBits[SMP_FRAMES];
 
 	// culling information
 	vec3_t			meshBounds[2];
@@ -661,6 +671,9 @@ typedef struct srfGridMesh_s {
 	int				lodFixed;
 	int				lodStitched;
 
+	// full detail range in the world vertex buffer, or 0 indexes
+	int				firstVBOIndex, numVBOIndexes;
+
 	// vertexes
 	int				width, height;
 	float			*widthLodError;
@@ -672,8 +685,11 @@ typedef struct srfSurfaceFace_s {
 	surfaceType_t	surfaceType;
 	cplane_t	plane;
 
-	// dynamic lighting information
-	int			dlightBits;
+	// dynamic lighting information, for each frame the front end can be ahead of the back end by
+	int			dlightBits[SMP_FRAMES];
+
+	// range in the world vertex buffer, or 0 indexes
+	int			firstVBOIndex, numVBOIndexes;
 
 	// triangle definitions (no normals at points)
 	int			numPoints;
@@ -687,14 +703,17 @@ typedef struct srfSurfaceFace_s {
 typedef struct srfTriangles_s {
 	surfaceType_t	surfaceType;
 
-	// dynamic lighting information
-	int				dlightBits;
+	// dynamic lighting information, for each frame the front end can be ahead of the back end by
+	int				dlightBits[SMP_FRAMES];
 
 	// culling information (FIXME: use this!)
 	vec3_t			bounds[2];
 //	vec3_t			localOrigin;
 //	float			radius;
 
+	// range in the world vertex buffer, or 0 indexes
+	int				firstVBOIndex, numVBOIndexes;
+
 	// triangle definitions
 	int				numIndexes;
 	int				*indexes;
@@ -755,6 +774,27 @@ typedef struct mnode_s {
 	int			nummarksurfaces;
 } mnode_t;
 
+// a node's bounds padded to whole vectors, kept apart from mnode_t so
+// the frustum walk touches 32 bytes per node instead of a full node
+typedef struct mnodeBounds_s {
+	float		mins[4];
+	float		maxs[4];
+} mnodeBounds_t;
+
+#define	MARKLEAVES_CACHE_SIZE	4
+
+// the nodes one R_MarkLeaves pass marked, so that going back to a recently
+// seen cluster (or rendering a portal view in another one) only has to
+// stamp them again instead of walking every leaf and its parents
+typedef struct markLeavesCache_s {
+	int			cluster;		// -2 while unused
+	qboolean	novis;
+	byte		areamask[MAX_MAP_AREA_BYTES];
+	int			lastUsed;
+	int			numMarked;
+	int			*marked;		// numnodes entries
+} markLeavesCache_t;
+
 typedef struct bmodel_s {
 	vec3_t		bounds[2];		// for culling
 	msurface_t	*firstSurface;
@@ -788,6 +828,10 @@ typedef struct world_s {
 	int			numnodes;		// includes leafs
 	int			numDecisionNodes;
 	mnode_t		*nodes;
+	mnodeBounds_t	*nodeBounds;	// parallel to nodes
+
+	markLeavesCache_t	markLeavesCache[MARKLEAVES_CACHE_SIZE];
+	int			markLeavesTime;
 
 	int			numsurfaces;
 	msurface_t	*surfaces;
@@ -881,6 +925,9 @@ typedef struct frontEndCounters_s {
 	int		c_leafs;
 	int		c_dlightSurfaces;
 	int		c_dlightSurfacesCulled;
+
+	int		c_ghoul2Skeletons;			// bone caches built by R_BuildGhoulSkeletons
+	int		c_ghoul2SkeletonsRebuilt, c_ghoul2SkeletonsReused;	// G2_NeedsRecalc answers
 } frontEndCounters_t;
 
 #define	FOG_TABLE_SIZE		256
@@ -929,6 +976,7 @@ typedef struct backEndState_s {
 	byte		color2D[4];
 	qboolean	vertexes2D;		// shader needs to be finished
 	trRefEntity_t	entity2D;	// currentEntity will point at this when doing 2D rendering
+	int			smpFrame;	// which backEndFrameData is being drawn, indexes surface dlightBits
 } backEndState_t;
 
 /*
@@ -955,6 +1003,8 @@ typedef struct trGlobals_s {
 
 	int						frameSceneNum;	// zeroed at RE_BeginFrame
 
+	int						smpFrame;		// which backEndFrameData the front end is filling
+
 	qboolean				worldMapLoaded;
 	world_t					*world;
 	char					worldDir[MAX_QPATH];		// ie: maps/tim_dm2 (copy of world_t::name sans extension but still includes the path)
@@ -991,6 +1041,10 @@ typedef struct trGlobals_s {
 	GLuint					gammaCorrectVtxShader;
 	GLuint					gammaCorrectPxShader;
 
+	// static world geometry, see tr_vbo.cpp
+	GLuint					worldVertexBuffer;
+	GLuint					worldIndexBuffer;
+
 	shader_t				*defaultShader;
 	shader_t				*shadowShader;
 	shader_t				*distortionShader;
@@ -1066,6 +1120,9 @@ struct glconfigExt_t
 
 	qboolean doGammaCorrectionWithShaders;
 	const char *originalExtensionString;
+
+	qboolean smpActive;		// the back end runs on its own thread, see tr_cmds.cpp
+	qboolean pixelBufferObjects;	// GL_ARB_pixel_buffer_object, for video capture
 };
 
 int		 R_Images_StartIteration(void);
@@ -1108,6 +1165,7 @@ extern cvar_t	*r_lodbias;				// push/pull LOD transitions
 extern cvar_t	*r_lodscale;
 extern cvar_t	*r_autolodscalevalue;
 
+extern cvar_t	*r_worldVBO;			// draw static world surfaces from a vertex buffer object
 extern cvar_t	*r_primitives;			// "0" = based on compiled vertex array existance
 										// "1" = glDrawElemet tristrips
 										// "2" = glDrawElements triangles
@@ -1141,9 +1199,14 @@ extern	cvar_t	*r_autoMap; //automap renderside toggle for debugging -rww
 extern	cvar_t	*r_autoMapBackAlpha; //alpha of automap bg -rww
 extern	cvar_t	*r_autoMapDisable;
 
+extern cvar_t	*r_aviMotionJpegQuality;
+extern cvar_t	*r_aviEncodeThreads;
+
 extern cvar_t	*r_dlightStyle;
 extern cvar_t	*r_surfaceSprites;
 extern cvar_t	*r_surfaceWeather;
+extern cvar_t	*r_surfaceSpriteCache;
+extern cvar_t	*r_weatherThreads;
 
 extern cvar_t	*r_windSpeed;
 extern cvar_t	*r_windAngle;
@@ -1216,6 +1279,7 @@ extern	cvar_t	*r_portalOnly;
 extern	cvar_t	*r_subdivisions;
 extern	cvar_t	*r_lodCurveError;
 extern	cvar_t	*r_skipBackEnd;
+extern	cvar_t	*r_smp;					// run the back end on a separate thread
 
 extern	cvar_t	*r_ignoreGLErrors;
 
@@ -1224,6 +1288,8 @@ extern	cvar_t	*r_mapOverBrightBits;
 
 extern	cvar_t	*r_debugSurface;
 extern	cvar_t	*r_simpleMipMaps;
+extern	cvar_t	*r_imageDecodeThreads;			// workers decoding a map's images at load, 0 decodes them as they are asked for
+extern	cvar_t	*r_shaderCache;					// keep the scanned shader files in shadercache.dat
 
 extern	cvar_t	*r_showImages;
 extern	cvar_t	*r_debugSort;
@@ -1243,6 +1309,8 @@ extern	cvar_t	*r_noPrecacheGLA;
 #endif
 
 extern	cvar_t	*r_noServerGhoul2;
+extern	cvar_t	*r_ghoul2SkinThreads;
+extern	cvar_t	*r_ghoul2SkeletonThreads;
 /*
 Ghoul2 Insert End
 */
@@ -1362,6 +1430,17 @@ image_t		*R_FindImageFile( const char *name, qboolean mipmap, qboolean allowPicm
 
 image_t		*R_CreateImage( const char *name, const byte *pic, int width, int height, GLenum format, qboolean mipmap, qboolean allowPicmip, qboolean allowTC, int wrapClampMode, bool bRectangle = false );
 
+// an image R_FindImageFile is going to be asked for, with the parameters it will be asked with
+typedef struct imageRequest_s {
+	char		name[MAX_QPATH];
+	qboolean	mipmap;
+	qboolean	allowPicmip;
+	qboolean	allowTC;
+	int			glWrapClampMode;
+} imageRequest_t;
+
+void		R_DecodeImages( const imageRequest_t *requests, int numRequests );
+
 qboolean	R_GetModeInfo( int *width, int *height, int mode );
 
 void		R_SetColorMappings( void );
@@ -1399,6 +1478,7 @@ const char		*RE_ShaderNameFromIndex(int index);
 qhandle_t RE_RegisterShaderFromImage(const char *name, int *lightmapIndex, byte *styles, image_t *image, qboolean mipRawImage);
 
 shader_t	*R_FindShader( const char *name, const int *lightmapIndex, const byte *styles, qboolean mipRawImage );
+void		R_DecodeShaderImages( const dshader_t *shaders, int numShaders );
 shader_t	*R_GetShaderByHandle( qhandle_t hShader );
 shader_t	*R_GetShaderByState( int index, long *cycleTime );
 shader_t *R_FindShaderByName( const char *name );
@@ -1439,6 +1519,13 @@ typedef struct stageVars
 
 #define	NUM_TEX_COORDS		(MAXLIGHTMAPS+1)
 
+#define	MAX_VBO_RANGES		1024
+
+typedef struct vboRange_s {
+	int			firstIndex;
+	int			numIndexes;
+} vboRange_t;
+
 struct shaderCommands_s
 {
 	glIndex_t	indexes[SHADER_MAX_INDEXES] QALIGN(16);
@@ -1471,6 +1558,11 @@ struct shaderCommands_s
 
 	//rww - doing a fade, don't compute shader color/alpha overrides
 	bool		fading;
+
+	// world surfaces drawn from the world vertex buffer instead of the arrays above
+	qboolean	useWorldVBO;
+	int			numVBORanges;
+	vboRange_t	vboRanges[MAX_VBO_RANGES];
 };
 
 #ifdef _MSC_VER
@@ -1495,6 +1587,21 @@ void RB_AddQuadStampExt( vec3_t origin, vec3_t left, vec3_t up, byte *color, flo
 
 void RB_ShowImages( void );
 
+/*
+============================================================
+
+WORLD VERTEX BUFFER
+
+============================================================
+*/
+
+qboolean R_ShaderCanUseWorldVBO( const shader_t *shader );
+void R_BuildWorldVBO( world_t *world );
+void R_DeleteWorldVBO( void );
+
+qboolean RB_AddWorldVBOSurface( int dlightBits, int firstIndex, int numIndexes );
+void RB_DrawWorldVBO( void );
+
 
 /*
 ============================================================
@@ -1633,8 +1740,9 @@ public:
 #else
 	const int		ident;			// ident of this surface - required so the materials renderer knows what sort of surface this refers to
 #endif
-	CBoneCache 		*boneCache;
+	const mdxaBone_t	*bones;			// every bone of the model, copied into backEndData for the frame
 	mdxmSurface_t	*surfaceData;	// pointer to surface data loaded into file - only used by client renderer DO NOT USE IN GAME SIDE - if there is a vid restart this will be out of wack on the game
+	vec4_t			*skinnedVerts;	// xyz then normals, if RB_SkinGhoulSurfaces already did this surface
 #ifdef _G2_GORE
 	float			*alternateTex;		// alternate texture coordinates.
 	void			*goreChain;
@@ -1648,8 +1756,9 @@ public:
 	CRenderableSurface& operator= ( const CRenderableSurface& src )
 	{
 		ident	 = src.ident;
-		boneCache = src.boneCache;
+		bones = src.bones;
 		surfaceData = src.surfaceData;
+		skinnedVerts = NULL;
 		alternateTex = src.alternateTex;
 		goreChain = src.goreChain;
 
@@ -1659,13 +1768,14 @@ public:
 
 CRenderableSurface():
 	ident(SF_MDX),
-	boneCache(0),
-#ifdef _G2_GORE
+	bones(0),
 	surfaceData(0),
+#ifdef _G2_GORE
+	skinnedVerts(0),
 	alternateTex(0),
 	goreChain(0)
 #else
-	surfaceData(0)
+	skinnedVerts(0)
 #endif
 	{}
 
@@ -1673,16 +1783,28 @@ CRenderableSurface():
 	void Init()
 	{
 		ident = SF_MDX;
-		boneCache=0;
+		bones=0;
 		surfaceData=0;
+		skinnedVerts=0;
 		alternateTex=0;
 		goreChain=0;
 	}
 #endif
 };
 
+// per backEndData frame, see R_InitGhoulFrame
+#define	MAX_GHOUL2_SURFS		8192
+#define	MAX_GHOUL2_BONES		16384
+
+struct GoreTextureCoordinates;
+
 void R_AddGhoulSurfaces( trRefEntity_t *ent );
 void RB_SurfaceGhoul( CRenderableSurface *surface );
+void RB_SkinGhoulSurfaces( drawSurf_t *drawSurfs, int numDrawSurfs );
+void R_BuildGhoulSkeletons( void );
+void R_InitGhoulFrame( void );
+void R_RetireGoreTexCoordinates( GoreTextureCoordinates *gTC );
+void R_ShutdownGhoulWorkers( void );
 /*
 Ghoul2 Insert End
 */
@@ -1802,8 +1924,6 @@ typedef struct videoFrameCommand_s {
 	int            commandId;
 	int            width;
 	int            height;
-	byte          *captureBuffer;
-	byte          *encodeBuffer;
 	qboolean      motionJpeg;
 } videoFrameCommand_t;
 
@@ -1831,13 +1951,18 @@ typedef struct backEndData_s {
 	trMiniRefEntity_t	miniEntities[MAX_MINI_ENTITIES];
 	srfPoly_t	*polys;//[MAX_POLYS];
 	polyVert_t	*polyVerts;//[MAX_POLYVERTS];
+	CRenderableSurface	*ghoulSurfs;//[MAX_GHOUL2_SURFS];
+	mdxaBone_t	*ghoulBones;//[MAX_GHOUL2_BONES];
+	int			numGhoulSurfs;
+	int			numGhoulBones;
 	renderCommandList_t	commands;
 } backEndData_t;
 
 extern	int		max_polys;
 extern	int		max_polyverts;
 
-extern	backEndData_t	*backEndData;
+extern	backEndData_t	*backEndData;	// the frame the front end is filling, backEndFrameData[tr.smpFrame]
+extern	backEndData_t	*backEndFrameData[SMP_FRAMES];
 
 
 void *R_GetCommandBuffer( int bytes );
@@ -1845,6 +1970,12 @@ void RB_ExecuteRenderCommands( const void *data );
 
 void R_IssuePendingRenderCommands( void );
 
+refimport_t *R_RenderThreadImports( refimport_t *rimp );
+void R_SpawnRenderThread( void );
+void R_ShutdownRenderThread( void );
+void R_SyncRenderThread( void );
+void R_WaitRenderThread( void );
+
 void R_AddDrawSurfCmd( drawSurf_t *drawSurfs, int numDrawSurfs );
 
 void RE_SetColor( const float *rgba );
@@ -1856,7 +1987,12 @@ void RE_RotatePic2 ( float x, float y, float w, float h,
 					  float s1, float t1, float s2, float t2,float a, qhandle_t hShader );
 void RE_BeginFrame( stereoFrame_t stereoFrame );
 void RE_EndFrame( int *frontEndMsec, int *backEndMsec );
-void RE_TakeVideoFrame( int width, int height, byte *captureBuffer, byte *encodeBuffer, qboolean motionJpeg );
+void RE_TakeVideoFrame( int width, int height, qboolean motionJpeg );
+
+// tr_video.cpp
+void RE_FlushVideoFrames( void );
+void R_ReportVideoCapture( void );
+void R_ShutdownVideoCapture( void );
 
 /*
 Ghoul2 Insert Start
@@ -1877,6 +2013,7 @@ void R_AddDecals( void );
 
 // tr_surfacesprites
 void RB_DrawSurfaceSprites( shaderStage_t *stage, shaderCommands_t *input);
+void RB_ClearSurfaceSpriteCache( void );
 
 extern refimport_t *ri;
 
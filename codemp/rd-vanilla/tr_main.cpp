@@ -863,6 +863,10 @@ static qboolean SurfIsOffscreen( const drawSurf_t *drawSurf, vec4_t clipDest[128
 	R_RotateForViewer();
 
 	R_DecomposeSort( drawSurf->sort, &entityNum, &shader, &fogNum, &dlighted );
+
+	// tess belongs to the back end
+	R_WaitRenderThread();
+
 	RB_BeginSurface( shader, fogNum );
 	rb_surfaceTable[ *drawSurf->surface ]( drawSurf->surface );
 	assert( tess.numVertexes < 128 );
@@ -1203,6 +1207,8 @@ void R_AddEntitySurfaces (void) {
 		return;
 	}
 
+	R_BuildGhoulSkeletons();
+
 	for ( tr.currentEntityNum = 0;
 	      tr.currentEntityNum < tr.refdef.num_entities;
 		  tr.currentEntityNum++ ) {
@@ -1634,6 +1634,8 @@ void RE_BeginRegistration( glconfig_t *glconfigOut ) {
 
 	tr.viewCluster = -1;		// force markleafs to regenerate
 
+	RB_ClearSurfaceSpriteCache();
+
 	// rww - 9-13-01 [1-26-01-sof2]
 	//R_ClearFlares();
 
@@ -54,7 +54,16 @@ R_InitNextFrame
 ====================
 */
 void R_InitNextFrame( void ) {
+	// the render thread may still be drawing the frame we just finished
+	if ( glConfigExt.smpActive ) {
+		tr.smpFrame ^= 1;
+	} else {
+		tr.smpFrame = 0;
+	}
+	backEndData = backEndFrameData[tr.smpFrame];
+
 	backEndData->commands.used = 0;
+	R_InitGhoulFrame();
 
 	r_firstSceneDrawSurf = 0;
 
@@ -245,6 +254,7 @@ void RE_AddRefEntityToScene( const refEntity_t *ent ) {
 
 	backEndData->entities[r_numentities].e = *ent;
 	backEndData->entities[r_numentities].lightingCalculated = qfalse;
+	backEndData->entities[r_numentities].ghoul2Skeleton = G2SKELETON_NONE;
 
 	if (ent->ghoul2)
 	{
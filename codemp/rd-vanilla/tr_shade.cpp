@@ -371,6 +371,12 @@ void RB_BeginSurface( shader_t *shader, int fogNum ) {
 
 	tess.fading = false;
 
+	// static world surfaces can skip tess if nothing has to be computed per vertex
+	tess.numVBORanges = 0;
+	tess.useWorldVBO = (qboolean)( tr.worldVertexBuffer && !fogNum
+		&& ( r_primitives->integer == 0 || r_primitives->integer == 2 )
+		&& R_ShaderCanUseWorldVBO( state ) );
+
 	tess.registration++;
 }
 
@@ -1934,7 +1940,7 @@ void RB_EndSurface( void ) {
 
 	input = &tess;
 
-	if (input->numIndexes == 0) {
+	if (input->numIndexes == 0 && input->numVBORanges == 0) {
 		return;
 	}
 
@@ -1991,21 +1997,31 @@ void RB_EndSurface( void ) {
 	}
 
 	//
-	// call off to shader specific tess end function
-	//
-	tess.currentStageIteratorFunc();
-
-	//
-	// draw debugging stuff
+	// surfaces drawn straight from the world vertex buffer
 	//
-	if ( r_showtris->integer ) {
-		DrawTris (input);
+	if ( tess.numVBORanges ) {
+		RB_DrawWorldVBO();
 	}
-	if ( r_shownormals->integer ) {
-		DrawNormals (input);
+
+	if ( tess.numIndexes ) {
+		//
+		// call off to shader specific tess end function
+		//
+		tess.currentStageIteratorFunc();
+
+		//
+		// draw debugging stuff
+		//
+		if ( r_showtris->integer ) {
+			DrawTris (input);
+		}
+		if ( r_shownormals->integer ) {
+			DrawNormals (input);
+		}
 	}
 	// clear shader so we can tell we don't have any unclosed surfaces
 	tess.numIndexes = 0;
+	tess.numVBORanges = 0;
 
 	GLimp_LogComment( "----------\n" );
 }
@@ -25,6 +25,9 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "tr_local.h"
 
+#include <string>
+#include <vector>
+
 static char *s_shaderText;
 
 // the shader is parsed into these global variables, then copied into
@@ -3234,6 +3237,12 @@ static const char *FindShaderInShaderText( const char *shadername ) {
 		}
 	}
 
+	// every shader in the text is in the hash table, so there's no need to
+	// scan the whole text for one that isn't
+	if ( ShaderHashTableExists() ) {
+		return NULL;
+	}
+
 	p = s_shaderText;
 
 	if ( !p ) {
@@ -3531,6 +3540,131 @@ shader_t *R_FindShader( const char *name, const int *lightmapIndex, const byte *
 	return FinishShader();
 }
 
+/*
+===============
+R_AddImageRequest
+===============
+*/
+static void R_AddImageRequest( std::vector<imageRequest_t> &requests, const char *name, bool mipmap, bool allowPicmip, bool allowTC, int glWrapClampMode )
+{
+	imageRequest_t request;
+
+	Q_strncpyz( request.name, name, sizeof( request.name ) );
+	request.mipmap = (qboolean)mipmap;
+	request.allowPicmip = (qboolean)allowPicmip;
+	request.allowTC = (qboolean)allowTC;
+	request.glWrapClampMode = glWrapClampMode;
+	requests.push_back( request );
+}
+
+/*
+===============
+R_CollectShaderImages
+
+Walks a shader definition the way ParseShader and ParseStage do and
+records every image they will ask R_FindImageFile for, with the
+parameters they will ask with
+===============
+*/
+static void R_CollectShaderImages( const char *text, std::vector<imageRequest_t> &requests )
+{
+	bool	noMipMaps = false, noPicMip = false, noTC = false;
+	int		depth;
+	char	*token;
+
+	token = COM_ParseExt( &text, qtrue );
+	if ( token[0] != '{' ) {
+		return;
+	}
+
+	for ( depth = 1; depth > 0; ) {
+		token = COM_ParseExt( &text, qtrue );
+		if ( !token[0] ) {
+			return;
+		}
+
+		if ( token[0] == '{' ) {
+			depth++;
+		} else if ( token[0] == '}' ) {
+			depth--;
+		} else if ( depth == 1 ) {
+			// the shader flags only apply to the stages after them
+			if ( !Q_stricmp( token, "nomipmaps" ) ) {
+				noMipMaps = noPicMip = true;
+			} else if ( !Q_stricmp( token, "nopicmip" ) ) {
+				noPicMip = true;
+			} else if ( !Q_stricmp( token, "noTC" ) ) {
+				noTC = true;
+			} else if ( !Q_stricmp( token, "skyParms" ) ) {
+				const char	*suf[6] = {"rt", "lf", "bk", "ft", "up", "dn"};
+
+				token = COM_ParseExt( &text, qfalse );
+				if ( token[0] && strcmp( token, "-" ) ) {
+					for ( int i = 0; i < 6; i++ ) {
+						R_AddImageRequest( requests, va( "%s_%s", token, suf[i] ), true, true, !noTC, GL_CLAMP );
+					}
+				}
+				SkipRestOfLine( &text );
+			}
+		} else if ( depth == 2 ) {
+			if ( !Q_stricmp( token, "map" ) || !Q_stricmp( token, "clampmap" ) ) {
+				const int wrap = Q_stricmp( token, "map" ) ? GL_CLAMP : GL_REPEAT;
+
+				token = COM_ParseExt( &text, qfalse );
+				if ( token[0] && token[0] != '$' ) {
+					R_AddImageRequest( requests, token, !noMipMaps, !noPicMip, !noTC, wrap );
+				}
+			} else if ( !Q_stricmp( token, "animMap" ) || !Q_stricmp( token, "clampanimMap" ) || !Q_stricmp( token, "oneshotanimMap" ) ) {
+				const int wrap = Q_stricmp( token, "clampanimMap" ) ? GL_REPEAT : GL_CLAMP;
+
+				COM_ParseExt( &text, qfalse );	// frequency
+				for ( int num = 0; ; num++ ) {
+					token = COM_ParseExt( &text, qfalse );
+					if ( !token[0] ) {
+						break;
+					}
+					if ( num < MAX_IMAGE_ANIMATIONS ) {
+						R_AddImageRequest( requests, token, !noMipMaps, !noPicMip, !noTC, wrap );
+					}
+				}
+			}
+		}
+	}
+}
+
+/*
+===============
+R_DecodeShaderImages
+
+Has the images a map's shaders use decoded up front, before
+R_FindShader asks for them one at a time
+===============
+*/
+void R_DecodeShaderImages( const dshader_t *shaders, int numShaders )
+{
+	std::vector<imageRequest_t>	requests;
+	char						strippedName[MAX_QPATH];
+	const char					*shaderText;
+
+	if ( !r_imageDecodeThreads->integer ) {
+		return;
+	}
+
+	for ( int i = 0; i < numShaders; i++ ) {
+		COM_StripExtension( shaders[i].shader, strippedName, sizeof( strippedName ) );
+
+		shaderText = FindShaderInShaderText( strippedName );
+		if ( shaderText ) {
+			R_CollectShaderImages( shaderText, requests );
+		} else {
+			// the single image R_FindShader falls back to, as a map asks for it
+			R_AddImageRequest( requests, strippedName, true, true, true, GL_REPEAT );
+		}
+	}
+
+	R_DecodeImages( requests.data(), (int)requests.size() );
+}
+
 shader_t *R_FindServerShader( const char *name, const int *lightmapIndex, const byte *styles, qboolean mipRawImage )
 {
 	char		strippedName[MAX_QPATH];
@@ -3953,6 +4087,189 @@ int COM_CompressShader( char *data_p )
 	return out - data_p;
 }
 
+/*
+=============================================================================
+
+SHADER TEXT CACHE
+
+Scanning the shader files means reading every .shader file out of the
+pk3s, checking its structure, joining and compressing the lot and then
+parsing all of it again to hash the shader names.  ScanAndLoadShaderFiles
+keeps the result, the compressed text and where each shader starts in
+it, in SHADER_CACHE_FILE, so startup and vid_restart can load that
+instead.  The cache is keyed by the checksums of the loaded pk3s and
+the name, length and origin of every shader file, the pk3 it was read
+from or the modification time of a loose file, so it is rebuilt
+whenever any of those change.
+
+=============================================================================
+*/
+
+#define	SHADER_CACHE_FILE		"shadercache.dat"
+#define	SHADER_CACHE_IDENT		(('C'<<24)+('D'<<16)+('H'<<8)+'S')
+#define	SHADER_CACHE_VERSION	1
+
+typedef struct shaderCacheHeader_s {
+	int		ident;
+	int		version;
+	int		keyLength;		// the key follows the header, then the text, then the entries
+	int		textLength;		// including the terminating NUL
+	int		numEntries;
+} shaderCacheHeader_t;
+
+typedef struct shaderCacheEntry_s {
+	int		hash;			// generateHashValue of the name, for shaderTextHashTable
+	int		offset;			// of the shader's name in s_shaderText
+} shaderCacheEntry_t;
+
+/*
+====================
+R_ShaderCacheKey
+
+Describes everything the shader text was built from
+====================
+*/
+static void R_ShaderCacheKey( char **shaderFiles, int numShaderFiles, std::string &key )
+{
+	key = ri->FS_LoadedPakChecksums();
+
+	for ( int i = 0; i < numShaderFiles; i++ ) {
+		fileHandle_t	f;
+		long			len;
+
+		len = ri->FS_FOpenFileRead( va( "shaders/%s", shaderFiles[i] ), &f, qfalse );
+		key += va( "\n%s %li", shaderFiles[i], len );
+		if ( f ) {
+			// an edited or overriding loose file can keep the length
+			key += ' ';
+			key += ri->FS_FileOrigin( f );
+			ri->FS_FCloseFile( f );
+		}
+	}
+}
+
+/*
+====================
+R_BuildShaderTextHashTable
+
+Points shaderTextHashTable at the shaders in s_shaderText, keeping
+them in the order they appear in the text
+====================
+*/
+static void R_BuildShaderTextHashTable( const shaderCacheEntry_t *entries, int numEntries )
+{
+	int		shaderTextHashTableSizes[MAX_SHADERTEXT_HASH];
+	char	*hashMem;
+	int		i;
+
+	memset(shaderTextHashTableSizes, 0, sizeof(shaderTextHashTableSizes));
+	for ( i = 0; i < numEntries; i++ ) {
+		shaderTextHashTableSizes[entries[i].hash]++;
+	}
+
+	hashMem = (char *)ri->Hunk_Alloc( (numEntries + MAX_SHADERTEXT_HASH) * sizeof(char *), h_low );
+
+	for (i = 0; i < MAX_SHADERTEXT_HASH; i++) {
+		shaderTextHashTable[i] = (char **) hashMem;
+		hashMem = ((char *) hashMem) + ((shaderTextHashTableSizes[i] + 1) * sizeof(char *));
+	}
+
+	memset(shaderTextHashTableSizes, 0, sizeof(shaderTextHashTableSizes));
+	for ( i = 0; i < numEntries; i++ ) {
+		const int hash = entries[i].hash;
+		shaderTextHashTable[hash][shaderTextHashTableSizes[hash]++] = s_shaderText + entries[i].offset;
+	}
+}
+
+/*
+====================
+R_LoadShaderCache
+====================
+*/
+static qboolean R_LoadShaderCache( const std::string &key )
+{
+	const shaderCacheHeader_t	*header;
+	const shaderCacheEntry_t	*entries;
+	const char					*text;
+	void						*buffer;
+	long						len;
+	qboolean					valid;
+
+	len = ri->FS_ReadFile( SHADER_CACHE_FILE, &buffer );
+	if ( !buffer ) {
+		return qfalse;
+	}
+
+	header = (const shaderCacheHeader_t *)buffer;
+	valid = (qboolean)( len >= (long)sizeof( *header )
+		&& header->ident == SHADER_CACHE_IDENT
+		&& header->version == SHADER_CACHE_VERSION
+		&& header->keyLength == (int)key.length()
+		&& header->textLength > 0
+		&& header->numEntries >= 0
+		&& len == (long)( sizeof( *header ) + header->keyLength + header->textLength + header->numEntries * sizeof( shaderCacheEntry_t ) )
+		&& !memcmp( header + 1, key.c_str(), header->keyLength ) );
+
+	text = (const char *)( header + 1 ) + ( valid ? header->keyLength : 0 );
+	entries = (const shaderCacheEntry_t *)( text + ( valid ? header->textLength : 0 ) );
+
+	if ( valid && text[header->textLength - 1] ) {
+		valid = qfalse;
+	}
+	for ( int i = 0; valid && i < header->numEntries; i++ ) {
+		shaderCacheEntry_t entry;
+
+		memcpy( &entry, &entries[i], sizeof( entry ) );	// the entries needn't be aligned
+		if ( entry.hash < 0 || entry.hash >= MAX_SHADERTEXT_HASH || entry.offset < 0 || entry.offset >= header->textLength ) {
+			valid = qfalse;
+		}
+	}
+
+	if ( valid ) {
+		std::vector<shaderCacheEntry_t> alignedEntries( header->numEntries );
+
+		if ( header->numEntries ) {
+			memcpy( alignedEntries.data(), entries, header->numEntries * sizeof( shaderCacheEntry_t ) );
+		}
+
+		s_shaderText = (char *)ri->Hunk_Alloc( header->textLength, h_low );
+		memcpy( s_shaderText, text, header->textLength );
+		R_BuildShaderTextHashTable( alignedEntries.data(), header->numEntries );
+
+		ri->Printf( PRINT_DEVELOPER, "...loaded %i shaders from %s\n", header->numEntries, SHADER_CACHE_FILE );
+	}
+
+	ri->FS_FreeFile( buffer );
+	return valid;
+}
+
+/*
+====================
+R_WriteShaderCache
+====================
+*/
+static void R_WriteShaderCache( const std::string &key, const std::vector<shaderCacheEntry_t> &entries )
+{
+	shaderCacheHeader_t	header;
+	std::vector<char>	buffer;
+
+	header.ident = SHADER_CACHE_IDENT;
+	header.version = SHADER_CACHE_VERSION;
+	header.keyLength = (int)key.length();
+	header.textLength = (int)strlen( s_shaderText ) + 1;
+	header.numEntries = (int)entries.size();
+
+	buffer.reserve( sizeof( header ) + header.keyLength + header.textLength + header.numEntries * sizeof( shaderCacheEntry_t ) );
+	buffer.insert( buffer.end(), (const char *)&header, (const char *)( &header + 1 ) );
+	buffer.insert( buffer.end(), key.begin(), key.end() );
+	buffer.insert( buffer.end(), s_shaderText, s_shaderText + header.textLength );
+	if ( !entries.empty() ) {
+		buffer.insert( buffer.end(), (const char *)entries.data(), (const char *)( entries.data() + entries.size() ) );
+	}
+
+	ri->FS_WriteFile( SHADER_CACHE_FILE, buffer.data(), (int)buffer.size() );
+}
+
 /*
 ====================
 ScanAndLoadShaderFiles
@@ -3969,10 +4286,11 @@ static void ScanAndLoadShaderFiles( void )
 	const char *p;
 	int numShaderFiles;
 	int i;
-	char *oldp, *token, *hashMem, *textEnd;
-	int shaderTextHashTableSizes[MAX_SHADERTEXT_HASH], hash, size;
+	char *oldp, *token, *textEnd;
 	char shaderName[MAX_QPATH];
 	int shaderLine;
+	std::string cacheKey;
+	std::vector<shaderCacheEntry_t> entries;
 
 	long sum = 0, summand;
 	// scan for shader files
@@ -3988,6 +4306,14 @@ static void ScanAndLoadShaderFiles( void )
 		numShaderFiles = MAX_SHADER_FILES;
 	}
 
+	if ( r_shaderCache->integer ) {
+		R_ShaderCacheKey( shaderFiles, numShaderFiles, cacheKey );
+		if ( R_LoadShaderCache( cacheKey ) ) {
+			ri->FS_FreeFileList( shaderFiles );
+			return;
+		}
+	}
+
 	// load and parse shader files
 	for ( i = 0; i < numShaderFiles; i++ )
 	{
@@ -4074,43 +4400,11 @@ static void ScanAndLoadShaderFiles( void )
 	// free up memory
 	ri->FS_FreeFileList( shaderFiles );
 
-	memset(shaderTextHashTableSizes, 0, sizeof(shaderTextHashTableSizes));
-	size = 0;
-
 	p = s_shaderText;
 	// look for shader names
 	while ( 1 ) {
-		token = COM_ParseExt( &p, qtrue );
-		if ( token[0] == 0 ) {
-			break;
-		}
+		shaderCacheEntry_t entry;
 
-		if ( token[0] == '#' )
-		{
-			SkipRestOfLine( &p );
-			continue;
-		}
-
-		hash = generateHashValue(token, MAX_SHADERTEXT_HASH);
-		shaderTextHashTableSizes[hash]++;
-		size++;
-		SkipBracedSection( &p, 0 );
-	}
-
-	size += MAX_SHADERTEXT_HASH;
-
-	hashMem = (char *)ri->Hunk_Alloc( size * sizeof(char *), h_low );
-
-	for (i = 0; i < MAX_SHADERTEXT_HASH; i++) {
-		shaderTextHashTable[i] = (char **) hashMem;
-		hashMem = ((char *) hashMem) + ((shaderTextHashTableSizes[i] + 1) * sizeof(char *));
-	}
-
-	memset(shaderTextHashTableSizes, 0, sizeof(shaderTextHashTableSizes));
-
-	p = s_shaderText;
-	// look for shader names
-	while ( 1 ) {
 		oldp = (char *)p;
 		token = COM_ParseExt( &p, qtrue );
 		if ( token[0] == 0 ) {
@@ -4123,12 +4417,19 @@ static void ScanAndLoadShaderFiles( void )
 			continue;
 		}
 
-		hash = generateHashValue(token, MAX_SHADERTEXT_HASH);
-		shaderTextHashTable[hash][shaderTextHashTableSizes[hash]++] = oldp;
+		entry.hash = generateHashValue(token, MAX_SHADERTEXT_HASH);
+		entry.offset = oldp - s_shaderText;
+		entries.push_back( entry );
 
 		SkipBracedSection( &p, 0 );
 	}
 
+	R_BuildShaderTextHashTable( entries.data(), (int)entries.size() );
+
+	if ( r_shaderCache->integer ) {
+		R_WriteShaderCache( cacheKey, entries );
+	}
+
 	return;
 }
 
@@ -320,7 +320,11 @@ void RB_SurfaceTriangles( srfTriangles_t *srf ) {
 	byte		*color;
 	int			dlightBits;
 
-	dlightBits = srf->dlightBits;
+	if ( srf->numVBOIndexes && RB_AddWorldVBOSurface( srf->dlightBits[backEnd.smpFrame], srf->firstVBOIndex, srf->numVBOIndexes ) ) {
+		return;
+	}
+
+	dlightBits = srf->dlightBits[backEnd.smpFrame];
 	tess.dlightBits |= dlightBits;
 
 	RB_CHECKOVERFLOW( srf->numVerts, srf->numIndexes );
@@ -1303,9 +1307,13 @@ void RB_SurfaceFace( srfSurfaceFace_t *surf ) {
 	int			dlightBits;
 	byteAlias_t	ba;
 
+	if ( surf->numVBOIndexes && RB_AddWorldVBOSurface( surf->dlightBits[backEnd.smpFrame], surf->firstVBOIndex, surf->numVBOIndexes ) ) {
+		return;
+	}
+
 	RB_CHECKOVERFLOW( surf->numPoints, surf->numIndices );
 
-	dlightBits = surf->dlightBits;
+	dlightBits = surf->dlightBits[backEnd.smpFrame];
 	tess.dlightBits |= dlightBits;
 
 	indices = ( unsigned * ) ( ( ( char  * ) surf ) + surf->ofsIndices );
@@ -1413,7 +1421,11 @@ void RB_SurfaceGrid( srfGridMesh_t *cv ) {
 	int		dlightBits;
 	int		*vDlightBits;
 
-	dlightBits = cv->dlightBits;
+	if ( cv->numVBOIndexes && RB_AddWorldVBOSurface( cv->dlightBits[backEnd.smpFrame], cv->firstVBOIndex, cv->numVBOIndexes ) ) {
+		return;
+	}
+
+	dlightBits = cv->dlightBits[backEnd.smpFrame];
 	tess.dlightBits |= dlightBits;
 
 	// determine the allowable discrepance
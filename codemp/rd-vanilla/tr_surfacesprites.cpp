@@ -27,6 +27,18 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "tr_quicksprite.h"
 #include "tr_WorldEffects.h"
 
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+// four sprites at a time where SSE2 is always there
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define SS_SIMD_SSE2	1
+#include <emmintrin.h>
+#else
+#define SS_SIMD_SSE2	0
+#endif
+
 
 /////===== Part of the VERTIGON system =====/////
 // The surfacesprites are a simple system.  When a polygon with this shader stage on it is drawn,
@@ -97,7 +109,6 @@ float	rangescalefactor=1.0;
 
 vec3_t  ssrightvectors[4];
 vec3_t  ssfwdvector;
-int		rightvectorcount;
 
 trRefEntity_t *ssLastEntityDrawn=NULL;
 vec3_t	ssViewOrigin, ssViewRight, ssViewUp;
@@ -326,26 +337,397 @@ vec2_t SSVertWindDir[SHADER_MAX_VERTEXES];
 qboolean SSAdditiveTransparency=qfalse;
 qboolean SSUsingFog=qfalse;
 
+// the time part of the vertical sprites' sway angles, worked out once per call
+static float ssSwayTimeCos, ssSwayTimeSin;
+static float ssBobTimeCos, ssBobTimeSin;
+
+
+/////////////////////////////////////////////
+// Sprite placement cache
+//
+// Where the sprites go on a triangle, and how big they are, only depends on
+// the triangle and the stage, so it is worked out once and kept.  Each frame
+// then only has to do the fade, lighting and wind.
+//
+// Every model has a cache of its own, the world being one of them, so a model
+// whose triangles keep changing under deforms or animation only ever throws
+// away its own placements when it fills up.
+
+#define SS_MAX_CACHED_PLACEMENTS	(1<<18)		// per model
+
+typedef struct ssPlacement_s {
+	vec3_t	point;				// on the triangle
+	float	bary[3];			// weights of the triangle's vertexes at point
+	float	fadeRand;			// where in the fade range this sprite starts fading
+	float	width, height;		// before fadeScale, negative width mirrors the sprite
+	vec2_t	skew;
+	float	swayCos, swaySin;	// sway angle without its time part, vertical sprites only
+	float	bobCos, bobSin;		// 2.5 times the sway angle
+	float	flatSin, flatCos;	// flattened sprites' direction
+	int		rightVector;		// which of ssrightvectors to use
+} ssPlacement_t;
+
+typedef struct ssTriangleKey_s {
+	const surfaceSprite_t	*ss;
+	float					xyz[9];
+
+	bool operator==( const ssTriangleKey_s &other ) const {
+		return !memcmp( this, &other, sizeof( *this ) );
+	}
+} ssTriangleKey_t;
+
+struct ssTriangleKeyHash {
+	size_t operator()( const ssTriangleKey_t &key ) const {
+		const byte	*b = (const byte *)&key;
+		size_t		hash = 2166136261u;
+
+		for ( size_t i = 0 ; i < sizeof( key ) ; i++ ) {
+			hash = ( hash ^ b[i] ) * 16777619u;
+		}
+		return hash;
+	}
+};
+
+typedef struct ssPlacementRange_s {
+	int		first, count;
+} ssPlacementRange_t;
+
+typedef struct ssModelCache_s {
+	std::unordered_map<ssTriangleKey_t, ssPlacementRange_t, ssTriangleKeyHash>	index;
+	std::vector<ssPlacement_t>	placements;
+} ssModelCache_t;
+
+// keyed on tr.world or the entity's model_t
+static std::unordered_map<const void *, ssModelCache_t>	ssModelCaches;
+static const void					*ssCacheModel;
+static ssModelCache_t				*ssCache;
+static std::vector<ssPlacement_t>	ssScratchPlacements;
+
+/*
+==================
+RB_ClearSurfaceSpriteCache
+
+The stages the cache is keyed on go away with the shaders
+==================
+*/
+void RB_ClearSurfaceSpriteCache( void )
+{
+	ssModelCaches.clear();
+	ssCacheModel = NULL;
+	ssCache = NULL;
+	std::vector<ssPlacement_t>().swap( ssScratchPlacements );
+}
+
+/*
+==================
+RB_SurfaceSpriteCache
+
+The cache of the model backEnd.currentEntity draws
+==================
+*/
+static ssModelCache_t *RB_SurfaceSpriteCache( void )
+{
+	const void *model;
+
+	if ( backEnd.currentEntity == &tr.worldEntity )
+	{
+		model = tr.world;
+	}
+	else
+	{
+		model = R_GetModelByHandle( backEnd.currentEntity->e.hModel );
+	}
+
+	if ( !ssCache || model != ssCacheModel )
+	{
+		ssCacheModel = model;
+		ssCache = &ssModelCaches[model];
+	}
+	return ssCache;
+}
+
+/*
+==================
+RB_BuildSurfaceSpritePlacements
+
+Walks the triangle the way the draw loops always have, so the sprites end up
+in the same places and with the same random sizes
+==================
+*/
+static void RB_BuildSurfaceSpritePlacements( const surfaceSprite_t *ss, const vec3_t v1, const vec3_t v2, const vec3_t v3,
+											float step, std::vector<ssPlacement_t> &out )
+{
+	const bool	vertical = ( ss->surfaceSpriteType == SURFSPRITE_VERTICAL || ss->surfaceSpriteType == SURFSPRITE_FLATTENED );
+	byte		index, interval, index2;
+	int			rightvector = 0;
+	float		posi, posj;
+	float		fa, fb, fc, base;
+	ssPlacement_t	sp;
+
+	index = (byte)(v1[0]+v1[1]+v2[0]+v2[1]+v3[0]+v3[1]);
+	interval = (byte)(v1[0]+v2[1]+v3[2])|0x03;	// Make sure the interval is at least 3, and always odd
+
+	for (posi=0; posi<1.0; posi+=step)
+	{
+		for (posj=0; posj<(1.0-posi); posj+=step)
+		{
+			fa=posi+randomchart[index]*step;
+			index += interval;
+
+			if (vertical)
+			{
+				fb=posj+randomchart[index]*step;
+				index += interval;
+
+				rightvector=(rightvector+1)&3;
+
+				if (fa>1.0)
+					continue;
+			}
+			else
+			{
+				if (fa>1.0)
+					continue;
+
+				fb=posj+randomchart[index]*step;
+				index += interval;
+			}
+
+			if (fb>(1.0-fa))
+				continue;
+
+			fc = 1.0-fa-fb;
+
+			sp.bary[0] = fa;
+			sp.bary[1] = fb;
+			sp.bary[2] = fc;
+			VectorScale(v1, fa, sp.point);
+			VectorMA(sp.point, fb, v2, sp.point);
+			VectorMA(sp.point, fc, v3, sp.point);
+
+			sp.fadeRand = randomchart[index];
+			index += interval;
+			if (!vertical)
+			{
+				index += interval;
+			}
+
+			index2 = index;
+			sp.width = ss->width*(1.0 + (ss->variance[0]*randomchart[index2]));
+			sp.height = ss->height*(1.0 + (ss->variance[1]*randomchart[index2++]));
+			if (randomchart[index2++]>0.5)
+			{
+				sp.width = -sp.width;
+			}
+
+			sp.skew[0] = sp.skew[1] = 0.0f;
+			sp.swayCos = sp.swaySin = sp.bobCos = sp.bobSin = 0.0f;
+			sp.flatSin = sp.flatCos = 0.0f;
+			sp.rightVector = rightvector;
+
+			if (vertical)
+			{
+				if (ss->vertSkew != 0)
+				{	// flrand(-vertskew, vertskew)
+					sp.skew[0] = sp.height * ((ss->vertSkew*2.0f*randomchart[index2++])-ss->vertSkew);
+					sp.skew[1] = sp.height * ((ss->vertSkew*2.0f*randomchart[index2++])-ss->vertSkew);
+				}
+
+				base = (sp.point[0]+sp.point[1])*0.02;
+				sp.swayCos = cos(base);
+				sp.swaySin = sin(base);
+				sp.bobCos = cos(base*2.5);
+				sp.bobSin = sin(base*2.5);
+				sp.flatSin = sin( DEG2RAD( sp.point[0] ) );
+				sp.flatCos = cos( DEG2RAD( sp.point[0] ) );
+			}
+
+			out.push_back( sp );
+		}
+	}
+}
+
+/*
+==================
+RB_SurfaceSpritePlacements
+
+Returns the triangle's sprites, from the cache when r_surfaceSpriteCache is on.
+The pointer is good until the next call.
+==================
+*/
+static const ssPlacement_t *RB_SurfaceSpritePlacements( const surfaceSprite_t *ss, const vec3_t v1, const vec3_t v2, const vec3_t v3,
+														float step, int *numPlacements )
+{
+	ssTriangleKey_t	key;
+
+	if ( !r_surfaceSpriteCache->integer )
+	{
+		ssScratchPlacements.clear();
+		RB_BuildSurfaceSpritePlacements( ss, v1, v2, v3, step, ssScratchPlacements );
+		*numPlacements = (int)ssScratchPlacements.size();
+		return ssScratchPlacements.empty() ? NULL : &ssScratchPlacements[0];
+	}
+
+	memset( &key, 0, sizeof( key ) );
+	key.ss = ss;
+	VectorCopy( v1, key.xyz );
+	VectorCopy( v2, key.xyz + 3 );
+	VectorCopy( v3, key.xyz + 6 );
+
+	ssModelCache_t *cache = RB_SurfaceSpriteCache();
+	auto it = cache->index.find( key );
+	if ( it == cache->index.end() )
+	{
+		ssPlacementRange_t	range;
+
+		if ( cache->placements.size() >= SS_MAX_CACHED_PLACEMENTS )
+		{	// start over rather than grow without bound on huge fields of grass
+			cache->index.clear();
+			cache->placements.clear();
+		}
+
+		range.first = (int)cache->placements.size();
+		RB_BuildSurfaceSpritePlacements( ss, v1, v2, v3, step, cache->placements );
+		range.count = (int)cache->placements.size() - range.first;
+		it = cache->index.insert( std::make_pair( key, range ) ).first;
+	}
+
+	*numPlacements = it->second.count;
+	return it->second.count ? &cache->placements[it->second.first] : NULL;
+}
+
+
+/////////////////////////////////////////////
+// Per sprite fade, light and wind
+//
+// The triangle's vertex values are blended at every sprite of it in one pass
+// before any of them is drawn.
+
+enum {
+	SS_SHADE_ALPHA,			// at most 1, the sprite is faded out at 0 and below
+	SS_SHADE_ALPHAPOS,		// the vertexes' alpha at the sprite, for fadeScale
+	SS_SHADE_LIGHT,
+	SS_SHADE_WINDX,			// wind point direction and force, only with a wind point
+	SS_SHADE_WINDY,
+	SS_SHADE_WINDFORCE,
+	SS_SHADE_ROWS
+};
+
+static std::vector<float>	ssShadeRows;
+static float				*ssShade[SS_SHADE_ROWS];
+
+#if SS_SIMD_SSE2
+static inline __m128 SS_Blend4( const float *vert, __m128 b0, __m128 b1, __m128 b2 )
+{
+	return _mm_add_ps( _mm_add_ps(
+		_mm_mul_ps( _mm_set1_ps( vert[0] ), b0 ),
+		_mm_mul_ps( _mm_set1_ps( vert[1] ), b1 ) ),
+		_mm_mul_ps( _mm_set1_ps( vert[2] ), b2 ) );
+}
+#endif
+
+/*
+==================
+RB_ShadeSurfaceSprites
+
+Fills ssShade for a triangle's sprites, four at a time where SSE2 is there.
+vertWind is the wind direction and force at the vertexes, NULL without a wind
+point.
+==================
+*/
+static void RB_ShadeSurfaceSprites( const ssPlacement_t *sp, int numPlacements, const float *vertAlpha, const float *vertLight,
+									const float (*vertWind)[3], float faderange )
+{
+	const float	invFaderange = 1.0f / faderange;
+	int			i = 0;
+
+	if ( numPlacements <= 0 )
+	{
+		return;
+	}
+	if ( (int)ssShadeRows.size() < numPlacements * SS_SHADE_ROWS )
+	{
+		ssShadeRows.resize( numPlacements * SS_SHADE_ROWS );
+	}
+	for ( int row = 0 ; row < SS_SHADE_ROWS ; row++ )
+	{
+		ssShade[row] = &ssShadeRows[row * numPlacements];
+	}
+
+#if SS_SIMD_SSE2
+	const __m128	one = _mm_set1_ps( 1.0f );
+	const __m128	fadeBase = _mm_set1_ps( faderange );
+	const __m128	fadeScale = _mm_set1_ps( 1.0f - faderange );
+	const __m128	fadeInv = _mm_set1_ps( invFaderange );
+
+	for ( ; i + 4 <= numPlacements ; i += 4 )
+	{
+		const ssPlacement_t	*s = sp + i;
+		const __m128		b0 = _mm_setr_ps( s[0].bary[0], s[1].bary[0], s[2].bary[0], s[3].bary[0] );
+		const __m128		b1 = _mm_setr_ps( s[0].bary[1], s[1].bary[1], s[2].bary[1], s[3].bary[1] );
+		const __m128		b2 = _mm_setr_ps( s[0].bary[2], s[1].bary[2], s[2].bary[2], s[3].bary[2] );
+		const __m128		fadeRand = _mm_setr_ps( s[0].fadeRand, s[1].fadeRand, s[2].fadeRand, s[3].fadeRand );
+		const __m128		alphapos = SS_Blend4( vertAlpha, b0, b1, b2 );
+
+		// same as the scalar version below
+		const __m128		fadestart = _mm_add_ps( fadeBase, _mm_mul_ps( fadeScale, fadeRand ) );
+		const __m128		alpha = _mm_sub_ps( one, _mm_mul_ps( _mm_sub_ps( fadestart, alphapos ), fadeInv ) );
+
+		_mm_storeu_ps( &ssShade[SS_SHADE_ALPHA][i], _mm_min_ps( alpha, one ) );
+		_mm_storeu_ps( &ssShade[SS_SHADE_ALPHAPOS][i], alphapos );
+		_mm_storeu_ps( &ssShade[SS_SHADE_LIGHT][i], SS_Blend4( vertLight, b0, b1, b2 ) );
+		if ( vertWind )
+		{
+			_mm_storeu_ps( &ssShade[SS_SHADE_WINDX][i], SS_Blend4( vertWind[0], b0, b1, b2 ) );
+			_mm_storeu_ps( &ssShade[SS_SHADE_WINDY][i], SS_Blend4( vertWind[1], b0, b1, b2 ) );
+			_mm_storeu_ps( &ssShade[SS_SHADE_WINDFORCE][i], SS_Blend4( vertWind[2], b0, b1, b2 ) );
+		}
+	}
+#endif
+
+	for ( ; i < numPlacements ; i++ )
+	{
+		const float	*b = sp[i].bary;
+		const float	alphapos = vertAlpha[0]*b[0] + vertAlpha[1]*b[1] + vertAlpha[2]*b[2];
+
+		// Note that the alpha at this point is a value from 1.0 to 0.0, but represents when to START fading,
+		// minus a random factor so some things fade out sooner
+		const float	fadestart = faderange + (1.0f-faderange) * sp[i].fadeRand;
+
+		// Find where the alpha is relative to the fadestart, and calc the real alpha to draw at.
+		const float	alpha = 1.0f - ((fadestart-alphapos)*invFaderange);
+
+		ssShade[SS_SHADE_ALPHA][i] = alpha > 1.0f ? 1.0f : alpha;
+		ssShade[SS_SHADE_ALPHAPOS][i] = alphapos;
+		ssShade[SS_SHADE_LIGHT][i] = vertLight[0]*b[0] + vertLight[1]*b[1] + vertLight[2]*b[2];
+		if ( vertWind )
+		{
+			ssShade[SS_SHADE_WINDX][i] = vertWind[0][0]*b[0] + vertWind[0][1]*b[1] + vertWind[0][2]*b[2];
+			ssShade[SS_SHADE_WINDY][i] = vertWind[1][0]*b[0] + vertWind[1][1]*b[1] + vertWind[1][2]*b[2];
+			ssShade[SS_SHADE_WINDFORCE][i] = vertWind[2][0]*b[0] + vertWind[2][1]*b[1] + vertWind[2][2]*b[2];
+		}
+	}
+}
+
 
 /////////////////////////////////////////////
 // Vertical surface sprites
 
-static void RB_VerticalSurfaceSprite(vec3_t loc, float width, float height, byte light,
-										byte alpha, float wind, float windidle, vec2_t fog, int hangdown, vec2_t skew, bool flattened)
+static void RB_VerticalSurfaceSprite(const ssPlacement_t *sp, float width, float height, byte light,
+										byte alpha, float wind, float windidle, vec2_t fog, int hangdown, bool flattened)
 {
+	const float *loc = sp->point;
+	const float *skew = sp->skew;
 	vec3_t loc2, right;
-	float angle;
 	float windsway;
 	float points[16];
 	color4ub_t color;
 
-	angle = ((loc[0]+loc[1])*0.02+(tr.refdef.time*0.0015));
-
 	if (windidle>0.0)
 	{
 		windsway = (height*windidle*0.075);
-		loc2[0] = loc[0]+skew[0]+cos(angle)*windsway;
-		loc2[1] = loc[1]+skew[1]+sin(angle)*windsway;
+		loc2[0] = loc[0]+skew[0]+(sp->swayCos*ssSwayTimeCos - sp->swaySin*ssSwayTimeSin)*windsway;
+		loc2[1] = loc[1]+skew[1]+(sp->swaySin*ssSwayTimeCos + sp->swayCos*ssSwayTimeSin)*windsway;
 
 		if (hangdown)
 		{
@@ -385,18 +767,18 @@ static void RB_VerticalSurfaceSprite(vec3_t loc, float width, float height, byte
 		{
 			windsway *= 0.4f;
 		}
-		loc2[2] += sin(angle*2.5)*windsway;
+		loc2[2] += (sp->bobSin*ssBobTimeCos + sp->bobCos*ssBobTimeSin)*windsway;
 	}
 
 	if ( flattened )
 	{
-		right[0] = sin( DEG2RAD( loc[0] ) ) * width;
-		right[1] = cos( DEG2RAD( loc[0] ) ) * height;
+		right[0] = sp->flatSin * width;
+		right[1] = sp->flatCos * height;
 		right[2] = 0.0f;
 	}
 	else
 	{
-		VectorScale(ssrightvectors[rightvectorcount], width*0.5, right);
+		VectorScale(ssrightvectors[sp->rightVector], width*0.5, right);
 	}
 
 	color[0]=light;
@@ -436,12 +818,13 @@ static void RB_VerticalSurfaceSprite(vec3_t loc, float width, float height, byte
 	SQuickSprite.Add(points, color, fog);
 }
 
-static void RB_VerticalSurfaceSpriteWindPoint(vec3_t loc, float width, float height, byte light,
+static void RB_VerticalSurfaceSpriteWindPoint(const ssPlacement_t *sp, float width, float height, byte light,
 												byte alpha, float wind, float windidle, vec2_t fog,
-												int hangdown, vec2_t skew, vec2_t winddiff, float windforce, bool flattened)
+												int hangdown, vec2_t winddiff, float windforce, bool flattened)
 {
+	const float *loc = sp->point;
+	const float *skew = sp->skew;
 	vec3_t loc2, right;
-	float angle;
 	float windsway;
 	float points[16];
 	color4ub_t color;
@@ -451,13 +834,11 @@ static void RB_VerticalSurfaceSpriteWindPoint(vec3_t loc, float width, float hei
 
 //	wind += 1.0-windforce;
 
-	angle = (loc[0]+loc[1])*0.02+(tr.refdef.time*0.0015);
-
 	if (curWindSpeed <80.0)
 	{
 		windsway = (height*windidle*0.1)*(1.0+windforce);
-		loc2[0] = loc[0]+skew[0]+cos(angle)*windsway;
-		loc2[1] = loc[1]+skew[1]+sin(angle)*windsway;
+		loc2[0] = loc[0]+skew[0]+(sp->swayCos*ssSwayTimeCos - sp->swaySin*ssSwayTimeSin)*windsway;
+		loc2[1] = loc[1]+skew[1]+(sp->swaySin*ssSwayTimeCos + sp->swayCos*ssSwayTimeSin)*windsway;
 	}
 	else
 	{
@@ -485,13 +866,13 @@ static void RB_VerticalSurfaceSpriteWindPoint(vec3_t loc, float width, float hei
 
 	if ( flattened )
 	{
-		right[0] = sin( DEG2RAD( loc[0] ) ) * width;
-		right[1] = cos( DEG2RAD( loc[0] ) ) * height;
+		right[0] = sp->flatSin * width;
+		right[1] = sp->flatCos * height;
 		right[2] = 0.0f;
 	}
 	else
 	{
-		VectorScale(ssrightvectors[rightvectorcount], width*0.5, right);
+		VectorScale(ssrightvectors[sp->rightVector], width*0.5, right);
 	}
 
 
@@ -540,23 +921,19 @@ static void RB_DrawVerticalSurfaceSprites( shaderStage_t *stage, shaderCommands_
 	vec2_t vec1to2, vec1to3;
 
 	vec3_t v1,v2,v3;
-	float a1,a2,a3;
-	float l1,l2,l3;
+	float vertAlpha[3], vertLight[3];
 	vec2_t fog1, fog2, fog3;
-	vec2_t winddiff1, winddiff2, winddiff3;
-	float  windforce1, windforce2, windforce3;
+	float vertWind[3][3];		// direction x and y, then force, at each vertex
 
-	float posi, posj;
 	float step;
 	float fa,fb,fc;
 
-	vec3_t curpoint;
+	const ssPlacement_t *sp;
+	int numPlacements;
 	float width, height;
-	float alpha, alphapos, thisspritesfadestart, light;
-
-	byte randomindex2;
+	int i;
+	float alpha, alphapos, light;
 
-	vec2_t skew={0,0};
 	vec2_t fogv;
 	vec2_t winddiffv;
 	float windforce=0;
@@ -576,6 +953,12 @@ static void RB_DrawVerticalSurfaceSprites( shaderStage_t *stage, shaderCommands_
 		faderange = 1.0;
 	}
 
+	// The sway angle's time part, so each sprite only has to rotate its own part by it
+	ssSwayTimeCos = cos(tr.refdef.time*0.0015);
+	ssSwayTimeSin = sin(tr.refdef.time*0.0015);
+	ssBobTimeCos = cos(tr.refdef.time*0.0015*2.5);
+	ssBobTimeSin = sin(tr.refdef.time*0.0015*2.5);
+
 	// Quickly calc all the alphas and windstuff for each vertex
 	for (curvert=0; curvert<input->numVertexes; curvert++)
 	{
@@ -637,13 +1020,13 @@ static void RB_DrawVerticalSurfaceSprites( shaderStage_t *stage, shaderCommands_
 				continue;
 			}
 		}
-		l1 = input->vertexColors[curvert][2];
-		a1 = SSVertAlpha[curvert];
+		vertLight[0] = input->vertexColors[curvert][2];
+		vertAlpha[0] = SSVertAlpha[curvert];
 		fog1[0] = *((float *)(tess.svars.texcoords[0])+(curvert<<1));
 		fog1[1] = *((float *)(tess.svars.texcoords[0])+(curvert<<1)+1);
-		winddiff1[0] = SSVertWindDir[curvert][0];
-		winddiff1[1] = SSVertWindDir[curvert][1];
-		windforce1 = SSVertWindForce[curvert];
+		vertWind[0][0] = SSVertWindDir[curvert][0];
+		vertWind[1][0] = SSVertWindDir[curvert][1];
+		vertWind[2][0] = SSVertWindForce[curvert];
 
 		curvert = input->indexes[curindex+1];
 		VectorCopy(input->xyz[curvert], v2);
@@ -661,13 +1044,13 @@ static void RB_DrawVerticalSurfaceSprites( shaderStage_t *stage, shaderCommands_
 				continue;
 			}
 		}
-		l2 = input->vertexColors[curvert][2];
-		a2 = SSVertAlpha[curvert];
+		vertLight[1] = input->vertexColors[curvert][2];
+		vertAlpha[1] = SSVertAlpha[curvert];
 		fog2[0] = *((float *)(tess.svars.texcoords[0])+(curvert<<1));
 		fog2[1] = *((float *)(tess.svars.texcoords[0])+(curvert<<1)+1);
-		winddiff2[0] = SSVertWindDir[curvert][0];
-		winddiff2[1] = SSVertWindDir[curvert][1];
-		windforce2 = SSVertWindForce[curvert];
+		vertWind[0][1] = SSVertWindDir[curvert][0];
+		vertWind[1][1] = SSVertWindDir[curvert][1];
+		vertWind[2][1] = SSVertWindForce[curvert];
 
 		curvert = input->indexes[curindex+2];
 		VectorCopy(input->xyz[curvert], v3);
@@ -685,15 +1068,15 @@ static void RB_DrawVerticalSurfaceSprites( shaderStage_t *stage, shaderCommands_
 				continue;
 			}
 		}
-		l3 = input->vertexColors[curvert][2];
-		a3 = SSVertAlpha[curvert];
+		vertLight[2] = input->vertexColors[curvert][2];
+		vertAlpha[2] = SSVertAlpha[curvert];
 		fog3[0] = *((float *)(tess.svars.texcoords[0])+(curvert<<1));
 		fog3[1] = *((float *)(tess.svars.texcoords[0])+(curvert<<1)+1);
-		winddiff3[0] = SSVertWindDir[curvert][0];
-		winddiff3[1] = SSVertWindDir[curvert][1];
-		windforce3 = SSVertWindForce[curvert];
+		vertWind[0][2] = SSVertWindDir[curvert][0];
+		vertWind[1][2] = SSVertWindDir[curvert][1];
+		vertWind[2][2] = SSVertWindForce[curvert];
 
-		if (a1 <= 0.0 && a2 <= 0.0 && a3 <= 0.0)
+		if (vertAlpha[0] <= 0.0 && vertAlpha[1] <= 0.0 && vertAlpha[2] <= 0.0)
 		{
 			continue;
 		}
@@ -713,118 +1096,76 @@ static void RB_DrawVerticalSurfaceSprites( shaderStage_t *stage, shaderCommands_
 		}
 		step = stage->ss->density * Q_rsqrt(triarea);
 
-		randomindex = (byte)(v1[0]+v1[1]+v2[0]+v2[1]+v3[0]+v3[1]);
-		randominterval = (byte)(v1[0]+v2[1]+v3[2])|0x03;	// Make sure the interval is at least 3, and always odd
-		rightvectorcount = 0;
-
-		for (posi=0; posi<1.0; posi+=step)
+		sp = RB_SurfaceSpritePlacements(stage->ss, v1, v2, v3, step, &numPlacements);
+		RB_ShadeSurfaceSprites(sp, numPlacements, vertAlpha, vertLight, usewindpoint ? vertWind : NULL, faderange);
+		for (i = 0; i < numPlacements; i++, sp++)
 		{
-			for (posj=0; posj<(1.0-posi); posj+=step)
+			alpha = ssShade[SS_SHADE_ALPHA][i];
+			if (alpha > 0.0)
 			{
-				fa=posi+randomchart[randomindex]*step;
-				randomindex += randominterval;
-
-				fb=posj+randomchart[randomindex]*step;
-				randomindex += randominterval;
-
-				rightvectorcount=(rightvectorcount+1)&3;
-
-				if (fa>1.0)
-					continue;
+				fa = sp->bary[0];
+				fb = sp->bary[1];
+				fc = sp->bary[2];
+				alphapos = ssShade[SS_SHADE_ALPHAPOS][i];
 
-				if (fb>(1.0-fa))
-					continue;
-
-				fc = 1.0-fa-fb;
+				if (SSUsingFog)
+				{
+					fogv[0] = fog1[0]*fa + fog2[0]*fb + fog3[0]*fc;
+					fogv[1] = fog1[1]*fa + fog2[1]*fb + fog3[1]*fc;
+				}
 
-				// total alpha, minus random factor so some things fade out sooner.
-				alphapos = a1*fa + a2*fb + a3*fc;
+				if (usewindpoint)
+				{
+					winddiffv[0] = ssShade[SS_SHADE_WINDX][i];
+					winddiffv[1] = ssShade[SS_SHADE_WINDY][i];
+					windforce = ssShade[SS_SHADE_WINDFORCE][i];
+				}
 
-				// Note that the alpha at this point is a value from 1.0 to 0.0, but represents when to START fading
-				thisspritesfadestart = faderange + (1.0-faderange) * randomchart[randomindex];
-				randomindex += randominterval;
+				light = ssShade[SS_SHADE_LIGHT][i];
+				if (SSAdditiveTransparency)
+				{	// Additive transparency, scale light value
+//					light *= alpha;
+					light = (128 + (light*0.5))*alpha;
+					alpha = 1.0;
+				}
 
-				// Find where the alpha is relative to the fadestart, and calc the real alpha to draw at.
-				alpha = 1.0 - ((thisspritesfadestart-alphapos)/faderange);
-				if (alpha > 0.0)
+				width = sp->width;
+				height = sp->height;
+				if (stage->ss->fadeScale!=0 && alphapos < 1.0)
 				{
-					if (alpha > 1.0)
-						alpha=1.0;
+					width *= 1.0 + (stage->ss->fadeScale*(1.0-alphapos));
+				}
 
+				if (usewindpoint && windforce > 0 && stage->ss->wind > 0.0)
+				{
 					if (SSUsingFog)
 					{
-						fogv[0] = fog1[0]*fa + fog2[0]*fb + fog3[0]*fc;
-						fogv[1] = fog1[1]*fa + fog2[1]*fb + fog3[1]*fc;
-					}
-
-					if (usewindpoint)
-					{
-						winddiffv[0] = winddiff1[0]*fa + winddiff2[0]*fb + winddiff3[0]*fc;
-						winddiffv[1] = winddiff1[1]*fa + winddiff2[1]*fb + winddiff3[1]*fc;
-						windforce = windforce1*fa + windforce2*fb + windforce3*fc;
-					}
-
-					VectorScale(v1, fa, curpoint);
-					VectorMA(curpoint, fb, v2, curpoint);
-					VectorMA(curpoint, fc, v3, curpoint);
-
-					light = l1*fa + l2*fb + l3*fc;
-					if (SSAdditiveTransparency)
-					{	// Additive transparency, scale light value
-//						light *= alpha;
-						light = (128 + (light*0.5))*alpha;
-						alpha = 1.0;
-					}
-
-					randomindex2 = randomindex;
-					width = stage->ss->width*(1.0 + (stage->ss->variance[0]*randomchart[randomindex2]));
-					height = stage->ss->height*(1.0 + (stage->ss->variance[1]*randomchart[randomindex2++]));
-					if (randomchart[randomindex2++]>0.5)
-					{
-						width = -width;
+						RB_VerticalSurfaceSpriteWindPoint(sp, width, height, (byte)light, (byte)(alpha*255.0),
+									stage->ss->wind, stage->ss->windIdle, fogv, stage->ss->facing,
+									winddiffv, windforce, SURFSPRITE_FLATTENED == stage->ss->surfaceSpriteType);
 					}
-					if (stage->ss->fadeScale!=0 && alphapos < 1.0)
+					else
 					{
-						width *= 1.0 + (stage->ss->fadeScale*(1.0-alphapos));
-					}
-
-					if (stage->ss->vertSkew != 0)
-					{	// flrand(-vertskew, vertskew)
-						skew[0] = height * ((stage->ss->vertSkew*2.0f*randomchart[randomindex2++])-stage->ss->vertSkew);
-						skew[1] = height * ((stage->ss->vertSkew*2.0f*randomchart[randomindex2++])-stage->ss->vertSkew);
+						RB_VerticalSurfaceSpriteWindPoint(sp, width, height, (byte)light, (byte)(alpha*255.0),
+									stage->ss->wind, stage->ss->windIdle, NULL, stage->ss->facing,
+									winddiffv, windforce, SURFSPRITE_FLATTENED == stage->ss->surfaceSpriteType);
 					}
-
-					if (usewindpoint && windforce > 0 && stage->ss->wind > 0.0)
+				}
+				else
+				{
+					if (SSUsingFog)
 					{
-						if (SSUsingFog)
-						{
-							RB_VerticalSurfaceSpriteWindPoint(curpoint, width, height, (byte)light, (byte)(alpha*255.0),
-										stage->ss->wind, stage->ss->windIdle, fogv, stage->ss->facing, skew,
-										winddiffv, windforce, SURFSPRITE_FLATTENED == stage->ss->surfaceSpriteType);
-						}
-						else
-						{
-							RB_VerticalSurfaceSpriteWindPoint(curpoint, width, height, (byte)light, (byte)(alpha*255.0),
-										stage->ss->wind, stage->ss->windIdle, NULL, stage->ss->facing, skew,
-										winddiffv, windforce, SURFSPRITE_FLATTENED == stage->ss->surfaceSpriteType);
-						}
+						RB_VerticalSurfaceSprite(sp, width, height, (byte)light, (byte)(alpha*255.0),
+									stage->ss->wind, stage->ss->windIdle, fogv, stage->ss->facing, SURFSPRITE_FLATTENED == stage->ss->surfaceSpriteType);
 					}
 					else
 					{
-						if (SSUsingFog)
-						{
-							RB_VerticalSurfaceSprite(curpoint, width, height, (byte)light, (byte)(alpha*255.0),
-										stage->ss->wind, stage->ss->windIdle, fogv, stage->ss->facing, skew, SURFSPRITE_FLATTENED == stage->ss->surfaceSpriteType);
-						}
-						else
-						{
-							RB_VerticalSurfaceSprite(curpoint, width, height, (byte)light, (byte)(alpha*255.0),
-										stage->ss->wind, stage->ss->windIdle, NULL, stage->ss->facing, skew, SURFSPRITE_FLATTENED == stage->ss->surfaceSpriteType);
-						}
+						RB_VerticalSurfaceSprite(sp, width, height, (byte)light, (byte)(alpha*255.0),
+									stage->ss->wind, stage->ss->windIdle, NULL, stage->ss->facing, SURFSPRITE_FLATTENED == stage->ss->surfaceSpriteType);
 					}
-
-					totalsurfsprites++;
 				}
+
+				totalsurfsprites++;
 			}
 		}
 	}
@@ -924,18 +1265,18 @@ static void RB_DrawOrientedSurfaceSprites( shaderStage_t *stage, shaderCommands_
 	vec2_t vec1to2, vec1to3;
 
 	vec3_t v1,v2,v3;
-	float a1,a2,a3;
-	float l1,l2,l3;
+	float vertAlpha[3], vertLight[3];
 	vec2_t fog1, fog2, fog3;
 
-	float posi, posj;
 	float step;
 	float fa,fb,fc;
 
+	const ssPlacement_t *sp;
+	int numPlacements;
 	vec3_t curpoint;
 	float width, height;
-	float alpha, alphapos, thisspritesfadestart, light;
-	byte randomindex2;
+	int i;
+	float alpha, alphapos, light;
 	vec2_t fogv;
 
 	float cutdist=stage->ss->fadeMax*rangescalefactor, cutdist2=cutdist*cutdist;
@@ -977,8 +1318,8 @@ static void RB_DrawOrientedSurfaceSprites( shaderStage_t *stage, shaderCommands_
 		{
 			continue;
 		}
-		l1 = input->vertexColors[curvert][2];
-		a1 = SSVertAlpha[curvert];
+		vertLight[0] = input->vertexColors[curvert][2];
+		vertAlpha[0] = SSVertAlpha[curvert];
 		fog1[0] = *((float *)(tess.svars.texcoords[0])+(curvert<<1));
 		fog1[1] = *((float *)(tess.svars.texcoords[0])+(curvert<<1)+1);
 
@@ -988,8 +1329,8 @@ static void RB_DrawOrientedSurfaceSprites( shaderStage_t *stage, shaderCommands_
 		{
 			continue;
 		}
-		l2 = input->vertexColors[curvert][2];
-		a2 = SSVertAlpha[curvert];
+		vertLight[1] = input->vertexColors[curvert][2];
+		vertAlpha[1] = SSVertAlpha[curvert];
 		fog2[0] = *((float *)(tess.svars.texcoords[0])+(curvert<<1));
 		fog2[1] = *((float *)(tess.svars.texcoords[0])+(curvert<<1)+1);
 
@@ -999,12 +1340,12 @@ static void RB_DrawOrientedSurfaceSprites( shaderStage_t *stage, shaderCommands_
 		{
 			continue;
 		}
-		l3 = input->vertexColors[curvert][2];
-		a3 = SSVertAlpha[curvert];
+		vertLight[2] = input->vertexColors[curvert][2];
+		vertAlpha[2] = SSVertAlpha[curvert];
 		fog3[0] = *((float *)(tess.svars.texcoords[0])+(curvert<<1));
 		fog3[1] = *((float *)(tess.svars.texcoords[0])+(curvert<<1)+1);
 
-		if (a1 <= 0.0 && a2 <= 0.0 && a3 <= 0.0)
+		if (vertAlpha[0] <= 0.0 && vertAlpha[1] <= 0.0 && vertAlpha[2] <= 0.0)
 		{
 			continue;
 		}
@@ -1024,82 +1365,51 @@ static void RB_DrawOrientedSurfaceSprites( shaderStage_t *stage, shaderCommands_
 		}
 		step = stage->ss->density * Q_rsqrt(triarea);
 
-		randomindex = (byte)(v1[0]+v1[1]+v2[0]+v2[1]+v3[0]+v3[1]);
-		randominterval = (byte)(v1[0]+v2[1]+v3[2])|0x03;	// Make sure the interval is at least 3, and always odd
-
-		for (posi=0; posi<1.0; posi+=step)
+		sp = RB_SurfaceSpritePlacements(stage->ss, v1, v2, v3, step, &numPlacements);
+		RB_ShadeSurfaceSprites(sp, numPlacements, vertAlpha, vertLight, NULL, faderange);
+		for (i = 0; i < numPlacements; i++, sp++)
 		{
-			for (posj=0; posj<(1.0-posi); posj+=step)
+			alpha = ssShade[SS_SHADE_ALPHA][i];
+			if (alpha > 0.0)
 			{
-				fa=posi+randomchart[randomindex]*step;
-				randomindex += randominterval;
-				if (fa>1.0)
-					continue;
+				fa = sp->bary[0];
+				fb = sp->bary[1];
+				fc = sp->bary[2];
+				alphapos = ssShade[SS_SHADE_ALPHAPOS][i];
 
-				fb=posj+randomchart[randomindex]*step;
-				randomindex += randominterval;
-				if (fb>(1.0-fa))
-					continue;
-
-				fc = 1.0-fa-fb;
-
-				// total alpha, minus random factor so some things fade out sooner.
-				alphapos = a1*fa + a2*fb + a3*fc;
-
-				// Note that the alpha at this point is a value from 1.0 to 0.0, but represents when to START fading
-				thisspritesfadestart = faderange + (1.0-faderange) * randomchart[randomindex];
-				randomindex += randominterval;
-
-				// Find where the alpha is relative to the fadestart, and calc the real alpha to draw at.
-				alpha = 1.0 - ((thisspritesfadestart-alphapos)/faderange);
-
-				randomindex += randominterval;
-				if (alpha > 0.0)
+				if (SSUsingFog)
 				{
-					if (alpha > 1.0)
-						alpha=1.0;
-
-					if (SSUsingFog)
-					{
-						fogv[0] = fog1[0]*fa + fog2[0]*fb + fog3[0]*fc;
-						fogv[1] = fog1[1]*fa + fog2[1]*fb + fog3[1]*fc;
-					}
+					fogv[0] = fog1[0]*fa + fog2[0]*fb + fog3[0]*fc;
+					fogv[1] = fog1[1]*fa + fog2[1]*fb + fog3[1]*fc;
+				}
 
-					VectorScale(v1, fa, curpoint);
-					VectorMA(curpoint, fb, v2, curpoint);
-					VectorMA(curpoint, fc, v3, curpoint);
+				VectorCopy(sp->point, curpoint);
 
-					light = l1*fa + l2*fb + l3*fc;
-					if (SSAdditiveTransparency)
-					{	// Additive transparency, scale light value
-//						light *= alpha;
-						light = (128 + (light*0.5))*alpha;
-						alpha = 1.0;
-					}
-
-					randomindex2 = randomindex;
-					width = stage->ss->width*(1.0 + (stage->ss->variance[0]*randomchart[randomindex2]));
-					height = stage->ss->height*(1.0 + (stage->ss->variance[1]*randomchart[randomindex2++]));
-					if (randomchart[randomindex2++]>0.5)
-					{
-						width = -width;
-					}
-					if (stage->ss->fadeScale!=0 && alphapos < 1.0)
-					{
-						width *= 1.0 + (stage->ss->fadeScale*(1.0-alphapos));
-					}
+				light = ssShade[SS_SHADE_LIGHT][i];
+				if (SSAdditiveTransparency)
+				{	// Additive transparency, scale light value
+//					light *= alpha;
+					light = (128 + (light*0.5))*alpha;
+					alpha = 1.0;
+				}
 
-					if (SSUsingFog)
-					{
-						RB_OrientedSurfaceSprite(curpoint, width, height, (byte)light, (byte)(alpha*255.0), fogv, stage->ss->facing);
-					}
-					else
-					{
-						RB_OrientedSurfaceSprite(curpoint, width, height, (byte)light, (byte)(alpha*255.0), NULL, stage->ss->facing);
-					}
+				width = sp->width;
+				height = sp->height;
+				if (stage->ss->fadeScale!=0 && alphapos < 1.0)
+				{
+					width *= 1.0 + (stage->ss->fadeScale*(1.0-alphapos));
+				}
 
-					totalsurfsprites++;
+				if (SSUsingFog)
+				{
+					RB_OrientedSurfaceSprite(curpoint, width, height, (byte)light, (byte)(alpha*255.0), fogv, stage->ss->facing);
 				}
+				else
+				{
+					RB_OrientedSurfaceSprite(curpoint, width, height, (byte)light, (byte)(alpha*255.0), NULL, stage->ss->facing);
+				}
+
+				totalsurfsprites++;
 			}
 		}
 	}
@@ -0,0 +1,694 @@
+/*
+===========================================================================
+Copyright (C) 2013 - 2015, OpenJK contributors
+
+This file is part of the OpenJK source code.
+
+OpenJK is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+
+// tr_vbo.cpp -- static world geometry in vertex buffer objects
+
+#include "tr_local.h"
+
+#include <stddef.h>
+
+extern bool g_bRenderGlowingObjects;
+void R_BindAnimatedImage( textureBundle_t *bundle );
+
+/*
+=============================================================================
+
+WORLD VERTEX BUFFER
+
+With r_worldVBO set, the faces, curves and triangle soups of the world are
+uploaded once when the map loads, grouped by shader so that the surfaces of
+one batch sit next to each other.  Surfaces whose shader needs no per-vertex
+work on the CPU are then drawn as index ranges of that buffer instead of
+being copied into tess every frame.  Everything else, and any surface that
+is dynamically lit or fogged this frame, still goes through tess.
+
+=============================================================================
+*/
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+typedef struct worldVertex_s {
+	vec3_t		xyz;
+	vec2_t		st;
+	vec2_t		lightmap;
+	color4ub_t	color;			// CGEN_EXACT_VERTEX
+	color4ub_t	litColor;		// CGEN_VERTEX, rgb scaled by tr.identityLight
+} worldVertex_t;
+
+typedef enum {
+	VBOCOLOR_CONST,
+	VBOCOLOR_EXACT,
+	VBOCOLOR_LIT
+} vboColorSource_t;
+
+/*
+===============
+R_VBOStageColors
+
+Works out where a stage's colors come from when it is drawn from the world
+buffer, or returns qfalse if ComputeColors would have to generate them
+===============
+*/
+static qboolean R_VBOStageColors( const shader_t *shader, const shaderStage_t *pStage, vboColorSource_t *source, byte *constant ) {
+	switch ( pStage->rgbGen )
+	{
+	case CGEN_IDENTITY:
+		*source = VBOCOLOR_CONST;
+		constant[0] = constant[1] = constant[2] = constant[3] = 0xff;
+		break;
+	case CGEN_IDENTITY_LIGHTING:
+		*source = VBOCOLOR_CONST;
+		constant[0] = constant[1] = constant[2] = constant[3] = tr.identityLightByte;
+		break;
+	case CGEN_CONST:
+		*source = VBOCOLOR_CONST;
+		memcpy( constant, pStage->constantColor, 4 );
+		break;
+	case CGEN_EXACT_VERTEX:
+		*source = VBOCOLOR_EXACT;
+		break;
+	case CGEN_VERTEX:
+		*source = VBOCOLOR_LIT;
+		break;
+	default:
+		return qfalse;
+	}
+
+	// vertex lit shaders mix their colors from the light styles every frame
+	if ( *source != VBOCOLOR_CONST && shader->lightmapIndex[0] == LIGHTMAP_BY_VERTEX ) {
+		return qfalse;
+	}
+
+	// same rules as ComputeColors
+	switch ( pStage->alphaGen )
+	{
+	case AGEN_SKIP:
+		break;
+	case AGEN_IDENTITY:
+		if ( pStage->rgbGen == CGEN_IDENTITY || ( pStage->rgbGen == CGEN_VERTEX && tr.identityLight == 1 ) ) {
+			break;
+		}
+		if ( *source != VBOCOLOR_CONST ) {
+			return qfalse;
+		}
+		constant[3] = 0xff;
+		break;
+	case AGEN_CONST:
+		if ( pStage->rgbGen == CGEN_CONST ) {
+			break;
+		}
+		if ( *source != VBOCOLOR_CONST ) {
+			return qfalse;
+		}
+		constant[3] = pStage->constantColor[3];
+		break;
+	case AGEN_VERTEX:
+		// both color arrays carry the vertex alpha
+		if ( *source == VBOCOLOR_CONST ) {
+			return qfalse;
+		}
+		break;
+	default:
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+/*
+===============
+R_VBOTexCoords
+
+Returns the offset of a bundle's texture coordinates in worldVertex_t,
+or -1 if ComputeTexCoords would have to generate them
+===============
+*/
+static int R_VBOTexCoords( const textureBundle_t *bundle ) {
+	if ( bundle->numTexMods ) {
+		return -1;
+	}
+
+	switch ( bundle->tcGen )
+	{
+	case TCGEN_TEXTURE:
+		return offsetof( worldVertex_t, st );
+	case TCGEN_LIGHTMAP:
+		return offsetof( worldVertex_t, lightmap );
+	default:
+		return -1;
+	}
+}
+
+/*
+===============
+R_ShaderCanUseWorldVBO
+
+True if every stage of the shader can be drawn straight from the world
+buffer, without deforms or per-vertex colors and texture coordinates
+===============
+*/
+qboolean R_ShaderCanUseWorldVBO( const shader_t *shader ) {
+	int					stage;
+	vboColorSource_t	source;
+	byte				constant[4];
+
+	if ( shader->sky || shader->numDeforms || shader->sort == SS_PORTAL || ( shader->surfaceFlags & SURF_SKY ) ) {
+		return qfalse;
+	}
+	if ( shader == tr.shadowShader || shader == tr.projectionShadowShader || shader == tr.distortionShader ) {
+		return qfalse;
+	}
+
+	for ( stage = 0; stage < shader->numUnfoggedPasses; stage++ ) {
+		const shaderStage_t *pStage = &shader->stages[stage];
+
+		if ( !pStage->active ) {
+			break;
+		}
+		// surface sprites are built from the tess vertexes
+		if ( pStage->ss && pStage->ss->surfaceSpriteType ) {
+			return qfalse;
+		}
+		if ( !R_VBOStageColors( shader, pStage, &source, constant ) ) {
+			return qfalse;
+		}
+		if ( R_VBOTexCoords( &pStage->bundle[0] ) < 0 ) {
+			return qfalse;
+		}
+		if ( pStage->bundle[1].image && R_VBOTexCoords( &pStage->bundle[1] ) < 0 ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+===============
+R_SurfaceVBOSize
+===============
+*/
+static qboolean R_SurfaceVBOSize( const msurface_t *surf, int *numVerts, int *numIndexes ) {
+	switch ( *surf->data )
+	{
+	case SF_FACE:
+		*numVerts = ((srfSurfaceFace_t *)surf->data)->numPoints;
+		*numIndexes = ((srfSurfaceFace_t *)surf->data)->numIndices;
+		return qtrue;
+	case SF_GRID:
+		{
+			const srfGridMesh_t *grid = (srfGridMesh_t *)surf->data;
+
+			*numVerts = grid->width * grid->height;
+			*numIndexes = ( grid->width - 1 ) * ( grid->height - 1 ) * 6;
+		}
+		return qtrue;
+	case SF_TRIANGLES:
+		*numVerts = ((srfTriangles_t *)surf->data)->numVerts;
+		*numIndexes = ((srfTriangles_t *)surf->data)->numIndexes;
+		return qtrue;
+	default:
+		return qfalse;
+	}
+}
+
+/*
+===============
+R_SetWorldVertex
+===============
+*/
+static void R_SetWorldVertex( worldVertex_t *out, const float *xyz, const float *st, const float *lightmap, const byte *color ) {
+	VectorCopy( xyz, out->xyz );
+	out->st[0] = st[0];
+	out->st[1] = st[1];
+	out->lightmap[0] = lightmap[0];
+	out->lightmap[1] = lightmap[1];
+
+	out->color[0] = color[0];
+	out->color[1] = color[1];
+	out->color[2] = color[2];
+	out->color[3] = color[3];
+
+	if ( tr.identityLight == 1 ) {
+		memcpy( out->litColor, out->color, sizeof( out->litColor ) );
+	} else {
+		out->litColor[0] = color[0] * tr.identityLight;
+		out->litColor[1] = color[1] * tr.identityLight;
+		out->litColor[2] = color[2] * tr.identityLight;
+		out->litColor[3] = color[3];
+	}
+}
+
+/*
+===============
+R_AddSurfaceToWorldVBO
+
+Appends the surface's vertexes and indexes and remembers where they went.
+Curves go in at full detail, since the buffer can't follow the LOD
+RB_SurfaceGrid picks each frame.
+===============
+*/
+static void R_AddSurfaceToWorldVBO( msurface_t *surf, worldVertex_t *verts, int *numVerts, glIndex_t *indexes, int *numIndexes ) {
+	const int	firstVert = *numVerts;
+	const int	firstIndex = *numIndexes;
+	int			i, j;
+
+	switch ( *surf->data )
+	{
+	case SF_FACE:
+		{
+			srfSurfaceFace_t	*face = (srfSurfaceFace_t *)surf->data;
+			const unsigned		*faceIndexes = (unsigned *)( (byte *)face + face->ofsIndices );
+			const float			*v = face->points[0];
+
+			for ( i = 0; i < face->numPoints; i++, v += VERTEXSIZE ) {
+				R_SetWorldVertex( &verts[firstVert + i], v, v + 3, v + VERTEX_LM, (byte *)&v[VERTEX_COLOR] );
+			}
+			for ( i = 0; i < face->numIndices; i++ ) {
+				indexes[firstIndex + i] = firstVert + faceIndexes[i];
+			}
+			*numVerts += face->numPoints;
+			*numIndexes += face->numIndices;
+
+			face->firstVBOIndex = firstIndex;
+			face->numVBOIndexes = face->numIndices;
+		}
+		break;
+
+	case SF_GRID:
+		{
+			srfGridMesh_t	*grid = (srfGridMesh_t *)surf->data;
+			glIndex_t		*out = indexes + firstIndex;
+
+			for ( i = 0; i < grid->width * grid->height; i++ ) {
+				const drawVert_t *dv = &grid->verts[i];
+				R_SetWorldVertex( &verts[firstVert + i], dv->xyz, dv->st, dv->lightmap[0], dv->color[0] );
+			}
+
+			// same triangle order as RB_SurfaceGrid
+			for ( i = 0; i < grid->height - 1; i++ ) {
+				for ( j = 0; j < grid->width - 1; j++ ) {
+					int		v1, v2, v3, v4;
+
+					v1 = firstVert + i*grid->width + j + 1;
+					v2 = v1 - 1;
+					v3 = v2 + grid->width;
+					v4 = v3 + 1;
+
+					*out++ = v2;
+					*out++ = v3;
+					*out++ = v1;
+
+					*out++ = v1;
+					*out++ = v3;
+					*out++ = v4;
+				}
+			}
+			*numVerts += grid->width * grid->height;
+			*numIndexes += out - ( indexes + firstIndex );
+
+			grid->firstVBOIndex = firstIndex;
+			grid->numVBOIndexes = out - ( indexes + firstIndex );
+		}
+		break;
+
+	case SF_TRIANGLES:
+		{
+			srfTriangles_t	*tri = (srfTriangles_t *)surf->data;
+
+			for ( i = 0; i < tri->numVerts; i++ ) {
+				const drawVert_t *dv = &tri->verts[i];
+				R_SetWorldVertex( &verts[firstVert + i], dv->xyz, dv->st, dv->lightmap[0], dv->color[0] );
+			}
+			for ( i = 0; i < tri->numIndexes; i++ ) {
+				indexes[firstIndex + i] = firstVert + tri->indexes[i];
+			}
+			*numVerts += tri->numVerts;
+			*numIndexes += tri->numIndexes;
+
+			tri->firstVBOIndex = firstIndex;
+			tri->numVBOIndexes = tri->numIndexes;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+===============
+R_CompareSurfaceShaders
+===============
+*/
+static int R_CompareSurfaceShaders( const void *a, const void *b ) {
+	const msurface_t	*sa = *(const msurface_t **)a;
+	const msurface_t	*sb = *(const msurface_t **)b;
+
+	if ( sa->shader->sortedIndex != sb->shader->sortedIndex ) {
+		return sa->shader->sortedIndex - sb->shader->sortedIndex;
+	}
+	return sa - sb;
+}
+
+/*
+===============
+R_BuildWorldVBO
+
+Called once the world's surfaces are loaded
+===============
+*/
+void R_BuildWorldVBO( world_t *world ) {
+	msurface_t		**surfs;
+	worldVertex_t	*verts;
+	glIndex_t		*indexes;
+	int				numSurfs, numVerts, numIndexes;
+	int				i, surfVerts, surfIndexes;
+
+	R_DeleteWorldVBO();
+
+	if ( !r_worldVBO->integer || !qglGenBuffersARB ) {
+		return;
+	}
+
+	R_SyncRenderThread();
+
+	// group the surfaces by shader, which also keeps each lightmap together
+	surfs = (msurface_t **)Z_Malloc( world->numsurfaces * sizeof( *surfs ), TAG_TEMP_WORKSPACE, qfalse );
+	numSurfs = numVerts = numIndexes = 0;
+	for ( i = 0; i < world->numsurfaces; i++ ) {
+		msurface_t *surf = &world->surfaces[i];
+
+		if ( !surf->shader || !R_SurfaceVBOSize( surf, &surfVerts, &surfIndexes ) || !surfIndexes ) {
+			continue;
+		}
+		if ( !R_ShaderCanUseWorldVBO( surf->shader ) ) {
+			continue;
+		}
+		surfs[numSurfs++] = surf;
+		numVerts += surfVerts;
+		numIndexes += surfIndexes;
+	}
+
+	if ( !numSurfs ) {
+		Z_Free( surfs );
+		return;
+	}
+
+	qsort( surfs, numSurfs, sizeof( *surfs ), R_CompareSurfaceShaders );
+
+	verts = (worldVertex_t *)Z_Malloc( numVerts * sizeof( *verts ), TAG_TEMP_WORKSPACE, qfalse );
+	indexes = (glIndex_t *)Z_Malloc( numIndexes * sizeof( *indexes ), TAG_TEMP_WORKSPACE, qfalse );
+
+	numVerts = numIndexes = 0;
+	for ( i = 0; i < numSurfs; i++ ) {
+		R_AddSurfaceToWorldVBO( surfs[i], verts, &numVerts, indexes, &numIndexes );
+	}
+
+	qglGenBuffersARB( 1, &tr.worldVertexBuffer );
+	qglBindBufferARB( GL_ARRAY_BUFFER_ARB, tr.worldVertexBuffer );
+	qglBufferDataARB( GL_ARRAY_BUFFER_ARB, numVerts * sizeof( *verts ), verts, GL_STATIC_DRAW_ARB );
+	qglBindBufferARB( GL_ARRAY_BUFFER_ARB, 0 );
+
+	qglGenBuffersARB( 1, &tr.worldIndexBuffer );
+	qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, tr.worldIndexBuffer );
+	qglBufferDataARB( GL_ELEMENT_ARRAY_BUFFER_ARB, numIndexes * sizeof( *indexes ), indexes, GL_STATIC_DRAW_ARB );
+	qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, 0 );
+
+	Z_Free( indexes );
+	Z_Free( verts );
+	Z_Free( surfs );
+
+	if ( qglGetError() == GL_OUT_OF_MEMORY ) {
+		ri->Printf( PRINT_WARNING, "R_BuildWorldVBO: out of memory, drawing the world from client memory\n" );
+		R_DeleteWorldVBO();
+		return;
+	}
+
+	ri->Printf( PRINT_DEVELOPER, "world vertex buffer: %i surfaces, %i vertexes, %i indexes\n", numSurfs, numVerts, numIndexes );
+}
+
+/*
+===============
+R_DeleteWorldVBO
+===============
+*/
+void R_DeleteWorldVBO( void ) {
+	if ( tr.worldVertexBuffer || tr.worldIndexBuffer ) {
+		R_SyncRenderThread();
+	}
+	if ( tr.worldVertexBuffer ) {
+		qglDeleteBuffersARB( 1, &tr.worldVertexBuffer );
+		tr.worldVertexBuffer = 0;
+	}
+	if ( tr.worldIndexBuffer ) {
+		qglDeleteBuffersARB( 1, &tr.worldIndexBuffer );
+		tr.worldIndexBuffer = 0;
+	}
+}
+
+/*
+=============================================================================
+
+BACK END
+
+=============================================================================
+*/
+
+/*
+===============
+RB_AddWorldVBOSurface
+
+Called by the world surface functions before they copy anything into tess.
+Returns qtrue if the surface will be drawn from the world buffer instead.
+===============
+*/
+qboolean RB_AddWorldVBOSurface( int dlightBits, int firstIndex, int numIndexes ) {
+	vboRange_t	*range;
+
+	if ( !tess.useWorldVBO || dlightBits || backEnd.currentEntity != &tr.worldEntity ) {
+		return qfalse;
+	}
+
+	if ( tess.numVBORanges ) {
+		// surfaces of one shader were uploaded together, so they often join up
+		range = &tess.vboRanges[tess.numVBORanges - 1];
+		if ( range->firstIndex + range->numIndexes == firstIndex ) {
+			range->numIndexes += numIndexes;
+			return qtrue;
+		}
+	}
+
+	if ( tess.numVBORanges == MAX_VBO_RANGES ) {
+		RB_EndSurface();
+		RB_BeginSurface( tess.shader, tess.fogNum );
+	}
+
+	range = &tess.vboRanges[tess.numVBORanges++];
+	range->firstIndex = firstIndex;
+	range->numIndexes = numIndexes;
+	return qtrue;
+}
+
+/*
+===============
+RB_CompareVBORanges
+===============
+*/
+static int RB_CompareVBORanges( const void *a, const void *b ) {
+	return ((const vboRange_t *)a)->firstIndex - ((const vboRange_t *)b)->firstIndex;
+}
+
+/*
+===============
+RB_DrawVBORanges
+===============
+*/
+static void RB_DrawVBORanges( void ) {
+	int i;
+
+	for ( i = 0; i < tess.numVBORanges; i++ ) {
+		qglDrawElements( GL_TRIANGLES, tess.vboRanges[i].numIndexes, GL_INDEX_TYPE,
+			BUFFER_OFFSET( tess.vboRanges[i].firstIndex * sizeof( glIndex_t ) ) );
+	}
+}
+
+/*
+===============
+RB_SetVBOColors
+===============
+*/
+static void RB_SetVBOColors( const shaderStage_t *pStage ) {
+	vboColorSource_t	source;
+	byte				constant[4];
+
+	R_VBOStageColors( tess.shader, pStage, &source, constant );
+
+	if ( source == VBOCOLOR_CONST ) {
+		qglDisableClientState( GL_COLOR_ARRAY );
+		qglColor4ubv( constant );
+	} else {
+		qglEnableClientState( GL_COLOR_ARRAY );
+		qglColorPointer( 4, GL_UNSIGNED_BYTE, sizeof( worldVertex_t ),
+			BUFFER_OFFSET( source == VBOCOLOR_EXACT ? offsetof( worldVertex_t, color ) : offsetof( worldVertex_t, litColor ) ) );
+	}
+}
+
+/*
+===============
+RB_DrawWorldVBO
+
+The RB_StageIteratorGeneric equivalent for the ranges collected by
+RB_AddWorldVBOSurface.  The shader was checked by R_ShaderCanUseWorldVBO,
+so there are no deforms, dlights, fog or surface sprites to deal with.
+===============
+*/
+void RB_DrawWorldVBO( void ) {
+	shader_t	*shader = tess.shader;
+	int			i, numRanges, numIndexes;
+	int			stage;
+
+	// put the ranges back in buffer order and join the neighbours
+	qsort( tess.vboRanges, tess.numVBORanges, sizeof( tess.vboRanges[0] ), RB_CompareVBORanges );
+	numRanges = 0;
+	numIndexes = 0;
+	for ( i = 0; i < tess.numVBORanges; i++ ) {
+		vboRange_t *range = &tess.vboRanges[i];
+
+		numIndexes += range->numIndexes;
+		if ( numRanges && tess.vboRanges[numRanges - 1].firstIndex + tess.vboRanges[numRanges - 1].numIndexes == range->firstIndex ) {
+			tess.vboRanges[numRanges - 1].numIndexes += range->numIndexes;
+		} else {
+			tess.vboRanges[numRanges++] = *range;
+		}
+	}
+	tess.numVBORanges = numRanges;
+
+	backEnd.pc.c_indexes += numIndexes;
+	backEnd.pc.c_totalIndexes += numIndexes * tess.numPasses;
+
+	GL_Cull( shader->cullType );
+
+	if ( shader->polygonOffset ) {
+		qglEnable( GL_POLYGON_OFFSET_FILL );
+		qglPolygonOffset( r_offsetFactor->value, r_offsetUnits->value );
+	}
+
+	qglBindBufferARB( GL_ARRAY_BUFFER_ARB, tr.worldVertexBuffer );
+	qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, tr.worldIndexBuffer );
+	qglVertexPointer( 3, GL_FLOAT, sizeof( worldVertex_t ), BUFFER_OFFSET( offsetof( worldVertex_t, xyz ) ) );
+
+	for ( stage = 0; stage < shader->numUnfoggedPasses; stage++ ) {
+		shaderStage_t *pStage = &tess.xstages[stage];
+
+		if ( !pStage->active ) {
+			break;
+		}
+
+		// Reject this stage if it's not a glow stage but we are doing a glow pass.
+		if ( g_bRenderGlowingObjects && !pStage->glow ) {
+			continue;
+		}
+
+		if ( stage && r_lightmap->integer && !( pStage->bundle[0].isLightmap || pStage->bundle[1].isLightmap || pStage->bundle[0].vertexLightmap ) ) {
+			break;
+		}
+
+		RB_SetVBOColors( pStage );
+
+		GL_SelectTexture( 0 );
+		qglEnableClientState( GL_TEXTURE_COORD_ARRAY );
+		qglTexCoordPointer( 2, GL_FLOAT, sizeof( worldVertex_t ), BUFFER_OFFSET( R_VBOTexCoords( &pStage->bundle[0] ) ) );
+
+		if ( pStage->bundle[1].image != 0 ) {
+			// same as DrawMultitextured
+			GL_State( pStage->stateBits );
+
+			if ( backEnd.viewParms.isPortal ) {
+				qglPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+			}
+
+			R_BindAnimatedImage( &pStage->bundle[0] );
+
+			GL_SelectTexture( 1 );
+			qglEnable( GL_TEXTURE_2D );
+			qglEnableClientState( GL_TEXTURE_COORD_ARRAY );
+
+			if ( r_lightmap->integer ) {
+				GL_TexEnv( GL_REPLACE );
+			} else {
+				GL_TexEnv( shader->multitextureEnv );
+			}
+
+			qglTexCoordPointer( 2, GL_FLOAT, sizeof( worldVertex_t ), BUFFER_OFFSET( R_VBOTexCoords( &pStage->bundle[1] ) ) );
+			R_BindAnimatedImage( &pStage->bundle[1] );
+
+			RB_DrawVBORanges();
+
+			qglDisable( GL_TEXTURE_2D );
+			GL_SelectTexture( 0 );
+		} else {
+			if ( pStage->bundle[0].vertexLightmap && ( r_vertexLight->integer && !r_uiFullScreen->integer ) && r_lightmap->integer ) {
+				GL_Bind( tr.whiteImage );
+			} else {
+				R_BindAnimatedImage( &pStage->bundle[0] );
+			}
+
+			GL_State( pStage->stateBits );
+
+			RB_DrawVBORanges();
+		}
+	}
+
+	if ( shader->polygonOffset ) {
+		qglDisable( GL_POLYGON_OFFSET_FILL );
+	}
+
+	if ( r_showtris->integer ) {
+		GL_Bind( tr.whiteImage );
+		qglColor3f( 1, 1, 1 );
+		GL_State( GLS_POLYMODE_LINE | GLS_DEPTHMASK_TRUE );
+		qglDepthRange( 0, 0 );
+		qglDisableClientState( GL_COLOR_ARRAY );
+		qglDisableClientState( GL_TEXTURE_COORD_ARRAY );
+
+		RB_DrawVBORanges();
+
+		qglDepthRange( 0, 1 );
+	}
+
+	// everyone else draws from client memory and expects the
+	// pointers RB_StageIteratorGeneric leaves behind
+	qglBindBufferARB( GL_ARRAY_BUFFER_ARB, 0 );
+	qglBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, 0 );
+
+	qglVertexPointer( 3, GL_FLOAT, 16, tess.xyz );
+	qglEnableClientState( GL_COLOR_ARRAY );
+	qglColorPointer( 4, GL_UNSIGNED_BYTE, 0, tess.svars.colors );
+	if ( qglActiveTextureARB ) {
+		GL_SelectTexture( 1 );
+		qglTexCoordPointer( 2, GL_FLOAT, 0, tess.svars.texcoords[1] );
+		GL_SelectTexture( 0 );
+	}
+	qglEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	qglTexCoordPointer( 2, GL_FLOAT, 0, tess.svars.texcoords[0] );
+
+	tess.numVBORanges = 0;
+}
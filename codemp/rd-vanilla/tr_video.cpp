@@ -0,0 +1,455 @@
+/*
+===========================================================================
+Copyright (C) 2013 - 2015, OpenJK contributors
+
+This file is part of the OpenJK source code.
+
+OpenJK is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+
+#include "tr_local.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+=============================================================================
+
+VIDEO CAPTURE
+
+With GL_ARB_pixel_buffer_object, RB_TakeVideoFrameCmd reads each frame into
+one of a ring of pixel pack buffers, so glReadPixels returns without waiting
+for the GPU, and maps the buffer a frame later when the copy has finished.
+Without it the frame is read straight into memory as before.
+
+The pixels are then gamma corrected and encoded, as JPEG or as padded BGR
+lines, by r_aviEncodeThreads worker threads, or on the back end if that is
+0.  Finished frames go to ri->CL_WriteAVIVideoFrame in the order they were
+taken, from whichever thread completes the oldest one.  The client calls
+RE_FlushVideoFrames before it closes the file, to get the frames that are
+still in flight.
+
+Nothing is printed off the main thread.  A frame that couldn't be encoded
+is dropped and the reason kept with it, and R_ReportVideoCapture prints
+whatever was kept when the client asks for the next frame or flushes.
+
+=============================================================================
+*/
+
+#define	VIDEO_PBO_COUNT			2		// frames being read back at once
+#define	VIDEO_QUEUE_PER_THREAD	2		// frames waiting to be encoded, per thread
+
+typedef struct videoFrame_s {
+	int			width, height;
+	int			padlen;				// glReadPixels padding at the end of each line
+	qboolean	motionJpeg;
+	int			quality;
+	qboolean	gammaCorrect;
+
+	byte		*pixels;			// NULL if the readback failed
+	byte		*encoded;
+	size_t		encodedSize;
+	char		message[MAX_STRING_CHARS];	// from the encoder, empty if it had nothing to say
+	bool		done;
+} videoFrame_t;
+
+static GLuint						videoPBOs[VIDEO_PBO_COUNT];
+static int							videoPBOSize;
+static videoFrame_t					*videoReadbacks[VIDEO_PBO_COUNT];	// frame each buffer is being read for
+static int							videoReadbackFirst;
+static int							videoReadbackCount;
+
+static std::vector<std::thread>		videoWorkers;
+static std::mutex					videoMutex;
+static std::condition_variable		videoWake;		// frames to encode, or quit
+static std::condition_variable		videoIdle;		// a frame was taken off a queue
+static std::deque<videoFrame_t *>	videoEncodeQueue;
+static std::deque<videoFrame_t *>	videoFrames;	// every frame not handed over yet, oldest first
+static std::vector<std::string>		videoMessages;	// for R_ReportVideoCapture
+static bool							videoQuit;
+
+/*
+===============
+R_AllocVideoFrame
+===============
+*/
+static videoFrame_t *R_AllocVideoFrame( const videoFrameCommand_t *cmd, int padlen ) {
+	videoFrame_t *frame = new videoFrame_t();
+
+	frame->width = cmd->width;
+	frame->height = cmd->height;
+	frame->padlen = padlen;
+	frame->motionJpeg = cmd->motionJpeg;
+	frame->quality = r_aviMotionJpegQuality->integer;
+	frame->gammaCorrect = (qboolean)( glConfig.deviceSupportsGamma && !glConfigExt.doGammaCorrectionWithShaders );
+	frame->pixels = (byte *)malloc( ( cmd->width * 3 + padlen ) * cmd->height );
+
+	return frame;
+}
+
+/*
+===============
+R_EncodeVideoFrame
+
+Runs on the encode threads, so it only touches the frame
+===============
+*/
+static void R_EncodeVideoFrame( videoFrame_t *frame ) {
+	const size_t	linelen = frame->width * 3;
+	const size_t	memcount = ( linelen + frame->padlen ) * frame->height;
+
+	if ( !frame->pixels ) {
+		return;
+	}
+
+	if ( frame->gammaCorrect ) {
+		R_GammaCorrect( frame->pixels, memcount );
+	}
+
+	if ( frame->motionJpeg ) {
+		frame->encoded = (byte *)malloc( linelen * frame->height );
+		frame->encodedSize = RE_SaveJPGToBuffer( frame->encoded, linelen * frame->height,
+			frame->quality, frame->width, frame->height, frame->pixels, frame->padlen,
+			frame->message, sizeof( frame->message ) );
+		if ( !frame->encodedSize ) {
+			free( frame->encoded );
+			frame->encoded = NULL;
+		}
+	} else {
+		const int	avipadwidth = PAD( linelen, AVI_LINE_PADDING );
+		const int	avipadlen = avipadwidth - linelen;
+		byte		*lineend, *memend;
+		byte		*srcptr, *destptr;
+
+		frame->encoded = (byte *)malloc( avipadwidth * frame->height );
+		frame->encodedSize = avipadwidth * frame->height;
+
+		srcptr = frame->pixels;
+		destptr = frame->encoded;
+		memend = srcptr + memcount;
+
+		// swap R and B and remove line paddings
+		while ( srcptr < memend ) {
+			lineend = srcptr + linelen;
+			while ( srcptr < lineend ) {
+				*destptr++ = srcptr[2];
+				*destptr++ = srcptr[1];
+				*destptr++ = srcptr[0];
+				srcptr += 3;
+			}
+
+			Com_Memset( destptr, '\0', avipadlen );
+			destptr += avipadlen;
+
+			srcptr += frame->padlen;
+		}
+	}
+
+	free( frame->pixels );
+	frame->pixels = NULL;
+}
+
+/*
+===============
+R_DeliverVideoFrames
+
+Hands the client every finished frame that isn't waiting behind an
+unfinished one.  Called with videoMutex held, which keeps the order.
+===============
+*/
+static void R_DeliverVideoFrames( void ) {
+	while ( !videoFrames.empty() && videoFrames.front()->done ) {
+		videoFrame_t *frame = videoFrames.front();
+
+		videoFrames.pop_front();
+
+		if ( frame->message[0] ) {
+			videoMessages.push_back( std::string( frame->encoded ? "" : "Video frame dropped: " ) + frame->message );
+		}
+
+		// a frame that couldn't be read still frees its place in the file
+		ri->CL_WriteAVIVideoFrame( frame->encoded, (int)frame->encodedSize );
+
+		free( frame->encoded );
+		delete frame;
+	}
+	videoIdle.notify_all();
+}
+
+/*
+===============
+R_VideoWorker
+===============
+*/
+static void R_VideoWorker( void ) {
+	std::unique_lock<std::mutex> lock( videoMutex );
+
+	for ( ;; ) {
+		videoWake.wait( lock, [] { return videoQuit || !videoEncodeQueue.empty(); } );
+
+		// quitting still finishes the queue
+		if ( videoEncodeQueue.empty() ) {
+			return;
+		}
+
+		videoFrame_t *frame = videoEncodeQueue.front();
+
+		videoEncodeQueue.pop_front();
+		videoIdle.notify_all();
+
+		lock.unlock();
+		R_EncodeVideoFrame( frame );
+		lock.lock();
+
+		frame->done = true;
+		R_DeliverVideoFrames();
+	}
+}
+
+/*
+===============
+R_StopVideoWorkers
+
+Waits for the workers to encode and hand over everything they were given
+===============
+*/
+static void R_StopVideoWorkers( void ) {
+	if ( videoWorkers.empty() ) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( videoMutex );
+		videoQuit = true;
+	}
+	videoWake.notify_all();
+
+	for ( auto &worker : videoWorkers ) {
+		worker.join();
+	}
+	videoWorkers.clear();
+	videoQuit = false;
+}
+
+/*
+===============
+R_SubmitVideoFrame
+===============
+*/
+static void R_SubmitVideoFrame( videoFrame_t *frame ) {
+	if ( (int)videoWorkers.size() != r_aviEncodeThreads->integer ) {
+		R_StopVideoWorkers();
+		for ( int i = 0 ; i < r_aviEncodeThreads->integer ; i++ ) {
+			videoWorkers.emplace_back( R_VideoWorker );
+		}
+	}
+
+	std::unique_lock<std::mutex> lock( videoMutex );
+
+	videoFrames.push_back( frame );
+
+	if ( videoWorkers.empty() ) {
+		lock.unlock();
+		R_EncodeVideoFrame( frame );
+		lock.lock();
+
+		frame->done = true;
+		R_DeliverVideoFrames();
+		return;
+	}
+
+	// don't let capture run arbitrarily far ahead of the encoders
+	videoIdle.wait( lock, [] { return videoEncodeQueue.size() < VIDEO_QUEUE_PER_THREAD * videoWorkers.size(); } );
+	videoEncodeQueue.push_back( frame );
+	videoWake.notify_one();
+}
+
+/*
+===============
+R_FinishVideoReadback
+
+Maps the oldest pixel pack buffer and passes its frame on
+===============
+*/
+static void R_FinishVideoReadback( void ) {
+	videoFrame_t	*frame = videoReadbacks[videoReadbackFirst];
+	const int		size = ( frame->width * 3 + frame->padlen ) * frame->height;
+	void			*data;
+
+	qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, videoPBOs[videoReadbackFirst] );
+	data = qglMapBufferARB( GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB );
+	if ( data && frame->pixels ) {
+		Com_Memcpy( frame->pixels, data, size );
+	} else {
+		free( frame->pixels );
+		frame->pixels = NULL;
+	}
+	if ( data ) {
+		qglUnmapBufferARB( GL_PIXEL_PACK_BUFFER_ARB );
+	}
+	qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+
+	videoReadbacks[videoReadbackFirst] = NULL;
+	videoReadbackFirst = ( videoReadbackFirst + 1 ) % VIDEO_PBO_COUNT;
+	videoReadbackCount--;
+
+	R_SubmitVideoFrame( frame );
+}
+
+/*
+===============
+R_FreeVideoPBOs
+===============
+*/
+static void R_FreeVideoPBOs( void ) {
+	while ( videoReadbackCount ) {
+		R_FinishVideoReadback();
+	}
+
+	if ( videoPBOs[0] ) {
+		qglDeleteBuffersARB( VIDEO_PBO_COUNT, videoPBOs );
+		Com_Memset( videoPBOs, 0, sizeof( videoPBOs ) );
+	}
+	videoPBOSize = 0;
+	videoReadbackFirst = 0;
+}
+
+/*
+==================
+RB_TakeVideoFrameCmd
+==================
+*/
+const void *RB_TakeVideoFrameCmd( const void *data )
+{
+	const videoFrameCommand_t	*cmd;
+	videoFrame_t		*frame;
+	int					linelen, padwidth, padlen;
+	GLint				packAlign;
+
+	cmd = (const videoFrameCommand_t *)data;
+
+	qglGetIntegerv( GL_PACK_ALIGNMENT, &packAlign );
+
+	linelen = cmd->width * 3;
+
+	// Alignment stuff for glReadPixels
+	padwidth = PAD( linelen, packAlign );
+	padlen = padwidth - linelen;
+
+	frame = R_AllocVideoFrame( cmd, padlen );
+
+	if ( !glConfigExt.pixelBufferObjects ) {
+		if ( frame->pixels ) {
+			qglReadPixels( 0, 0, cmd->width, cmd->height, GL_RGB, GL_UNSIGNED_BYTE, frame->pixels );
+		}
+		R_SubmitVideoFrame( frame );
+		return (const void *)( cmd + 1 );
+	}
+
+	if ( videoPBOSize != padwidth * cmd->height ) {
+		R_FreeVideoPBOs();
+
+		qglGenBuffersARB( VIDEO_PBO_COUNT, videoPBOs );
+		for ( int i = 0 ; i < VIDEO_PBO_COUNT ; i++ ) {
+			qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, videoPBOs[i] );
+			qglBufferDataARB( GL_PIXEL_PACK_BUFFER_ARB, padwidth * cmd->height, NULL, GL_STREAM_READ_ARB );
+		}
+		qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+		videoPBOSize = padwidth * cmd->height;
+	}
+
+	const int slot = ( videoReadbackFirst + videoReadbackCount ) % VIDEO_PBO_COUNT;
+
+	qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, videoPBOs[slot] );
+	qglReadPixels( 0, 0, cmd->width, cmd->height, GL_RGB, GL_UNSIGNED_BYTE, NULL );
+	qglBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, 0 );
+
+	videoReadbacks[slot] = frame;
+	videoReadbackCount++;
+
+	// the oldest copy has had a whole frame to finish
+	if ( videoReadbackCount == VIDEO_PBO_COUNT ) {
+		R_FinishVideoReadback();
+	}
+
+	return (const void *)( cmd + 1 );
+}
+
+/*
+===============
+R_FlushVideoFrames
+
+Hands over every frame that has been read back or is being read back.
+Needs the context.
+===============
+*/
+static void R_FlushVideoFrames( void ) {
+	R_FreeVideoPBOs();
+
+	std::unique_lock<std::mutex> lock( videoMutex );
+	videoIdle.wait( lock, [] { return videoFrames.empty(); } );
+}
+
+/*
+===============
+RE_FlushVideoFrames
+
+Runs any queued RC_VIDEOFRAME and waits until all its frames reach the client
+===============
+*/
+void RE_FlushVideoFrames( void ) {
+	if ( !tr.registered ) {
+		return;
+	}
+
+	R_IssuePendingRenderCommands();
+	R_FlushVideoFrames();
+	R_ReportVideoCapture();
+}
+
+/*
+===============
+R_ReportVideoCapture
+
+Prints what the encoders had to say.  Main thread only.
+===============
+*/
+void R_ReportVideoCapture( void ) {
+	std::vector<std::string> messages;
+
+	{
+		std::lock_guard<std::mutex> lock( videoMutex );
+		messages.swap( videoMessages );
+	}
+
+	for ( const std::string &message : messages ) {
+		ri->Printf( PRINT_WARNING, "%s\n", message.c_str() );
+	}
+}
+
+/*
+===============
+R_ShutdownVideoCapture
+
+Called with the context on this thread
+===============
+*/
+void R_ShutdownVideoCapture( void ) {
+	R_FlushVideoFrames();
+	R_StopVideoWorkers();
+}
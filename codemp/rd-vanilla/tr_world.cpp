@@ -23,6 +23,14 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "tr_local.h"
 
+// a node box is tested against all four frustum planes at once where SSE is always there
+#if defined(__SSE__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+#define WORLD_SIMD_SSE	1
+#include <xmmintrin.h>
+#else
+#define WORLD_SIMD_SSE	0
+#endif
+
 inline void Q_CastShort2Float(float *f, const short *s)
 {
 	*f = ((float)*s);
@@ -271,7 +279,7 @@ static int R_DlightFace( srfSurfaceFace_t *face, int dlightBits ) {
 		tr.pc.c_dlightSurfacesCulled++;
 	}
 
-	face->dlightBits = dlightBits;
+	face->dlightBits[tr.smpFrame] = dlightBits;
 	return dlightBits;
 }
 
@@ -299,14 +307,14 @@ static int R_DlightGrid( srfGridMesh_t *grid, int dlightBits ) {
 		tr.pc.c_dlightSurfacesCulled++;
 	}
 
-	grid->dlightBits = dlightBits;
+	grid->dlightBits[tr.smpFrame] = dlightBits;
 	return dlightBits;
 }
 
 
 static int R_DlightTrisurf( srfTriangles_t *surf, int dlightBits ) {
 	// FIXME: more dlight culling to trisurfs...
-	surf->dlightBits = dlightBits;
+	surf->dlightBits[tr.smpFrame] = dlightBits;
 	return dlightBits;
 #if 0
 	int			i;
@@ -385,15 +393,15 @@ static void R_AddWorldSurface( msurface_t *surf, int dlightBits, qboolean noView
 			// already in this view, but lets make sure all the dlight bits are set
 			if ( *surf->data == SF_FACE )
 			{
-				((srfSurfaceFace_t *)surf->data)->dlightBits |= dlightBits;
+				((srfSurfaceFace_t *)surf->data)->dlightBits[tr.smpFrame] |= dlightBits;
 			}
 			else if ( *surf->data == SF_GRID )
 			{
-				((srfGridMesh_t *)surf->data)->dlightBits |= dlightBits;
+				((srfGridMesh_t *)surf->data)->dlightBits[tr.smpFrame] |= dlightBits;
 			}
 			else if ( *surf->data == SF_TRIANGLES )
 			{
-				((srfTriangles_t *)surf->data)->dlightBits |= dlightBits;
+				((srfTriangles_t *)surf->data)->dlightBits[tr.smpFrame] |= dlightBits;
 			}
 			return;
 		}
@@ -1109,13 +1117,14 @@ qboolean R_InitializeWireframeAutomap(void)
 static float g_lastHeight = 0.0f;
 static bool g_lastHeightValid = false;
 static void R_RecursiveWorldNode( mnode_t *node, int planeBits, int dlightBits );
+static void R_SetupNodeFrustum( void );
 const void *R_DrawWireframeAutomap(const void *data)
 {
 	const drawBufferCommand_t *cmd = (const drawBufferCommand_t *)data;
 	float e = 0.0f;
 	float alpha;
-	wireframeMapSurf_t *s = g_autoMapFrame.surfs;
 #ifndef _ALT_AUTOMAP_METHOD
+	wireframeMapSurf_t *s = g_autoMapFrame.surfs;
 	int i;
 #endif
 
@@ -1327,6 +1336,7 @@ const void *R_DrawWireframeAutomap(const void *data)
 	}
 #else
 	tr_drawingAutoMap = true;
+	R_SetupNodeFrustum();
 	R_RecursiveWorldNode( tr.world->nodes, 15, 0 );
 	tr_drawingAutoMap = false;
 #endif
@@ -1349,6 +1359,104 @@ const void *R_DrawWireframeAutomap(const void *data)
 }
 
 
+/*
+=============================================================================
+
+NODE FRUSTUM CULLING
+
+The world walk tests every node against the frustum planes still in
+planeBits.  The planes are kept here component by component, so one node's
+box is checked against all four of them with a handful of vector ops on
+the compact bounds in world_t::nodeBounds.
+
+=============================================================================
+*/
+
+typedef struct frustumPlanes_s {
+	float	normal[3][4];		// [axis][plane]
+	float	dist[4];
+} frustumPlanes_t;
+
+static frustumPlanes_t	s_frustumPlanes;
+
+/*
+================
+R_SetupNodeFrustum
+
+Must be called after the view's frustum is set up and before the world walk
+================
+*/
+static void R_SetupNodeFrustum( void ) {
+	int		i, j;
+
+	for ( i = 0 ; i < 4 ; i++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			s_frustumPlanes.normal[j][i] = tr.viewParms.frustum[i].normal[j];
+		}
+		s_frustumPlanes.dist[i] = tr.viewParms.frustum[i].dist;
+	}
+}
+
+/*
+================
+R_CullNodeBounds
+
+Returns planeBits without the planes the box is completely in front of,
+or -1 if the box is completely behind one of the planes in planeBits.
+Gives the same answers as BoxOnPlaneSide for each plane.
+================
+*/
+static int R_CullNodeBounds( const mnodeBounds_t *bounds, int planeBits ) {
+	int		front, back;
+#if WORLD_SIMD_SSE
+	__m128	lo, hi, a, b, n, d;
+	int		j;
+
+	n = _mm_loadu_ps( s_frustumPlanes.normal[0] );
+	a = _mm_mul_ps( n, _mm_set1_ps( bounds->mins[0] ) );
+	b = _mm_mul_ps( n, _mm_set1_ps( bounds->maxs[0] ) );
+	lo = _mm_min_ps( a, b );
+	hi = _mm_max_ps( a, b );
+	for ( j = 1 ; j < 3 ; j++ ) {
+		n = _mm_loadu_ps( s_frustumPlanes.normal[j] );
+		a = _mm_mul_ps( n, _mm_set1_ps( bounds->mins[j] ) );
+		b = _mm_mul_ps( n, _mm_set1_ps( bounds->maxs[j] ) );
+		lo = _mm_add_ps( lo, _mm_min_ps( a, b ) );
+		hi = _mm_add_ps( hi, _mm_max_ps( a, b ) );
+	}
+
+	d = _mm_loadu_ps( s_frustumPlanes.dist );
+	front = _mm_movemask_ps( _mm_cmpge_ps( lo, d ) );
+	back = _mm_movemask_ps( _mm_cmplt_ps( hi, d ) );
+#else
+	int		i, j;
+
+	front = back = 0;
+	for ( i = 0 ; i < 4 ; i++ ) {
+		float	lo = 0.0f, hi = 0.0f;
+
+		for ( j = 0 ; j < 3 ; j++ ) {
+			const float	a = s_frustumPlanes.normal[j][i] * bounds->mins[j];
+			const float	b = s_frustumPlanes.normal[j][i] * bounds->maxs[j];
+
+			lo += a < b ? a : b;
+			hi += a < b ? b : a;
+		}
+		if ( lo >= s_frustumPlanes.dist[i] ) {
+			front |= 1 << i;
+		}
+		if ( hi < s_frustumPlanes.dist[i] ) {
+			back |= 1 << i;
+		}
+	}
+#endif
+
+	if ( back & planeBits ) {
+		return -1;
+	}
+	return planeBits & ~front;
+}
+
 /*
 ================
 R_RecursiveWorldNode
@@ -1377,53 +1485,16 @@ static void R_RecursiveWorldNode( mnode_t *node, int planeBits, int dlightBits )
 		// inside can be visible OPTIMIZE: don't do this all the way to leafs?
 
 #ifdef _ALT_AUTOMAP_METHOD
-		if ( r_nocull->integer!=1 && !tr_drawingAutoMap )
+		if ( r_nocull->integer!=1 && !tr_drawingAutoMap && planeBits )
 #else
-		if (r_nocull->integer!=1)
+		if ( r_nocull->integer!=1 && planeBits )
 #endif
 		{
-			int		r;
-
-			if ( planeBits & 1 ) {
-				r = BoxOnPlaneSide(node->mins, node->maxs, &tr.viewParms.frustum[0]);
-				if (r == 2) {
-					return;						// culled
-				}
-				if ( r == 1 ) {
-					planeBits &= ~1;			// all descendants will also be in front
-				}
-			}
-
-			if ( planeBits & 2 ) {
-				r = BoxOnPlaneSide(node->mins, node->maxs, &tr.viewParms.frustum[1]);
-				if (r == 2) {
-					return;						// culled
-				}
-				if ( r == 1 ) {
-					planeBits &= ~2;			// all descendants will also be in front
-				}
-			}
-
-			if ( planeBits & 4 ) {
-				r = BoxOnPlaneSide(node->mins, node->maxs, &tr.viewParms.frustum[2]);
-				if (r == 2) {
-					return;						// culled
-				}
-				if ( r == 1 ) {
-					planeBits &= ~4;			// all descendants will also be in front
-				}
-			}
-
-			if ( planeBits & 8 ) {
-				r = BoxOnPlaneSide(node->mins, node->maxs, &tr.viewParms.frustum[3]);
-				if (r == 2) {
-					return;						// culled
-				}
-				if ( r == 1 ) {
-					planeBits &= ~8;			// all descendants will also be in front
-				}
+			// descendants skip the planes this node is completely in front of
+			planeBits = R_CullNodeBounds( &tr.world->nodeBounds[node - tr.world->nodes], planeBits );
+			if ( planeBits < 0 ) {
+				return;						// culled
 			}
-
 		}
 
 		if ( node->contents != -1 ) {
@@ -1583,6 +1654,42 @@ qboolean R_inPVS( const vec3_t p1, const vec3_t p2, byte *mask ) {
 	return qtrue;
 }
 
+/*
+===============
+R_MarkLeavesCacheEntry
+
+Finds the cached marking for the cluster and areamask, or picks the least
+recently used entry to hold a new one
+===============
+*/
+static markLeavesCache_t *R_MarkLeavesCacheEntry( int cluster, qboolean novis, qboolean *hit ) {
+	markLeavesCache_t	*entry, *oldest;
+	int					i;
+
+	tr.world->markLeavesTime++;
+
+	oldest = &tr.world->markLeavesCache[0];
+	for ( i = 0, entry = tr.world->markLeavesCache ; i < MARKLEAVES_CACHE_SIZE ; i++, entry++ ) {
+		if ( entry->cluster == cluster && entry->novis == novis
+			&& ( novis || !memcmp( entry->areamask, tr.refdef.areamask, sizeof( entry->areamask ) ) ) ) {
+			entry->lastUsed = tr.world->markLeavesTime;
+			*hit = qtrue;
+			return entry;
+		}
+		if ( entry->lastUsed < oldest->lastUsed ) {
+			oldest = entry;
+		}
+	}
+
+	oldest->cluster = cluster;
+	oldest->novis = novis;
+	memcpy( oldest->areamask, tr.refdef.areamask, sizeof( oldest->areamask ) );
+	oldest->lastUsed = tr.world->markLeavesTime;
+	oldest->numMarked = 0;
+	*hit = qfalse;
+	return oldest;
+}
+
 /*
 ===============
 R_MarkLeaves
@@ -1596,6 +1703,8 @@ static void R_MarkLeaves (void) {
 	mnode_t	*leaf, *parent;
 	int		i;
 	int		cluster;
+	qboolean	novis, hit;
+	markLeavesCache_t	*entry;
 
 	// lockpvs lets designers walk around to determine the
 	// extent of the current pvs
@@ -1626,10 +1735,21 @@ static void R_MarkLeaves (void) {
 	tr.visCount++;
 	tr.viewCluster = cluster;
 
-	if ( r_novis->integer || tr.viewCluster == -1 ) {
+	// a cluster seen recently only needs its nodes stamped again
+	novis = (qboolean)( r_novis->integer || tr.viewCluster == -1 );
+	entry = R_MarkLeavesCacheEntry( tr.viewCluster, novis, &hit );
+	if ( hit ) {
+		for ( i = 0 ; i < entry->numMarked ; i++ ) {
+			tr.world->nodes[entry->marked[i]].visframe = tr.visCount;
+		}
+		return;
+	}
+
+	if ( novis ) {
 		for (i=0 ; i<tr.world->numnodes ; i++) {
 			if (tr.world->nodes[i].contents != CONTENTS_SOLID) {
 				tr.world->nodes[i].visframe = tr.visCount;
+				entry->marked[entry->numMarked++] = i;
 			}
 		}
 		return;
@@ -1658,6 +1778,7 @@ static void R_MarkLeaves (void) {
 			if (parent->visframe == tr.visCount)
 				break;
 			parent->visframe = tr.visCount;
+			entry->marked[entry->numMarked++] = parent - tr.world->nodes;
 			parent = parent->parent;
 		} while (parent);
 	}
@@ -1691,5 +1812,6 @@ void R_AddWorldSurfaces (void) {
 		tr.refdef.num_dlights = 32 ;
 	}
 
+	R_SetupNodeFrustum();
 	R_RecursiveWorldNode( tr.world->nodes, 15, ( 1 << tr.refdef.num_dlights ) - 1 );
 }
@@ -29,6 +29,8 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "game/bg_public.h"
 #include "rd-common/tr_public.h"
 
+#include <atomic>
+
 //=============================================================================
 
 #define	PERS_SCORE				0		// !!! MUST NOT CHANGE, SERVER AND
@@ -39,13 +41,13 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
 	struct svEntity_s *nextEntityInWorldSector;
+	int			areaLeaf;			// area tree leaf + 1, 0 if not in the tree
 
 	entityState_t	baseline;		// for delta compression of initial sighting
 	int			numClusters;		// if -1, use headnode instead
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
 typedef enum {
@@ -60,7 +62,6 @@ typedef struct server_s {
 	int				serverId;			// changes each server start
 	int				restartedServerId;	// serverId before a map_restart
 	int				checksumFeed;		//
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	char			*configstrings[MAX_CONFIGSTRINGS];
@@ -126,7 +127,7 @@ typedef struct {
 	qboolean	demorecording;
 	qboolean	demowaiting;	// don't record until a non-delta message is sent
 	int			minDeltaFrame;	// the first non-delta frame stored in the demo.  cannot delta against frames older than this
-	fileHandle_t	demofile;
+	struct svDemoStream_s	*stream;	// see sv_demo.cpp
 	qboolean	isBot;
 	int			botReliableAcknowledge; // for bots, need to maintain a separate reliableAcknowledge to record server messages into the demo file
 } demoInfo_t;
@@ -266,8 +267,14 @@ extern	cvar_t	*sv_filterCommands;
 extern	cvar_t	*sv_autoDemo;
 extern	cvar_t	*sv_autoDemoBots;
 extern	cvar_t	*sv_autoDemoMaxMaps;
+extern	cvar_t	*sv_demoBufferSize;
+extern	cvar_t	*sv_demoCompress;
 extern	cvar_t	*sv_legacyFixForceSelect;
 extern	cvar_t	*sv_banFile;
+extern	cvar_t	*sv_snapshotThreads;
+extern	cvar_t	*sv_snapshotIndex;
+extern	cvar_t	*sv_snapshotCache;
+extern	cvar_t	*sv_areaTree;
 
 extern	serverBan_t serverBans[SERVER_MAXBANS];
 extern	int serverBansCount;
@@ -363,6 +370,17 @@ void SV_AutoRecordDemo( client_t *cl );
 void SV_StopAutoRecordDemos();
 void SV_BeginAutoRecordDemos();
 
+//
+// sv_demo.cpp
+//
+void SV_DemoFileName( const char *name, char *fileName, int fileNameSize );
+qboolean SV_OpenDemoFile( client_t *cl, const char *name );
+void SV_WriteDemoRecord( client_t *cl, int sequence, const byte *data, int len );
+void SV_CloseDemoFile( client_t *cl );
+void SV_DemoFrame( void );
+void SV_ShutdownDemoWriter( void );
+void SV_DemoStats_f( void );
+
 //
 // sv_snapshot.c
 //
@@ -372,6 +390,8 @@ void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_ShutdownSnapshots( void );
+void SV_SnapshotCache_f( void );
 
 //
 // sv_game.c
@@ -442,6 +462,7 @@ int SV_PointContents( const vec3_t p, int passEntityNum );
 
 
 void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule, int traceFlags, int useLod );
+void SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int numRequests );
 // mins and maxs are relative
 
 // if the entire move stays in a solid volume, trace.allsolid will be set,
@@ -462,3 +483,41 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 void SV_Netchan_Transmit( client_t *client, msg_t *msg);	//int length, const byte *data );
 void SV_Netchan_TransmitNextFragment( netchan_t *chan );
 qboolean SV_Netchan_Process( client_t *client, msg_t *msg );
+
+//
+// sv_profile.cpp
+//
+extern std::atomic<bool> svProfileActive;
+
+int64_t SV_ProfileTime( void );
+void SV_ProfileRecord( const char *name, int64_t start, int64_t end );
+void SV_ProfileBegin( const char *name );
+void SV_ProfileEnd( void );
+void SV_Profile_f( void );
+
+static inline bool SV_ProfileActive( void ) {
+	return svProfileActive.load( std::memory_order_relaxed );
+}
+
+// times the rest of the enclosing block while "sv_profile start" is in effect
+class svProfileZone_t {
+public:
+	explicit svProfileZone_t( const char *zoneName ) :
+		name( SV_ProfileActive() ? zoneName : NULL ),
+		start( name ? SV_ProfileTime() : 0 ) {
+	}
+	~svProfileZone_t() {
+		if ( name ) {
+			SV_ProfileRecord( name, start, SV_ProfileTime() );
+		}
+	}
+
+private:
+	svProfileZone_t( const svProfileZone_t & );
+	svProfileZone_t &operator=( const svProfileZone_t & );
+
+	const char	*name;
+	int64_t		start;
+};
+
+#define SV_PROFILE_ZONE( zoneName )	svProfileZone_t profileZone( zoneName )
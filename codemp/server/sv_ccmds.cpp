@@ -1525,34 +1525,17 @@ static void SV_KillServer_f( void ) {
 }
 
 void SV_WriteDemoMessage ( client_t *cl, msg_t *msg, int headerBytes ) {
-	int		len, swlen;
-
-	// write the packet sequence
-	len = cl->netchan.outgoingSequence;
-	swlen = LittleLong( len );
-	FS_Write( &swlen, 4, cl->demo.demofile );
-
-	// skip the packet sequencing information
-	len = msg->cursize - headerBytes;
-	swlen = LittleLong( len );
-	FS_Write( &swlen, 4, cl->demo.demofile );
-	FS_Write( msg->data + headerBytes, len, cl->demo.demofile );
+	// write the packet sequence, skipping the packet sequencing information
+	SV_WriteDemoRecord( cl, cl->netchan.outgoingSequence, msg->data + headerBytes, msg->cursize - headerBytes );
 }
 
 void SV_StopRecordDemo( client_t *cl ) {
-	int		len;
-
 	if ( !cl->demo.demorecording ) {
 		Com_Printf( "Client %d is not recording a demo.\n", cl - svs.clients );
 		return;
 	}
 
-	// finish up
-	len = -1;
-	FS_Write (&len, 4, cl->demo.demofile);
-	FS_Write (&len, 4, cl->demo.demofile);
-	FS_FCloseFile (cl->demo.demofile);
-	cl->demo.demofile = 0;
+	SV_CloseDemoFile( cl );
 	cl->demo.demorecording = qfalse;
 	Com_Printf ("Stopped demo for client %d.\n", cl - svs.clients);
 }
@@ -1623,7 +1606,6 @@ void SV_RecordDemo( client_t *cl, char *demoName ) {
 	char		name[MAX_OSPATH];
 	byte		bufData[MAX_MSGLEN];
 	msg_t		msg;
-	int			len;
 
 	if ( cl->demo.demorecording ) {
 		Com_Printf( "Already recording.\n" );
@@ -1638,9 +1620,7 @@ void SV_RecordDemo( client_t *cl, char *demoName ) {
 	// open the demo file
 	Q_strncpyz( cl->demo.demoName, demoName, sizeof( cl->demo.demoName ) );
 	Com_sprintf( name, sizeof( name ), "demos/%s.dm_%d", cl->demo.demoName, PROTOCOL_VERSION );
-	Com_Printf( "recording to %s.\n", name );
-	cl->demo.demofile = FS_FOpenFileWrite( name );
-	if ( !cl->demo.demofile ) {
+	if ( !SV_OpenDemoFile( cl, name ) ) {
 		Com_Printf ("ERROR: couldn't open.\n");
 		return;
 	}
@@ -1664,12 +1644,7 @@ void SV_RecordDemo( client_t *cl, char *demoName ) {
 	MSG_WriteByte( &msg, svc_EOF );
 
 	// write it to the demo file
-	len = LittleLong( cl->netchan.outgoingSequence - 1 );
-	FS_Write( &len, 4, cl->demo.demofile );
-
-	len = LittleLong( msg.cursize );
-	FS_Write( &len, 4, cl->demo.demofile );
-	FS_Write( msg.data, msg.cursize, cl->demo.demofile );
+	SV_WriteDemoRecord( cl, cl->netchan.outgoingSequence - 1, msg.data, msg.cursize );
 
 	// the rest of the demo file will be copied from net messages
 }
@@ -1830,6 +1805,7 @@ void SV_BeginAutoRecordDemos() {
 static void SV_Record_f( void ) {
 	char		demoName[MAX_OSPATH];
 	char		name[MAX_OSPATH];
+	char		fileName[MAX_OSPATH];
 	int			i;
 	char		*s;
 	client_t	*cl;
@@ -1896,8 +1872,9 @@ static void SV_Record_f( void ) {
 		SV_DemoFilename( demoName, sizeof( demoName ) );
 
 		Com_sprintf (name, sizeof(name), "demos/%s.dm_%d", demoName, PROTOCOL_VERSION );
+		SV_DemoFileName( name, fileName, sizeof( fileName ) );
 
-		if ( FS_FileExists( name ) ) {
+		if ( FS_FileExists( fileName ) ) {
 			Com_Printf( "Record: Couldn't create a file\n");
 			return;
  		}
@@ -1942,7 +1919,8 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("systeminfo", SV_Systeminfo_f, "Prints the systeminfo variables that are replicated to clients" );
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f, "Prints the userinfo for a given userid" );
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f, "Restart the current map" );
-	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("sectorlist", SV_SectorList_f, "Prints entity links and area query statistics, \"reset\" clears the statistics" );
+	Cmd_AddCommand ("snapshotcache", SV_SnapshotCache_f, "Prints snapshot entity cache statistics, \"reset\" clears them" );
 	Cmd_AddCommand ("map", SV_Map_f, "Load a new map with cheats disabled" );
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 	Cmd_AddCommand ("devmap", SV_Map_f, "Load a new map with cheats enabled" );
@@ -1959,6 +1937,7 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("weapontoggle", SV_WeaponToggle_f, "Toggle g_weaponDisable bits" );
 	Cmd_AddCommand ("svrecord", SV_Record_f, "Record a server-side demo" );
 	Cmd_AddCommand ("svstoprecord", SV_StopRecord_f, "Stop recording a server-side demo" );
+	Cmd_AddCommand ("svdemostats", SV_DemoStats_f, "Prints server-side demo writer statistics, \"reset\" clears them" );
 	Cmd_AddCommand ("sv_rehashbans", SV_RehashBans_f, "Reloads banlist from file" );
 	Cmd_AddCommand ("sv_listbans", SV_ListBans_f, "Lists bans" );
 	Cmd_AddCommand ("sv_banaddr", SV_BanAddr_f, "Bans a user" );
@@ -1966,6 +1945,7 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("sv_bandel", SV_BanDel_f, "Removes a ban" );
 	Cmd_AddCommand ("sv_exceptdel", SV_ExceptDel_f, "Removes a ban exception" );
 	Cmd_AddCommand ("sv_flushbans", SV_FlushBans_f, "Removes all bans and exceptions" );
+	Cmd_AddCommand ("sv_profile", SV_Profile_f, "Records server frame timings, \"dump\" writes them as a Chrome trace" );
 }
 
 /*
@@ -1483,6 +1483,8 @@ void SV_ExecuteClientMessage( client_t *cl, msg_t *msg ) {
 	int			c;
 	int			serverId;
 
+	SV_PROFILE_ZONE( "SV_ExecuteClientMessage" );
+
 	MSG_Bitstream(msg);
 
 	serverId = MSG_ReadLong( msg );
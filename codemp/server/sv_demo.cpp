@@ -0,0 +1,585 @@
+/*
+===========================================================================
+Copyright (C) 2013 - 2015, OpenJK contributors
+
+This file is part of the OpenJK source code.
+
+OpenJK is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+
+#include "server.h"
+
+#ifdef USE_INTERNAL_ZLIB
+#include "zlib/zlib.h"
+#else
+#include <zlib.h>
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+=============================================================================
+
+Server demo writer
+
+Every client that records a server-side demo gets a demo stream.  With
+sv_demoBufferSize set, SV_WriteDemoRecord only copies each record into
+the stream's ring buffer, and a writer thread turns whatever has been
+queued into a few large FS_Write calls, so a slow disk no longer stalls
+the server frame.  A stream whose buffer is full makes the main thread
+wait for the writer, and "svdemostats" counts those stalls along with
+the flushes.  With sv_demoCompress set, the file is written as gzip,
+which unpacks to exactly the demo that would have been written
+uncompressed.  Opening and closing files isn't thread safe, so a stream
+that has been closed is finished by the writer and its file is closed
+on the main thread afterwards.  The writer doesn't print either: a failed
+write is flagged on its stream and reported when the file is closed.
+
+=============================================================================
+*/
+
+#define	DEMO_FLUSH_BYTES		0x8000		// wake the writer once this much is queued
+#define	DEMO_FLUSH_MSEC			500			// and write everything out at least this often
+#define	DEMO_MAX_CLOSING		8			// streams left draining before new demos wait for them
+#define	DEMO_DEFLATE_BUFFER		0x10000
+
+typedef struct demoStats_s {
+	int64_t		bytesIn;		// demo bytes recorded
+	int64_t		bytesOut;		// bytes written to the file, fewer if compressed
+	int			flushes;
+	int64_t		flushUsec;
+	int			maxFlushUsec;
+	int			stalls;			// records that had to wait for buffer space
+	int64_t		stallUsec;
+} demoStats_t;
+
+typedef struct svDemoStream_s {
+	struct svDemoStream_s	*next;
+	fileHandle_t			file;
+	int						client;
+	char					name[MAX_OSPATH];
+
+	z_stream				*deflate;		// NULL if not compressed
+	byte					*deflateBuffer;
+
+	byte					*buffer;		// ring buffer, NULL if written synchronously
+	int						size;
+	int64_t					head;			// bytes queued so far
+	int64_t					tail;			// bytes taken by the writer so far
+	int						peak;			// most bytes queued at once
+	std::chrono::steady_clock::time_point	lastFlush;
+	bool					waiting;		// the main thread is stalled on this stream
+	bool					closing;		// nothing more will be queued
+	bool					done;			// all written, the file can be closed
+	bool					failed;			// a write came up short, set by whoever writes
+
+	demoStats_t				stats;
+} svDemoStream_t;
+
+static svDemoStream_t			*svDemoStreams;		// only the main thread links and unlinks these
+static demoStats_t				svDemoTotals;		// of the streams already closed
+
+static std::thread				svDemoWriter;
+static std::mutex				svDemoMutex;
+static std::condition_variable	svDemoWake;			// data queued, a stream closed, or quit
+static std::condition_variable	svDemoSpace;		// data written, or a stream done
+static bool						svDemoQuit;
+
+/*
+===============
+SV_DemoUsec
+===============
+*/
+static int SV_DemoUsec( std::chrono::steady_clock::time_point start ) {
+	return (int)std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+}
+
+/*
+===============
+SV_AddDemoStats
+===============
+*/
+static void SV_AddDemoStats( demoStats_t *to, const demoStats_t *from ) {
+	to->bytesIn += from->bytesIn;
+	to->bytesOut += from->bytesOut;
+	to->flushes += from->flushes;
+	to->flushUsec += from->flushUsec;
+	to->maxFlushUsec = Q_max( to->maxFlushUsec, from->maxFlushUsec );
+	to->stalls += from->stalls;
+	to->stallUsec += from->stallUsec;
+}
+
+/*
+===============
+SV_DemoOutput
+
+Writes demo bytes to the file, through deflate if the stream is
+compressed.  Returns the number of bytes that went to the file.
+===============
+*/
+static int SV_DemoOutput( svDemoStream_t *stream, const byte *data, int len, int flush ) {
+	z_stream	*z = stream->deflate;
+	int			written = 0;
+
+	if ( !z ) {
+		written = FS_Write( data, len, stream->file );
+		if ( written < len ) {
+			stream->failed = true;
+		}
+		return written;
+	}
+
+	z->next_in = (Bytef *)data;
+	z->avail_in = len;
+	do {
+		z->next_out = stream->deflateBuffer;
+		z->avail_out = DEMO_DEFLATE_BUFFER;
+		deflate( z, flush );
+
+		const int out = DEMO_DEFLATE_BUFFER - z->avail_out;
+		if ( out ) {
+			const int outWritten = FS_Write( stream->deflateBuffer, out, stream->file );
+			if ( outWritten < out ) {
+				stream->failed = true;
+			}
+			written += outWritten;
+		}
+	} while ( z->avail_out == 0 );
+
+	return written;
+}
+
+/*
+===============
+SV_FlushDemoStream
+
+Writes out everything queued on a stream.  Called by the writer with
+the lock held, which is released while writing; the main thread only
+ever adds data past the head, so the queued part stays put.
+===============
+*/
+static void SV_FlushDemoStream( svDemoStream_t *stream, std::unique_lock<std::mutex> &lock ) {
+	const int64_t	start = stream->tail;
+	const int64_t	end = stream->head;
+	const bool		finish = stream->closing;
+	int				written = 0;
+
+	const std::chrono::steady_clock::time_point flushStart = std::chrono::steady_clock::now();
+
+	lock.unlock();
+	for ( int64_t pos = start ; pos < end ; ) {
+		const int	offset = (int)( pos % stream->size );
+		const int	len = (int)Q_min( end - pos, (int64_t)( stream->size - offset ) );
+
+		pos += len;
+		written += SV_DemoOutput( stream, stream->buffer + offset, len, pos == end ? Z_SYNC_FLUSH : Z_NO_FLUSH );
+	}
+	if ( finish && stream->deflate ) {
+		written += SV_DemoOutput( stream, NULL, 0, Z_FINISH );
+	}
+	const int usec = SV_DemoUsec( flushStart );
+	lock.lock();
+
+	stream->tail = end;
+	stream->lastFlush = std::chrono::steady_clock::now();
+	stream->stats.bytesOut += written;
+	stream->stats.flushes++;
+	stream->stats.flushUsec += usec;
+	stream->stats.maxFlushUsec = Q_max( stream->stats.maxFlushUsec, usec );
+	if ( finish ) {
+		stream->done = true;
+	}
+	svDemoSpace.notify_all();
+}
+
+/*
+===============
+SV_DemoWriterThread
+===============
+*/
+static void SV_DemoWriterThread( void ) {
+	std::unique_lock<std::mutex> lock( svDemoMutex );
+
+	while ( !svDemoQuit ) {
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		svDemoStream_t *flush = NULL;
+
+		for ( svDemoStream_t *stream = svDemoStreams ; stream ; stream = stream->next ) {
+			const int64_t queued = stream->head - stream->tail;
+
+			if ( !stream->buffer || stream->done ) {
+				continue;
+			}
+			if ( stream->closing || ( queued && ( stream->waiting || queued >= DEMO_FLUSH_BYTES
+				|| now - stream->lastFlush >= std::chrono::milliseconds( DEMO_FLUSH_MSEC ) ) ) ) {
+				flush = stream;
+				break;
+			}
+		}
+
+		if ( flush ) {
+			SV_FlushDemoStream( flush, lock );
+		} else {
+			svDemoWake.wait_for( lock, std::chrono::milliseconds( DEMO_FLUSH_MSEC ) );
+		}
+	}
+}
+
+/*
+===============
+SV_FreeDemoStream
+===============
+*/
+static void SV_FreeDemoStream( svDemoStream_t *stream ) {
+	if ( stream->deflate ) {
+		deflateEnd( stream->deflate );
+		delete stream->deflate;
+		delete[] stream->deflateBuffer;
+	}
+	delete[] stream->buffer;
+	delete stream;
+}
+
+/*
+===============
+SV_FinishDemoStreams
+
+Closes the files of the streams the writer is done with, first waiting
+until no more than maxClosing are still being written out
+===============
+*/
+static void SV_FinishDemoStreams( int maxClosing ) {
+	std::unique_lock<std::mutex> lock( svDemoMutex );
+
+	for ( ;; ) {
+		svDemoStream_t	**link = &svDemoStreams;
+		int				closing = 0;
+
+		while ( *link ) {
+			svDemoStream_t *stream = *link;
+
+			if ( !stream->done ) {
+				closing += stream->closing;
+				link = &stream->next;
+				continue;
+			}
+
+			*link = stream->next;
+			SV_AddDemoStats( &svDemoTotals, &stream->stats );
+			if ( stream->failed ) {
+				Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write all of %s\n", stream->name );
+			}
+			FS_FCloseFile( stream->file );
+			SV_FreeDemoStream( stream );
+		}
+
+		if ( closing <= maxClosing ) {
+			return;
+		}
+		svDemoWake.notify_one();
+		svDemoSpace.wait( lock );
+	}
+}
+
+/*
+===============
+SV_DemoFileName
+
+The name a demo is written to, with .gz added if it will be compressed
+===============
+*/
+void SV_DemoFileName( const char *name, char *fileName, int fileNameSize ) {
+	Q_strncpyz( fileName, name, fileNameSize );
+	if ( sv_demoCompress->integer ) {
+		Q_strcat( fileName, fileNameSize, ".gz" );
+	}
+}
+
+/*
+===============
+SV_OpenDemoFile
+
+Opens the demo file for a client and sets up its stream
+===============
+*/
+qboolean SV_OpenDemoFile( client_t *cl, const char *name ) {
+	svDemoStream_t	*stream;
+	char			fileName[MAX_OSPATH];
+	fileHandle_t	file;
+	const int		level = sv_demoCompress->integer;
+
+	// a map change stops and starts every demo at once, don't let the old ones pile up
+	SV_FinishDemoStreams( DEMO_MAX_CLOSING );
+
+	SV_DemoFileName( name, fileName, sizeof( fileName ) );
+	Com_Printf( "recording to %s.\n", fileName );
+
+	file = FS_FOpenFileWrite( fileName );
+	if ( !file ) {
+		return qfalse;
+	}
+
+	stream = new svDemoStream_t();
+	stream->file = file;
+	stream->client = cl - svs.clients;
+	Q_strncpyz( stream->name, fileName, sizeof( stream->name ) );
+	stream->lastFlush = std::chrono::steady_clock::now();
+
+	if ( level ) {
+		stream->deflate = new z_stream();
+		stream->deflateBuffer = new byte[DEMO_DEFLATE_BUFFER];
+
+		// 16 more window bits for a gzip header and trailer
+		if ( deflateInit2( stream->deflate, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) {
+			delete stream->deflate;
+			delete[] stream->deflateBuffer;
+			stream->deflate = NULL;
+			stream->deflateBuffer = NULL;
+			Com_Printf( S_COLOR_YELLOW "WARNING: couldn't start compressing %s\n", fileName );
+		}
+	}
+
+	if ( sv_demoBufferSize->integer > 0 ) {
+		// a whole record of the largest message always fits
+		stream->size = Q_max( sv_demoBufferSize->integer * 1024, 2 * ( MAX_MSGLEN + 8 ) );
+		stream->buffer = new byte[stream->size];
+
+		if ( !svDemoWriter.joinable() ) {
+			svDemoQuit = false;
+			svDemoWriter = std::thread( SV_DemoWriterThread );
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( svDemoMutex );
+		stream->next = svDemoStreams;
+		svDemoStreams = stream;
+	}
+
+	cl->demo.stream = stream;
+	return qtrue;
+}
+
+/*
+===============
+SV_QueueDemoData
+
+Copies data into a stream's ring buffer, waiting for the writer if it
+doesn't fit
+===============
+*/
+static void SV_QueueDemoData( svDemoStream_t *stream, const void *data, int len, std::unique_lock<std::mutex> &lock ) {
+	const int64_t	pos = stream->head;
+	const int		offset = (int)( pos % stream->size );
+	const int		first = Q_min( len, stream->size - offset );
+
+	if ( !len ) {
+		return;
+	}
+
+	if ( stream->size - ( stream->head - stream->tail ) < len ) {
+		const std::chrono::steady_clock::time_point stallStart = std::chrono::steady_clock::now();
+
+		stream->waiting = true;
+		svDemoWake.notify_one();
+		svDemoSpace.wait( lock, [stream, len] { return stream->size - ( stream->head - stream->tail ) >= len; } );
+		stream->waiting = false;
+
+		stream->stats.stalls++;
+		stream->stats.stallUsec += SV_DemoUsec( stallStart );
+	}
+
+	Com_Memcpy( stream->buffer + offset, data, first );
+	Com_Memcpy( stream->buffer, (const byte *)data + first, len - first );
+	stream->head += len;
+}
+
+/*
+===============
+SV_WriteDemoRecord
+
+Writes one demo record, the message sequence and length followed by the
+message itself.  A length of -1 with no data marks the end of the demo.
+===============
+*/
+void SV_WriteDemoRecord( client_t *cl, int sequence, const byte *data, int len ) {
+	svDemoStream_t	*stream = cl->demo.stream;
+	int				header[2];
+
+	header[0] = LittleLong( sequence );
+	header[1] = LittleLong( len );
+	len = Q_max( len, 0 );
+
+	if ( !stream->buffer ) {
+		const std::chrono::steady_clock::time_point flushStart = std::chrono::steady_clock::now();
+		int written = SV_DemoOutput( stream, (const byte *)header, sizeof( header ), Z_NO_FLUSH );
+
+		written += SV_DemoOutput( stream, data, len, Z_NO_FLUSH );
+
+		const int usec = SV_DemoUsec( flushStart );
+		std::lock_guard<std::mutex> lock( svDemoMutex );
+		stream->stats.bytesIn += sizeof( header ) + len;
+		stream->stats.bytesOut += written;
+		stream->stats.flushes++;
+		stream->stats.flushUsec += usec;
+		stream->stats.maxFlushUsec = Q_max( stream->stats.maxFlushUsec, usec );
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock( svDemoMutex );
+	const int64_t queuedBefore = stream->head - stream->tail;
+
+	SV_QueueDemoData( stream, header, sizeof( header ), lock );
+	SV_QueueDemoData( stream, data, len, lock );
+	stream->stats.bytesIn += sizeof( header ) + len;
+
+	const int64_t queued = stream->head - stream->tail;
+	stream->peak = Q_max( stream->peak, (int)queued );
+	if ( queuedBefore < DEMO_FLUSH_BYTES && queued >= DEMO_FLUSH_BYTES ) {
+		svDemoWake.notify_one();
+	}
+}
+
+/*
+===============
+SV_CloseDemoFile
+
+Ends a client's demo.  Buffered streams are handed to the writer to
+finish, the rest are closed right away.
+===============
+*/
+void SV_CloseDemoFile( client_t *cl ) {
+	svDemoStream_t *stream = cl->demo.stream;
+
+	// finish up
+	SV_WriteDemoRecord( cl, -1, NULL, -1 );
+	cl->demo.stream = NULL;
+
+	if ( !stream->buffer ) {
+		if ( stream->deflate ) {
+			const int written = SV_DemoOutput( stream, NULL, 0, Z_FINISH );
+
+			std::lock_guard<std::mutex> lock( svDemoMutex );
+			stream->stats.bytesOut += written;
+		}
+
+		std::lock_guard<std::mutex> lock( svDemoMutex );
+		stream->closing = true;
+		stream->done = true;
+	} else {
+		std::lock_guard<std::mutex> lock( svDemoMutex );
+		stream->closing = true;
+		svDemoWake.notify_one();
+	}
+
+	SV_FinishDemoStreams( MAX_CLIENTS );
+}
+
+/*
+===============
+SV_DemoFrame
+
+Closes the files of the demos the writer has finished
+===============
+*/
+void SV_DemoFrame( void ) {
+	if ( svDemoStreams ) {
+		SV_FinishDemoStreams( MAX_CLIENTS );
+	}
+}
+
+/*
+===============
+SV_ShutdownDemoWriter
+
+Ends every demo still recording and waits for all of them to be written
+===============
+*/
+void SV_ShutdownDemoWriter( void ) {
+	if ( svs.clients ) {
+		for ( client_t *client = svs.clients ; client - svs.clients < sv_maxclients->integer ; client++ ) {
+			if ( client->demo.demorecording ) {
+				SV_StopRecordDemo( client );
+			}
+		}
+	}
+
+	SV_FinishDemoStreams( 0 );
+
+	if ( svDemoWriter.joinable() ) {
+		{
+			std::lock_guard<std::mutex> lock( svDemoMutex );
+			svDemoQuit = true;
+		}
+		svDemoWake.notify_one();
+		svDemoWriter.join();
+	}
+}
+
+/*
+===============
+SV_PrintDemoStats
+===============
+*/
+static void SV_PrintDemoStats( const char *label, const demoStats_t *stats, int64_t queued, int peak ) {
+	Com_Printf( "%-6s %8lld %8d %10lld %10lld %7d %7.2f %7.2f %6d %8.1f\n",
+		label,
+		(long long)( queued / 1024 ), peak / 1024,
+		(long long)( stats->bytesIn / 1024 ), (long long)( stats->bytesOut / 1024 ),
+		stats->flushes,
+		stats->flushes ? stats->flushUsec / 1000.0 / stats->flushes : 0.0,
+		stats->maxFlushUsec / 1000.0,
+		stats->stalls, stats->stallUsec / 1000.0 );
+}
+
+/*
+===============
+SV_DemoStats_f
+===============
+*/
+void SV_DemoStats_f( void ) {
+	std::lock_guard<std::mutex> lock( svDemoMutex );
+	demoStats_t		total = svDemoTotals;
+	int64_t			totalQueued = 0;
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( &svDemoTotals, 0, sizeof( svDemoTotals ) );
+		for ( svDemoStream_t *stream = svDemoStreams ; stream ; stream = stream->next ) {
+			Com_Memset( &stream->stats, 0, sizeof( stream->stats ) );
+			stream->peak = 0;
+		}
+		Com_Printf( "Demo writer statistics reset\n" );
+		return;
+	}
+
+	if ( sv_demoBufferSize->integer > 0 ) {
+		Com_Printf( "Demos are buffered, %i KB per client", sv_demoBufferSize->integer );
+	} else {
+		Com_Printf( "Demos are written synchronously" );
+	}
+	Com_Printf( ", compression %s\n", sv_demoCompress->integer ? va( "level %i", sv_demoCompress->integer ) : "off" );
+
+	Com_Printf( "client queuedKB   peakKB  recordedKB  writtenKB flushes  avg ms  max ms stalls stall ms\n" );
+	for ( svDemoStream_t *stream = svDemoStreams ; stream ; stream = stream->next ) {
+		const int64_t queued = stream->head - stream->tail;
+
+		SV_PrintDemoStats( stream->closing ? "closed" : va( "%i", stream->client ), &stream->stats, queued, stream->peak );
+		SV_AddDemoStats( &total, &stream->stats );
+		totalQueued += queued;
+	}
+	SV_PrintDemoStats( "total", &total, totalQueued, 0 );
+}
@@ -108,6 +108,8 @@ void GVM_ClientCommand( int clientNum ) {
 }
 
 void GVM_ClientThink( int clientNum, usercmd_t *ucmd ) {
+	SV_PROFILE_ZONE( "ClientThink" );
+
 	if ( gvm->isLegacy ) {
 		VM_Call( gvm, GAME_CLIENT_THINK, clientNum, reinterpret_cast< intptr_t >( ucmd ) );
 		return;
@@ -118,6 +120,8 @@ void GVM_ClientThink( int clientNum, usercmd_t *ucmd ) {
 }
 
 void GVM_RunFrame( int levelTime ) {
+	SV_PROFILE_ZONE( "GVM_RunFrame" );
+
 	if ( gvm->isLegacy ) {
 		VM_Call( gvm, GAME_RUN_FRAME, levelTime );
 		return;
@@ -2858,6 +2862,18 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		SV_BotCalculatePaths(args[1]);
 		return 0;
 
+	case G_TRACEBATCH:
+		SV_TraceBatch( (trace_t *)VMA(1), (const traceRequest_t *)VMA(2), args[3] );
+		return 0;
+
+	case G_PROFILE_BEGIN:
+		SV_ProfileBegin( (const char *)VMA(1) );
+		return 0;
+
+	case G_PROFILE_END:
+		SV_ProfileEnd();
+		return 0;
+
 	case G_GET_ENTITY_TOKEN:
 		return SV_GetEntityToken((char *)VMA(1), args[2]);
 
@@ -3199,6 +3215,10 @@ void SV_BindGame( void ) {
 		gi.G2API_OverrideServer					= SV_G2API_OverrideServer;
 		gi.G2API_GetSurfaceName					= SV_G2API_GetSurfaceName;
 
+		gi.TraceBatch							= SV_TraceBatch;
+		gi.ProfileBegin							= SV_ProfileBegin;
+		gi.ProfileEnd							= SV_ProfileEnd;
+
 		GetGameAPI = (GetGameAPI_t)gvm->GetModuleAPI;
 		ret = GetGameAPI( GAME_API_VERSION, &gi );
 		if ( !ret ) {
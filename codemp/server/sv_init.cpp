@@ -864,6 +864,7 @@ static void SV_InitRef( void ) {
 	ri.FS_FreeFileList = FS_FreeFileList;
 	ri.FS_Read = FS_Read;
 	ri.FS_ReadFile = FS_ReadFile;
+	ri.FS_ReadFileMapped = FS_ReadFileMapped;
 	ri.FS_FCloseFile = FS_FCloseFile;
 	ri.FS_FOpenFileRead = FS_FOpenFileRead;
 	ri.FS_FOpenFileWrite = FS_FOpenFileWrite;
@@ -873,6 +874,8 @@ static void SV_InitRef( void ) {
 	ri.FS_ListFiles = FS_ListFiles;
 	ri.FS_Write = FS_Write;
 	ri.FS_WriteFile = FS_WriteFile;
+	ri.FS_LoadedPakChecksums = FS_LoadedPakChecksums;
+	ri.FS_FileOrigin = FS_FileOrigin;
 	ri.CM_BoxTrace = CM_BoxTrace;
 	ri.CM_DrawDebugSurface = CM_DrawDebugSurface;
 //	ri.CM_CullWorldBox = CM_CullWorldBox;
@@ -994,11 +997,20 @@ void SV_Init (void) {
 	sv_autoDemo = Cvar_Get( "sv_autoDemo", "0", CVAR_ARCHIVE | CVAR_SERVERINFO, "Automatically take server-side demos" );
 	sv_autoDemoBots = Cvar_Get( "sv_autoDemoBots", "0", CVAR_ARCHIVE, "Record server-side demos for bots" );
 	sv_autoDemoMaxMaps = Cvar_Get( "sv_autoDemoMaxMaps", "0", CVAR_ARCHIVE );
+	sv_demoBufferSize = Cvar_Get( "sv_demoBufferSize", "256", CVAR_ARCHIVE, "KB of server-side demo data each client can queue for a background writer thread, 0 writes demos on the main thread" );
+	sv_demoCompress = Cvar_Get( "sv_demoCompress", "0", CVAR_ARCHIVE, "Write server-side demos gzip compressed at this level, 0 for uncompressed" );
+	Cvar_CheckRange( sv_demoCompress, 0, 9, qtrue );
 
 	sv_legacyFixForceSelect = Cvar_Get( "sv_legacyFixForceSelect", "1", CVAR_ARCHIVE );
 
 	sv_banFile = Cvar_Get( "sv_banFile", "serverbans.dat", CVAR_ARCHIVE, "File to use to store bans and exceptions" );
 
+	sv_snapshotThreads = Cvar_Get( "sv_snapshotThreads", "0", CVAR_ARCHIVE, "Number of worker threads that build and encode client snapshots, 0 builds them on the main thread" );
+	Cvar_CheckRange( sv_snapshotThreads, 0, MAX_CLIENTS, qtrue );
+	sv_snapshotIndex = Cvar_Get( "sv_snapshotIndex", "1", CVAR_ARCHIVE, "Index entities by PVS cluster once per frame instead of testing every entity for every client" );
+	sv_snapshotCache = Cvar_Get( "sv_snapshotCache", "1", CVAR_ARCHIVE, "Encode each entity delta once per frame and share it between clients" );
+	sv_areaTree = Cvar_Get( "sv_areaTree", "0", CVAR_ARCHIVE, "Keep entities in a dynamic bounding box tree instead of the uniform world sectors, takes effect on the next map load" );
+
 	// initialize bot cvars so they are listed and can be set before loading the botlib
 	SV_BotInitCvars();
 
@@ -1072,6 +1084,8 @@ void SV_Shutdown( char *finalmsg )
 	SV_RemoveOperatorCommands();
 	SV_MasterShutdown();
 	SV_ChallengeShutdown();
+	SV_ShutdownDemoWriter();
+	SV_ShutdownSnapshots();
 	SV_ShutdownGameProgs();
 	svs.gameStarted = qfalse;
 /*
@@ -62,8 +62,14 @@ cvar_t	*sv_filterCommands; // strict filtering on commands (replace: \r \n ;)
 cvar_t	*sv_autoDemo;
 cvar_t	*sv_autoDemoBots;
 cvar_t	*sv_autoDemoMaxMaps;
+cvar_t	*sv_demoBufferSize;		// KB of demo data each client can queue for the writer thread
+cvar_t	*sv_demoCompress;		// gzip level for server-side demos
 cvar_t	*sv_legacyFixForceSelect;
 cvar_t	*sv_banFile;
+cvar_t	*sv_snapshotThreads;	// worker threads used to build and encode snapshots
+cvar_t	*sv_snapshotIndex;		// bucket entities by PVS cluster before building snapshots
+cvar_t	*sv_snapshotCache;		// share entity delta encodings between clients
+cvar_t	*sv_areaTree;			// dynamic bounding box tree instead of the uniform world sectors
 
 serverBan_t serverBans[SERVER_MAXBANS];
 int serverBansCount = 0;
@@ -785,6 +791,8 @@ void SV_PacketEvent( netadr_t from, msg_t *msg ) {
 	client_t	*cl;
 	int			qport;
 
+	SV_PROFILE_ZONE( "SV_PacketEvent" );
+
 	// check for connectionless packet (0xffffffff) first
 	if ( msg->cursize >= 4 && *(int *)msg->data == -1) {
 		SV_ConnectionlessPacket( from, msg );
@@ -1064,6 +1072,8 @@ void SV_Frame( int msec ) {
 	int		frameMsec;
 	int		startTime;
 
+	SV_PROFILE_ZONE( "SV_Frame" );
+
 	// the menu kills the server with this cvar
 	if ( sv_killserver->integer ) {
 		SV_Shutdown ("Server was killed.\n");
@@ -1163,6 +1173,9 @@ void SV_Frame( int msec ) {
 	// send messages back to the clients
 	SV_SendClientMessages();
 
+	// close the demos the writer has finished
+	SV_DemoFrame();
+
 	SV_CheckCvars();
 
 	// send a heartbeat to the master if needed
@@ -152,6 +152,8 @@ SV_Netchan_Transmit
 
 void SV_Netchan_Transmit( client_t *client, msg_t *msg) {	//int length, const byte *data ) {
 //	int i;
+	SV_PROFILE_ZONE( "SV_Netchan_Transmit" );
+
 	MSG_WriteByte( msg, svc_EOF );
 //	for(i=SV_ENCODE_START;i<msg->cursize;i++) {
 //		chksum[i-SV_ENCODE_START] = msg->data[i];
@@ -169,6 +171,8 @@ Netchan_SV_Process
 qboolean SV_Netchan_Process( client_t *client, msg_t *msg ) {
 	int ret;
 //	int i;
+	SV_PROFILE_ZONE( "SV_Netchan_Process" );
+
 	ret = Netchan_Process( &client->netchan, msg );
 	if (!ret)
 		return qfalse;
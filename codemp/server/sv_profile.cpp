@@ -0,0 +1,325 @@
+/*
+===========================================================================
+Copyright (C) 2013 - 2015, OpenJK contributors
+
+This file is part of the OpenJK source code.
+
+OpenJK is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+
+#include "server.h"
+
+#include <chrono>
+
+/*
+=============================================================================
+
+Server frame profiler
+
+While "sv_profile start" is in effect, every SV_PROFILE_ZONE and every
+zone the game module opens with trap->ProfileBegin records its start and
+duration into a ring buffer.  Writers claim slots with a single atomic
+increment, so the snapshot workers can record alongside the main thread,
+and once the buffer wraps the oldest events are overwritten.
+"sv_profile dump" writes whatever is in the buffer as Chrome trace-event
+JSON, which chrome://tracing and similar viewers load directly.
+
+=============================================================================
+*/
+
+#define	PROFILE_MAX_EVENTS		(1<<16)		// must be a power of two
+#define	PROFILE_MAX_DEPTH		32			// game zones open at once
+#define	PROFILE_NAME_POOL		4096		// copies of the names the game module uses
+#define	PROFILE_NAME_HASH		2048		// must be a power of two, and hold every name the pool can
+
+typedef struct profileEvent_s {
+	std::atomic<unsigned>	sequence;	// index + 1 once written, 0 while being written
+	const char				*name;
+	int64_t					start;		// usec since the profile started
+	int						duration;	// usec
+	int						thread;
+} profileEvent_t;
+
+typedef struct profileGameZone_s {
+	const char	*name;		// NULL if the profiler wasn't running when it opened
+	int64_t		start;
+} profileGameZone_t;
+
+std::atomic<bool>				svProfileActive{ false };
+
+static profileEvent_t			svProfileEvents[PROFILE_MAX_EVENTS];
+static std::atomic<unsigned>	svProfileNext{ 0 };
+static std::atomic<int>			svProfileThreads{ 0 };
+static std::chrono::steady_clock::time_point	svProfileEpoch;
+
+static profileGameZone_t		svProfileGameZones[PROFILE_MAX_DEPTH];
+static int						svProfileGameDepth;
+
+static char						svProfileNamePool[PROFILE_NAME_POOL];
+static int						svProfileNamePoolUsed;
+static const char				*svProfileNameHash[PROFILE_NAME_HASH];
+
+/*
+===============
+SV_ProfileTime
+===============
+*/
+int64_t SV_ProfileTime( void ) {
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - svProfileEpoch ).count();
+}
+
+/*
+===============
+SV_ProfileThread
+
+Small per-thread ids for the trace viewer's tracks
+===============
+*/
+static int SV_ProfileThread( void ) {
+	static thread_local int thread = -1;
+
+	if ( thread < 0 ) {
+		thread = svProfileThreads++;
+	}
+	return thread;
+}
+
+/*
+===============
+SV_ProfileRecord
+===============
+*/
+void SV_ProfileRecord( const char *name, int64_t start, int64_t end ) {
+	const unsigned	index = svProfileNext++;
+	profileEvent_t	*event = &svProfileEvents[index & ( PROFILE_MAX_EVENTS - 1 )];
+
+	event->sequence.store( 0, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	event->name = name;
+	event->start = start;
+	event->duration = (int)( end - start );
+	event->thread = SV_ProfileThread();
+	event->sequence.store( index + 1, std::memory_order_release );
+}
+
+/*
+===============
+SV_ProfileNameHash
+===============
+*/
+static unsigned SV_ProfileNameHash( const char *name ) {
+	unsigned	hash = 0;
+	int			i;
+
+	for ( i = 0 ; name[i] ; i++ ) {
+		hash = hash * 31 + (unsigned char)name[i];
+	}
+	return hash ^ ( hash >> 11 );
+}
+
+/*
+===============
+SV_ProfileGameName
+
+The game module's strings go away with it, so keep copies of them,
+found again through a hash table as every zone the game opens looks
+its name up
+===============
+*/
+static const char *SV_ProfileGameName( const char *name ) {
+	const char	**slot;
+	char		*s;
+	unsigned	hash;
+	int			i, len;
+
+	hash = SV_ProfileNameHash( name );
+	for ( i = 0 ; i < PROFILE_NAME_HASH ; i++ ) {
+		slot = &svProfileNameHash[( hash + i ) & ( PROFILE_NAME_HASH - 1 )];
+		if ( !*slot ) {
+			break;
+		}
+		if ( !strcmp( *slot, name ) ) {
+			return *slot;
+		}
+	}
+	if ( i == PROFILE_NAME_HASH ) {
+		return "game";
+	}
+
+	len = strlen( name ) + 1;
+	if ( svProfileNamePoolUsed + len > PROFILE_NAME_POOL ) {
+		return "game";
+	}
+	s = svProfileNamePool + svProfileNamePoolUsed;
+	Q_strncpyz( s, name, len );
+	svProfileNamePoolUsed += len;
+	*slot = s;
+	return s;
+}
+
+/*
+===============
+SV_ProfileBegin
+
+Opens a zone for the game module, which can't use SV_PROFILE_ZONE
+===============
+*/
+void SV_ProfileBegin( const char *name ) {
+	profileGameZone_t *zone;
+
+	if ( svProfileGameDepth++ >= PROFILE_MAX_DEPTH ) {
+		return;
+	}
+
+	zone = &svProfileGameZones[svProfileGameDepth - 1];
+	if ( !SV_ProfileActive() || !name ) {
+		zone->name = NULL;
+		return;
+	}
+	zone->name = SV_ProfileGameName( name );
+	zone->start = SV_ProfileTime();
+}
+
+/*
+===============
+SV_ProfileEnd
+===============
+*/
+void SV_ProfileEnd( void ) {
+	profileGameZone_t *zone;
+
+	if ( svProfileGameDepth <= 0 ) {
+		return;
+	}
+	if ( svProfileGameDepth-- > PROFILE_MAX_DEPTH ) {
+		return;
+	}
+
+	zone = &svProfileGameZones[svProfileGameDepth];
+	if ( zone->name && SV_ProfileActive() ) {
+		SV_ProfileRecord( zone->name, zone->start, SV_ProfileTime() );
+	}
+}
+
+/*
+===============
+SV_ProfileEscapeName
+
+Names from the game module can hold anything, so escape them for a JSON
+string, with bytes outside of ASCII read as Latin-1
+===============
+*/
+static void SV_ProfileEscapeName( const char *name, char *buf, int size ) {
+	int		len = 0;
+
+	for ( ; *name && len < size - 7 ; name++ ) {
+		const unsigned char c = *name;
+
+		if ( c == '"' || c == '\\' ) {
+			buf[len++] = '\\';
+			buf[len++] = c;
+		} else if ( c < 0x20 || c >= 0x7f ) {
+			len += Com_sprintf( buf + len, size - len, "\\u%04x", c );
+		} else {
+			buf[len++] = c;
+		}
+	}
+	buf[len] = '\0';
+}
+
+/*
+===============
+SV_ProfileDump
+===============
+*/
+static void SV_ProfileDump( const char *filename ) {
+	const unsigned	total = svProfileNext;
+	const unsigned	count = Q_min( total, (unsigned)PROFILE_MAX_EVENTS );
+	char			path[MAX_QPATH];
+	fileHandle_t	f;
+	unsigned		i;
+	int				written = 0;
+	char			escaped[MAX_STRING_CHARS];
+
+	Com_sprintf( path, sizeof( path ), "profiles/%s", filename );
+	COM_DefaultExtension( path, sizeof( path ), ".json" );
+
+	f = FS_FOpenFileWrite( path );
+	if ( !f ) {
+		Com_Printf( "Couldn't open %s for writing\n", path );
+		return;
+	}
+
+	FS_Printf( f, "{\"traceEvents\":[\n" );
+	for ( i = total - count ; i != total ; i++ ) {
+		profileEvent_t	*event = &svProfileEvents[i & ( PROFILE_MAX_EVENTS - 1 )];
+		const char		*name;
+		int64_t			start;
+		int				duration, thread;
+
+		if ( event->sequence.load( std::memory_order_acquire ) != i + 1 ) {
+			continue;	// still being written, or already written over
+		}
+		name = event->name;
+		start = event->start;
+		duration = event->duration;
+		thread = event->thread;
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if ( event->sequence.load( std::memory_order_relaxed ) != i + 1 ) {
+			continue;
+		}
+
+		SV_ProfileEscapeName( name, escaped, sizeof( escaped ) );
+		FS_Printf( f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%i,\"pid\":1,\"tid\":%i}\n",
+			written ? "," : "", escaped, (long long)start, duration, thread );
+		written++;
+	}
+	FS_Printf( f, "],\"displayTimeUnit\":\"ms\"}\n" );
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %i profile events to %s\n", written, path );
+}
+
+/*
+===============
+SV_Profile_f
+===============
+*/
+void SV_Profile_f( void ) {
+	const char		*cmd = Cmd_Argv( 1 );
+	const unsigned	total = svProfileNext;
+
+	if ( !Q_stricmp( cmd, "start" ) ) {
+		svProfileActive = false;
+		svProfileNext = 0;
+		svProfileEpoch = std::chrono::steady_clock::now();
+		for ( int i = 0 ; i < PROFILE_MAX_EVENTS ; i++ ) {
+			svProfileEvents[i].sequence.store( 0, std::memory_order_relaxed );
+		}
+		svProfileActive = true;
+		Com_Printf( "Server profiling started\n" );
+	} else if ( !Q_stricmp( cmd, "stop" ) ) {
+		svProfileActive = false;
+		Com_Printf( "Server profiling stopped\n" );
+	} else if ( !Q_stricmp( cmd, "dump" ) ) {
+		SV_ProfileDump( Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : "sv_profile" );
+	} else {
+		Com_Printf( "usage: sv_profile <start|stop|dump [filename]>\n" );
+		Com_Printf( "profiling is %s, %u events recorded", SV_ProfileActive() ? "running" : "stopped", total );
+		if ( total > PROFILE_MAX_EVENTS ) {
+			Com_Printf( ", the oldest %u written over", total - PROFILE_MAX_EVENTS );
+		}
+		Com_Printf( "\n" );
+	}
+}
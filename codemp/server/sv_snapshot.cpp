@@ -23,6 +23,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "server.h"
 #include "qcommon/cm_public.h"
+#include "qcommon/jobs.h"
 
 /*
 =============================================================================
@@ -46,14 +47,232 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Entity delta cache
+
+Most entities in a frame get delta compressed against the same baseline or
+the same previous state for every client that sees them. While
+SV_SendClientMessages runs, every delta that actually writes something is
+encoded once into a separate bitstream and later clients get those bits
+spliced into their message. Since the delta depends on nothing but the two
+states and the force flag, the result is the same as encoding it again.
+
+=============================================================================
+*/
+
+#define	SNAPSHOT_CACHE_ENTRIES	2048
+#define	SNAPSHOT_CACHE_BYTES	0x40000
+#define	SNAPSHOT_CACHE_LOCKS	64			// must be a power of two
+#define	MAX_DELTA_ENTITY_BYTES	4096		// longer deltas are never cached
+
+typedef struct snapshotCacheEntry_s {
+	entityState_t	from;
+	entityState_t	to;
+	qboolean		force;
+	int				bits;
+	int				offset;					// into snapshotCache_t::data
+	int				next;					// next entry for the same entity number, -1 ends
+} snapshotCacheEntry_t;
+
+typedef struct snapshotCache_s {
+	qboolean				valid;
+	int						head[MAX_GENTITIES];
+	std::atomic<int>		numEntries;
+	snapshotCacheEntry_t	entries[SNAPSHOT_CACHE_ENTRIES];
+	std::atomic<int>		dataUsed;
+	byte					data[SNAPSHOT_CACHE_BYTES];
+
+	// statistics since the last reset, shown by the snapshotcache command
+	std::atomic<uint64_t>	hits;
+	std::atomic<uint64_t>	misses;
+	std::atomic<uint64_t>	uncached;		// out of space, too long or too close to overflowing the message
+	std::atomic<uint64_t>	bitsSpliced;
+	int						frames;
+	uint64_t				entriesUsed;	// summed over frames
+	uint64_t				bytesUsed;		// summed over frames
+} snapshotCache_t;
+
+static snapshotCache_t	svSnapshotCache;
+static std::mutex		svSnapshotCacheLocks[SNAPSHOT_CACHE_LOCKS];
+
+/*
+===============
+SV_BeginSnapshotCache
+===============
+*/
+static void SV_BeginSnapshotCache( void ) {
+	snapshotCache_t	*cache = &svSnapshotCache;
+
+	cache->valid = (qboolean)( sv_snapshotCache->integer != 0 );
+	if ( !cache->valid ) {
+		return;
+	}
+	memset( cache->head, -1, sizeof( cache->head ) );
+	cache->numEntries = 0;
+	cache->dataUsed = 0;
+}
+
+/*
+===============
+SV_EndSnapshotCache
+===============
+*/
+static void SV_EndSnapshotCache( void ) {
+	snapshotCache_t	*cache = &svSnapshotCache;
+
+	if ( !cache->valid ) {
+		return;
+	}
+	cache->valid = qfalse;
+	cache->frames++;
+	cache->entriesUsed += Q_min( cache->numEntries.load(), SNAPSHOT_CACHE_ENTRIES );
+	cache->bytesUsed += Q_min( cache->dataUsed.load(), SNAPSHOT_CACHE_BYTES );
+}
+
+/*
+===============
+SV_FindCachedDelta
+
+Returns the cached encoding of the delta, adding it if it wasn't there yet.
+Returns NULL if the delta can't be cached.
+Must be called with the lock for to->number held.
+===============
+*/
+static const snapshotCacheEntry_t *SV_FindCachedDelta( entityState_t *from, entityState_t *to, qboolean force ) {
+	snapshotCache_t			*cache = &svSnapshotCache;
+	snapshotCacheEntry_t	*entry;
+	msg_t					scratch;
+	byte					scratchData[MAX_DELTA_ENTITY_BYTES];
+	int						index, offset, numBytes;
+
+	for ( index = cache->head[to->number] ; index != -1 ; index = entry->next ) {
+		entry = &cache->entries[index];
+		if ( entry->force == force
+			&& !memcmp( &entry->from, from, sizeof( *from ) )
+			&& !memcmp( &entry->to, to, sizeof( *to ) ) )
+		{
+			cache->hits++;
+			return entry;
+		}
+	}
+	cache->misses++;
+
+	MSG_Init( &scratch, scratchData, sizeof( scratchData ) );
+	MSG_WriteDeltaEntity( &scratch, from, to, force );
+	if ( scratch.overflowed ) {
+		return NULL;
+	}
+
+	index = cache->numEntries++;
+	if ( index >= SNAPSHOT_CACHE_ENTRIES ) {
+		return NULL;
+	}
+	numBytes = ( scratch.bit + 7 ) >> 3;
+	offset = cache->dataUsed.fetch_add( numBytes );
+	if ( offset + numBytes > SNAPSHOT_CACHE_BYTES ) {
+		return NULL;
+	}
+	Com_Memcpy( cache->data + offset, scratchData, numBytes );
+
+	entry = &cache->entries[index];
+	entry->from = *from;
+	entry->to = *to;
+	entry->force = force;
+	entry->bits = scratch.bit;
+	entry->offset = offset;
+	entry->next = cache->head[to->number];
+	cache->head[to->number] = index;
+
+	return entry;
+}
+
+/*
+===============
+SV_WriteDeltaEntity
+
+MSG_WriteDeltaEntity through the delta cache
+===============
+*/
+static void SV_WriteDeltaEntity( msg_t *msg, entityState_t *from, entityState_t *to, qboolean force ) {
+	snapshotCache_t				*cache = &svSnapshotCache;
+	const snapshotCacheEntry_t	*entry;
+
+	if ( !cache->valid || !from || !to || to->number < 0 || to->number >= MAX_GENTITIES ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	// unchanged entities don't write anything unless forced, don't bother looking them up
+	if ( !force && !memcmp( from, to, sizeof( *to ) ) ) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( svSnapshotCacheLocks[to->number & (SNAPSHOT_CACHE_LOCKS-1)] );
+		entry = SV_FindCachedDelta( from, to, force );
+	}
+
+	// writing it directly keeps the overflow behaviour exactly as it was
+	if ( !entry || msg->maxsize - ( ( ( msg->bit + entry->bits ) >> 3 ) + 1 ) < 4 ) {
+		cache->uncached++;
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	MSG_WriteBitstream( msg, cache->data + entry->offset, entry->bits );
+	cache->bitsSpliced += entry->bits;
+}
+
+/*
+===============
+SV_SnapshotCache_f
+===============
+*/
+void SV_SnapshotCache_f( void ) {
+	snapshotCache_t	*cache = &svSnapshotCache;
+	uint64_t		hits, misses, lookups;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		cache->hits = 0;
+		cache->misses = 0;
+		cache->uncached = 0;
+		cache->bitsSpliced = 0;
+		cache->frames = 0;
+		cache->entriesUsed = 0;
+		cache->bytesUsed = 0;
+		Com_Printf( "Snapshot cache statistics reset\n" );
+		return;
+	}
+
+	hits = cache->hits;
+	misses = cache->misses;
+	lookups = hits + misses;
+
+	Com_Printf( "Snapshot entity cache (%s):\n", sv_snapshotCache->integer ? "enabled" : "disabled" );
+	Com_Printf( "%llu lookups, %llu hits, %llu misses, %.1f%% hit rate\n",
+		(unsigned long long)lookups, (unsigned long long)hits, (unsigned long long)misses,
+		lookups ? 100.0 * hits / lookups : 0.0 );
+	Com_Printf( "%llu deltas written without the cache\n", (unsigned long long)cache->uncached.load() );
+	Com_Printf( "%llu bytes spliced from the cache\n", (unsigned long long)( cache->bitsSpliced.load() >> 3 ) );
+	if ( cache->frames ) {
+		Com_Printf( "%llu of %i entries and %llu of %i bytes used per frame on average\n",
+			(unsigned long long)( cache->entriesUsed / cache->frames ), SNAPSHOT_CACHE_ENTRIES,
+			(unsigned long long)( cache->bytesUsed / cache->frames ), SNAPSHOT_CACHE_BYTES );
+	}
+}
+
 /*
 =============
 SV_EmitPacketEntities
 
 Writes a delta update of an entityState_t list to the message.
+If newEntities is set, the states of the new frame are read from it
+instead of from svs.snapshotEntities.
 =============
 */
-static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to, msg_t *msg ) {
+static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to, entityState_t *newEntities, msg_t *msg ) {
 	entityState_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		oldnum, newnum;
@@ -74,7 +293,11 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 		if ( newindex >= to->num_entities ) {
 			newnum = 9999;
 		} else {
-			newent = &svs.snapshotEntities[(to->first_entity+newindex) % svs.numSnapshotEntities];
+			if ( newEntities ) {
+				newent = &newEntities[newindex];
+			} else {
+				newent = &svs.snapshotEntities[(to->first_entity+newindex) % svs.numSnapshotEntities];
+			}
 			newnum = newent->number;
 		}
 
@@ -89,7 +312,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			SV_WriteDeltaEntity (msg, oldent, newent, qfalse );
 			oldindex++;
 			newindex++;
 			continue;
@@ -97,7 +320,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 		if ( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			SV_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
 			newindex++;
 			continue;
 		}
@@ -115,18 +338,39 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 
 
+/*
+==================
+snapshotReport_t
+
+What a snapshot built on a worker would have printed or raised, for the
+main thread to pass on once the workers are done.  Functions taking a
+report print and raise directly when they are given NULL.
+==================
+*/
+typedef struct snapshotReport_s {
+	qboolean	outOfDatePacket;
+	qboolean	outOfDateEntities;
+	const char	*error;			// raised with ERR_DROP
+} snapshotReport_t;
+
 /*
 ==================
 SV_WriteSnapshotToClient
+
+nextSnapshotEntities is the value svs.nextSnapshotEntities had right after
+this snapshot's entities were stored, which decides whether the entities of
+the frame we delta from have rolled off the buffer.
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
+static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg, entityState_t *newEntities, int nextSnapshotEntities, snapshotReport_t *report ) {
 	clientSnapshot_t	*frame, *oldframe;
 	int					lastframe;
 	int					i;
 	int					snapFlags;
 	int					deltaMessage;
 
+	SV_PROFILE_ZONE( "SV_WriteSnapshotToClient" );
+
 	// this is the snapshot we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
@@ -145,7 +389,11 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	} else if ( client->netchan.outgoingSequence - deltaMessage
 		>= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
-		Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
+		if ( report ) {
+			report->outOfDatePacket = qtrue;
+		} else {
+			Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
+		}
 		oldframe = NULL;
 		lastframe = 0;
 	} else if ( client->demo.demorecording && client->demo.demowaiting ) {
@@ -164,8 +412,12 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 		lastframe = client->netchan.outgoingSequence - deltaMessage;
 
 		// the snapshot's entities may still have rolled off the buffer, though
-		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
-			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
+		if ( oldframe->first_entity <= nextSnapshotEntities - svs.numSnapshotEntities ) {
+			if ( report ) {
+				report->outOfDateEntities = qtrue;
+			} else {
+				Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
+			}
 			oldframe = NULL;
 			lastframe = 0;
 		}
@@ -261,7 +513,7 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	}
 
 	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	SV_EmitPacketEntities (oldframe, frame, newEntities, msg);
 
 	// padding for rate debugging
 	if ( sv_padPackets->integer ) {
@@ -309,6 +561,7 @@ Build a client snapshot structure
 typedef struct snapshotEntityNumbers_s {
 	int		numSnapshotEntities;
 	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];
+	byte	added[MAX_GENTITIES/8];		// used to prevent double adding from portal views
 } snapshotEntityNumbers_t;
 
 /*
@@ -322,15 +575,14 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 	ea = (int *)a;
 	eb = (int *)b;
 
-	if ( *ea == *eb ) {
-		Com_Error( ERR_DROP, "SV_QsortEntityStates: duplicated entity" );
-	}
-
 	if ( *ea < *eb ) {
 		return -1;
 	}
+	if ( *ea > *eb ) {
+		return 1;
+	}
 
-	return 1;
+	return 0;
 }
 
 
@@ -339,197 +591,441 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddEntToSnapshot( int num, snapshotEntityNumbers_t *eNums ) {
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	if ( eNums->added[num >> 3] & (1 << (num & 7)) ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[num >> 3] |= 1 << (num & 7);
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
 		return;
 	}
 
-	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = gEnt->s.number;
+	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = num;
 	eNums->numSnapshotEntities++;
 }
 
 /*
 ===============
-SV_AddEntitiesVisibleFromPoint
+SV_FixEntityNumbers
+
+Makes sure every entity that can be sent has its own slot number in
+s.number before any snapshot is gathered, so the snapshot workers never
+have to write to the entities
 ===============
 */
-float g_svCullDist = -1.0f;
-static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame,
-									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
-	sharedEntity_t *ent;
-	svEntity_t	*svEnt;
-	int		l;
-	int		clientarea, clientcluster;
-	int		leafnum;
-	byte	*clientpvs;
-	byte	*bitvector;
-	vec3_t	difference;
-	float	length, radius;
-
-	// during an error shutdown message we may need to transmit
-	// the shutdown message after the server has shutdown, so
-	// specfically check for it
-	if ( !sv.state ) {
-		return;
-	}
-
-	leafnum = CM_PointLeafnum (origin);
-	clientarea = CM_LeafArea (leafnum);
-	clientcluster = CM_LeafCluster (leafnum);
-
-	// calculate the visible areas
-	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
-
-	clientpvs = CM_ClusterPVS (clientcluster);
+static void SV_FixEntityNumbers( void ) {
+	sharedEntity_t	*ent;
+	int				e;
 
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
 		ent = SV_GentityNum(e);
-
-		// never send entities that aren't linked in
-		if ( !ent->r.linked ) {
-			continue;
-		}
-
-		if (ent->s.eFlags & EF_PERMANENT)
-		{	// he's permanent, so don't send him down!
+		if ( !ent->r.linked || (ent->s.eFlags & EF_PERMANENT) ) {
 			continue;
 		}
-
 		if (ent->s.number != e) {
 			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
 			ent->s.number = e;
 		}
+	}
+}
 
-		// entities can be flagged to explicitly not be sent to the client
-		if ( ent->r.svFlags & SVF_NOCLIENT ) {
-			continue;
-		}
+/*
+=============================================================================
 
-		// entities can be flagged to be sent to only one client
-		if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
-			if ( ent->r.singleClient != frame->ps.clientNum ) {
-				continue;
-			}
+Entity visibility index
+
+Rebuilt at the start of SV_SendClientMessages.  Entities that can only reach
+a client through the PVS are bucketed by the clusters they touch, so a
+viewpoint only visits the buckets of the clusters set in its PVS.  Entities
+that may be sent regardless of the PVS (broadcasts, portal entities,
+per-client broadcasts, and entities touching too many clusters to list) are
+kept on a list that every viewpoint checks.
+
+The index only narrows down the candidates: each one still goes through the
+full test in SV_AddEntityIfVisible, in entity number order, so the result is
+exactly what testing every entity would give.
+
+=============================================================================
+*/
+
+typedef struct snapshotIndex_s {
+	qboolean	valid;
+	int			numClusters;
+	int			*clusterStart;		// [numClusters+1] offsets into clusterEntities
+	int			clusterEntities[MAX_GENTITIES*MAX_ENT_CLUSTERS];
+	int			numAlwaysChecked;
+	int			alwaysChecked[MAX_GENTITIES];
+} snapshotIndex_t;
+
+static snapshotIndex_t	svSnapshotIndex;
+
+/*
+===============
+SV_FreeSnapshotIndex
+===============
+*/
+static void SV_FreeSnapshotIndex( void ) {
+	if ( svSnapshotIndex.clusterStart ) {
+		Z_Free( svSnapshotIndex.clusterStart );
+		svSnapshotIndex.clusterStart = NULL;
+	}
+	svSnapshotIndex.numClusters = 0;
+	svSnapshotIndex.valid = qfalse;
+}
+
+/*
+===============
+SV_IsIndexedEntity
+
+Returns qfalse for entities that are never sent to anyone
+===============
+*/
+static qboolean SV_IsIndexedEntity( sharedEntity_t *ent ) {
+	if ( !ent->r.linked ) {
+		return qfalse;
+	}
+	if ( ent->s.eFlags & EF_PERMANENT ) {
+		return qfalse;
+	}
+	if ( ent->r.svFlags & SVF_NOCLIENT ) {
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+===============
+SV_IsAlwaysCheckedEntity
+
+Returns qtrue if the entity can be visible without touching a cluster in the PVS
+===============
+*/
+static qboolean SV_IsAlwaysCheckedEntity( sharedEntity_t *ent, svEntity_t *svEnt, int numClusters ) {
+	int		i;
+
+	if ( ent->r.svFlags & SVF_BROADCAST ) {
+		return qtrue;
+	}
+	if ( ent->s.isPortalEnt ) {
+		return qtrue;
+	}
+	for ( i = 0 ; i < (int)ARRAY_LEN( ent->r.broadcastClients ) ; i++ ) {
+		if ( ent->r.broadcastClients[i] ) {
+			return qtrue;
 		}
-		// entities can be flagged to be sent to everyone but one client
-		if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
-			if ( ent->r.singleClient == frame->ps.clientNum ) {
-				continue;
-			}
+	}
+	if ( svEnt->lastCluster ) {
+		return qtrue;
+	}
+	for ( i = 0 ; i < svEnt->numClusters ; i++ ) {
+		if ( svEnt->clusternums[i] < 0 || svEnt->clusternums[i] >= numClusters ) {
+			return qtrue;
 		}
+	}
+	return qfalse;
+}
 
-		svEnt = SV_SvEntityForGentity( ent );
+/*
+===============
+SV_BuildSnapshotIndex
+===============
+*/
+static void SV_BuildSnapshotIndex( void ) {
+	snapshotIndex_t	*index = &svSnapshotIndex;
+	sharedEntity_t	*ent;
+	svEntity_t		*svEnt;
+	int				e, i, c;
+	int				numClusters, total;
 
-		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
-			continue;
-		}
+	SV_PROFILE_ZONE( "SV_BuildSnapshotIndex" );
 
-		// entities can request not to be sent to certain clients (NOTE: always send to ourselves)
-		if ( e != frame->ps.clientNum && (ent->r.svFlags & SVF_BROADCASTCLIENTS)
-			&& !(ent->r.broadcastClients[frame->ps.clientNum/32] & (1 << (frame->ps.clientNum % 32))) )
-		{
+	index->valid = qfalse;
+	if ( !sv.state || !sv_snapshotIndex->integer ) {
+		return;
+	}
+
+	numClusters = CM_NumClusters();
+	if ( numClusters <= 0 ) {
+		return;
+	}
+	if ( numClusters != index->numClusters ) {
+		SV_FreeSnapshotIndex();
+		index->clusterStart = (int *)Z_Malloc( (numClusters + 1) * sizeof( int ), TAG_GENERAL, qfalse );
+		index->numClusters = numClusters;
+	}
+	Com_Memset( index->clusterStart, 0, (numClusters + 1) * sizeof( int ) );
+	index->numAlwaysChecked = 0;
+
+	// count the bucket sizes and pick out the entities every viewpoint has to check
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum(e);
+		if ( !SV_IsIndexedEntity( ent ) ) {
 			continue;
 		}
-		// broadcast entities are always sent, and so is the main player so we don't see noclip weirdness
-		if ( (ent->r.svFlags & SVF_BROADCAST) || e == frame->ps.clientNum
-			|| (ent->r.broadcastClients[frame->ps.clientNum/32] & (1 << (frame->ps.clientNum % 32))) )
-		{
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+		svEnt = SV_SvEntityForGentity( ent );
+		if ( SV_IsAlwaysCheckedEntity( ent, svEnt, numClusters ) ) {
+			index->alwaysChecked[index->numAlwaysChecked++] = e;
 			continue;
 		}
+		for ( i = 0 ; i < svEnt->numClusters ; i++ ) {
+			index->clusterStart[svEnt->clusternums[i] + 1]++;
+		}
+	}
+
+	// turn the counts into bucket ends
+	for ( c = 0 ; c < numClusters ; c++ ) {
+		index->clusterStart[c + 1] += index->clusterStart[c];
+	}
 
-		if (ent->s.isPortalEnt)
-		{ //rww - portal entities are always sent as well
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+	// fill the buckets back to front, which leaves clusterStart[c+1] at the start of bucket c
+	total = index->clusterStart[numClusters];
+	for ( e = sv.num_entities - 1 ; e >= 0 ; e-- ) {
+		ent = SV_GentityNum(e);
+		if ( !SV_IsIndexedEntity( ent ) ) {
+			continue;
+		}
+		svEnt = SV_SvEntityForGentity( ent );
+		if ( SV_IsAlwaysCheckedEntity( ent, svEnt, numClusters ) ) {
 			continue;
 		}
+		for ( i = 0 ; i < svEnt->numClusters ; i++ ) {
+			index->clusterEntities[--index->clusterStart[svEnt->clusternums[i] + 1]] = e;
+		}
+	}
+	// shift the bucket starts back into place
+	for ( c = 0 ; c < numClusters ; c++ ) {
+		index->clusterStart[c] = index->clusterStart[c + 1];
+	}
+	index->clusterStart[numClusters] = total;
 
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
-			}
+	index->valid = qtrue;
+}
+
+float g_svCullDist = -1.0f;
+static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame,
+									snapshotEntityNumbers_t *eNums, qboolean portal );
+
+/*
+===============
+SV_AddEntityIfVisible
+===============
+*/
+static void SV_AddEntityIfVisible( int e, vec3_t origin, int clientarea, byte *clientpvs,
+									clientSnapshot_t *frame, snapshotEntityNumbers_t *eNums ) {
+	int		i;
+	sharedEntity_t *ent;
+	svEntity_t	*svEnt;
+	int		l;
+	byte	*bitvector;
+	vec3_t	difference;
+	float	length, radius;
+
+	ent = SV_GentityNum(e);
+
+	// never send entities that aren't linked in
+	if ( !ent->r.linked ) {
+		return;
+	}
+
+	if (ent->s.eFlags & EF_PERMANENT)
+	{	// he's permanent, so don't send him down!
+		return;
+	}
+
+	// s.number was checked by SV_FixEntityNumbers
+
+	// entities can be flagged to explicitly not be sent to the client
+	if ( ent->r.svFlags & SVF_NOCLIENT ) {
+		return;
+	}
+
+	// entities can be flagged to be sent to only one client
+	if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
+		if ( ent->r.singleClient != frame->ps.clientNum ) {
+			return;
+		}
+	}
+	// entities can be flagged to be sent to everyone but one client
+	if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
+		if ( ent->r.singleClient == frame->ps.clientNum ) {
+			return;
 		}
+	}
 
-		bitvector = clientpvs;
+	svEnt = &sv.svEntities[e];
 
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
-			continue;
+	// don't double add an entity through portals
+	if ( eNums->added[e >> 3] & (1 << (e & 7)) ) {
+		return;
+	}
+
+	// entities can request not to be sent to certain clients (NOTE: always send to ourselves)
+	if ( e != frame->ps.clientNum && (ent->r.svFlags & SVF_BROADCASTCLIENTS)
+		&& !(ent->r.broadcastClients[frame->ps.clientNum/32] & (1 << (frame->ps.clientNum % 32))) )
+	{
+		return;
+	}
+	// broadcast entities are always sent, and so is the main player so we don't see noclip weirdness
+	if ( (ent->r.svFlags & SVF_BROADCAST) || e == frame->ps.clientNum
+		|| (ent->r.broadcastClients[frame->ps.clientNum/32] & (1 << (frame->ps.clientNum % 32))) )
+	{
+		SV_AddEntToSnapshot( e, eNums );
+		return;
+	}
+
+	if (ent->s.isPortalEnt)
+	{ //rww - portal entities are always sent as well
+		SV_AddEntToSnapshot( e, eNums );
+		return;
+	}
+
+	// ignore if not touching a PV leaf
+	// check area
+	if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+			return;		// blocked by a door
 		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
+	}
+
+	bitvector = clientpvs;
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			break;
 		}
+	}
 
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( i == svEnt->numClusters ) {
+		if ( svEnt->lastCluster ) {
+			for ( ; l <= svEnt->lastCluster ; l++ ) {
+				if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+					break;
 				}
-			} else {
-				continue;
 			}
+			if ( l == svEnt->lastCluster ) {
+				return;	// not visible
+			}
+		} else {
+			return;
+		}
+	}
+
+	if (g_svCullDist != -1.0f)
+	{ //do a distance cull check
+		VectorAdd(ent->r.absmax, ent->r.absmin, difference);
+		VectorScale(difference, 0.5f, difference);
+		VectorSubtract(origin, difference, difference);
+		length = VectorLength(difference);
+
+		// calculate the diameter
+		VectorSubtract(ent->r.absmax, ent->r.absmin, difference);
+		radius = VectorLength(difference);
+		if (length-radius >= g_svCullDist)
+		{ //then don't add it
+			return;
 		}
+	}
 
-		if (g_svCullDist != -1.0f)
-		{ //do a distance cull check
-			VectorAdd(ent->r.absmax, ent->r.absmin, difference);
-			VectorScale(difference, 0.5f, difference);
-			VectorSubtract(origin, difference, difference);
-			length = VectorLength(difference);
+	// add it
+	SV_AddEntToSnapshot( e, eNums );
 
-			// calculate the diameter
-			VectorSubtract(ent->r.absmax, ent->r.absmin, difference);
-			radius = VectorLength(difference);
-			if (length-radius >= g_svCullDist)
-			{ //then don't add it
-				continue;
+	// if its a portal entity, add everything visible from its camera position
+	if ( ent->r.svFlags & SVF_PORTAL ) {
+		if ( ent->s.generic1 ) {
+			vec3_t dir;
+			VectorSubtract(ent->s.origin, origin, dir);
+			if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
+				return;
 			}
 		}
+		SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
+	}
+}
 
-		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
+/*
+===============
+SV_AddEntitiesVisibleFromPoint
+===============
+*/
+static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame,
+									snapshotEntityNumbers_t *eNums, qboolean portal ) {
+	int		e, i, c;
+	int		clientarea, clientcluster;
+	int		leafnum;
+	byte	*clientpvs;
+	const snapshotIndex_t *index = &svSnapshotIndex;
+	uint32_t	candidates[MAX_GENTITIES/32];
 
-		// if its a portal entity, add everything visible from its camera position
-		if ( ent->r.svFlags & SVF_PORTAL ) {
-			if ( ent->s.generic1 ) {
-				vec3_t dir;
-				VectorSubtract(ent->s.origin, origin, dir);
-				if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
-					continue;
-				}
+	// during an error shutdown message we may need to transmit
+	// the shutdown message after the server has shutdown, so
+	// specfically check for it
+	if ( !sv.state ) {
+		return;
+	}
+
+	leafnum = CM_PointLeafnum (origin);
+	clientarea = CM_LeafArea (leafnum);
+	clientcluster = CM_LeafCluster (leafnum);
+
+	// calculate the visible areas
+	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
+
+	clientpvs = CM_ClusterPVS (clientcluster);
+
+	if ( !index->valid ) {
+		for ( e = 0 ; e < sv.num_entities ; e++ ) {
+			SV_AddEntityIfVisible( e, origin, clientarea, clientpvs, frame, eNums );
+		}
+		return;
+	}
+
+	// gather the candidates from the index
+	Com_Memset( candidates, 0, sizeof( candidates ) );
+	for ( i = 0 ; i < index->numAlwaysChecked ; i++ ) {
+		e = index->alwaysChecked[i];
+		candidates[e >> 5] |= 1u << (e & 31);
+	}
+	for ( c = 0 ; c < index->numClusters ; c++ ) {
+		if ( !clientpvs[c >> 3] ) {
+			c |= 7;		// skip the whole byte
+			continue;
+		}
+		if ( !(clientpvs[c >> 3] & (1 << (c & 7))) ) {
+			continue;
+		}
+		for ( i = index->clusterStart[c] ; i < index->clusterStart[c + 1] ; i++ ) {
+			e = index->clusterEntities[i];
+			candidates[e >> 5] |= 1u << (e & 31);
+		}
+	}
+
+	// and test them in entity order
+	for ( i = 0 ; i < MAX_GENTITIES/32 ; i++ ) {
+		uint32_t bits = candidates[i];
+		for ( e = i << 5 ; bits ; e++, bits >>= 1 ) {
+			if ( bits & 1 ) {
+				SV_AddEntityIfVisible( e, origin, clientarea, clientpvs, frame, eNums );
 			}
-			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
 		}
 	}
 }
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_GatherClientSnapshot
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstate and areabits.
@@ -538,34 +1034,33 @@ This properly handles multiple recursive portals, but the render
 currently doesn't.
 
 For viewing through other player's eyes, client can be something other than client->gentity
+
+Only touches the client's own frame, so snapshots for several clients
+can be gathered at the same time.  Returns qfalse if the client gets an
+empty snapshot, in which case no entities should be stored for it.
+Errors go to the report when there is one.
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
+static qboolean SV_GatherClientSnapshot( client_t *client, snapshotEntityNumbers_t *entityNumbers, snapshotReport_t *report ) {
 	vec3_t						org;
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	playerState_t				*ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	entityNumbers->numSnapshotEntities = 0;
+	Com_Memset( entityNumbers->added, 0, sizeof( entityNumbers->added ) );
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
 	frame->num_entities = 0;
 
 	clent = client->gentity;
 	if ( !clent || client->state == CS_ZOMBIE ) {
-		return;
+		return qfalse;
 	}
 
 	// grab the current playerState_t
@@ -597,10 +1092,13 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// be regenerated from the playerstate
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		if ( !report ) {
+			Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		}
+		report->error = "SV_SvEntityForGentity: bad gEnt";
+		return qfalse;
 	}
-	svEnt = &sv.svEntities[ clientNum ];
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	entityNumbers->added[clientNum >> 3] |= 1 << (clientNum & 7);
 
 
 	// find the client's viewpoint
@@ -609,14 +1107,24 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	SV_AddEntitiesVisibleFromPoint( org, frame, entityNumbers, qfalse );
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
-	// to work correctly.  This also catches the error condition
-	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities,
-		sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	// to work correctly.
+	qsort( entityNumbers->snapshotEntities, entityNumbers->numSnapshotEntities,
+		sizeof( entityNumbers->snapshotEntities[0] ), SV_QsortEntityNumbers );
+
+	// catch the error condition of an entity being included twice
+	for ( i = 1 ; i < entityNumbers->numSnapshotEntities ; i++ ) {
+		if ( entityNumbers->snapshotEntities[i] == entityNumbers->snapshotEntities[i - 1] ) {
+			if ( !report ) {
+				Com_Error( ERR_DROP, "SV_QsortEntityStates: duplicated entity" );
+			}
+			report->error = "SV_QsortEntityStates: duplicated entity";
+			return qfalse;
+		}
+	}
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
@@ -624,19 +1132,63 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
 
-	// copy the entity states out
-	frame->num_entities = 0;
+	return qtrue;
+}
+
+/*
+=============
+SV_ReserveSnapshotEntities
+
+Claims the next range of svs.snapshotEntities for the frame
+=============
+*/
+static void SV_ReserveSnapshotEntities( clientSnapshot_t *frame, int numEntities ) {
+	frame->num_entities = numEntities;
 	frame->first_entity = svs.nextSnapshotEntities;
+	svs.nextSnapshotEntities += numEntities;
+	// this should never hit, map should always be restarted first in SV_Frame
+	if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
+		Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
+	}
+}
+
+/*
+=============
+SV_CopySnapshotEntities
+
+Copies the entity states out of the game into a snapshot's storage
+=============
+*/
+static void SV_CopySnapshotEntities( const snapshotEntityNumbers_t *entityNumbers, entityState_t *states ) {
+	int		i;
+
+	for ( i = 0 ; i < entityNumbers->numSnapshotEntities ; i++ ) {
+		states[i] = SV_GentityNum(entityNumbers->snapshotEntities[i])->s;
+	}
+}
+
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot( client_t *client ) {
+	snapshotEntityNumbers_t		entityNumbers;
+	clientSnapshot_t			*frame;
+	int							i;
+
+	SV_PROFILE_ZONE( "SV_BuildClientSnapshot" );
+
+	if ( !SV_GatherClientSnapshot( client, &entityNumbers, NULL ) ) {
+		return;
+	}
+
+	// copy the entity states out
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+	SV_ReserveSnapshotEntities( frame, entityNumbers.numSnapshotEntities );
 	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
-		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
-		*state = ent->s;
-		svs.nextSnapshotEntities++;
-		// this should never hit, map should always be restarted first in SV_Frame
-		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
-			Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
-		}
-		frame->num_entities++;
+		svs.snapshotEntities[(frame->first_entity + i) % svs.numSnapshotEntities] =
+			SV_GentityNum(entityNumbers.snapshotEntities[i])->s;
 	}
 }
 
@@ -753,62 +1305,68 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client ) {
 
 /*
 =======================
-SV_SendClientSnapshot
-
-Also called by SV_FinalMessage
+SV_SendClientGamedir
 
+rww - if the client hasn't been sent an svc_setgame yet, make sure there
+is one before the next snapshot
 =======================
 */
 extern cvar_t	*fs_gamedirvar;
-void SV_SendClientSnapshot( client_t *client ) {
+static void SV_SendClientGamedir( client_t *client ) {
 	byte		msg_buf[MAX_MSGLEN];
 	msg_t		msg;
+	int			i = 0;
 
-	if (!client->sentGamedir)
-	{ //rww - if this is the case then make sure there is an svc_setgame sent before this snap
-		int i = 0;
+	if ( client->sentGamedir ) {
+		return;
+	}
 
-		MSG_Init (&msg, msg_buf, sizeof(msg_buf));
+	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
 
-		//have to include this for each message.
-		MSG_WriteLong( &msg, client->lastClientCommand );
+	//have to include this for each message.
+	MSG_WriteLong( &msg, client->lastClientCommand );
 
-		MSG_WriteByte (&msg, svc_setgame);
+	MSG_WriteByte (&msg, svc_setgame);
 
-		const char *gamedir = FS_GetCurrentGameDir(true);
+	const char *gamedir = FS_GetCurrentGameDir(true);
 
-		while (gamedir[i])
-		{
-			MSG_WriteByte(&msg, gamedir[i]);
-			i++;
-		}
-		MSG_WriteByte(&msg, 0);
+	while (gamedir[i])
+	{
+		MSG_WriteByte(&msg, gamedir[i]);
+		i++;
+	}
+	MSG_WriteByte(&msg, 0);
 
-		// MW - my attempt to fix illegible server message errors caused by
-		// packet fragmentation of initial snapshot.
-		//rww - reusing this code here
-		while(client->state&&client->netchan.unsentFragments)
-		{
-			// send additional message fragments if the last message
-			// was too large to send at once
-			Com_Printf ("[ISM]SV_SendClientGameState() [1] for %s, writing out old fragments\n", client->name);
-			SV_Netchan_TransmitNextFragment(&client->netchan);
-		}
+	// MW - my attempt to fix illegible server message errors caused by
+	// packet fragmentation of initial snapshot.
+	//rww - reusing this code here
+	while(client->state&&client->netchan.unsentFragments)
+	{
+		// send additional message fragments if the last message
+		// was too large to send at once
+		Com_Printf ("[ISM]SV_SendClientGameState() [1] for %s, writing out old fragments\n", client->name);
+		SV_Netchan_TransmitNextFragment(&client->netchan);
+	}
 
-		// record information about the message
-		client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSize = msg.cursize;
-		client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSent = svs.time;
-		client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageAcked = -1;
+	// record information about the message
+	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSize = msg.cursize;
+	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageSent = svs.time;
+	client->frames[client->netchan.outgoingSequence & PACKET_MASK].messageAcked = -1;
 
-		// send the datagram
-		SV_Netchan_Transmit( client, &msg );	//msg->cursize, msg->data );
+	// send the datagram
+	SV_Netchan_Transmit( client, &msg );	//msg->cursize, msg->data );
 
-		client->sentGamedir = qtrue;
-	}
+	client->sentGamedir = qtrue;
+}
 
-	// build the snapshot
-	SV_BuildClientSnapshot( client );
+/*
+=======================
+SV_CheckAutoRecordDemo
 
+Returns qfalse if the snapshot only needs to be built, not sent
+=======================
+*/
+static qboolean SV_CheckAutoRecordDemo( client_t *client ) {
 	if ( sv_autoDemo->integer && !client->demo.demorecording ) {
 		if ( client->netchan.remoteAddress.type != NA_BOT || sv_autoDemoBots->integer ) {
 			SV_BeginAutoRecordDemos();
@@ -818,33 +1376,239 @@ void SV_SendClientSnapshot( client_t *client ) {
 	// bots need to have their snapshots built, but
 	// they query them directly without needing to be sent
 	if ( client->netchan.remoteAddress.type == NA_BOT && !client->demo.demorecording ) {
-		return;
+		return qfalse;
 	}
+	return qtrue;
+}
 
-	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
-	msg.allowoverflow = qtrue;
+/*
+=======================
+SV_InitClientSnapshotMessage
 
+MSG_Init loads the netf overrides the first time it runs, so it stays on
+the main thread
+=======================
+*/
+static void SV_InitClientSnapshotMessage( msg_t *msg, byte *msg_buf ) {
+	MSG_Init (msg, msg_buf, MAX_MSGLEN);
+	msg->allowoverflow = qtrue;
+}
+
+/*
+=======================
+SV_WriteClientSnapshotMessage
+
+Everything in a snapshot message that can be encoded without touching
+state shared with other clients.  msg must have been set up with
+SV_InitClientSnapshotMessage.
+=======================
+*/
+static void SV_WriteClientSnapshotMessage( client_t *client, msg_t *msg, entityState_t *newEntities, int nextSnapshotEntities, snapshotReport_t *report ) {
 	// NOTE, MRE: all server->client messages now acknowledge
 	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	MSG_WriteLong( msg, client->lastClientCommand );
 
 	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	SV_UpdateServerCommandsToClient( client, msg );
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+	SV_WriteSnapshotToClient( client, msg, newEntities, nextSnapshotEntities, report );
+}
 
+/*
+=======================
+SV_FinishClientSnapshotMessage
+=======================
+*/
+static void SV_FinishClientSnapshotMessage( client_t *client, msg_t *msg ) {
 	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient( client, &msg );
+	SV_WriteDownloadToClient( client, msg );
 
 	// check for overflow
-	if ( msg.overflowed ) {
+	if ( msg->overflowed ) {
 		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+		MSG_Clear (msg);
+	}
+
+	SV_SendMessageToClient( msg, client );
+}
+
+/*
+=======================
+SV_BuildAndSendClientSnapshot
+
+Expects the entity numbers to have been checked with SV_FixEntityNumbers
+=======================
+*/
+static void SV_BuildAndSendClientSnapshot( client_t *client ) {
+	byte		msg_buf[MAX_MSGLEN];
+	msg_t		msg;
+
+	SV_SendClientGamedir( client );
+
+	// build the snapshot
+	SV_BuildClientSnapshot( client );
+
+	if ( !SV_CheckAutoRecordDemo( client ) ) {
+		return;
+	}
+
+	SV_InitClientSnapshotMessage( &msg, msg_buf );
+	SV_WriteClientSnapshotMessage( client, &msg, NULL, svs.nextSnapshotEntities, NULL );
+
+	SV_FinishClientSnapshotMessage( client, &msg );
+}
+
+/*
+=======================
+SV_SendClientSnapshot
+
+Also called by SV_FinalMessage
+
+=======================
+*/
+void SV_SendClientSnapshot( client_t *client ) {
+	SV_FixEntityNumbers();
+	SV_BuildAndSendClientSnapshot( client );
+}
+
+
+/*
+=============================================================================
+
+Parallel snapshot building
+
+With sv_snapshotThreads set, the snapshots of all clients due in a frame are
+gathered and delta encoded on a worker pool.  The messages are identical to
+the ones SV_SendClientSnapshot would produce one client at a time:
+
+- each client gets its range of svs.snapshotEntities reserved in client
+  order, exactly where the serial path would have put it
+- the new entity states are encoded from a private copy, and only copied
+  into svs.snapshotEntities once every message is encoded, so the frames
+  clients delta from look the same as they did in the serial path
+- everything that talks to the filesystem or the network (gamedir,
+  demos, downloads, netchan) stays on the main thread
+- workers don't write to the entities, print or raise errors: what they
+  would have printed or raised goes into the job's report, and the main
+  thread passes it on in client order once they are done
+
+=============================================================================
+*/
+
+typedef struct snapshotJob_s {
+	client_t				*client;
+	qboolean				gathered;		// qfalse if the snapshot is empty
+	qboolean				encode;			// qfalse if only the snapshot needs to be built
+	int						nextSnapshotEntities;
+	snapshotReport_t		report;
+	snapshotEntityNumbers_t	entityNumbers;
+	entityState_t			entities[MAX_SNAPSHOT_ENTITIES];
+	msg_t					msg;
+	byte					msgBuf[MAX_MSGLEN];
+} snapshotJob_t;
+
+static Q::JobPool		svSnapshotPool;
+static snapshotJob_t	*svSnapshotJobs;
+static int				svNumSnapshotJobs;
+
+/*
+=======================
+SV_ShutdownSnapshots
+
+Stops the snapshot workers and frees the per-frame snapshot data
+=======================
+*/
+void SV_ShutdownSnapshots( void ) {
+	SV_FreeSnapshotIndex();
+	SV_EndSnapshotCache();
+	svSnapshotPool.setNumWorkers( 0 );
+	delete[] svSnapshotJobs;
+	svSnapshotJobs = NULL;
+	svNumSnapshotJobs = 0;
+}
+
+/*
+=======================
+SV_SendClientSnapshotsParallel
+=======================
+*/
+static void SV_SendClientSnapshotsParallel( client_t **clients, int numClients ) {
+	int				i, j;
+	snapshotJob_t	*job;
+
+	if ( svNumSnapshotJobs < numClients ) {
+		delete[] svSnapshotJobs;
+		svNumSnapshotJobs = sv_maxclients->integer;
+		svSnapshotJobs = new snapshotJob_t[svNumSnapshotJobs];
 	}
 
-	SV_SendMessageToClient( &msg, client );
+	// main thread: anything sent before the snapshot
+	for ( i = 0 ; i < numClients ; i++ ) {
+		job = &svSnapshotJobs[i];
+		job->client = clients[i];
+		Com_Memset( &job->report, 0, sizeof( job->report ) );
+
+		SV_SendClientGamedir( job->client );
+		job->encode = SV_CheckAutoRecordDemo( job->client );
+		if ( job->encode ) {
+			SV_InitClientSnapshotMessage( &job->msg, job->msgBuf );
+		}
+	}
+
+	// workers: decide which entities are visible
+	svSnapshotPool.parallelFor( numClients, []( int index ) {
+		snapshotJob_t *job = &svSnapshotJobs[index];
+		job->gathered = SV_GatherClientSnapshot( job->client, &job->entityNumbers, &job->report );
+	} );
+
+	// main thread: raise the first error in client order, as the serial
+	// path would have, and reserve each client's entity range
+	for ( i = 0 ; i < numClients ; i++ ) {
+		if ( svSnapshotJobs[i].report.error ) {
+			Com_Error( ERR_DROP, "%s", svSnapshotJobs[i].report.error );
+		}
+	}
+	for ( i = 0 ; i < numClients ; i++ ) {
+		job = &svSnapshotJobs[i];
+		if ( job->gathered ) {
+			clientSnapshot_t *frame = &job->client->frames[ job->client->netchan.outgoingSequence & PACKET_MASK ];
+			SV_ReserveSnapshotEntities( frame, job->entityNumbers.numSnapshotEntities );
+		}
+		job->nextSnapshotEntities = svs.nextSnapshotEntities;
+	}
+
+	// workers: copy the entity states and delta encode the messages
+	svSnapshotPool.parallelFor( numClients, []( int index ) {
+		snapshotJob_t *job = &svSnapshotJobs[index];
+		if ( job->gathered ) {
+			SV_CopySnapshotEntities( &job->entityNumbers, job->entities );
+		}
+		if ( job->encode ) {
+			SV_WriteClientSnapshotMessage( job->client, &job->msg, job->entities, job->nextSnapshotEntities, &job->report );
+		}
+	} );
+
+	// main thread: publish the entity states and transmit
+	for ( i = 0 ; i < numClients ; i++ ) {
+		job = &svSnapshotJobs[i];
+		if ( job->gathered ) {
+			clientSnapshot_t *frame = &job->client->frames[ job->client->netchan.outgoingSequence & PACKET_MASK ];
+			for ( j = 0 ; j < frame->num_entities ; j++ ) {
+				svs.snapshotEntities[(frame->first_entity + j) % svs.numSnapshotEntities] = job->entities[j];
+			}
+		}
+		if ( job->report.outOfDatePacket ) {
+			Com_DPrintf ("%s: Delta request from out of date packet.\n", job->client->name);
+		}
+		if ( job->report.outOfDateEntities ) {
+			Com_DPrintf ("%s: Delta request from out of date entities.\n", job->client->name);
+		}
+		if ( job->encode ) {
+			SV_FinishClientSnapshotMessage( job->client, &job->msg );
+		}
+	}
 }
 
 
@@ -856,6 +1620,24 @@ SV_SendClientMessages
 void SV_SendClientMessages( void ) {
 	int			i;
 	client_t	*c;
+	client_t	*due[MAX_CLIENTS];
+	int			numDue = 0;
+
+	SV_PROFILE_ZONE( "SV_SendClientMessages" );
+
+	if ( svSnapshotPool.numWorkers() != sv_snapshotThreads->integer ) {
+		svSnapshotPool.setNumWorkers( sv_snapshotThreads->integer );
+	}
+
+	SV_FixEntityNumbers();
+
+	// only valid for this batch of snapshots, anyone else building
+	// one later on falls back to checking every entity
+	SV_BuildSnapshotIndex();
+	SV_BeginSnapshotCache();
+
+	// every client's datagrams go out in as few syscalls as possible
+	NET_BeginSendBatch();
 
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i < sv_maxclients->integer ; i++, c++) {
@@ -877,7 +1659,19 @@ void SV_SendClientMessages( void ) {
 		}
 
 		// generate and send a new message
-		SV_SendClientSnapshot( c );
+		if ( sv_snapshotThreads->integer > 0 ) {
+			due[numDue++] = c;
+		} else {
+			SV_BuildAndSendClientSnapshot( c );
+		}
 	}
-}
 
+	if ( numDue ) {
+		SV_SendClientSnapshotsParallel( due, numDue );
+	}
+
+	NET_FlushSendBatch();
+
+	svSnapshotIndex.valid = qfalse;
+	SV_EndSnapshotCache();
+}
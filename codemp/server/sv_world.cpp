@@ -62,6 +62,8 @@ the world is carved up with an evenly spaced, axially aligned bsp tree.  Entitie
 are kept in chains either at the final leafs, or at the first node that splits
 them, which prevents having to deal with multiple fragments of a single entity.
 
+With sv_areaTree 1 a dynamic bounding box tree is used instead, see below.
+
 ===============================================================================
 */
 
@@ -78,6 +80,411 @@ typedef struct worldSector_s {
 worldSector_t	sv_worldSectors[AREA_NODES];
 int			sv_numworldSectors;
 
+/*
+===============================================================================
+
+AREA TREE
+
+A dynamic bounding box tree with one leaf per linked entity.  Leaves are
+inserted next to the sibling that grows the tree the least and the tree is
+kept balanced with rotations, so queries only visit branches whose boxes
+touch the query bounds, however big the entities are.
+
+Leaf boxes are the entity bounds grown by AREA_TREE_MARGIN, so entities that
+move a little don't have to be reinserted every time they are linked.
+
+===============================================================================
+*/
+
+#define	AREA_TREE_NODES		(MAX_GENTITIES*2)
+#define	AREA_TREE_MARGIN	8.0f
+
+typedef struct areaNode_s {
+	vec3_t	mins, maxs;
+	int		parent;
+	int		children[2];		// -1 for leaves
+	int		height;				// 0 for leaves, -1 for free nodes
+	int		entityNum;			// leaves only
+} areaNode_t;
+
+static areaNode_t	sv_areaNodes[AREA_TREE_NODES];
+static int			sv_areaRoot;
+static int			sv_areaFreeList;
+static qboolean		sv_useAreaTree;
+
+// query cost since the world was cleared or "sectorlist reset", shown by sectorlist
+typedef struct areaStats_s {
+	int64_t		queries;
+	int64_t		nodesVisited;
+	int64_t		entitiesTested;
+	int64_t		entitiesFound;
+	int64_t		treeInserts;		// leaves (re)inserted by SV_LinkEntity
+	int64_t		treeKept;			// links that stayed inside the old leaf box
+} areaStats_t;
+
+static areaStats_t	sv_areaStats;
+
+#define AREA_LEAF(node)	(sv_areaNodes[node].children[0] == -1)
+
+/*
+===============
+SV_AreaBoxCost
+
+Half the surface area, which is what a box costs a query
+===============
+*/
+static float SV_AreaBoxCost( const vec3_t mins, const vec3_t maxs ) {
+	float	dx, dy, dz;
+
+	dx = maxs[0] - mins[0];
+	dy = maxs[1] - mins[1];
+	dz = maxs[2] - mins[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+/*
+===============
+SV_AreaBoxUnion
+===============
+*/
+static void SV_AreaBoxUnion( const areaNode_t *a, const areaNode_t *b, vec3_t mins, vec3_t maxs ) {
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = Q_min( a->mins[i], b->mins[i] );
+		maxs[i] = Q_max( a->maxs[i], b->maxs[i] );
+	}
+}
+
+/*
+===============
+SV_InitAreaTree
+===============
+*/
+static void SV_InitAreaTree( void ) {
+	int		i;
+
+	for ( i = 0 ; i < AREA_TREE_NODES ; i++ ) {
+		sv_areaNodes[i].parent = i + 1 < AREA_TREE_NODES ? i + 1 : -1;	// free list link
+		sv_areaNodes[i].height = -1;
+	}
+	sv_areaFreeList = 0;
+	sv_areaRoot = -1;
+}
+
+/*
+===============
+SV_AllocAreaNode
+===============
+*/
+static int SV_AllocAreaNode( void ) {
+	int			n;
+	areaNode_t	*node;
+
+	// a full tree over every entity fits, so this can't run out
+	n = sv_areaFreeList;
+	if ( n == -1 ) {
+		Com_Error( ERR_DROP, "SV_AllocAreaNode: out of nodes" );
+	}
+	node = &sv_areaNodes[n];
+	sv_areaFreeList = node->parent;
+
+	node->parent = -1;
+	node->children[0] = node->children[1] = -1;
+	node->height = 0;
+	node->entityNum = -1;
+	return n;
+}
+
+/*
+===============
+SV_FreeAreaNode
+===============
+*/
+static void SV_FreeAreaNode( int n ) {
+	sv_areaNodes[n].parent = sv_areaFreeList;
+	sv_areaNodes[n].height = -1;
+	sv_areaFreeList = n;
+}
+
+/*
+===============
+SV_BalanceAreaNode
+
+Rotates the taller child of an unbalanced node up.
+Returns the node that is now at the position of n.
+===============
+*/
+static int SV_BalanceAreaNode( int iA ) {
+	areaNode_t	*A, *B, *C;
+	int			iB, iC;
+
+	A = &sv_areaNodes[iA];
+	if ( AREA_LEAF( iA ) || A->height < 2 ) {
+		return iA;
+	}
+
+	iB = A->children[0];
+	iC = A->children[1];
+	B = &sv_areaNodes[iB];
+	C = &sv_areaNodes[iC];
+
+	if ( C->height - B->height > 1 ) {
+		// rotate C up
+		int			iF = C->children[0];
+		int			iG = C->children[1];
+		areaNode_t	*F = &sv_areaNodes[iF];
+		areaNode_t	*G = &sv_areaNodes[iG];
+
+		C->children[0] = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		if ( C->parent != -1 ) {
+			areaNode_t *P = &sv_areaNodes[C->parent];
+			P->children[P->children[0] == iA ? 0 : 1] = iC;
+		} else {
+			sv_areaRoot = iC;
+		}
+
+		if ( F->height > G->height ) {
+			C->children[1] = iF;
+			A->children[1] = iG;
+			G->parent = iA;
+			SV_AreaBoxUnion( B, G, A->mins, A->maxs );
+			SV_AreaBoxUnion( A, F, C->mins, C->maxs );
+			A->height = 1 + Q_max( B->height, G->height );
+			C->height = 1 + Q_max( A->height, F->height );
+		} else {
+			C->children[1] = iG;
+			A->children[1] = iF;
+			F->parent = iA;
+			SV_AreaBoxUnion( B, F, A->mins, A->maxs );
+			SV_AreaBoxUnion( A, G, C->mins, C->maxs );
+			A->height = 1 + Q_max( B->height, F->height );
+			C->height = 1 + Q_max( A->height, G->height );
+		}
+		return iC;
+	}
+
+	if ( B->height - C->height > 1 ) {
+		// rotate B up
+		int			iD = B->children[0];
+		int			iE = B->children[1];
+		areaNode_t	*D = &sv_areaNodes[iD];
+		areaNode_t	*E = &sv_areaNodes[iE];
+
+		B->children[0] = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		if ( B->parent != -1 ) {
+			areaNode_t *P = &sv_areaNodes[B->parent];
+			P->children[P->children[0] == iA ? 0 : 1] = iB;
+		} else {
+			sv_areaRoot = iB;
+		}
+
+		if ( D->height > E->height ) {
+			B->children[1] = iD;
+			A->children[0] = iE;
+			E->parent = iA;
+			SV_AreaBoxUnion( C, E, A->mins, A->maxs );
+			SV_AreaBoxUnion( A, D, B->mins, B->maxs );
+			A->height = 1 + Q_max( C->height, E->height );
+			B->height = 1 + Q_max( A->height, D->height );
+		} else {
+			B->children[1] = iE;
+			A->children[0] = iD;
+			D->parent = iA;
+			SV_AreaBoxUnion( C, D, A->mins, A->maxs );
+			SV_AreaBoxUnion( A, E, B->mins, B->maxs );
+			A->height = 1 + Q_max( C->height, D->height );
+			B->height = 1 + Q_max( A->height, E->height );
+		}
+		return iB;
+	}
+
+	return iA;
+}
+
+/*
+===============
+SV_RefitAreaTree
+
+Fixes boxes and heights from n up to the root after the tree changed
+===============
+*/
+static void SV_RefitAreaTree( int n ) {
+	areaNode_t	*node, *child0, *child1;
+
+	while ( n != -1 ) {
+		n = SV_BalanceAreaNode( n );
+
+		node = &sv_areaNodes[n];
+		child0 = &sv_areaNodes[node->children[0]];
+		child1 = &sv_areaNodes[node->children[1]];
+		node->height = 1 + Q_max( child0->height, child1->height );
+		SV_AreaBoxUnion( child0, child1, node->mins, node->maxs );
+
+		n = node->parent;
+	}
+}
+
+/*
+===============
+SV_InsertAreaLeaf
+===============
+*/
+static void SV_InsertAreaLeaf( int leaf ) {
+	areaNode_t	*leafNode, *node, *child;
+	vec3_t		mins, maxs;
+	float		area, combined, cost, inherited, childCost[2];
+	int			n, i, sibling, oldParent, newParent;
+
+	if ( sv_areaRoot == -1 ) {
+		sv_areaRoot = leaf;
+		sv_areaNodes[leaf].parent = -1;
+		return;
+	}
+
+	// find the sibling that makes the tree grow the least
+	leafNode = &sv_areaNodes[leaf];
+	n = sv_areaRoot;
+	while ( !AREA_LEAF( n ) ) {
+		node = &sv_areaNodes[n];
+		area = SV_AreaBoxCost( node->mins, node->maxs );
+		SV_AreaBoxUnion( node, leafNode, mins, maxs );
+		combined = SV_AreaBoxCost( mins, maxs );
+
+		// cost of making a new parent for this node and the leaf
+		cost = 2.0f * combined;
+		// cost of pushing the leaf further down
+		inherited = 2.0f * ( combined - area );
+
+		for ( i = 0 ; i < 2 ; i++ ) {
+			child = &sv_areaNodes[node->children[i]];
+			SV_AreaBoxUnion( child, leafNode, mins, maxs );
+			childCost[i] = SV_AreaBoxCost( mins, maxs ) + inherited;
+			if ( !AREA_LEAF( node->children[i] ) ) {
+				childCost[i] -= SV_AreaBoxCost( child->mins, child->maxs );
+			}
+		}
+
+		if ( cost < childCost[0] && cost < childCost[1] ) {
+			break;
+		}
+		n = childCost[0] < childCost[1] ? node->children[0] : node->children[1];
+	}
+	sibling = n;
+
+	// make a new parent for the two
+	oldParent = sv_areaNodes[sibling].parent;
+	newParent = SV_AllocAreaNode();
+	node = &sv_areaNodes[newParent];
+	node->parent = oldParent;
+	node->children[0] = sibling;
+	node->children[1] = leaf;
+	node->height = sv_areaNodes[sibling].height + 1;
+	SV_AreaBoxUnion( &sv_areaNodes[sibling], leafNode, node->mins, node->maxs );
+	sv_areaNodes[sibling].parent = newParent;
+	leafNode->parent = newParent;
+
+	if ( oldParent != -1 ) {
+		areaNode_t *P = &sv_areaNodes[oldParent];
+		P->children[P->children[0] == sibling ? 0 : 1] = newParent;
+	} else {
+		sv_areaRoot = newParent;
+	}
+
+	SV_RefitAreaTree( oldParent );
+}
+
+/*
+===============
+SV_RemoveAreaLeaf
+===============
+*/
+static void SV_RemoveAreaLeaf( int leaf ) {
+	areaNode_t	*parent;
+	int			p, grandParent, sibling;
+
+	if ( leaf == sv_areaRoot ) {
+		sv_areaRoot = -1;
+		return;
+	}
+
+	p = sv_areaNodes[leaf].parent;
+	parent = &sv_areaNodes[p];
+	grandParent = parent->parent;
+	sibling = parent->children[parent->children[0] == leaf ? 1 : 0];
+
+	// the sibling takes the parent's place
+	sv_areaNodes[sibling].parent = grandParent;
+	if ( grandParent != -1 ) {
+		areaNode_t *G = &sv_areaNodes[grandParent];
+		G->children[G->children[0] == p ? 0 : 1] = sibling;
+	} else {
+		sv_areaRoot = sibling;
+	}
+	SV_FreeAreaNode( p );
+
+	SV_RefitAreaTree( grandParent );
+}
+
+/*
+===============
+SV_LinkAreaTree
+
+Puts the entity in the tree, unless it still fits in its old leaf
+===============
+*/
+static void SV_LinkAreaTree( sharedEntity_t *gEnt, svEntity_t *ent ) {
+	areaNode_t	*leaf;
+	int			n, i;
+
+	if ( ent->areaLeaf ) {
+		leaf = &sv_areaNodes[ent->areaLeaf - 1];
+		for ( i = 0 ; i < 3 ; i++ ) {
+			if ( gEnt->r.absmin[i] < leaf->mins[i] || gEnt->r.absmax[i] > leaf->maxs[i] ) {
+				break;
+			}
+		}
+		if ( i == 3 ) {
+			sv_areaStats.treeKept++;
+			return;
+		}
+		SV_RemoveAreaLeaf( ent->areaLeaf - 1 );
+		SV_FreeAreaNode( ent->areaLeaf - 1 );
+		ent->areaLeaf = 0;
+	}
+
+	n = SV_AllocAreaNode();
+	leaf = &sv_areaNodes[n];
+	leaf->entityNum = ent - sv.svEntities;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		leaf->mins[i] = gEnt->r.absmin[i] - AREA_TREE_MARGIN;
+		leaf->maxs[i] = gEnt->r.absmax[i] + AREA_TREE_MARGIN;
+	}
+	SV_InsertAreaLeaf( n );
+	ent->areaLeaf = n + 1;
+	sv_areaStats.treeInserts++;
+}
+
+/*
+===============
+SV_UnlinkAreaTree
+===============
+*/
+static void SV_UnlinkAreaTree( svEntity_t *ent ) {
+	if ( !ent->areaLeaf ) {
+		return;
+	}
+	SV_RemoveAreaLeaf( ent->areaLeaf - 1 );
+	SV_FreeAreaNode( ent->areaLeaf - 1 );
+	ent->areaLeaf = 0;
+}
+
 
 /*
 ===============
@@ -88,15 +495,50 @@ void SV_SectorList_f( void ) {
 	int				i, c;
 	worldSector_t	*sec;
 	svEntity_t		*ent;
+	areaStats_t		*st = &sv_areaStats;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( st, 0, sizeof( *st ) );
+		Com_Printf( "Area query statistics reset\n" );
+		return;
+	}
 
-	for ( i = 0 ; i < AREA_NODES ; i++ ) {
-		sec = &sv_worldSectors[i];
+	if ( sv_useAreaTree ) {
+		int		leafs = 0, nodes = 0, depth, totalDepth = 0;
+
+		for ( i = 0 ; i < AREA_TREE_NODES ; i++ ) {
+			if ( sv_areaNodes[i].height == -1 ) {
+				continue;
+			}
+			nodes++;
+			if ( AREA_LEAF( i ) ) {
+				leafs++;
+				for ( depth = 0, c = i ; c != sv_areaRoot ; c = sv_areaNodes[c].parent ) {
+					depth++;
+				}
+				totalDepth += depth;
+			}
+		}
+		Com_Printf( "area tree: %i entities, %i nodes, height %i, average leaf depth %.1f\n",
+			leafs, nodes, sv_areaRoot != -1 ? sv_areaNodes[sv_areaRoot].height : 0,
+			leafs ? (float)totalDepth / leafs : 0.0f );
+		Com_Printf( "%lld links reinserted, %lld stayed in their leaf\n", (long long)st->treeInserts, (long long)st->treeKept );
+	} else {
+		for ( i = 0 ; i < AREA_NODES ; i++ ) {
+			sec = &sv_worldSectors[i];
 
-		c = 0;
-		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
-			c++;
+			c = 0;
+			for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
+				c++;
+			}
+			Com_Printf( "sector %i: %i entities\n", i, c );
 		}
-		Com_Printf( "sector %i: %i entities\n", i, c );
+	}
+
+	if ( st->queries ) {
+		Com_Printf( "%lld area queries, per query: %.1f nodes visited, %.1f entities tested, %.1f entities found\n",
+			(long long)st->queries, (double)st->nodesVisited / st->queries,
+			(double)st->entitiesTested / st->queries, (double)st->entitiesFound / st->queries );
 	}
 }
 
@@ -155,6 +597,10 @@ void SV_ClearWorld( void ) {
 	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
 	sv_numworldSectors = 0;
 
+	Com_Memset( &sv_areaStats, 0, sizeof(sv_areaStats) );
+	SV_InitAreaTree();
+	sv_useAreaTree = (qboolean)(sv_areaTree->integer != 0);
+
 	// get world map bounds
 	h = CM_InlineModel( 0 );
 	CM_ModelBounds( h, mins, maxs );
@@ -177,6 +623,8 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linked = qfalse;
 
+	SV_UnlinkAreaTree( ent );
+
 	ws = ent->worldSector;
 	if ( !ws ) {
 		return;		// not linked in anywhere
@@ -302,6 +750,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	// if none of the leafs were inside the map, the
 	// entity is outside the world and can be considered unlinked
 	if ( !num_leafs ) {
+		SV_UnlinkAreaTree( ent );
 		return;
 	}
 
@@ -343,6 +792,12 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linkcount++;
 
+	if ( sv_useAreaTree ) {
+		SV_LinkAreaTree( gEnt, ent );
+		gEnt->r.linked = qtrue;
+		return;
+	}
+
 	// find the first world sector node that the ent's box crosses
 	node = sv_worldSectors;
 	while (1)
@@ -393,10 +848,13 @@ void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	svEntity_t	*check, *next;
 	sharedEntity_t *gcheck;
 
+	sv_areaStats.nodesVisited++;
+
 	for ( check = node->entities  ; check ; check = next ) {
 		next = check->nextEntityInWorldSector;
 
 		gcheck = SV_GEntityForSvEntity( check );
+		sv_areaStats.entitiesTested++;
 
 		if ( gcheck->r.absmin[0] > ap->maxs[0]
 		|| gcheck->r.absmin[1] > ap->maxs[1]
@@ -429,6 +887,68 @@ void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	}
 }
 
+/*
+====================
+SV_AreaTreeEntities
+
+SV_AreaEntities_r for the area tree
+====================
+*/
+static void SV_AreaTreeEntities( areaParms_t *ap ) {
+	int				stack[AREA_TREE_NODES];
+	int				n, top;
+	areaNode_t		*node;
+	sharedEntity_t	*gcheck;
+
+	if ( sv_areaRoot == -1 ) {
+		return;
+	}
+
+	top = 0;
+	stack[top++] = sv_areaRoot;
+	while ( top ) {
+		n = stack[--top];
+		node = &sv_areaNodes[n];
+		sv_areaStats.nodesVisited++;
+
+		if ( node->mins[0] > ap->maxs[0]
+		|| node->mins[1] > ap->maxs[1]
+		|| node->mins[2] > ap->maxs[2]
+		|| node->maxs[0] < ap->mins[0]
+		|| node->maxs[1] < ap->mins[1]
+		|| node->maxs[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( !AREA_LEAF( n ) ) {
+			stack[top++] = node->children[1];
+			stack[top++] = node->children[0];
+			continue;
+		}
+
+		// the leaf box has a margin, check the real bounds
+		gcheck = SV_GentityNum( node->entityNum );
+		sv_areaStats.entitiesTested++;
+
+		if ( gcheck->r.absmin[0] > ap->maxs[0]
+		|| gcheck->r.absmin[1] > ap->maxs[1]
+		|| gcheck->r.absmin[2] > ap->maxs[2]
+		|| gcheck->r.absmax[0] < ap->mins[0]
+		|| gcheck->r.absmax[1] < ap->mins[1]
+		|| gcheck->r.absmax[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( ap->count == ap->maxcount ) {
+			Com_DPrintf ("SV_AreaEntities: MAXCOUNT\n");
+			return;
+		}
+
+		ap->list[ap->count] = node->entityNum;
+		ap->count++;
+	}
+}
+
 /*
 ================
 SV_AreaEntities
@@ -443,7 +963,13 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	sv_areaStats.queries++;
+	if ( sv_useAreaTree ) {
+		SV_AreaTreeEntities( &ap );
+	} else {
+		SV_AreaEntities_r( sv_worldSectors, &ap );
+	}
+	sv_areaStats.entitiesFound += ap.count;
 
 	return ap.count;
 }
@@ -535,7 +1061,7 @@ static float VectorDistance(vec3_t p1, vec3_t p2)
 }
 #endif
 
-static void SV_ClipMoveToEntities( moveclip_t *clip ) {
+static void SV_ClipMoveToEntities( moveclip_t *clip, const int *candidates, int numCandidates ) {
 	static int	touchlist[MAX_GENTITIES];
 	int			i, num;
 	sharedEntity_t *touch;
@@ -545,7 +1071,25 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 	float		*origin, *angles;
 	int			thisOwnerShared = 1;
 
-	num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
+	if ( candidates ) {
+		// already gathered for a whole batch of traces, which were found in
+		// the same order SV_AreaEntities would return this trace's entities
+		num = 0;
+		for ( i = 0 ; i < numCandidates ; i++ ) {
+			touch = SV_GentityNum( candidates[i] );
+			if ( touch->r.absmin[0] > clip->boxmaxs[0]
+			|| touch->r.absmin[1] > clip->boxmaxs[1]
+			|| touch->r.absmin[2] > clip->boxmaxs[2]
+			|| touch->r.absmax[0] < clip->boxmins[0]
+			|| touch->r.absmax[1] < clip->boxmins[1]
+			|| touch->r.absmax[2] < clip->boxmins[2]) {
+				continue;
+			}
+			touchlist[num++] = candidates[i];
+		}
+	} else {
+		num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
+	}
 
 	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
 		passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
@@ -806,21 +1350,35 @@ Ghoul2 Insert End
 
 /*
 ==================
-SV_Trace
+SV_MoveBounds
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+The bounding box of the entire move, which is what gets checked for entities
 ==================
 */
+static void SV_MoveBounds( const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, vec3_t boxmins, vec3_t boxmaxs ) {
+	int			i;
+
+	for ( i=0 ; i<3 ; i++ ) {
+		if ( end[i] > start[i] ) {
+			boxmins[i] = start[i] + mins[i] - 1;
+			boxmaxs[i] = end[i] + maxs[i] + 1;
+		} else {
+			boxmins[i] = end[i] + mins[i] - 1;
+			boxmaxs[i] = start[i] + maxs[i] + 1;
+		}
+	}
+}
+
 /*
-Ghoul2 Insert Start
-*/
-void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule, int traceFlags, int useLod ) {
-/*
-Ghoul2 Insert End
+==================
+SV_TraceCandidates
+
+SV_Trace that only clips against the given entities if candidates is set
+==================
 */
+static void SV_TraceCandidates( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule, int traceFlags, int useLod,
+								const int *candidates, int numCandidates ) {
 	moveclip_t	clip;
-	int			i;
 
 	if ( !mins ) {
 		mins = vec3_origin;
@@ -860,22 +1418,84 @@ Ghoul2 Insert End
 	// we can limit it to the part of the move not
 	// already clipped off by the world, which can be
 	// a significant savings for line of sight and shot traces
-	for ( i=0 ; i<3 ; i++ ) {
-		if ( end[i] > start[i] ) {
-			clip.boxmins[i] = clip.start[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.end[i] + clip.maxs[i] + 1;
-		} else {
-			clip.boxmins[i] = clip.end[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.start[i] + clip.maxs[i] + 1;
-		}
-	}
+	SV_MoveBounds( clip.start, clip.mins, clip.maxs, clip.end, clip.boxmins, clip.boxmaxs );
 
 	// clip to other solid entities
-	SV_ClipMoveToEntities ( &clip );
+	SV_ClipMoveToEntities ( &clip, candidates, numCandidates );
 
 	*results = clip.trace;
 }
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+/*
+Ghoul2 Insert Start
+*/
+void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule, int traceFlags, int useLod ) {
+/*
+Ghoul2 Insert End
+*/
+	SV_PROFILE_ZONE( "SV_Trace" );
+
+	SV_TraceCandidates( results, start, mins, maxs, end, passEntityNum, contentmask, capsule, traceFlags, useLod, NULL, 0 );
+}
+
+/*
+==================
+SV_TraceBatch
+
+Gives the same results as calling SV_Trace for every request, but the
+entities around the batch are only gathered once.  Each trace then only
+checks those against its own move bounds, which keeps them in the order
+its own SV_AreaEntities call would have returned them.
+==================
+*/
+void SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int numRequests ) {
+	static int				candidates[MAX_GENTITIES];
+	const traceRequest_t	*req;
+	vec3_t					mins, maxs, boxmins, boxmaxs;
+	int						i, j, numCandidates;
+
+	SV_PROFILE_ZONE( "SV_TraceBatch" );
+
+	if ( numRequests <= 0 ) {
+		return;
+	}
+	if ( numRequests == 1 ) {
+		SV_Trace( results, requests->start, requests->mins, requests->maxs, requests->end, requests->passEntityNum,
+			requests->contentmask, requests->capsule, requests->traceFlags, requests->useLod );
+		return;
+	}
+
+	ClearBounds( mins, maxs );
+	for ( i = 0, req = requests ; i < numRequests ; i++, req++ ) {
+		SV_MoveBounds( req->start, req->mins, req->maxs, req->end, boxmins, boxmaxs );
+		for ( j = 0 ; j < 3 ; j++ ) {
+			mins[j] = Q_min( mins[j], boxmins[j] );
+			maxs[j] = Q_max( maxs[j], boxmaxs[j] );
+		}
+	}
+
+	numCandidates = SV_AreaEntities( mins, maxs, candidates, MAX_GENTITIES );
+
+	for ( i = 0, req = requests ; i < numRequests ; i++, req++ ) {
+		if ( numCandidates == MAX_GENTITIES ) {
+			// the list may have been cut short, gather for each trace
+			SV_Trace( &results[i], req->start, req->mins, req->maxs, req->end, req->passEntityNum,
+				req->contentmask, req->capsule, req->traceFlags, req->useLod );
+			continue;
+		}
+		SV_TraceCandidates( &results[i], req->start, req->mins, req->maxs, req->end, req->passEntityNum,
+			req->contentmask, req->capsule, req->traceFlags, req->useLod, candidates, numCandidates );
+	}
+}
+
 
 
 /*
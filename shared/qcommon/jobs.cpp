@@ -0,0 +1,117 @@
+#include "jobs.h"
+
+namespace Q
+{
+	JobPool::~JobPool()
+	{
+		setNumWorkers( 0 );
+	}
+
+	void JobPool::setNumWorkers( int numWorkers )
+	{
+		if( numWorkers < 0 )
+		{
+			numWorkers = 0;
+		}
+		if( numWorkers == this->numWorkers() )
+		{
+			return;
+		}
+
+		// stop everyone, then start the requested amount
+		{
+			std::lock_guard< std::mutex > lock( _mutex );
+			_quit = true;
+		}
+		_wake.notify_all();
+		for( auto& worker : _workers )
+		{
+			worker.join();
+		}
+		_workers.clear();
+		_quit = false;
+
+		// workers must start from the current generation, not from whatever
+		// it is by the time they get scheduled
+		_workers.reserve( numWorkers );
+		for( int i = 0; i < numWorkers; ++i )
+		{
+			_workers.emplace_back( &JobPool::workerMain, this, _generation );
+		}
+	}
+
+	void JobPool::parallelFor( int count, const Job& job )
+	{
+		if( count <= 0 )
+		{
+			return;
+		}
+		if( _workers.empty() || count == 1 )
+		{
+			for( int i = 0; i < count; ++i )
+			{
+				job( i );
+			}
+			return;
+		}
+
+		{
+			std::lock_guard< std::mutex > lock( _mutex );
+			_job = &job;
+			_count = count;
+			_next = 0;
+			_busy = numWorkers();
+			++_generation;
+		}
+		_wake.notify_all();
+
+		runJobs();
+
+		std::unique_lock< std::mutex > lock( _mutex );
+		_done.wait( lock, [this] { return _busy == 0; } );
+		_job = nullptr;
+	}
+
+	int JobPool::hardwareThreads()
+	{
+		const unsigned n = std::thread::hardware_concurrency();
+		return n ? static_cast< int >( n ) : 1;
+	}
+
+	void JobPool::workerMain( unsigned seen )
+	{
+		for( ;; )
+		{
+			{
+				std::unique_lock< std::mutex > lock( _mutex );
+				_wake.wait( lock, [this, seen] { return _quit || _generation != seen; } );
+				if( _quit )
+				{
+					return;
+				}
+				seen = _generation;
+			}
+
+			runJobs();
+
+			std::lock_guard< std::mutex > lock( _mutex );
+			if( --_busy == 0 )
+			{
+				_done.notify_one();
+			}
+		}
+	}
+
+	void JobPool::runJobs()
+	{
+		for( ;; )
+		{
+			const int i = _next.fetch_add( 1 );
+			if( i >= _count )
+			{
+				return;
+			}
+			( *_job )( i );
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+@file Minimal fork/join worker pool for engine-side parallel loops
+*/
+
+namespace Q
+{
+	/**
+	A fixed set of worker threads that execute parallel for-loops.
+
+	The thread calling parallelFor() takes part in the loop and returns once
+	every index has been processed, so with zero workers the loop simply runs
+	inline. Jobs must not call back into the pool.
+	*/
+	class JobPool
+	{
+	public:
+		using Job = std::function< void( int index ) >;
+
+		JobPool() = default;
+		~JobPool();
+		// noncopyable
+		JobPool( const JobPool& ) = delete;
+		JobPool& operator=( const JobPool& ) = delete;
+
+		/// Starts or stops workers so exactly numWorkers are running. Must not be called from a job.
+		void setNumWorkers( int numWorkers );
+		int numWorkers() const
+		{
+			return static_cast< int >( _workers.size() );
+		}
+
+		/// Calls job( i ) for every i in [0, count), spread over the workers and the calling thread.
+		void parallelFor( int count, const Job& job );
+
+		/// Number of hardware threads, or 1 if unknown.
+		static int hardwareThreads();
+
+	private:
+		void workerMain( unsigned seen );
+		void runJobs();
+
+		std::vector< std::thread > _workers;
+
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::condition_variable _done;
+		bool _quit = false;
+		unsigned _generation = 0;
+
+		// state of the loop currently being run
+		const Job* _job = nullptr;
+		int _count = 0;
+		std::atomic< int > _next{ 0 };
+		int _busy = 0;
+	};
+}
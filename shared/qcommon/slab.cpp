@@ -0,0 +1,279 @@
+#include "slab.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace Q
+{
+	const std::size_t SlabAllocator::maxSize;
+	const std::size_t SlabAllocator::pageSize;
+	const int SlabAllocator::numClasses;
+
+	namespace
+	{
+		// 16 byte steps up to 64, then two classes per power of two
+		const std::size_t classSizes[ SlabAllocator::numClasses ] = {
+			16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+		};
+
+		// class of every 16 byte step, a table rather than arithmetic as random
+		// sizes would keep mispredicting the branches
+		const unsigned char sizeClassIndex[ SlabAllocator::maxSize / 16 ] = {
+			0, 1, 2, 3, 4, 4, 5, 5,
+			6, 6, 6, 6, 7, 7, 7, 7,
+			8, 8, 8, 8, 8, 8, 8, 8,
+			9, 9, 9, 9, 9, 9, 9, 9,
+			10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+			11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11
+		};
+
+		const std::uintptr_t chunkAlignment = 16;
+
+		// chunks a thread keeps per class, half of them move at a time
+		const int cacheSize = 32;
+
+		// bumped whenever pages are freed or an allocator goes away, which
+		// turns every thread's kept chunks stale
+		std::atomic< unsigned > slabGeneration{ 0 };
+	}
+
+	struct SlabAllocator::ThreadCache
+	{
+		SlabAllocator* owner = nullptr;
+		unsigned generation = 0;
+		bool exited = false;
+		int count[ numClasses ] = {};
+		void* chunks[ numClasses ][ cacheSize ];
+
+		~ThreadCache()
+		{
+			if( owner && generation == slabGeneration.load( std::memory_order_acquire ) )
+			{
+				owner->flush( *this );
+			}
+			owner = nullptr;
+			exited = true;
+		}
+	};
+
+	SlabAllocator::~SlabAllocator()
+	{
+		slabGeneration.fetch_add( 1, std::memory_order_acq_rel );
+	}
+
+	int SlabAllocator::classForSize( std::size_t size )
+	{
+		assert( size > 0 && size <= maxSize );
+		return sizeClassIndex[ ( size - 1 ) >> 4 ];
+	}
+
+	std::size_t SlabAllocator::chunkSize( std::size_t size )
+	{
+		if( size == 0 || size > maxSize )
+		{
+			return 0;
+		}
+		return classSizes[ classForSize( size ) ];
+	}
+
+	SlabAllocator::ThreadCache* SlabAllocator::threadCache( SlabAllocator* owner )
+	{
+		static thread_local ThreadCache cache;
+
+		const unsigned generation = slabGeneration.load( std::memory_order_acquire );
+		if( cache.owner == owner && cache.generation == generation )
+		{
+			return &cache;
+		}
+		if( cache.exited || ( cache.owner && cache.generation == generation ) )
+		{
+			// this thread keeps chunks for another allocator, or is going away
+			return nullptr;
+		}
+
+		// unused, or what it kept belongs to pages that are gone
+		cache.owner = owner;
+		cache.generation = generation;
+		std::memset( cache.count, 0, sizeof( cache.count ) );
+		return &cache;
+	}
+
+	bool SlabAllocator::grow( SizeClass& sizeClass, std::size_t chunkSize )
+	{
+		char* memory = static_cast< char* >( std::malloc( pageSize ) );
+		if( !memory )
+		{
+			return false;
+		}
+
+		Page* page = reinterpret_cast< Page* >( memory );
+		page->next = sizeClass.pages;
+		sizeClass.pages = page;
+		sizeClass.numPages++;
+
+		// thread the page's chunks onto the free list, lowest address first
+		const std::uintptr_t first = ( reinterpret_cast< std::uintptr_t >( memory + sizeof( Page ) ) + chunkAlignment - 1 ) & ~( chunkAlignment - 1 );
+		char* chunk = reinterpret_cast< char* >( first );
+		char* const end = memory + pageSize;
+		FreeChunk** link = &sizeClass.freeList;
+		while( chunk + chunkSize <= end )
+		{
+			FreeChunk* freeChunk = reinterpret_cast< FreeChunk* >( chunk );
+			*link = freeChunk;
+			link = &freeChunk->next;
+			chunk += chunkSize;
+		}
+		*link = nullptr;
+		return true;
+	}
+
+	void* SlabAllocator::allocLocked( int index )
+	{
+		SizeClass& sizeClass = _classes[ index ];
+		std::lock_guard< std::mutex > lock( sizeClass.mutex );
+		if( !sizeClass.freeList && !grow( sizeClass, classSizes[ index ] ) )
+		{
+			return nullptr;
+		}
+		FreeChunk* chunk = sizeClass.freeList;
+		sizeClass.freeList = chunk->next;
+		sizeClass.numChunks++;
+		return chunk;
+	}
+
+	void SlabAllocator::refill( ThreadCache& cache, int index )
+	{
+		SizeClass& sizeClass = _classes[ index ];
+		std::lock_guard< std::mutex > lock( sizeClass.mutex );
+		while( cache.count[ index ] < cacheSize / 2 )
+		{
+			if( !sizeClass.freeList && !grow( sizeClass, classSizes[ index ] ) )
+			{
+				return;
+			}
+			FreeChunk* chunk = sizeClass.freeList;
+			sizeClass.freeList = chunk->next;
+			sizeClass.numChunks++;
+			cache.chunks[ index ][ cache.count[ index ]++ ] = chunk;
+		}
+	}
+
+	void SlabAllocator::drain( ThreadCache& cache, int index, int count )
+	{
+		SizeClass& sizeClass = _classes[ index ];
+		std::lock_guard< std::mutex > lock( sizeClass.mutex );
+		for( int i = 0; i < count; ++i )
+		{
+			FreeChunk* chunk = static_cast< FreeChunk* >( cache.chunks[ index ][ --cache.count[ index ] ] );
+			chunk->next = sizeClass.freeList;
+			sizeClass.freeList = chunk;
+		}
+		sizeClass.numChunks -= count;
+	}
+
+	void SlabAllocator::flush( ThreadCache& cache )
+	{
+		for( int i = 0; i < numClasses; ++i )
+		{
+			if( cache.count[ i ] )
+			{
+				drain( cache, i, cache.count[ i ] );
+			}
+		}
+	}
+
+	void* SlabAllocator::alloc( std::size_t size )
+	{
+		if( size == 0 || size > maxSize )
+		{
+			return nullptr;
+		}
+		const int index = classForSize( size );
+
+		ThreadCache* cache = threadCache( this );
+		if( !cache )
+		{
+			return allocLocked( index );
+		}
+		if( !cache->count[ index ] )
+		{
+			refill( *cache, index );
+			if( !cache->count[ index ] )
+			{
+				return nullptr;
+			}
+		}
+		return cache->chunks[ index ][ --cache->count[ index ] ];
+	}
+
+	void SlabAllocator::free( void* chunk, std::size_t size )
+	{
+		assert( chunk && size > 0 && size <= maxSize );
+		const int index = classForSize( size );
+
+		ThreadCache* cache = threadCache( this );
+		if( !cache )
+		{
+			SizeClass& sizeClass = _classes[ index ];
+			FreeChunk* freeChunk = static_cast< FreeChunk* >( chunk );
+			std::lock_guard< std::mutex > lock( sizeClass.mutex );
+			freeChunk->next = sizeClass.freeList;
+			sizeClass.freeList = freeChunk;
+			sizeClass.numChunks--;
+			return;
+		}
+		if( cache->count[ index ] == cacheSize )
+		{
+			drain( *cache, index, cacheSize / 2 );
+		}
+		cache->chunks[ index ][ cache->count[ index ]++ ] = chunk;
+	}
+
+	void SlabAllocator::releaseAll()
+	{
+		ThreadCache* cache = threadCache( this );
+		if( cache )
+		{
+			flush( *cache );
+		}
+		slabGeneration.fetch_add( 1, std::memory_order_acq_rel );
+
+		for( SizeClass& sizeClass : _classes )
+		{
+			std::lock_guard< std::mutex > lock( sizeClass.mutex );
+			while( sizeClass.pages )
+			{
+				Page* next = sizeClass.pages->next;
+				std::free( sizeClass.pages );
+				sizeClass.pages = next;
+			}
+			sizeClass.freeList = nullptr;
+			sizeClass.numPages = 0;
+			sizeClass.numChunks = 0;
+		}
+	}
+
+	SlabAllocator::Stats SlabAllocator::stats()
+	{
+		ThreadCache* cache = threadCache( this );
+		if( cache )
+		{
+			flush( *cache );
+		}
+
+		Stats stats = {};
+		for( int i = 0; i < numClasses; ++i )
+		{
+			SizeClass& sizeClass = _classes[ i ];
+			std::lock_guard< std::mutex > lock( sizeClass.mutex );
+			stats.pageBytes += sizeClass.numPages * pageSize;
+			stats.usedBytes += sizeClass.numChunks * classSizes[ i ];
+			stats.numPages += sizeClass.numPages;
+			stats.numChunks += sizeClass.numChunks;
+		}
+		return stats;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+
+/**
+@file Size-class slab allocator for small, short-lived engine allocations
+*/
+
+namespace Q
+{
+	/**
+	Hands out blocks of up to maxSize bytes from 64KB pages carved into
+	fixed-size chunks, one free list per size class.
+
+	Freed chunks go back on their class' free list and pages are kept until
+	releaseAll(), so memory use stays at the peak of each class. The caller
+	passes the size it allocated with to free(), which lets a chunk carry no
+	header of its own.
+
+	Any thread may allocate and free. Each thread keeps a few chunks of every
+	class for the first allocator it used, so most calls take no lock; the
+	class' lock is only taken to move a batch of chunks to or from its free
+	list. A thread hands its chunks back when it exits. The allocator can be
+	used during static initialization, as its constructor is constexpr.
+	*/
+	class SlabAllocator
+	{
+	public:
+		static const std::size_t maxSize = 1024;
+		static const std::size_t pageSize = 64 * 1024;
+		static const int numClasses = 12;
+
+		struct Stats
+		{
+			std::size_t pageBytes;	///< reserved by pages of every class
+			std::size_t usedBytes;	///< in chunks not on a free list, rounded up to their class
+			int numPages;
+			int numChunks;			///< not on a free list, including the ones other threads keep
+		};
+
+		SlabAllocator() = default;
+		/// Doesn't free the pages, call releaseAll() for that.
+		~SlabAllocator();
+		// noncopyable
+		SlabAllocator( const SlabAllocator& ) = delete;
+		SlabAllocator& operator=( const SlabAllocator& ) = delete;
+
+		/// Returns a chunk of at least size bytes, aligned to 16 bytes, or nullptr if size is 0, above maxSize, or out of memory.
+		void* alloc( std::size_t size );
+		/// Returns a chunk from alloc( size ) to the pool.
+		void free( void* chunk, std::size_t size );
+
+		/// Frees every page. No chunk may still be in use; chunks other threads keep are dropped.
+		void releaseAll();
+
+		/// Hands back the calling thread's chunks first, so they don't count as used.
+		Stats stats();
+
+		/// Size of the chunks handed out for size, or 0 if size isn't served.
+		static std::size_t chunkSize( std::size_t size );
+
+	private:
+		struct FreeChunk
+		{
+			FreeChunk* next;
+		};
+		struct Page
+		{
+			Page* next;
+		};
+		struct SizeClass
+		{
+			std::mutex mutex;
+			FreeChunk* freeList = nullptr;
+			Page* pages = nullptr;
+			int numPages = 0;
+			int numChunks = 0;
+		};
+		struct ThreadCache;
+
+		static int classForSize( std::size_t size );
+		static ThreadCache* threadCache( SlabAllocator* owner );
+		bool grow( SizeClass& sizeClass, std::size_t chunkSize );
+		void* allocLocked( int index );
+		void refill( ThreadCache& cache, int index );
+		void drain( ThreadCache& cache, int index, int count );
+		void flush( ThreadCache& cache );
+
+		SizeClass _classes[ numClasses ];
+	};
+}
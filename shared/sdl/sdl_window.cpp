@@ -150,7 +150,14 @@ void GLimp_Alert(void) {
 }
 #endif
 
-void WIN_Present( window_t *window )
+/*
+===============
+WIN_SwapBuffers
+
+Can be called from whichever thread the GL context is current on
+===============
+*/
+void WIN_SwapBuffers( window_t *window )
 {
 	if ( window->api == GRAPHICS_API_OPENGL )
 	{
@@ -165,7 +172,17 @@ void WIN_Present( window_t *window )
 			}
 		}
 	}
+}
+
+/*
+===============
+WIN_UpdateWindow
 
+Applies window cvar changes, main thread only
+===============
+*/
+void WIN_UpdateWindow( window_t *window )
+{
 	if ( r_fullscreen->modified )
 	{
 		bool	fullscreen;
@@ -200,6 +217,12 @@ void WIN_Present( window_t *window )
 	}
 }
 
+void WIN_Present( window_t *window )
+{
+	WIN_SwapBuffers( window );
+	WIN_UpdateWindow( window );
+}
+
 /*
 ===============
 GLimp_CompareModes
@@ -898,3 +921,13 @@ qboolean WIN_GL_ExtensionSupported( const char *extension )
 {
 	return SDL_GL_ExtensionSupported( extension ) == SDL_TRUE ? qtrue : qfalse;
 }
+
+qboolean WIN_GL_MakeCurrent( qboolean current )
+{
+	if ( SDL_GL_MakeCurrent( screen, current ? opengl_context : NULL ) < 0 )
+	{
+		Com_DPrintf( "SDL_GL_MakeCurrent failed: %s\n", SDL_GetError() );
+		return qfalse;
+	}
+	return qtrue;
+}
@@ -144,6 +144,9 @@ const char *Sys_Basename( char *path );
 
 bool Sys_PathCmp( const char *path1, const char *path2 );
 
+void	*Sys_MapFile( const char *path, size_t *length );
+void	Sys_UnmapFile( void *data, size_t length );
+
 char **Sys_ListFiles( const char *directory, const char *extension, char *filter, int *numfiles, qboolean wantsubs );
 void	Sys_FreeFileList( char **fileList );
 //rwwRMG - changed to fileList to not conflict with list type
@@ -198,9 +201,12 @@ typedef struct windowDesc_s
 typedef struct glconfig_s glconfig_t;
 window_t	WIN_Init( const windowDesc_t *desc, glconfig_t *glConfig );
 void		WIN_Present( window_t *window );
+void		WIN_SwapBuffers( window_t *window );
+void		WIN_UpdateWindow( window_t *window );
 void		WIN_SetGamma( glconfig_t *glConfig, byte red[256], byte green[256], byte blue[256] );
 void		WIN_Shutdown( void );
 void *		WIN_GL_GetProcAddress( const char *proc );
 qboolean	WIN_GL_ExtensionSupported( const char *extension );
+qboolean	WIN_GL_MakeCurrent( qboolean current );
 
 uint8_t ConvertUTF32ToExpectedCharset( uint32_t utf32 );
@@ -27,6 +27,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <pwd.h>
 #include <libgen.h>
@@ -442,6 +443,51 @@ bool Sys_PathCmp( const char *path1, const char *path2 )
 	return false;
 }
 
+/*
+==================
+Sys_MapFile
+
+Maps a whole file read-only.  Returns NULL if the file can't be mapped.
+==================
+*/
+void *Sys_MapFile( const char *path, size_t *length )
+{
+	struct stat	st;
+	void		*data;
+	int			fd;
+
+	*length = 0;
+
+	fd = open( path, O_RDONLY );
+	if ( fd == -1 )
+		return NULL;
+
+	if ( fstat( fd, &st ) == -1 || st.st_size <= 0 )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( data == MAP_FAILED )
+		return NULL;
+
+	*length = (size_t)st.st_size;
+	return data;
+}
+
+/*
+==================
+Sys_UnmapFile
+==================
+*/
+void Sys_UnmapFile( void *data, size_t length )
+{
+	if ( data )
+		munmap( data, length );
+}
+
 /*
 ==================
 Sys_DefaultHomePath
@@ -308,6 +308,54 @@ bool Sys_PathCmp( const char *path1, const char *path2 ) {
 	return false;
 }
 
+/*
+==============
+Sys_MapFile
+
+Maps a whole file read-only.  Returns NULL if the file can't be mapped.
+==============
+*/
+void *Sys_MapFile( const char *path, size_t *length ) {
+	HANDLE			file, mapping;
+	LARGE_INTEGER	size;
+	void			*data;
+
+	*length = 0;
+
+	file = CreateFile( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( file == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	if ( !GetFileSizeEx( file, &size ) || size.QuadPart <= 0 || (unsigned long long)size.QuadPart > (size_t)-1 ) {
+		CloseHandle( file );
+		return NULL;
+	}
+
+	mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	CloseHandle( file );
+	if ( !mapping )
+		return NULL;
+
+	// the view keeps the mapping alive
+	data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( mapping );
+	if ( !data )
+		return NULL;
+
+	*length = (size_t)size.QuadPart;
+	return data;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( void *data, size_t length ) {
+	if ( data )
+		UnmapViewOfFile( data );
+}
+
 /*
 ==============================================================
 
@@ -0,0 +1,298 @@
+// Round trips server demos through the writer in sv_demo.cpp, with the
+// file system and the rest of the server stubbed out below.
+
+#include "server/server.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef USE_INTERNAL_ZLIB
+#include "zlib/zlib.h"
+#else
+#include <zlib.h>
+#endif
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+	struct StubFile
+	{
+		std::string name;
+		std::string data;
+		bool open = true;
+		bool full = false;	// writes fail, like a full disk
+	};
+
+	std::mutex stubMutex;
+	std::map< int, StubFile > stubFiles;
+	int stubNextHandle = 1;
+	std::string stubFullName;
+	std::vector< std::string > stubPrints;
+	bool stubPrintedOffMain = false;
+	std::thread::id stubMainThread;
+
+	cvar_t bufferSizeCvar;
+	cvar_t compressCvar;
+	cvar_t maxClientsCvar;
+}
+
+serverStatic_t svs;
+cvar_t *sv_demoBufferSize = &bufferSizeCvar;
+cvar_t *sv_demoCompress = &compressCvar;
+cvar_t *sv_maxclients = &maxClientsCvar;
+
+void QDECL Com_Printf( const char *fmt, ... )
+{
+	char msg[MAXPRINTMSG];
+	va_list argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( msg, sizeof( msg ), fmt, argptr );
+	va_end( argptr );
+
+	std::lock_guard< std::mutex > lock( stubMutex );
+	stubPrints.push_back( msg );
+	if( std::this_thread::get_id() != stubMainThread )
+	{
+		stubPrintedOffMain = true;
+	}
+}
+
+char * QDECL va( const char *format, ... )
+{
+	static char string[MAXPRINTMSG];
+	va_list argptr;
+
+	va_start( argptr, format );
+	Q_vsnprintf( string, sizeof( string ), format, argptr );
+	va_end( argptr );
+	return string;
+}
+
+char *Cmd_Argv( int arg )
+{
+	static char empty[] = "";
+	return empty;
+}
+
+fileHandle_t FS_FOpenFileWrite( const char *qpath, qboolean safe )
+{
+	std::lock_guard< std::mutex > lock( stubMutex );
+	StubFile &file = stubFiles[ stubNextHandle ];
+	file.name = qpath;
+	file.full = file.name == stubFullName;
+	return stubNextHandle++;
+}
+
+int FS_Write( const void *buffer, int len, fileHandle_t h )
+{
+	std::lock_guard< std::mutex > lock( stubMutex );
+	StubFile &file = stubFiles[ h ];
+	if( !file.open || file.full )
+	{
+		return 0;
+	}
+	file.data.append( static_cast< const char * >( buffer ), len );
+	return len;
+}
+
+void FS_FCloseFile( fileHandle_t f )
+{
+	std::lock_guard< std::mutex > lock( stubMutex );
+	stubFiles[ f ].open = false;
+}
+
+void SV_StopRecordDemo( client_t *cl )
+{
+	SV_CloseDemoFile( cl );
+	cl->demo.demorecording = qfalse;
+}
+
+namespace
+{
+	const int numClients = 4;
+
+	struct DemoFixture
+	{
+		std::vector< client_t > clients;
+
+		DemoFixture( int bufferSizeKB, int compress )
+			: clients( numClients )
+		{
+			bufferSizeCvar.integer = bufferSizeKB;
+			compressCvar.integer = compress;
+			maxClientsCvar.integer = numClients;
+			svs.clients = clients.data();
+
+			std::lock_guard< std::mutex > lock( stubMutex );
+			stubFiles.clear();
+			stubPrints.clear();
+			stubPrintedOffMain = false;
+			stubMainThread = std::this_thread::get_id();
+		}
+
+		~DemoFixture()
+		{
+			SV_ShutdownDemoWriter();
+			svs.clients = nullptr;
+			stubFullName.clear();
+		}
+	};
+
+	void appendLong( std::string &out, int value )
+	{
+		const int little = LittleLong( value );
+		out.append( reinterpret_cast< const char * >( &little ), sizeof( little ) );
+	}
+
+	// records every client with interleaved records of random length, some of them as large as a message gets
+	std::vector< std::string > recordDemos( DemoFixture &fixture, unsigned int seed )
+	{
+		std::mt19937 rng( seed );
+		std::vector< std::string > expected( numClients );
+		std::vector< byte > message( MAX_MSGLEN );
+
+		for( int i = 0; i < numClients; ++i )
+		{
+			BOOST_REQUIRE( SV_OpenDemoFile( &fixture.clients[ i ], va( "demos/test%d.dm_26", i ) ) );
+			fixture.clients[ i ].demo.demorecording = qtrue;
+		}
+
+		for( int sequence = 1; sequence <= 400; ++sequence )
+		{
+			for( int i = 0; i < numClients; ++i )
+			{
+				const int len = ( rng() % 16 ) ? static_cast< int >( rng() % 1500 ) : MAX_MSGLEN - static_cast< int >( rng() % 64 );
+				for( int b = 0; b < len; ++b )
+				{
+					message[ b ] = static_cast< byte >( rng() );
+				}
+				SV_WriteDemoRecord( &fixture.clients[ i ], sequence, message.data(), len );
+
+				appendLong( expected[ i ], sequence );
+				appendLong( expected[ i ], len );
+				expected[ i ].append( reinterpret_cast< const char * >( message.data() ), len );
+			}
+			SV_DemoFrame();
+		}
+
+		for( int i = 0; i < numClients; ++i )
+		{
+			SV_StopRecordDemo( &fixture.clients[ i ] );
+			appendLong( expected[ i ], -1 );
+			appendLong( expected[ i ], -1 );
+		}
+		return expected;
+	}
+
+	std::string gunzip( const std::string &data )
+	{
+		z_stream z = {};
+		std::string out;
+		char buffer[ 0x10000 ];
+
+		BOOST_REQUIRE_EQUAL( inflateInit2( &z, MAX_WBITS + 16 ), Z_OK );
+		z.next_in = reinterpret_cast< Bytef * >( const_cast< char * >( data.data() ) );
+		z.avail_in = static_cast< uInt >( data.size() );
+		int result;
+		do
+		{
+			z.next_out = reinterpret_cast< Bytef * >( buffer );
+			z.avail_out = sizeof( buffer );
+			result = inflate( &z, Z_NO_FLUSH );
+			out.append( buffer, sizeof( buffer ) - z.avail_out );
+		} while( result == Z_OK );
+		inflateEnd( &z );
+
+		BOOST_CHECK_EQUAL( result, Z_STREAM_END );
+		return out;
+	}
+
+	// every file was closed, and holds exactly what was recorded for its client
+	void checkDemos( const std::vector< std::string > &expected, bool compressed )
+	{
+		SV_ShutdownDemoWriter();
+
+		std::lock_guard< std::mutex > lock( stubMutex );
+		BOOST_REQUIRE_EQUAL( stubFiles.size(), expected.size() );
+		for( const auto &entry : stubFiles )
+		{
+			const StubFile &file = entry.second;
+			int client;
+			char suffix[ 8 ] = {};
+
+			BOOST_CHECK( !file.open );
+			BOOST_REQUIRE_EQUAL( std::sscanf( file.name.c_str(), "demos/test%d.dm_26%7s", &client, suffix ), compressed ? 2 : 1 );
+			BOOST_CHECK_EQUAL( suffix, compressed ? ".gz" : "" );
+			BOOST_REQUIRE( client >= 0 && client < static_cast< int >( expected.size() ) );
+
+			const std::string data = compressed ? gunzip( file.data ) : file.data;
+			BOOST_CHECK_EQUAL( data.size(), expected[ client ].size() );
+			BOOST_CHECK( data == expected[ client ] );
+		}
+		BOOST_CHECK( !stubPrintedOffMain );
+	}
+}
+
+BOOST_AUTO_TEST_SUITE( demo_writer )
+
+BOOST_AUTO_TEST_CASE( synchronous )
+{
+	DemoFixture fixture( 0, 0 );
+	checkDemos( recordDemos( fixture, 1 ), false );
+}
+
+BOOST_AUTO_TEST_CASE( buffered )
+{
+	DemoFixture fixture( 256, 0 );
+	checkDemos( recordDemos( fixture, 2 ), false );
+}
+
+// the smallest buffer holds two messages, so the main thread keeps waiting for the writer
+BOOST_AUTO_TEST_CASE( buffered_minimum )
+{
+	DemoFixture fixture( 1, 0 );
+	checkDemos( recordDemos( fixture, 3 ), false );
+}
+
+BOOST_AUTO_TEST_CASE( compressed )
+{
+	DemoFixture fixture( 0, 6 );
+	checkDemos( recordDemos( fixture, 4 ), true );
+}
+
+BOOST_AUTO_TEST_CASE( buffered_compressed )
+{
+	DemoFixture fixture( 256, 6 );
+	checkDemos( recordDemos( fixture, 5 ), true );
+}
+
+// a failed write is only reported from the main thread, once the file is closed
+BOOST_AUTO_TEST_CASE( write_failure )
+{
+	DemoFixture fixture( 256, 0 );
+	stubFullName = "demos/test2.dm_26";
+	recordDemos( fixture, 6 );
+	SV_ShutdownDemoWriter();
+
+	std::lock_guard< std::mutex > lock( stubMutex );
+	int warnings = 0;
+	for( const std::string &print : stubPrints )
+	{
+		if( print.find( "couldn't write all of demos/test2.dm_26" ) != std::string::npos )
+		{
+			warnings++;
+		}
+	}
+	BOOST_CHECK_EQUAL( warnings, 1 );
+	BOOST_CHECK( !stubPrintedOffMain );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
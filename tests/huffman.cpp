@@ -0,0 +1,159 @@
+#include "huffman_fixture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+	using HuffmanFixture::Codec;
+	using HuffmanFixture::makeCodec;
+	using HuffmanFixture::typicalCounts;
+
+	// a fibonacci run gives a deep tree, so some codes are longer than the lookup table
+	std::vector< int > skewedCounts()
+	{
+		std::vector< int > counts( 256, 1 );
+		int a = 1, b = 1;
+		for( int ch = 0; ch < 22; ++ch )
+		{
+			counts[ ch ] = a;
+			const int next = a + b;
+			a = b;
+			b = next;
+		}
+		return counts;
+	}
+
+	int maxCodeLength( const Codec& codec )
+	{
+		int longest = 0;
+		for( int ch = 0; ch < 256; ++ch )
+		{
+			longest = std::max( longest, static_cast< int >( codec.tables.codeLength[ ch ] ) );
+		}
+		return longest;
+	}
+
+	void checkCodec( const Codec& codec )
+	{
+		std::mt19937 rng( 1234 );
+		std::vector< int > symbols( 20000 );
+		for( int& ch : symbols )
+		{
+			ch = rng() % 256;
+		}
+
+		// both encoders produce the same bits
+		std::vector< byte > treeBits( symbols.size() * 8 + 16 ), tableBits( treeBits.size() );
+		int treeOffset = 0, tableOffset = 0;
+		for( int ch : symbols )
+		{
+			Huff_offsetTransmit( const_cast< huff_t* >( &codec.huff.compressor ), ch, treeBits.data(), &treeOffset );
+			Huff_tableTransmit( &codec.tables, ch, tableBits.data(), &tableOffset );
+			BOOST_REQUIRE_EQUAL( treeOffset, tableOffset );
+		}
+		const int numBytes = ( treeOffset + 7 ) >> 3;
+		BOOST_CHECK( std::equal( treeBits.begin(), treeBits.begin() + numBytes, tableBits.begin() ) );
+
+		// and the table decoder reads them back like the tree walk does
+		int treeRead = 0, tableRead = 0;
+		for( int ch : symbols )
+		{
+			int fromTree = -1, fromTable = -1;
+			Huff_offsetReceive( codec.huff.decompressor.tree, &fromTree, treeBits.data(), &treeRead );
+			Huff_tableReceive( &codec.tables, &fromTable, treeBits.data(), numBytes, &tableRead );
+			BOOST_REQUIRE_EQUAL( fromTree, ch );
+			BOOST_REQUIRE_EQUAL( fromTable, ch );
+			BOOST_REQUIRE_EQUAL( treeRead, tableRead );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE( huffman )
+
+BOOST_AUTO_TEST_CASE( tables_match_tree )
+{
+	const auto codec = makeCodec( typicalCounts() );
+	checkCodec( *codec );
+}
+
+BOOST_AUTO_TEST_CASE( codes_longer_than_lookup )
+{
+	const auto codec = makeCodec( skewedCounts() );
+	BOOST_REQUIRE_GT( maxCodeLength( *codec ), HUFF_LOOKUP_BITS );
+	checkCodec( *codec );
+}
+
+// the connect packet exactly as CL_CheckForResend and NET_OutOfBandData put it
+// together, which SV_ConnectionlessPacket decompresses with the adaptive coder
+BOOST_AUTO_TEST_CASE( adaptive_connect_packet )
+{
+	const std::string info =
+		"\\name\\Padawan\\rate\\25000\\snaps\\40\\model\\kyle/default\\forcepowers\\7-1-032330000000001333"
+		"\\color1\\4\\color2\\4\\handicap\\100\\sex\\male\\cg_predictItems\\1\\saber1\\single_1\\saber2\\none"
+		"\\char_color_red\\255\\char_color_green\\255\\char_color_blue\\255\\teamtask\\0"
+		"\\protocol\\26\\qport\\41632\\challenge\\-1871232094";
+	const std::string data = "connect \"" + info + "\"";
+
+	std::vector< byte > packet( MAX_MSGLEN * 2 );
+	packet[ 0 ] = packet[ 1 ] = packet[ 2 ] = packet[ 3 ] = 0xff;
+	std::memcpy( packet.data() + 4, data.data(), data.size() );
+	const std::vector< byte > original( packet.begin(), packet.begin() + 4 + data.size() );
+
+	msg_t msg;
+	std::memset( &msg, 0, sizeof( msg ) );
+	msg.data = packet.data();
+	msg.maxsize = static_cast< int >( packet.size() );
+	msg.cursize = static_cast< int >( original.size() );
+
+	Huff_Compress( &msg, 12 );
+	BOOST_CHECK_LT( msg.cursize, static_cast< int >( original.size() ) );
+	// the server still tells connect packets apart by their uncompressed start
+	BOOST_CHECK( std::equal( original.begin(), original.begin() + 12, packet.begin() ) );
+
+	Huff_Decompress( &msg, 12 );
+	BOOST_REQUIRE_EQUAL( msg.cursize, static_cast< int >( original.size() ) );
+	BOOST_CHECK( std::equal( original.begin(), original.end(), packet.begin() ) );
+}
+
+BOOST_AUTO_TEST_CASE( raw_bits )
+{
+	std::mt19937 rng( 99 );
+	std::vector< byte > buffer( 4096 );
+	std::vector< std::pair< unsigned int, int > > written;
+	int offset = 0;
+	while( offset < 30000 )
+	{
+		const int bits = 1 + rng() % 32;
+		const unsigned int value = bits == 32 ? rng() : rng() & ( ( 1u << bits ) - 1 );
+		written.emplace_back( value, bits );
+
+		// putBits has to match writing the same bits one at a time
+		std::vector< byte > single( 8 );
+		int singleOffset = offset & 7;
+		single[ 0 ] = buffer[ offset >> 3 ] & ( ( 1 << singleOffset ) - 1 );
+		for( int i = 0; i < bits; ++i )
+		{
+			Huff_putBit( ( value >> i ) & 1, single.data(), &singleOffset );
+		}
+		Huff_putBits( value, bits, buffer.data(), &offset );
+		BOOST_REQUIRE_EQUAL( offset & 7, singleOffset & 7 );
+		for( int i = 0; i < ( singleOffset + 7 ) >> 3; ++i )
+		{
+			BOOST_REQUIRE_EQUAL( buffer[ ( ( offset - singleOffset ) >> 3 ) + i ], single[ i ] );
+		}
+	}
+
+	offset = 0;
+	for( const auto& w : written )
+	{
+		BOOST_REQUIRE_EQUAL( Huff_getBits( buffer.data(), w.second, &offset ), w.first );
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
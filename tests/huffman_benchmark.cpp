@@ -0,0 +1,103 @@
+// Compares the msg_t huffman tree walk with the lookup tables.
+// Usage: HuffmanBenchmark [megabytes]
+
+#include "huffman_fixture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double secondsSince( Clock::time_point start )
+	{
+		return std::chrono::duration< double >( Clock::now() - start ).count();
+	}
+}
+
+int main( int argc, char** argv )
+{
+	const int megabytes = argc > 1 ? std::max( 1, std::atoi( argv[ 1 ] ) ) : 16;
+	const size_t numSymbols = static_cast< size_t >( megabytes ) << 20;
+
+	const auto codec = HuffmanFixture::makeCodec( HuffmanFixture::typicalCounts() );
+	huffman_t* const huff = &codec->huff;
+	const huffTables_t* const tables = &codec->tables;
+
+	// mostly small values, like delta compressed entity fields
+	std::mt19937 rng( 42 );
+	std::vector< byte > symbols( numSymbols );
+	for( byte& ch : symbols )
+	{
+		const unsigned int r = rng();
+		ch = ( r & 3 ) ? static_cast< byte >( ( r >> 8 ) & 0x0f ) : static_cast< byte >( r >> 8 );
+	}
+
+	// codes can't be longer than the tree is deep, 4 bytes per symbol is plenty
+	const size_t bufferSize = numSymbols * 4 + 16;
+	std::vector< byte > treeBits( bufferSize ), tableBits( bufferSize );
+	std::vector< byte > decoded( numSymbols );
+	int treeOffset = 0, tableOffset = 0;
+
+	auto start = Clock::now();
+	for( byte ch : symbols )
+	{
+		Huff_offsetTransmit( &huff->compressor, ch, treeBits.data(), &treeOffset );
+	}
+	const double treeEncode = secondsSince( start );
+
+	start = Clock::now();
+	for( byte ch : symbols )
+	{
+		Huff_tableTransmit( tables, ch, tableBits.data(), &tableOffset );
+	}
+	const double tableEncode = secondsSince( start );
+
+	const size_t numBytes = ( tableOffset + 7 ) >> 3;
+	if( treeOffset != tableOffset || !std::equal( treeBits.begin(), treeBits.begin() + numBytes, tableBits.begin() ) )
+	{
+		std::printf( "FAILED: table encoder output differs from the tree\n" );
+		return 1;
+	}
+
+	int offset = 0;
+	start = Clock::now();
+	for( byte& ch : decoded )
+	{
+		int get;
+		Huff_offsetReceive( huff->decompressor.tree, &get, treeBits.data(), &offset );
+		ch = static_cast< byte >( get );
+	}
+	const double treeDecode = secondsSince( start );
+	if( decoded != symbols )
+	{
+		std::printf( "FAILED: tree decoder didn't round trip\n" );
+		return 1;
+	}
+
+	offset = 0;
+	start = Clock::now();
+	for( byte& ch : decoded )
+	{
+		int get;
+		Huff_tableReceive( tables, &get, tableBits.data(), static_cast< int >( bufferSize ), &offset );
+		ch = static_cast< byte >( get );
+	}
+	const double tableDecode = secondsSince( start );
+	if( decoded != symbols || offset != treeOffset )
+	{
+		std::printf( "FAILED: table decoder didn't round trip\n" );
+		return 1;
+	}
+
+	const double mb = static_cast< double >( megabytes );
+	std::printf( "%d MB, %.2f bits per symbol\n", megabytes, static_cast< double >( tableOffset ) / numSymbols );
+	std::printf( "encode: tree %8.1f MB/s, table %8.1f MB/s (%.1fx)\n", mb / treeEncode, mb / tableEncode, treeEncode / tableEncode );
+	std::printf( "decode: tree %8.1f MB/s, table %8.1f MB/s (%.1fx)\n", mb / treeDecode, mb / tableDecode, treeDecode / tableDecode );
+	return 0;
+}
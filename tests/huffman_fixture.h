@@ -0,0 +1,47 @@
+#pragma once
+
+// Symbol counts and codecs shared by the huffman tests and HuffmanBenchmark.
+
+#include "qcommon/qcommon.h"
+
+#include <memory>
+#include <vector>
+
+namespace HuffmanFixture
+{
+	struct Codec
+	{
+		huffman_t huff;
+		huffTables_t tables;
+	};
+
+	// builds the tree the way MSG_initHuffman does, from a table of symbol counts
+	inline std::unique_ptr< Codec > makeCodec( const std::vector< int >& counts )
+	{
+		std::unique_ptr< Codec > codec( new Codec );
+		Huff_Init( &codec->huff );
+		for( int ch = 0; ch < 256; ++ch )
+		{
+			for( int i = 0; i < counts[ ch ]; ++i )
+			{
+				Huff_addRef( &codec->huff.compressor, static_cast< byte >( ch ) );
+				Huff_addRef( &codec->huff.decompressor, static_cast< byte >( ch ) );
+			}
+		}
+		Huff_BuildTables( &codec->huff.decompressor, &codec->tables );
+		return codec;
+	}
+
+	// roughly shaped like network traffic: lots of zeroes and 0xff, the rest flat
+	inline std::vector< int > typicalCounts()
+	{
+		std::vector< int > counts( 256 );
+		for( int ch = 0; ch < 256; ++ch )
+		{
+			counts[ ch ] = 200 + ( ch * 37 ) % 400;
+		}
+		counts[ 0 ] = 20000;
+		counts[ 255 ] = 8000;
+		return counts;
+	}
+}
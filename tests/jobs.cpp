@@ -0,0 +1,66 @@
+#include "qcommon/jobs.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE( jobs )
+
+BOOST_AUTO_TEST_CASE( inline_without_workers )
+{
+	Q::JobPool pool;
+	BOOST_CHECK_EQUAL( pool.numWorkers(), 0 );
+
+	std::vector< int > visited( 100, 0 );
+	pool.parallelFor( static_cast< int >( visited.size() ), [&visited]( int i ) {
+		visited[ i ]++;
+	} );
+	for( int v : visited )
+	{
+		BOOST_CHECK_EQUAL( v, 1 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( every_index_once )
+{
+	Q::JobPool pool;
+	pool.setNumWorkers( 3 );
+	BOOST_CHECK_EQUAL( pool.numWorkers(), 3 );
+
+	// run several loops back to back to exercise the generation handshake
+	for( int round = 0; round < 50; ++round )
+	{
+		std::vector< std::atomic< int > > visited( 257 );
+		for( auto& v : visited )
+		{
+			v = 0;
+		}
+		pool.parallelFor( static_cast< int >( visited.size() ), [&visited]( int i ) {
+			visited[ i ]++;
+		} );
+		for( auto& v : visited )
+		{
+			BOOST_CHECK_EQUAL( v.load(), 1 );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( resize )
+{
+	Q::JobPool pool;
+	pool.setNumWorkers( 4 );
+	pool.setNumWorkers( 1 );
+	BOOST_CHECK_EQUAL( pool.numWorkers(), 1 );
+
+	std::atomic< int > sum{ 0 };
+	pool.parallelFor( 10, [&sum]( int i ) {
+		sum += i;
+	} );
+	BOOST_CHECK_EQUAL( sum.load(), 45 );
+
+	pool.setNumWorkers( 0 );
+	BOOST_CHECK_EQUAL( pool.numWorkers(), 0 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,138 @@
+#include "qcommon/slab.h"
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE( slab )
+
+BOOST_AUTO_TEST_CASE( size_classes )
+{
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( 0 ), 0u );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( 1 ), 16u );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( 16 ), 16u );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( 17 ), 32u );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( 65 ), 96u );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( 97 ), 128u );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( 768 ), 768u );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( 769 ), 1024u );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( Q::SlabAllocator::maxSize ), Q::SlabAllocator::maxSize );
+	BOOST_CHECK_EQUAL( Q::SlabAllocator::chunkSize( Q::SlabAllocator::maxSize + 1 ), 0u );
+
+	for( std::size_t size = 1; size <= Q::SlabAllocator::maxSize; ++size )
+	{
+		const std::size_t chunk = Q::SlabAllocator::chunkSize( size );
+		BOOST_CHECK_GE( chunk, size );
+		BOOST_CHECK_EQUAL( chunk % 16, 0u );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( alloc_and_reuse )
+{
+	Q::SlabAllocator pool;
+	BOOST_CHECK( pool.alloc( 0 ) == nullptr );
+	BOOST_CHECK( pool.alloc( Q::SlabAllocator::maxSize + 1 ) == nullptr );
+
+	// enough chunks to need several pages, none of them overlapping
+	std::vector< void* > chunks;
+	std::set< void* > distinct;
+	for( int i = 0; i < 1000; ++i )
+	{
+		void* chunk = pool.alloc( 100 );
+		BOOST_REQUIRE( chunk != nullptr );
+		BOOST_CHECK_EQUAL( reinterpret_cast< std::uintptr_t >( chunk ) % 16, 0u );
+		std::memset( chunk, i & 0xff, 100 );
+		chunks.push_back( chunk );
+		distinct.insert( chunk );
+	}
+	BOOST_CHECK_EQUAL( distinct.size(), chunks.size() );
+	for( int i = 0; i < 1000; ++i )
+	{
+		BOOST_CHECK_EQUAL( static_cast< unsigned char* >( chunks[ i ] )[ 99 ], i & 0xff );
+	}
+
+	Q::SlabAllocator::Stats stats = pool.stats();
+	BOOST_CHECK_EQUAL( stats.numChunks, 1000 );
+	BOOST_CHECK_EQUAL( stats.usedBytes, 1000u * 128 );
+	BOOST_CHECK_GT( stats.numPages, 1 );
+
+	// freed chunks come back before new pages are taken
+	for( void* chunk : chunks )
+	{
+		pool.free( chunk, 100 );
+	}
+	const int numPages = stats.numPages;
+	for( int i = 0; i < 1000; ++i )
+	{
+		BOOST_CHECK( distinct.count( pool.alloc( 128 ) ) == 1 );
+	}
+	stats = pool.stats();
+	BOOST_CHECK_EQUAL( stats.numPages, numPages );
+
+	// sizes in the same class share it
+	for( void* chunk : distinct )
+	{
+		pool.free( chunk, 97 );
+	}
+	BOOST_CHECK_EQUAL( pool.stats().numChunks, 0 );
+
+	pool.releaseAll();
+	stats = pool.stats();
+	BOOST_CHECK_EQUAL( stats.numPages, 0 );
+	BOOST_CHECK_EQUAL( stats.pageBytes, 0u );
+}
+
+BOOST_AUTO_TEST_CASE( threads )
+{
+	Q::SlabAllocator pool;
+
+	std::vector< std::thread > threads;
+	std::vector< int > failures( 4, 0 );
+	for( int t = 0; t < 4; ++t )
+	{
+		threads.emplace_back( [&pool, &failures, t] {
+			std::vector< unsigned char* > live;
+			for( int round = 0; round < 2000; ++round )
+			{
+				const std::size_t size = 1 + ( round * 37 + t * 11 ) % Q::SlabAllocator::maxSize;
+				unsigned char* chunk = static_cast< unsigned char* >( pool.alloc( size ) );
+				chunk[ 0 ] = static_cast< unsigned char >( t );
+				chunk[ size - 1 ] = static_cast< unsigned char >( t );
+				live.push_back( chunk );
+				if( live.size() > 64 )
+				{
+					unsigned char* old = live.front();
+					const std::size_t oldSize = 1 + ( ( round - 64 ) * 37 + t * 11 ) % Q::SlabAllocator::maxSize;
+					if( old[ 0 ] != t || old[ oldSize - 1 ] != t )
+					{
+						failures[ t ]++;
+					}
+					pool.free( old, oldSize );
+					live.erase( live.begin() );
+				}
+			}
+			for( std::size_t i = 0; i < live.size(); ++i )
+			{
+				const int round = 2000 - static_cast< int >( live.size() ) + static_cast< int >( i );
+				pool.free( live[ i ], 1 + ( round * 37 + t * 11 ) % Q::SlabAllocator::maxSize );
+			}
+		} );
+	}
+	for( auto& thread : threads )
+	{
+		thread.join();
+	}
+
+	for( int f : failures )
+	{
+		BOOST_CHECK_EQUAL( f, 0 );
+	}
+	BOOST_CHECK_EQUAL( pool.stats().numChunks, 0 );
+	pool.releaseAll();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,257 @@
+// Compares malloc with the slab allocator behind Z_Malloc on zone-like traffic,
+// then runs the same traffic through Z_Malloc and Z_Free themselves, with the
+// rest of the engine stubbed out below.
+// Usage: ZoneBenchmark [threads] [millions of allocations per thread]
+
+#include "server/server.h"
+#include "qcommon/slab.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+void QDECL Com_Printf( const char *fmt, ... )
+{
+	va_list argptr;
+
+	va_start( argptr, fmt );
+	std::vprintf( fmt, argptr );
+	va_end( argptr );
+}
+
+void NORETURN QDECL Com_Error( int code, const char *fmt, ... )
+{
+	va_list argptr;
+
+	va_start( argptr, fmt );
+	std::vfprintf( stderr, fmt, argptr );
+	va_end( argptr );
+	std::exit( 1 );
+}
+
+void Cmd_AddCommand( const char *cmd_name, xcommand_t function, const char *cmd_desc )
+{
+}
+
+void Cmd_RemoveCommand( const char *cmd_name )
+{
+}
+
+cvar_t *Cvar_Get( const char *var_name, const char *value, uint32_t flags, const char *var_desc )
+{
+	return nullptr;
+}
+
+void Sys_Sleep( int msec )
+{
+}
+
+void VM_Clear( void )
+{
+}
+
+void SV_ShutdownGameProgs( void )
+{
+}
+
+// nothing to give back when Z_Malloc runs out of memory
+qboolean CM_DeleteCachedMap( qboolean bGuaranteedOkToDelete )
+{
+	return qfalse;
+}
+
+qboolean SND_RegisterAudio_LevelLoadEnd( qboolean bDeleteEverythingNotUsedThisLevel )
+{
+	return qfalse;
+}
+
+int SND_FreeOldestSound()
+{
+	return 0;
+}
+
+qboolean gbInsideLoadSound = qtrue;
+refexport_t *re = nullptr;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// what Z_Malloc adds around every block on 64 bit builds
+	const std::size_t zoneOverhead = 32 + 4;
+	const std::size_t liveBlocks = 4096;
+
+	struct Op
+	{
+		unsigned int slot;
+		unsigned int size;
+	};
+
+	// mostly CopyString sized, then Ghoul2 and FX sized blocks, all of them small enough for the pool
+	std::vector< Op > buildOps( std::size_t count, unsigned int seed )
+	{
+		std::mt19937 rng( seed );
+		std::vector< Op > ops( count );
+		for( Op& op : ops )
+		{
+			const unsigned int r = rng() % 100;
+			unsigned int size;
+			if( r < 60 )
+			{
+				size = 4 + rng() % 44;
+			}
+			else if( r < 90 )
+			{
+				size = 64 + rng() % 336;
+			}
+			else
+			{
+				size = 400 + rng() % ( Q::SlabAllocator::maxSize - zoneOverhead - 400 );
+			}
+			op.slot = rng() % liveBlocks;
+			op.size = static_cast< unsigned int >( size + zoneOverhead );
+		}
+		return ops;
+	}
+
+	// writes both ends of a block, like Z_Malloc does with the header and tail
+	void* touch( void* block, std::size_t size )
+	{
+		char* p = static_cast< char* >( block );
+		std::memset( p, 0, 16 );
+		p[ size - 1 ] = 0;
+		return p;
+	}
+
+	struct Malloc
+	{
+		void* alloc( std::size_t size )
+		{
+			return touch( std::malloc( size ), size );
+		}
+		void free( void* p, std::size_t )
+		{
+			std::free( p );
+		}
+	};
+
+	struct Slab
+	{
+		Q::SlabAllocator& pool;
+		void* alloc( std::size_t size )
+		{
+			return touch( pool.alloc( size ), size );
+		}
+		void free( void* p, std::size_t size )
+		{
+			pool.free( p, size );
+		}
+	};
+
+	// sizes include the header and tail, which Z_Malloc adds itself
+	struct Zone
+	{
+		void* alloc( std::size_t size )
+		{
+			return Z_Malloc( static_cast< int >( size - zoneOverhead ), TAG_SMALL, qfalse );
+		}
+		void free( void* p, std::size_t )
+		{
+			Z_Free( p );
+		}
+	};
+
+	// replaces a random live block with a new one for every op
+	template< typename Allocator >
+	void run( Allocator allocator, const std::vector< Op >& ops )
+	{
+		std::vector< void* > blocks( liveBlocks, nullptr );
+		std::vector< unsigned int > sizes( liveBlocks, 0 );
+		for( const Op& op : ops )
+		{
+			if( blocks[ op.slot ] )
+			{
+				allocator.free( blocks[ op.slot ], sizes[ op.slot ] );
+			}
+			blocks[ op.slot ] = allocator.alloc( op.size );
+			sizes[ op.slot ] = op.size;
+		}
+		for( std::size_t i = 0; i < liveBlocks; ++i )
+		{
+			if( blocks[ i ] )
+			{
+				allocator.free( blocks[ i ], sizes[ i ] );
+			}
+		}
+	}
+
+	template< typename Allocator >
+	double timeThreads( Allocator allocator, const std::vector< std::vector< Op > >& ops )
+	{
+		const auto start = Clock::now();
+		std::vector< std::thread > threads;
+		for( const auto& threadOps : ops )
+		{
+			threads.emplace_back( [allocator, &threadOps] { run( allocator, threadOps ); } );
+		}
+		for( auto& thread : threads )
+		{
+			thread.join();
+		}
+		return std::chrono::duration< double >( Clock::now() - start ).count();
+	}
+}
+
+int main( int argc, char** argv )
+{
+	const int maxThreads = argc > 1 ? std::max( 1, std::atoi( argv[ 1 ] ) ) : 4;
+	const int millions = argc > 2 ? std::max( 1, std::atoi( argv[ 2 ] ) ) : 4;
+	const std::size_t opsPerThread = static_cast< std::size_t >( millions ) * 1000000;
+
+	std::vector< std::vector< Op > > ops;
+	for( int t = 0; t < maxThreads; ++t )
+	{
+		ops.push_back( buildOps( opsPerThread, 42 + t ) );
+	}
+
+	Com_InitZoneMemory();
+
+	std::printf( "%d million allocations per thread, %d live blocks each\n", millions, static_cast< int >( liveBlocks ) );
+	for( int numThreads = 1; numThreads <= maxThreads; numThreads *= 2 )
+	{
+		const std::vector< std::vector< Op > > threadOps( ops.begin(), ops.begin() + numThreads );
+
+		const double mallocTime = timeThreads( Malloc(), threadOps );
+
+		Q::SlabAllocator pool;
+		const double slabTime = timeThreads( Slab{ pool }, threadOps );
+		const Q::SlabAllocator::Stats stats = pool.stats();
+		pool.releaseAll();
+
+		const double zoneTime = timeThreads( Zone(), threadOps );
+
+		const double total = static_cast< double >( opsPerThread ) * numThreads;
+		std::printf( "%2d threads: malloc %6.1f ns, slab %6.1f ns (%.2fx), Z_Malloc %6.1f ns per alloc/free, %.1f MB of pages\n",
+			numThreads, mallocTime * 1e9 / total, slabTime * 1e9 / total, mallocTime / slabTime,
+			zoneTime * 1e9 / total, stats.pageBytes / ( 1024.0 * 1024.0 ) );
+		if( stats.numChunks != 0 )
+		{
+			std::printf( "FAILED: %d chunks not returned\n", stats.numChunks );
+			return 1;
+		}
+		if( Z_MemSize( TAG_SMALL ) != 0 )
+		{
+			std::printf( "FAILED: %d zone bytes not freed\n", Z_MemSize( TAG_SMALL ) );
+			return 1;
+		}
+	}
+
+	Com_ShutdownZoneMemory();
+	return 0;
+}